@@ -1,8 +1,8 @@
 #include <serum-pyth/serum-pyth.h>
 #include <oracle/oracle.h>
 
-// This program takes a single instruction with no binary data
-// and the following accounts as parameters:
+// This program takes a single instruction, with optional sp_instruction_t
+// data, and the following accounts as parameters:
 enum
 {
   SP_ACC_PAYER,         // [signer,writeable]
@@ -34,6 +34,8 @@ static_assert( SP_NUM_META == 3, "" );
 typedef struct
 {
   SolAccountInfo accounts[ SP_NUM_ACCOUNTS ];
+  const uint8_t* data;
+  uint64_t data_len;
 } sp_program_input_t;
 
 typedef struct
@@ -43,9 +45,9 @@ typedef struct
   cmd_upd_price_t cmd;
 } sp_pyth_instruction_t;
 
-#define BUF_CAST( name, type, buf_ptr, buf_size ) \
+#define BUF_CAST( name, type, buf_ptr, buf_size, err ) \
   if ( SP_UNLIKELY( ( buf_size ) < sizeof( type ) ) ) { \
-    return ERROR_ACCOUNT_DATA_TOO_SMALL; \
+    return ( err ); \
   } \
   const type* const ( name ) = ( const type* ) ( buf_ptr ); \
   ( buf_ptr ) += sizeof( type ); \
@@ -70,43 +72,54 @@ static inline sp_errcode_t sp_get_pyth_instruction(
 
   bool trading = true;
 
+  // Pricing mode, midpoint unless instruction data says otherwise
+  sp_mode_t mode = SP_MODE_MIDPT;
+  if (input->data_len != 0) {
+    if (input->data_len != sizeof(sp_instruction_t))
+      return SP_ERR_INSTRUCTION_SIZE;
+    const sp_instruction_t* data = (const sp_instruction_t*) input->data;
+    if (data->Mode > SP_MODE_MICROPRICE)
+      return SP_ERR_INSTRUCTION_MODE;
+    mode = (sp_mode_t) data->Mode;
+  }
+
   // Verify constraints on payer
   if (!account_payer->is_signer || !account_payer->is_writable)
-    return ERROR_MISSING_REQUIRED_SIGNATURES;
+    return SP_ERR_PAYER_NOT_SIGNER;
 
   // Verify constraints on Clock sysvar
   {
     SolPubkey pk;
     sol_memcpy(pk.x, sysvar_clock, sizeof(pk.x));
     if (!SolPubkey_same(account_sysvar_clock->key, &pk))
-      return ERROR_INVALID_ARGUMENT;
+      return SP_ERR_CLOCK_KEY;
     if (account_sysvar_clock->data_len != sizeof(sysvar_clock_t))
-      return ERROR_ACCOUNT_DATA_TOO_SMALL;
+      return SP_ERR_CLOCK_SIZE;
   }
 
   // Verify constraints on Pyth program ID
   if (!account_pyth_prog->executable)
-    return ERROR_INVALID_ARGUMENT;
+    return SP_ERR_PYTH_PROG_NOT_EXEC;
 
   // Verify constraints on Serum progam ID
   if (!account_serum_prog->executable)
-    return ERROR_INVALID_ARGUMENT;
+    return SP_ERR_SERUM_PROG_NOT_EXEC;
 
   // Verify constraints on Pyth price account
   sp_expo_t pyth_exponent;
   {
     if (!SolPubkey_same(account_pyth_price->owner, account_pyth_prog->key))
-      return ERROR_INCORRECT_PROGRAM_ID;
+      return SP_ERR_PRICE_OWNER;
     if (!account_pyth_price->is_writable)
-      return ERROR_INVALID_ARGUMENT;
+      return SP_ERR_PRICE_NOT_WRITABLE;
     if (account_pyth_price->data_len != sizeof(pc_price_t))
-      return ERROR_ACCOUNT_DATA_TOO_SMALL;
+      return SP_ERR_PRICE_SIZE;
     pc_price_t* price = (pc_price_t*) account_pyth_price->data;
     if (price->magic_ != PC_MAGIC ||
         price->ver_ != PC_VERSION ||
         price->type_ != PC_ACCTYPE_PRICE ||
         price->ptype_ != PC_PTYPE_PRICE)
-      return ERROR_INVALID_ACCOUNT_DATA;
+      return SP_ERR_PRICE_HEADER;
     pyth_exponent = -1 * price->expo_;
   }
 
@@ -114,9 +127,9 @@ static inline sp_errcode_t sp_get_pyth_instruction(
   sp_expo_t quote_exponent;
   {
     if (!SolPubkey_same(account_spl_quote_mint->owner, &SPL_TOKEN_PROGRAM))
-      return ERROR_INCORRECT_PROGRAM_ID;
+      return SP_ERR_QUOTE_MINT_OWNER;
     if (account_spl_quote_mint->data_len != sizeof(spl_mint_t))
-      return ERROR_ACCOUNT_DATA_TOO_SMALL;
+      return SP_ERR_QUOTE_MINT_SIZE;
     quote_exponent = ((spl_mint_t*) account_spl_quote_mint->data)->Decimals;
   }
 
@@ -124,9 +137,9 @@ static inline sp_errcode_t sp_get_pyth_instruction(
   sp_expo_t base_exponent;
   {
     if (!SolPubkey_same(account_spl_base_mint->owner, &SPL_TOKEN_PROGRAM))
-      return ERROR_INCORRECT_PROGRAM_ID;
+      return SP_ERR_BASE_MINT_OWNER;
     if (account_spl_base_mint->data_len != sizeof(spl_mint_t))
-      return ERROR_ACCOUNT_DATA_TOO_SMALL;
+      return SP_ERR_BASE_MINT_SIZE;
     base_exponent = ((spl_mint_t*) account_spl_base_mint->data)->Decimals;
   }
 
@@ -135,24 +148,28 @@ static inline sp_errcode_t sp_get_pyth_instruction(
   sp_size_t quote_lot_size;
   {
     if (!SolPubkey_same(account_serum_market->owner, account_serum_prog->key))
-      return ERROR_INCORRECT_PROGRAM_ID;
+      return SP_ERR_MARKET_OWNER;
 
     uint8_t* iter = account_serum_market->data;
     uint64_t left = account_serum_market->data_len;
     if (!trim_serum_padding(&iter, &left))
-      return ERROR_INVALID_ACCOUNT_DATA;
+      return SP_ERR_MARKET_PADDING;
 
-    BUF_CAST(flags, serum_flags_t, iter, left);
+    BUF_CAST(flags, serum_flags_t, iter, left, SP_ERR_MARKET_TOO_SMALL);
     if (!sp_flags_valid(flags, flags->Market))
-      return ERROR_INVALID_ACCOUNT_DATA;
-
-    BUF_CAST(market, serum_market_t, iter, left);
-    if (!SolPubkey_same(&market->OwnAddress, account_serum_market->key) ||
-        !SolPubkey_same(&market->QuoteMint, account_spl_quote_mint->key) ||
-        !SolPubkey_same(&market->BaseMint, account_spl_base_mint->key) ||
-        !SolPubkey_same(&market->Bids, account_serum_bids->key) ||
-        !SolPubkey_same(&market->Asks, account_serum_asks->key))
-      return ERROR_INVALID_ACCOUNT_DATA;
+      return SP_ERR_MARKET_FLAGS;
+
+    BUF_CAST(market, serum_market_t, iter, left, SP_ERR_MARKET_TOO_SMALL);
+    if (!SolPubkey_same(&market->OwnAddress, account_serum_market->key))
+      return SP_ERR_MARKET_ADDRESS;
+    if (!SolPubkey_same(&market->QuoteMint, account_spl_quote_mint->key))
+      return SP_ERR_MARKET_QUOTE_MINT;
+    if (!SolPubkey_same(&market->BaseMint, account_spl_base_mint->key))
+      return SP_ERR_MARKET_BASE_MINT;
+    if (!SolPubkey_same(&market->Bids, account_serum_bids->key))
+      return SP_ERR_MARKET_BIDS;
+    if (!SolPubkey_same(&market->Asks, account_serum_asks->key))
+      return SP_ERR_MARKET_ASKS;
 
     base_lot_size = market->BaseLotSize;
     quote_lot_size = market->QuoteLotSize;
@@ -160,85 +177,81 @@ static inline sp_errcode_t sp_get_pyth_instruction(
 
   // Verify constraints on Serum bids
   sp_size_t serum_bid = 0;
+  sp_size_t serum_bid_qty = 0;
   {
     if (!SolPubkey_same(account_serum_bids->owner, account_serum_prog->key))
-      return ERROR_INCORRECT_PROGRAM_ID;
+      return SP_ERR_BIDS_OWNER;
 
     uint8_t* iter = account_serum_bids->data;
     uint64_t left = account_serum_bids->data_len;
     if (!trim_serum_padding(&iter, &left))
-      return ERROR_INVALID_ACCOUNT_DATA;
+      return SP_ERR_BIDS_PADDING;
 
-    BUF_CAST(flags, serum_flags_t, iter, left);
+    BUF_CAST(flags, serum_flags_t, iter, left, SP_ERR_BIDS_TOO_SMALL);
     if (!sp_flags_valid(flags, flags->Bids))
-      return ERROR_INVALID_ACCOUNT_DATA;
+      return SP_ERR_BIDS_FLAGS;
 
-    BUF_CAST(book, serum_book_t, iter, left);
+    BUF_CAST(book, serum_book_t, iter, left, SP_ERR_BIDS_TOO_SMALL);
     serum_node_any_t* nodes = (serum_node_any_t*) iter;
 
     uint64_t max_nodes = left / sizeof(serum_node_any_t);
     if (book->LeafCount > max_nodes)
-      return ERROR_INVALID_ACCOUNT_DATA;
+      return SP_ERR_BIDS_LEAF_COUNT;
 
     if (book->LeafCount == 0) {
       trading = false;
     } else {
-      uint32_t idx = book->Root;
-      while (true) {
-        if (idx >= max_nodes)
-          return ERROR_INVALID_ACCOUNT_DATA;
-        serum_node_any_t* node = &nodes[idx];
-        if (node->Tag == SERUM_NODE_TYPE_LEAF) {
-          serum_bid = ((serum_node_leaf_t*) node)->Key1;
-          break;
-        } else if (node->Tag == SERUM_NODE_TYPE_INNER) {
-          idx = ((serum_node_inner_t*) node)->ChildB; // Larger prices to the right
-        } else {
-          return ERROR_INVALID_ACCOUNT_DATA;
-        }
+      const serum_node_leaf_t* leaf = NULL;
+      // Larger prices to the right
+      switch (sp_find_extreme_leaf(book, nodes, max_nodes, true, &leaf)) {
+        case SP_DESCENT_LEAF: break;
+        case SP_DESCENT_NODE_INDEX: return SP_ERR_BIDS_NODE_INDEX;
+        case SP_DESCENT_NODE_TAG: return SP_ERR_BIDS_NODE_TAG;
+        case SP_DESCENT_PREFIX: return SP_ERR_BIDS_NODE_PREFIX;
+        default: return SP_ERR_BIDS_DEPTH;
       }
+      serum_bid = leaf->Key1;
+      serum_bid_qty = leaf->Quantity;
     }
   }
 
   // Verify constraints on Serum asks
   sp_size_t serum_ask = 0;
+  sp_size_t serum_ask_qty = 0;
   {
     if (!SolPubkey_same(account_serum_asks->owner, account_serum_prog->key))
-      return ERROR_INCORRECT_PROGRAM_ID;
+      return SP_ERR_ASKS_OWNER;
 
     uint8_t* iter = account_serum_asks->data;
     uint64_t left = account_serum_asks->data_len;
     if (!trim_serum_padding(&iter, &left))
-      return ERROR_INVALID_ACCOUNT_DATA;
+      return SP_ERR_ASKS_PADDING;
 
-    BUF_CAST(flags, serum_flags_t, iter, left);
+    BUF_CAST(flags, serum_flags_t, iter, left, SP_ERR_ASKS_TOO_SMALL);
     if (!sp_flags_valid(flags, flags->Asks))
-      return ERROR_INVALID_ACCOUNT_DATA;
+      return SP_ERR_ASKS_FLAGS;
 
-    BUF_CAST(book, serum_book_t, iter, left);
+    BUF_CAST(book, serum_book_t, iter, left, SP_ERR_ASKS_TOO_SMALL);
     serum_node_any_t* nodes = (serum_node_any_t*) iter;
 
     uint64_t max_nodes = left / sizeof(serum_node_any_t);
     if (book->LeafCount > max_nodes)
-      return ERROR_INVALID_ACCOUNT_DATA;
+      return SP_ERR_ASKS_LEAF_COUNT;
 
     if (book->LeafCount == 0) {
       trading = false;
     } else {
-      uint32_t idx = book->Root;
-      while (true) {
-        if (idx >= max_nodes)
-          return ERROR_INVALID_ACCOUNT_DATA;
-        serum_node_any_t* node = &nodes[idx];
-        if (node->Tag == SERUM_NODE_TYPE_LEAF) {
-          serum_ask = ((serum_node_leaf_t*) node)->Key1;
-          break;
-        } else if (node->Tag == SERUM_NODE_TYPE_INNER) {
-          idx = ((serum_node_inner_t*) node)->ChildA; // Smaller prices to the left
-        } else {
-          return ERROR_INVALID_ACCOUNT_DATA;
-        }
+      const serum_node_leaf_t* leaf = NULL;
+      // Smaller prices to the left
+      switch (sp_find_extreme_leaf(book, nodes, max_nodes, false, &leaf)) {
+        case SP_DESCENT_LEAF: break;
+        case SP_DESCENT_NODE_INDEX: return SP_ERR_ASKS_NODE_INDEX;
+        case SP_DESCENT_NODE_TAG: return SP_ERR_ASKS_NODE_TAG;
+        case SP_DESCENT_PREFIX: return SP_ERR_ASKS_NODE_PREFIX;
+        default: return SP_ERR_ASKS_DEPTH;
       }
+      serum_ask = leaf->Key1;
+      serum_ask_qty = leaf->Quantity;
     }
   }
 
@@ -255,21 +268,25 @@ static inline sp_errcode_t sp_get_pyth_instruction(
     );
 
     if ( SP_UNLIKELY( serum_to_pyth == SP_SIZE_OVERFLOW ) ) {
-      return ERROR_INVALID_ACCOUNT_DATA;
+      return SP_ERR_PRICE_OVERFLOW;
     }
 
     sp_size_t pyth_bid = serum_bid * serum_to_pyth;
     sp_size_t pyth_ask = serum_ask * serum_to_pyth;
-    pyth_price = ( int64_t ) sp_midpt( pyth_bid, pyth_ask );
-    pyth_conf = sp_confidence( pyth_bid, pyth_ask );
+    if ( mode == SP_MODE_MICROPRICE ) {
+      // Both sizes are in BaseLots, and only their ratio is used.
+      const sp_size_t micro = sp_microprice(
+        pyth_bid, pyth_ask, serum_bid_qty, serum_ask_qty
+      );
+      pyth_price = ( int64_t ) micro;
+      pyth_conf = sp_confidence_at( pyth_bid, pyth_ask, micro, SP_FEE_BPS );
+    } else {
+      pyth_price = ( int64_t ) sp_midpt( pyth_bid, pyth_ask );
+      pyth_conf = sp_confidence( pyth_bid, pyth_ask );
+    }
 
     // status will be unknown unless the spread is sufficiently tight.
-    int64_t threshold_conf = (pyth_price / PRICE_CONF_THRESHOLD);
-    if (threshold_conf < 0) {
-      // Safe as long as threshold_conf isn't the min int64, which it isn't as long as PRICE_CONF_THRESHOLD > 1.
-      threshold_conf = -threshold_conf;
-    }
-    if ( pyth_conf > (uint64_t) threshold_conf ) {
+    if ( ! sp_conf_within( pyth_price, pyth_conf, PRICE_CONF_THRESHOLD ) ) {
       trading = false;
     }
   }
@@ -325,11 +342,13 @@ extern sp_errcode_t entrypoint( const uint8_t* const buf )
 
   const bool valid = sol_deserialize( buf, &params, SP_NUM_ACCOUNTS );
   if ( SP_UNLIKELY( ! valid ) ) {
-    return ERROR_INVALID_ARGUMENT;
+    return SP_ERR_DESERIALIZE;
   }
   if ( SP_UNLIKELY( params.ka_num != SP_NUM_ACCOUNTS ) ) {
-    return ERROR_NOT_ENOUGH_ACCOUNT_KEYS;
+    return SP_ERR_NUM_ACCOUNTS;
   }
+  input.data = params.data;
+  input.data_len = params.data_len;
 
   sp_pyth_instruction_t inst;
   const sp_errcode_t err = sp_get_pyth_instruction( &input, &inst );
@@ -4,6 +4,7 @@
 extern "C" {
 #endif
 
+#include <serum-pyth/sp-error.h>
 #include <serum-pyth/sp-util.h>
 
 // --- SPL Token Program -------------------------------------------------------
@@ -122,7 +123,6 @@ typedef struct SP_PACKED serum_node_inner
 {
   SP_UNUSED
   uint32_t Tag;
-  SP_UNUSED
   uint32_t PrefixLen;
   SP_UNUSED
   uint64_t Key0;
@@ -149,7 +149,6 @@ typedef struct SP_PACKED serum_node_leaf
   uint64_t  Key1;
   SP_UNUSED
   SolPubkey Owner;
-  SP_UNUSED
   uint64_t  Quantity;
   SP_UNUSED
   uint64_t  ClientId;
@@ -221,6 +220,80 @@ static inline bool sp_flags_valid(
   );
 }
 
+// Critbit keys are 128 bits and an inner node's PrefixLen (its critical
+// bit) grows strictly on the way down, so a path from the root passes at
+// most 128 inner nodes, and at most LeafCount - 1.
+#define SERUM_KEY_BITS 128
+
+typedef enum sp_descent
+{
+  SP_DESCENT_LEAF = 0,
+  SP_DESCENT_NODE_INDEX,  // child outside the slab
+  SP_DESCENT_NODE_TAG,    // neither inner nor leaf
+  SP_DESCENT_PREFIX,      // PrefixLen not increasing: cycle or corruption
+  SP_DESCENT_DEPTH,       // deeper than LeafCount allows
+} sp_descent_t;
+
+// Walk from the root to the leaf with the largest key (best bid) or the
+// smallest (best ask). Requires 0 < LeafCount <= max_nodes. Takes at
+// most min( LeafCount, SERUM_KEY_BITS + 1 ) hops whatever the slab holds.
+static inline sp_descent_t sp_find_extreme_leaf(
+  const serum_book_t* const book,
+  const serum_node_any_t* const nodes,
+  const uint64_t max_nodes,
+  const bool largest,
+  const serum_node_leaf_t** const leaf
+) {
+  uint64_t max_hops = book->LeafCount;
+  if ( max_hops > SERUM_KEY_BITS + 1 ) {
+    max_hops = SERUM_KEY_BITS + 1;
+  }
+
+  uint32_t idx = book->Root;
+  uint32_t min_prefix = 0;
+  for ( uint64_t hop = 0; hop < max_hops; ++hop ) {
+    if ( SP_UNLIKELY( idx >= max_nodes ) ) {
+      return SP_DESCENT_NODE_INDEX;
+    }
+    const serum_node_any_t* const node = &nodes[ idx ];
+    if ( node->Tag == SERUM_NODE_TYPE_LEAF ) {
+      *leaf = ( const serum_node_leaf_t* ) node;
+      return SP_DESCENT_LEAF;
+    }
+    if ( SP_UNLIKELY( node->Tag != SERUM_NODE_TYPE_INNER ) ) {
+      return SP_DESCENT_NODE_TAG;
+    }
+    const serum_node_inner_t* const inner = ( const serum_node_inner_t* ) node;
+    if ( SP_UNLIKELY(
+      inner->PrefixLen < min_prefix || inner->PrefixLen >= SERUM_KEY_BITS
+    ) ) {
+      return SP_DESCENT_PREFIX;
+    }
+    min_prefix = inner->PrefixLen + 1;
+    idx = largest ? inner->ChildB : inner->ChildA;
+  }
+  return SP_DESCENT_DEPTH;
+}
+
+// --- serum-pyth Program -------------------------------------------------------
+
+// Price published by serum-pyth. Instructions without data publish
+// SP_MODE_MIDPT.
+typedef enum sp_mode
+{
+  SP_MODE_MIDPT      = 0,  // sp_midpt() and sp_confidence()
+  SP_MODE_MICROPRICE = 1,  // sp_microprice() and sp_confidence_at() of
+                           // the best order on each side
+} sp_mode_t;
+
+// Optional instruction data.
+typedef struct SP_PACKED sp_instruction
+{
+  uint8_t Mode;  // sp_mode_t
+} sp_instruction_t;
+
+SP_ASSERT_SIZE( sp_instruction_t, 1 );
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,128 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <serum-pyth/sp-util.h>
+
+// Custom program errors, one per validation failure. The runtime reports
+// these as InstructionError Custom(code), so off-chain tools can tell why
+// a market fails without parsing logs.
+//
+// Codes are grouped by account and must stay stable: append only.
+typedef enum sp_error
+{
+  // Entrypoint and fixed accounts
+  SP_ERR_DESERIALIZE            = 1,
+  SP_ERR_NUM_ACCOUNTS           = 2,
+  SP_ERR_PAYER_NOT_SIGNER       = 3,
+  SP_ERR_CLOCK_KEY              = 4,
+  SP_ERR_CLOCK_SIZE             = 5,
+  SP_ERR_PYTH_PROG_NOT_EXEC     = 6,
+  SP_ERR_SERUM_PROG_NOT_EXEC    = 7,
+  SP_ERR_INSTRUCTION_SIZE       = 8,
+  SP_ERR_INSTRUCTION_MODE       = 9,
+
+  // Pyth price
+  SP_ERR_PRICE_OWNER            = 100,
+  SP_ERR_PRICE_NOT_WRITABLE     = 101,
+  SP_ERR_PRICE_SIZE             = 102,
+  SP_ERR_PRICE_HEADER           = 103,
+  SP_ERR_PRICE_OVERFLOW         = 104,
+
+  // SPL mints
+  SP_ERR_QUOTE_MINT_OWNER       = 200,
+  SP_ERR_QUOTE_MINT_SIZE        = 201,
+  SP_ERR_BASE_MINT_OWNER        = 210,
+  SP_ERR_BASE_MINT_SIZE         = 211,
+
+  // Serum market
+  SP_ERR_MARKET_OWNER           = 300,
+  SP_ERR_MARKET_PADDING         = 301,
+  SP_ERR_MARKET_TOO_SMALL       = 302,
+  SP_ERR_MARKET_FLAGS           = 303,
+  SP_ERR_MARKET_ADDRESS         = 304,
+  SP_ERR_MARKET_QUOTE_MINT      = 305,
+  SP_ERR_MARKET_BASE_MINT       = 306,
+  SP_ERR_MARKET_BIDS            = 307,
+  SP_ERR_MARKET_ASKS            = 308,
+
+  // Serum bids
+  SP_ERR_BIDS_OWNER             = 400,
+  SP_ERR_BIDS_PADDING           = 401,
+  SP_ERR_BIDS_TOO_SMALL         = 402,
+  SP_ERR_BIDS_FLAGS             = 403,
+  SP_ERR_BIDS_LEAF_COUNT        = 404,
+  SP_ERR_BIDS_NODE_INDEX        = 405,
+  SP_ERR_BIDS_NODE_TAG          = 406,
+  SP_ERR_BIDS_NODE_PREFIX       = 407,
+  SP_ERR_BIDS_DEPTH             = 408,
+
+  // Serum asks
+  SP_ERR_ASKS_OWNER             = 500,
+  SP_ERR_ASKS_PADDING           = 501,
+  SP_ERR_ASKS_TOO_SMALL         = 502,
+  SP_ERR_ASKS_FLAGS             = 503,
+  SP_ERR_ASKS_LEAF_COUNT        = 504,
+  SP_ERR_ASKS_NODE_INDEX        = 505,
+  SP_ERR_ASKS_NODE_TAG          = 506,
+  SP_ERR_ASKS_NODE_PREFIX       = 507,
+  SP_ERR_ASKS_DEPTH             = 508,
+} sp_error_t;
+
+static inline const char* sp_error_name( const sp_errcode_t err )
+{
+  switch ( err ) {
+    case SP_ERR_DESERIALIZE: return "DESERIALIZE";
+    case SP_ERR_NUM_ACCOUNTS: return "NUM_ACCOUNTS";
+    case SP_ERR_PAYER_NOT_SIGNER: return "PAYER_NOT_SIGNER";
+    case SP_ERR_CLOCK_KEY: return "CLOCK_KEY";
+    case SP_ERR_CLOCK_SIZE: return "CLOCK_SIZE";
+    case SP_ERR_PYTH_PROG_NOT_EXEC: return "PYTH_PROG_NOT_EXEC";
+    case SP_ERR_SERUM_PROG_NOT_EXEC: return "SERUM_PROG_NOT_EXEC";
+    case SP_ERR_INSTRUCTION_SIZE: return "INSTRUCTION_SIZE";
+    case SP_ERR_INSTRUCTION_MODE: return "INSTRUCTION_MODE";
+    case SP_ERR_PRICE_OWNER: return "PRICE_OWNER";
+    case SP_ERR_PRICE_NOT_WRITABLE: return "PRICE_NOT_WRITABLE";
+    case SP_ERR_PRICE_SIZE: return "PRICE_SIZE";
+    case SP_ERR_PRICE_HEADER: return "PRICE_HEADER";
+    case SP_ERR_PRICE_OVERFLOW: return "PRICE_OVERFLOW";
+    case SP_ERR_QUOTE_MINT_OWNER: return "QUOTE_MINT_OWNER";
+    case SP_ERR_QUOTE_MINT_SIZE: return "QUOTE_MINT_SIZE";
+    case SP_ERR_BASE_MINT_OWNER: return "BASE_MINT_OWNER";
+    case SP_ERR_BASE_MINT_SIZE: return "BASE_MINT_SIZE";
+    case SP_ERR_MARKET_OWNER: return "MARKET_OWNER";
+    case SP_ERR_MARKET_PADDING: return "MARKET_PADDING";
+    case SP_ERR_MARKET_TOO_SMALL: return "MARKET_TOO_SMALL";
+    case SP_ERR_MARKET_FLAGS: return "MARKET_FLAGS";
+    case SP_ERR_MARKET_ADDRESS: return "MARKET_ADDRESS";
+    case SP_ERR_MARKET_QUOTE_MINT: return "MARKET_QUOTE_MINT";
+    case SP_ERR_MARKET_BASE_MINT: return "MARKET_BASE_MINT";
+    case SP_ERR_MARKET_BIDS: return "MARKET_BIDS";
+    case SP_ERR_MARKET_ASKS: return "MARKET_ASKS";
+    case SP_ERR_BIDS_OWNER: return "BIDS_OWNER";
+    case SP_ERR_BIDS_PADDING: return "BIDS_PADDING";
+    case SP_ERR_BIDS_TOO_SMALL: return "BIDS_TOO_SMALL";
+    case SP_ERR_BIDS_FLAGS: return "BIDS_FLAGS";
+    case SP_ERR_BIDS_LEAF_COUNT: return "BIDS_LEAF_COUNT";
+    case SP_ERR_BIDS_NODE_INDEX: return "BIDS_NODE_INDEX";
+    case SP_ERR_BIDS_NODE_TAG: return "BIDS_NODE_TAG";
+    case SP_ERR_BIDS_NODE_PREFIX: return "BIDS_NODE_PREFIX";
+    case SP_ERR_BIDS_DEPTH: return "BIDS_DEPTH";
+    case SP_ERR_ASKS_OWNER: return "ASKS_OWNER";
+    case SP_ERR_ASKS_PADDING: return "ASKS_PADDING";
+    case SP_ERR_ASKS_TOO_SMALL: return "ASKS_TOO_SMALL";
+    case SP_ERR_ASKS_FLAGS: return "ASKS_FLAGS";
+    case SP_ERR_ASKS_LEAF_COUNT: return "ASKS_LEAF_COUNT";
+    case SP_ERR_ASKS_NODE_INDEX: return "ASKS_NODE_INDEX";
+    case SP_ERR_ASKS_NODE_TAG: return "ASKS_NODE_TAG";
+    case SP_ERR_ASKS_NODE_PREFIX: return "ASKS_NODE_PREFIX";
+    case SP_ERR_ASKS_DEPTH: return "ASKS_DEPTH";
+    default: return NULL;
+  }
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,42 @@
+#pragma once
+
+// Minimal stand-ins for the solana_sdk.h definitions used by sp-util.h and
+// serum-pyth.h, so off-chain tools (e.g. test-crank) can decode Serum
+// accounts with the same structs and math as the on-chain program.
+//
+// Enabled by defining SP_HOST before including sp-util.h.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define SUCCESS 0
+
+#define SOL_ARRAY_SIZE( a ) ( sizeof( a ) / sizeof( a[ 0 ] ) )
+
+#define SIZE_PUBKEY 32
+
+typedef struct
+{
+  uint8_t x[ SIZE_PUBKEY ];
+} SolPubkey;
+
+static inline int sol_memcmp( const void* a, const void* b, size_t n )
+{
+  return memcmp( a, b, n );
+}
+
+static inline void sol_memcpy( void* dst, const void* src, size_t n )
+{
+  memcpy( dst, src, n );
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -4,7 +4,11 @@
 extern "C" {
 #endif
 
+#ifdef SP_HOST
+#include <serum-pyth/sp-host.h>
+#else
 #include <solana_sdk.h>
+#endif
 
 // 'SUCCESS' is too generic for global namespace.
 typedef uint64_t sp_errcode_t;
@@ -57,6 +61,9 @@ static const sp_size_t SP_SIZE_MAX = SP_SIZE_OVERFLOW - 1;
 // e.g. 20 means the confidence interval is at most 5% of the price.
 static const int64_t PRICE_CONF_THRESHOLD = 20;
 
+// Best aggressive (taker) fee included in the confidence interval.
+static const sp_size_t SP_FEE_BPS = 10ul;  // TODO Load from config or serum-dex.
+
 // Calculate 10^exp * numer / denom
 static inline sp_size_t sp_pow10_divide(
   sp_size_t numer,
@@ -131,16 +138,89 @@ static inline sp_size_t sp_midpt( const sp_size_t bid, const sp_size_t ask )
 //        = ask * (1.0 + fee) - bid * (1.0 - fee)
 //        = (ask - bid) + (ask + bid) * fee
 //
-static inline sp_size_t sp_confidence(
+static inline sp_size_t sp_confidence_fee(
   const sp_size_t bid,
-  const sp_size_t ask
+  const sp_size_t ask,
+  const sp_size_t fee_bps
 ) {
-  const sp_size_t fee_bps = 10ul;  // TODO Load from config or serum-dex.
   sp_size_t spread = SP_LIKELY( bid < ask ) ? ( ask - bid ) : ( bid - ask );
   spread += ( bid + ask ) * fee_bps / 10000ul;
   return spread / 2;
 }
 
+static inline sp_size_t sp_confidence(
+  const sp_size_t bid,
+  const sp_size_t ask
+) {
+  return sp_confidence_fee( bid, ask, SP_FEE_BPS );
+}
+
+// Size-weighted midpoint of the best bid and ask. It leans towards the
+// side with less resting size, which the next trade is more likely to
+// take out:
+//
+// microprice = ( bid * ask_qty + ask * bid_qty ) / ( bid_qty + ask_qty )
+//            = bid + ( ask - bid ) * bid_qty / ( bid_qty + ask_qty )
+//
+// Only the ratio of sizes matters, so they can be in any common unit.
+// The weight is taken to 1/65536 of the spread so nothing overflows.
+// Falls back to sp_midpt() without sizes or for a crossed book.
+static inline sp_size_t sp_microprice(
+  const sp_size_t bid,
+  const sp_size_t ask,
+  sp_size_t bid_qty,
+  sp_size_t ask_qty
+) {
+  if ( SP_UNLIKELY( bid > ask ) ) {
+    return sp_midpt( bid, ask );
+  }
+  while ( SP_UNLIKELY( ( ( bid_qty | ask_qty ) >> 46 ) != 0 ) ) {
+    bid_qty >>= 1;
+    ask_qty >>= 1;
+  }
+  const sp_size_t total = bid_qty + ask_qty;
+  if ( SP_UNLIKELY( total == 0 ) ) {
+    return sp_midpt( bid, ask );
+  }
+  const sp_size_t weight = ( bid_qty << 16 ) / total;  // <= 1 << 16
+  const sp_size_t spread = ask - bid;
+  return (
+    bid
+    + ( spread >> 16 ) * weight
+    + ( ( ( spread & 0xfffful ) * weight ) >> 16 )
+  );
+}
+
+// sp_confidence_fee() around a price other than the midpoint, widened by
+// the distance from the midpoint so it still spans the fee-adjusted bid
+// and ask. For the microprice that distance is half the spread times the
+// size imbalance.
+static inline sp_size_t sp_confidence_at(
+  const sp_size_t bid,
+  const sp_size_t ask,
+  const sp_size_t price,
+  const sp_size_t fee_bps
+) {
+  const sp_size_t mid = sp_midpt( bid, ask );
+  const sp_size_t off = price < mid ? ( mid - price ) : ( price - mid );
+  return sp_confidence_fee( bid, ask, fee_bps ) + off;
+}
+
+// False if conf is too wide for price to be published as trading,
+// i.e. conf > |price / threshold|. threshold must be > 1.
+static inline bool sp_conf_within(
+  const int64_t price,
+  const sp_size_t conf,
+  const int64_t threshold
+) {
+  int64_t threshold_conf = price / threshold;
+  if ( threshold_conf < 0 ) {
+    // Safe as long as threshold_conf isn't the min int64, which it isn't as long as threshold > 1.
+    threshold_conf = -threshold_conf;
+  }
+  return conf <= ( sp_size_t ) threshold_conf;
+}
+
 #ifdef __cplusplus
 }
 #endif
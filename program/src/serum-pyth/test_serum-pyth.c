@@ -7,8 +7,11 @@ char heap_start[ 8192 ];
 #include <serum-pyth/serum-pyth.c> // NOLINT(bugprone-suspicious-include)
 #include <serum-pyth/tests/assert.h>
 #include <serum-pyth/tests/confidence.h>
+#include <serum-pyth/tests/descent.h>
+#include <serum-pyth/tests/errors.h>
 #include <serum-pyth/tests/instruction.h>
 #include <serum-pyth/tests/math.h>
+#include <serum-pyth/tests/microprice.h>
 #include <serum-pyth/tests/serum_to_pyth.h>
 
 // Assert pyth-client allocations use test heap.
@@ -21,6 +24,10 @@ Test( serum_pyth, heap_start )
 
 Test( serum_pyth, confidence ) { sp_test_confidence(); }
 Test( serum_pyth, constants ) { sp_test_constants(); }
+Test( serum_pyth, descent ) { sp_test_descent(); }
+Test( serum_pyth, error_names ) { sp_test_error_names(); }
+Test( serum_pyth, errors ) { sp_test_errors(); }
+Test( serum_pyth, microprice ) { sp_test_microprice(); }
 Test( serum_pyth, midpt ) { sp_test_midpt(); }
 Test( serum_pyth, pow10_divide ) { sp_test_pow10div(); }
 Test( serum_pyth, pyth_instruction ) { sp_test_pyth_instruction(); }
@@ -12,6 +12,7 @@
 #define sp_assert_lt cr_expect_lt
 #define sp_assert_ge cr_expect_geq
 #define sp_assert_gt cr_expect_gt
+#define sp_assert_str cr_expect_str_eq
 #else
 #define sp_assert_eq cr_assert_eq
 #define sp_assert_ne cr_assert_neq
@@ -19,6 +20,7 @@
 #define sp_assert_lt cr_assert_lt
 #define sp_assert_ge cr_assert_geq
 #define sp_assert_gt cr_assert_gt
+#define sp_assert_str cr_assert_str_eq
 #endif
 
 // Disallow implicit conversion to bool.
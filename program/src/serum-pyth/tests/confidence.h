@@ -44,4 +44,18 @@ static void sp_test_confidence()
   // bid=$50,000.000, ask=$50,000.010, fee=10bps -> CI=$50.005
   sp_assert_conf( &input, 50000000, 50000010, 50005 );
   sp_assert_conf( &input, 50000010, 50000000, 50005 );
+
+  sp_assert_size_eq( sp_confidence_fee( 50000000, 50000010, 0 ), 5 );
+  sp_assert_size_eq( sp_confidence_fee( 50000000, 50000010, 20 ), 100005 );
+  sp_assert_size_eq(
+    sp_confidence_fee( 50000000, 50000010, SP_FEE_BPS ),
+    sp_confidence( 50000000, 50000010 )
+  );
+
+  // conf <= |price| / PRICE_CONF_THRESHOLD
+  sp_assert( sp_conf_within( 2000, 100, PRICE_CONF_THRESHOLD ) );
+  sp_assert( ! sp_conf_within( 2000, 101, PRICE_CONF_THRESHOLD ) );
+  sp_assert( sp_conf_within( -2000, 100, PRICE_CONF_THRESHOLD ) );
+  sp_assert( ! sp_conf_within( 2000, 101, 20 ) );
+  sp_assert( sp_conf_within( 2000, 200, 10 ) );
 }
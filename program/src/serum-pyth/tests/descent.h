@@ -0,0 +1,99 @@
+#pragma once
+
+#include <serum-pyth/serum-pyth.h>
+#include <serum-pyth/tests/assert.h>
+
+#define SP_TEST_DESCENT_NODES ( SERUM_KEY_BITS + 2 )
+
+// Chain of inner nodes 0..depth-1 with increasing PrefixLen, each with a
+// leaf on both sides: node i's children are node i + 1 and leaf
+// SP_TEST_DESCENT_NODES - 1, alternating sides.
+static void sp_init_descent_chain(
+  serum_node_any_t* const nodes,
+  const uint32_t depth,
+  const bool largest
+) {
+  sol_memset( nodes, 0, sizeof( serum_node_any_t ) * SP_TEST_DESCENT_NODES );
+  for ( uint32_t i = 0; i < depth; ++i ) {
+    serum_node_inner_t* const inner = ( serum_node_inner_t* ) &nodes[ i ];
+    inner->Tag = SERUM_NODE_TYPE_INNER;
+    inner->PrefixLen = i;
+    inner->ChildA = largest ? SP_TEST_DESCENT_NODES - 1 : i + 1;
+    inner->ChildB = largest ? i + 1 : SP_TEST_DESCENT_NODES - 1;
+  }
+  serum_node_leaf_t* const leaf = ( serum_node_leaf_t* ) &nodes[ depth ];
+  leaf->Tag = SERUM_NODE_TYPE_LEAF;
+  leaf->Key1 = 1234;
+}
+
+static void sp_assert_descent(
+  serum_node_any_t* const nodes,
+  const uint64_t leaf_count,
+  const bool largest,
+  const sp_descent_t expected
+) {
+  serum_book_t book;
+  SP_MEMSET_SIZEOF( &book, 0 );
+  book.Root = 0;
+  book.LeafCount = leaf_count;
+
+  const serum_node_leaf_t* leaf = NULL;
+  const sp_descent_t actual = sp_find_extreme_leaf(
+    &book, nodes, SP_TEST_DESCENT_NODES, largest, &leaf
+  );
+  sp_assert_eq(
+    actual,
+    expected,
+    "sp_find_extreme_leaf(leaf_count=%lu, largest=%d) == %d != %d",
+    leaf_count,
+    largest,
+    actual,
+    expected
+  );
+  if ( expected == SP_DESCENT_LEAF ) {
+    sp_assert_u64( leaf->Key1, 1234 );
+  }
+}
+
+static void sp_test_descent()
+{
+  serum_node_any_t nodes[ SP_TEST_DESCENT_NODES ];
+
+  for ( int side = 0; side < 2; ++side ) {
+    const bool largest = side == 0;
+
+    // Deepest possible path: one inner node per key bit.
+    sp_init_descent_chain( nodes, SERUM_KEY_BITS, largest );
+    sp_assert_descent( nodes, SERUM_KEY_BITS + 1, largest, SP_DESCENT_LEAF );
+    sp_assert_descent( nodes, UINT64_MAX, largest, SP_DESCENT_LEAF );
+    sp_assert_descent( nodes, SERUM_KEY_BITS, largest, SP_DESCENT_DEPTH );
+
+    // Root is the leaf.
+    sp_init_descent_chain( nodes, 0, largest );
+    sp_assert_descent( nodes, 1, largest, SP_DESCENT_LEAF );
+
+    // Cycle back to an ancestor.
+    sp_init_descent_chain( nodes, 8, largest );
+    serum_node_inner_t* const last = ( serum_node_inner_t* ) &nodes[ 7 ];
+    *( largest ? &last->ChildB : &last->ChildA ) = 3;
+    sp_assert_descent( nodes, UINT64_MAX, largest, SP_DESCENT_PREFIX );
+
+    // Self loop.
+    *( largest ? &last->ChildB : &last->ChildA ) = 7;
+    sp_assert_descent( nodes, UINT64_MAX, largest, SP_DESCENT_PREFIX );
+
+    // Critical bit past the key.
+    sp_init_descent_chain( nodes, 8, largest );
+    ( ( serum_node_inner_t* ) &nodes[ 4 ] )->PrefixLen = SERUM_KEY_BITS;
+    sp_assert_descent( nodes, UINT64_MAX, largest, SP_DESCENT_PREFIX );
+
+    sp_init_descent_chain( nodes, 8, largest );
+    ( ( serum_node_inner_t* ) &nodes[ 4 ] )->Tag = SERUM_NODE_TYPE_LEAF + 1;
+    sp_assert_descent( nodes, UINT64_MAX, largest, SP_DESCENT_NODE_TAG );
+
+    sp_init_descent_chain( nodes, 8, largest );
+    serum_node_inner_t* const mid = ( serum_node_inner_t* ) &nodes[ 4 ];
+    *( largest ? &mid->ChildB : &mid->ChildA ) = SP_TEST_DESCENT_NODES;
+    sp_assert_descent( nodes, UINT64_MAX, largest, SP_DESCENT_NODE_INDEX );
+  }
+}
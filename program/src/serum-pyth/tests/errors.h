@@ -0,0 +1,207 @@
+#pragma once
+
+#include <serum-pyth/sp-error.h>
+#include <serum-pyth/tests/assert.h>
+#include <serum-pyth/tests/instruction.h>
+
+// Break one field, expect its error code, then restore it.
+#define sp_assert_field_err( input, inst, field, bad, err ) do { \
+  const __typeof__( ( field ) + 0 ) good = ( field ); \
+  ( field ) = ( bad ); \
+  sp_assert_err( input, inst, err ); \
+  ( field ) = good; \
+  sp_assert_no_err( input, inst ); \
+} while ( 0 )
+
+static void sp_test_error_names()
+{
+  sp_assert_str( sp_error_name( SP_ERR_PRICE_OVERFLOW ), "PRICE_OVERFLOW" );
+  sp_assert_str( sp_error_name( SP_ERR_ASKS_NODE_TAG ), "ASKS_NODE_TAG" );
+  sp_assert_ptr( sp_error_name( SP_NO_ERROR ), NULL );
+  sp_assert_ptr( sp_error_name( ERROR_INVALID_ARGUMENT ), NULL );
+
+  // Custom codes must not collide with builtin errors.
+  sp_assert_u64( sp_error_idx( SP_ERR_ASKS_NODE_TAG ), 0 );
+  sp_assert_str( sp_error_msg( SP_ERR_MARKET_BIDS ), "MARKET_BIDS" );
+  sp_assert_str( sp_error_msg( ERROR_INVALID_ARGUMENT ), "INVALID_ARGUMENT" );
+}
+
+static void sp_test_errors()
+{
+  sp_test_input_t input;
+  sp_init_test_input( &input );
+
+  sp_pyth_instruction_t inst;
+  sp_assert_no_err( &input, &inst );
+
+  SolAccountInfo* const accounts = input.prog_input.accounts;
+  SolPubkey bad_key;
+  SP_MEMSET_SIZEOF( &bad_key, 5678 );
+
+  // Fixed accounts
+  sp_assert_field_err(
+    &input, &inst,
+    accounts[ SP_ACC_SYSVAR_CLOCK ].data_len,
+    sizeof( sysvar_clock_t ) + 1,
+    SP_ERR_CLOCK_SIZE
+  );
+
+  // Pyth price
+  sp_assert_field_err(
+    &input, &inst,
+    accounts[ SP_ACC_PYTH_PRICE ].owner, &bad_key, SP_ERR_PRICE_OWNER
+  );
+  sp_assert_field_err(
+    &input, &inst,
+    accounts[ SP_ACC_PYTH_PRICE ].is_writable, false, SP_ERR_PRICE_NOT_WRITABLE
+  );
+  sp_assert_field_err(
+    &input, &inst,
+    accounts[ SP_ACC_PYTH_PRICE ].data_len,
+    sizeof( pc_price_t ) - 1,
+    SP_ERR_PRICE_SIZE
+  );
+  sp_assert_field_err(
+    &input, &inst,
+    input.pyth_price.magic_, PC_MAGIC + 1, SP_ERR_PRICE_HEADER
+  );
+  sp_assert_field_err(
+    &input, &inst,
+    input.pyth_price.ptype_, PC_PTYPE_PRICE + 1, SP_ERR_PRICE_HEADER
+  );
+
+  // SPL mints
+  sp_assert_field_err(
+    &input, &inst,
+    accounts[ SP_ACC_QUOTE_MINT ].owner, &bad_key, SP_ERR_QUOTE_MINT_OWNER
+  );
+  sp_assert_field_err(
+    &input, &inst,
+    accounts[ SP_ACC_QUOTE_MINT ].data_len,
+    sizeof( spl_mint_t ) - 1,
+    SP_ERR_QUOTE_MINT_SIZE
+  );
+  sp_assert_field_err(
+    &input, &inst,
+    accounts[ SP_ACC_BASE_MINT ].owner, &bad_key, SP_ERR_BASE_MINT_OWNER
+  );
+  sp_assert_field_err(
+    &input, &inst,
+    accounts[ SP_ACC_BASE_MINT ].data_len,
+    sizeof( spl_mint_t ) - 1,
+    SP_ERR_BASE_MINT_SIZE
+  );
+
+  // Serum market
+  sp_assert_field_err(
+    &input, &inst,
+    accounts[ SP_ACC_SERUM_MARKET ].owner, &bad_key, SP_ERR_MARKET_OWNER
+  );
+  sp_assert_field_err(
+    &input, &inst,
+    input.mkt_buf[ 0 ], ( uint8_t )( input.mkt_buf[ 0 ] + 1 ),
+    SP_ERR_MARKET_PADDING
+  );
+  sp_assert_field_err(
+    &input, &inst,
+    input.mkt_flags->Market, 0, SP_ERR_MARKET_FLAGS
+  );
+  sp_assert_field_err(
+    &input, &inst,
+    input.market->OwnAddress.x[ 0 ], 0xff, SP_ERR_MARKET_ADDRESS
+  );
+  sp_assert_field_err(
+    &input, &inst,
+    input.market->QuoteMint.x[ 0 ], 0xff, SP_ERR_MARKET_QUOTE_MINT
+  );
+  sp_assert_field_err(
+    &input, &inst,
+    input.market->BaseMint.x[ 0 ], 0xff, SP_ERR_MARKET_BASE_MINT
+  );
+  sp_assert_field_err(
+    &input, &inst,
+    input.market->Bids.x[ 0 ], 0xff, SP_ERR_MARKET_BIDS
+  );
+  sp_assert_field_err(
+    &input, &inst,
+    input.market->Asks.x[ 0 ], 0xff, SP_ERR_MARKET_ASKS
+  );
+
+  // Serum bids
+  sp_assert_field_err(
+    &input, &inst,
+    accounts[ SP_ACC_SERUM_BIDS ].owner, &bad_key, SP_ERR_BIDS_OWNER
+  );
+  sp_assert_field_err(
+    &input, &inst,
+    input.bid_buf[ 0 ], ( uint8_t )( input.bid_buf[ 0 ] + 1 ),
+    SP_ERR_BIDS_PADDING
+  );
+  sp_assert_field_err(
+    &input, &inst,
+    input.bid_flags->Bids, 0, SP_ERR_BIDS_FLAGS
+  );
+  sp_assert_field_err(
+    &input, &inst,
+    input.bid_book->LeafCount, 3, SP_ERR_BIDS_LEAF_COUNT
+  );
+  sp_assert_field_err(
+    &input, &inst,
+    input.bid_inner->ChildB, 2, SP_ERR_BIDS_NODE_INDEX
+  );
+  sp_assert_field_err(
+    &input, &inst,
+    input.bid_leaf->Tag, SERUM_NODE_TYPE_LEAF + 7, SP_ERR_BIDS_NODE_TAG
+  );
+  sp_assert_field_err(
+    &input, &inst,
+    input.bid_inner->ChildB, 0, SP_ERR_BIDS_NODE_PREFIX
+  );
+  sp_assert_field_err(
+    &input, &inst,
+    input.bid_inner->PrefixLen, SERUM_KEY_BITS, SP_ERR_BIDS_NODE_PREFIX
+  );
+  sp_assert_field_err(
+    &input, &inst,
+    input.bid_book->LeafCount, 1, SP_ERR_BIDS_DEPTH
+  );
+
+  // Serum asks
+  sp_assert_field_err(
+    &input, &inst,
+    accounts[ SP_ACC_SERUM_ASKS ].owner, &bad_key, SP_ERR_ASKS_OWNER
+  );
+  sp_assert_field_err(
+    &input, &inst,
+    input.ask_buf[ 0 ], ( uint8_t )( input.ask_buf[ 0 ] + 1 ),
+    SP_ERR_ASKS_PADDING
+  );
+  sp_assert_field_err(
+    &input, &inst,
+    input.ask_flags->Asks, 0, SP_ERR_ASKS_FLAGS
+  );
+  sp_assert_field_err(
+    &input, &inst,
+    input.ask_book->LeafCount, 3, SP_ERR_ASKS_LEAF_COUNT
+  );
+  sp_assert_field_err(
+    &input, &inst,
+    input.ask_inner->ChildA, 2, SP_ERR_ASKS_NODE_INDEX
+  );
+  sp_assert_field_err(
+    &input, &inst,
+    input.ask_leaf->Tag, SERUM_NODE_TYPE_LEAF + 7, SP_ERR_ASKS_NODE_TAG
+  );
+  sp_assert_field_err(
+    &input, &inst,
+    input.ask_inner->ChildA, 0, SP_ERR_ASKS_NODE_PREFIX
+  );
+  sp_assert_field_err(
+    &input, &inst,
+    input.ask_inner->PrefixLen, SERUM_KEY_BITS, SP_ERR_ASKS_NODE_PREFIX
+  );
+  sp_assert_field_err(
+    &input, &inst,
+    input.ask_book->LeafCount, 1, SP_ERR_ASKS_DEPTH
+  );
+}
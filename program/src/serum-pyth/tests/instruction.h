@@ -32,6 +32,10 @@ static inline uint64_t sp_error_idx( const sp_errcode_t err )
 static inline const char* sp_error_msg( const sp_errcode_t err )
 {
   const uint64_t idx = sp_error_idx( err );
+  if ( idx == 0 && err != SP_NO_ERROR ) {
+    const char* const name = sp_error_name( err );
+    return name ? name : "UNKNOWN_CUSTOM_ERROR";
+  }
   return (
     idx < SOL_ARRAY_SIZE( SP_SOL_ERR_MSGS )
     ? SP_SOL_ERR_MSGS[ idx ]
@@ -61,6 +65,7 @@ typedef struct
 
   SolPubkey token_prog;
   sysvar_clock_t sys_clock;
+  sp_instruction_t data;
 
   pc_price_t pyth_price;
   spl_mint_t quote_mint;
@@ -121,6 +126,23 @@ static void sp_set_bid_ask(
   input->ask_leaf->Key1 = ask;
 }
 
+static void sp_set_bid_ask_qty(
+  sp_test_input_t* const input,
+  const sp_size_t bid_qty,
+  const sp_size_t ask_qty
+) {
+  input->bid_leaf->Quantity = bid_qty;
+  input->ask_leaf->Quantity = ask_qty;
+}
+
+// Send sp_instruction_t data selecting mode.
+static void sp_set_mode( sp_test_input_t* const input, const uint8_t mode )
+{
+  input->data.Mode = mode;
+  input->prog_input.data = ( const uint8_t* )( &input->data );
+  input->prog_input.data_len = sizeof( input->data );
+}
+
 static void sp_set_pyth_expo( sp_test_input_t* const input, const sp_expo_t e )
 {
   input->pyth_price.expo_ = -e;
@@ -153,6 +175,9 @@ static void sp_init_test_input( sp_test_input_t* const input )
   SolAccountInfo* const accounts = input->prog_input.accounts;
   SolPubkey* const keys = input->keys;
 
+  input->prog_input.data = NULL;
+  input->prog_input.data_len = 0;
+
   for ( int i = 0; i < SP_NUM_ACCOUNTS; ++i ) {
     SP_MEMSET_SIZEOF( &keys[ i ], i );
     accounts[ i ].key = &keys[ i ];
@@ -236,12 +261,16 @@ static void sp_init_test_input( sp_test_input_t* const input )
   input->bid_book->Root = 0;
   input->ask_book->Root = 0;
 
-  input->bid_book->LeafCount = 1;
-  input->ask_book->LeafCount = 1;
+  // One inner node over the best leaf; the other child is left out.
+  input->bid_book->LeafCount = 2;
+  input->ask_book->LeafCount = 2;
 
   input->bid_inner->Tag = SERUM_NODE_TYPE_INNER;
   input->ask_inner->Tag = SERUM_NODE_TYPE_INNER;
 
+  input->bid_inner->PrefixLen = 0;
+  input->ask_inner->PrefixLen = 0;
+
   input->bid_leaf->Tag = SERUM_NODE_TYPE_LEAF;
   input->ask_leaf->Tag = SERUM_NODE_TYPE_LEAF;
 
@@ -256,6 +285,7 @@ static void sp_init_test_input( sp_test_input_t* const input )
   input->pyth_price.ptype_ = PC_PTYPE_PRICE;
 
   sp_set_bid_ask( input, 1, 1 );
+  sp_set_bid_ask_qty( input, 1, 1 );
   sp_set_pyth_expo( input, 0 );
   sp_set_quote_expo( input, 0 );
   sp_set_base_expo( input, 0 );
@@ -333,14 +363,20 @@ static void sp_test_pyth_instruction()
 
     if ( i == SP_ACC_PAYER ) {
       acc->is_signer = false;
-      sp_assert_err( &input, &inst, ERROR_MISSING_REQUIRED_SIGNATURES );
+      sp_assert_err( &input, &inst, SP_ERR_PAYER_NOT_SIGNER );
       acc->is_signer = true;
       sp_assert_no_err( &input, &inst );
     }
 
     else if ( i == SP_ACC_PYTH_PROG || i == SP_ACC_SERUM_PROG ) {
       acc->executable = false;
-      sp_assert_err( &input, &inst, ERROR_INVALID_ARGUMENT );
+      sp_assert_err(
+        &input,
+        &inst,
+        i == SP_ACC_PYTH_PROG
+        ? SP_ERR_PYTH_PROG_NOT_EXEC
+        : SP_ERR_SERUM_PROG_NOT_EXEC
+      );
       acc->executable = true;
       sp_assert_no_err( &input, &inst );
     }
@@ -353,7 +389,7 @@ static void sp_test_pyth_instruction()
 
       if ( i == SP_ACC_SYSVAR_CLOCK ) {
         acc->key = &bad_key;
-        sp_assert_err( &input, &inst, ERROR_INVALID_ARGUMENT );
+        sp_assert_err( &input, &inst, SP_ERR_CLOCK_KEY );
         acc->key = &input.keys[ i ];
         sp_assert_no_err( &input, &inst );
       }
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <serum-pyth/sp-util.h>
+#include <serum-pyth/tests/assert.h>
+#include <serum-pyth/tests/instruction.h>
+
+static void sp_assert_microprice(
+  const sp_size_t bid,
+  const sp_size_t ask,
+  const sp_size_t bid_qty,
+  const sp_size_t ask_qty,
+  const sp_size_t expected
+) {
+  sp_assert_eq(
+    sp_microprice( bid, ask, bid_qty, ask_qty ),
+    expected,
+    "sp_microprice(%lu, %lu, %lu, %lu) == %lu != %lu",
+    bid,
+    ask,
+    bid_qty,
+    ask_qty,
+    sp_microprice( bid, ask, bid_qty, ask_qty ),
+    expected
+  );
+}
+
+static void sp_test_microprice()
+{
+  // Balanced book, or no sizes: midpoint.
+  sp_assert_microprice( 100, 200, 5, 5, 150 );
+  sp_assert_microprice( 100, 200, 0, 0, 150 );
+  sp_assert_microprice( 100, 101, 7, 7, 100 );
+
+  // Leans away from the larger side.
+  sp_assert_microprice( 100, 200, 3, 1, 175 );
+  sp_assert_microprice( 100, 200, 1, 3, 125 );
+  sp_assert_microprice( 100, 200, 1, 0, 200 );
+  sp_assert_microprice( 100, 200, 0, 1, 100 );
+
+  // Crossed book: midpoint.
+  sp_assert_microprice( 200, 100, 3, 1, 150 );
+
+  // No overflow at the extremes.
+  sp_assert_microprice( 0, UINT64_MAX, UINT64_MAX, UINT64_MAX, UINT64_MAX / 2 );
+  sp_assert_microprice( 0, UINT64_MAX, UINT64_MAX, 0, UINT64_MAX );
+  sp_assert_microprice( UINT64_MAX - 1, UINT64_MAX, 1, 1, UINT64_MAX - 1 );
+
+  // Widened by the distance from the midpoint.
+  sp_assert_size_eq( sp_confidence_at( 100, 200, 150, 0 ), 50 );
+  sp_assert_size_eq( sp_confidence_at( 100, 200, 175, 0 ), 75 );
+  sp_assert_size_eq( sp_confidence_at( 100, 200, 125, 0 ), 75 );
+  sp_assert_size_eq(
+    sp_confidence_at( 50000000, 50000010, 50000005, SP_FEE_BPS ),
+    sp_confidence( 50000000, 50000010 )
+  );
+
+  sp_test_input_t input;
+  sp_init_test_input( &input );
+  sp_set_bid_ask( &input, 1000000, 1001000 );
+  sp_set_bid_ask_qty( &input, 3, 1 );
+
+  // Without data, sizes are ignored.
+  sp_pyth_instruction_t inst;
+  sp_assert_no_err( &input, &inst );
+  sp_assert_u64( inst.cmd.price_, 1000500 );
+  sp_assert_u64( inst.cmd.conf_, sp_confidence( 1000000, 1001000 ) );
+
+  sp_set_mode( &input, SP_MODE_MIDPT );
+  sp_assert_no_err( &input, &inst );
+  sp_assert_u64( inst.cmd.price_, 1000500 );
+
+  sp_set_mode( &input, SP_MODE_MICROPRICE );
+  sp_assert_no_err( &input, &inst );
+  sp_assert_u64( inst.cmd.price_, 1000750 );
+  sp_assert_u64( inst.cmd.conf_, sp_confidence( 1000000, 1001000 ) + 250 );
+  sp_assert_u32( inst.cmd.status_, PC_STATUS_TRADING );
+
+  sp_set_mode( &input, SP_MODE_MICROPRICE + 1 );
+  sp_assert_err( &input, &inst, SP_ERR_INSTRUCTION_MODE );
+
+  sp_set_mode( &input, SP_MODE_MICROPRICE );
+  input.prog_input.data_len = 2;
+  sp_assert_err( &input, &inst, SP_ERR_INSTRUCTION_SIZE );
+}
@@ -43,7 +43,7 @@ static void sp_assert_s2p(
 
   sp_pyth_instruction_t inst;
   if ( expected_s2p == SP_SIZE_OVERFLOW ) {
-    sp_assert_err( input, &inst, ERROR_INVALID_ACCOUNT_DATA );
+    sp_assert_err( input, &inst, SP_ERR_PRICE_OVERFLOW );
   }
   else {
     sp_assert_no_err( input, &inst );
@@ -0,0 +1,674 @@
+#!/usr/bin/env python3
+"""
+Seeding, book movement and reporting for bench-validator.sh, against a
+solana-test-validator running serum-dex, the pyth oracle and serum-pyth
+at the addresses the crank uses.
+
+  seed    create N serum markets with post-only books of --depth orders
+          a side, and a pyth price account each with the publisher as
+          component; writes markets.txt (crank -F) and state.json
+  move    toggle a best bid on the markets at --rate per second, so the
+          crank has top-of-book changes to publish
+  report  landed serum-pyth updates per second, compute units per
+          instruction and transaction, and slots from a transaction's
+          blockhash to its block, over a slot range
+
+Only the standard library: transactions are built and signed here
+(ed25519 per RFC 8032), accounts are laid out as in serum-dex v3 and
+pyth-client v2 (oracle.h).
+"""
+
+import argparse
+import base64
+import hashlib
+import json
+import os
+import random
+import struct
+import time
+import urllib.request
+
+# --- ed25519 (RFC 8032, section 6) --------------------------------------------
+
+P = 2 ** 255 - 19
+Q = 2 ** 252 + 27742317777372353535851937790883648493
+D = -121665 * pow( 121666, P - 2, P ) % P
+SQRT_M1 = pow( 2, ( P - 1 ) // 4, P )
+
+
+def _recover_x( y, sign ):
+  x2 = ( y * y - 1 ) * pow( D * y * y + 1, P - 2, P ) % P
+  if x2 == 0:
+    return 0
+  x = pow( x2, ( P + 3 ) // 8, P )
+  if ( x * x - x2 ) % P:
+    x = x * SQRT_M1 % P
+  if x & 1 != sign:
+    x = P - x
+  return x
+
+
+_GY = 4 * pow( 5, P - 2, P ) % P
+_GX = _recover_x( _GY, 0 )
+G = ( _GX, _GY, 1, _GX * _GY % P )
+
+
+def _add( p1, p2 ):
+  a = ( p1[ 1 ] - p1[ 0 ] ) * ( p2[ 1 ] - p2[ 0 ] ) % P
+  b = ( p1[ 1 ] + p1[ 0 ] ) * ( p2[ 1 ] + p2[ 0 ] ) % P
+  c = 2 * p1[ 3 ] * p2[ 3 ] * D % P
+  d = 2 * p1[ 2 ] * p2[ 2 ] % P
+  e, f, g, h = b - a, d - c, d + c, b + a
+  return ( e * f % P, g * h % P, f * g % P, e * h % P )
+
+
+def _mul( s, pt ):
+  acc = ( 0, 1, 1, 0 )
+  while s:
+    if s & 1:
+      acc = _add( acc, pt )
+    pt = _add( pt, pt )
+    s >>= 1
+  return acc
+
+
+def _compress( pt ):
+  zinv = pow( pt[ 2 ], P - 2, P )
+  x, y = pt[ 0 ] * zinv % P, pt[ 1 ] * zinv % P
+  return int.to_bytes( y | ( ( x & 1 ) << 255 ), 32, 'little' )
+
+
+def _expand( seed ):
+  h = hashlib.sha512( seed ).digest()
+  a = int.from_bytes( h[ :32 ], 'little' )
+  a &= ( 1 << 254 ) - 8
+  a |= 1 << 254
+  return a, h[ 32: ]
+
+
+def on_curve( key ):
+  y = int.from_bytes( key, 'little' ) & ( ( 1 << 255 ) - 1 )
+  if y >= P:
+    return False
+  x2 = ( y * y - 1 ) * pow( D * y * y + 1, P - 2, P ) % P
+  return x2 == 0 or pow( x2, ( P - 1 ) // 2, P ) == 1
+
+
+class Keypair:
+
+  def __init__( self, seed=None ):
+    self.seed = seed or os.urandom( 32 )
+    self.a, self.prefix = _expand( self.seed )
+    self.pub = _compress( _mul( self.a, G ) )
+
+  @staticmethod
+  def load( path ):
+    with open( path ) as f:
+      return Keypair( bytes( json.load( f )[ :32 ] ) )
+
+  def save( self, path ):
+    with open( path, 'w' ) as f:
+      json.dump( list( self.seed + self.pub ), f )
+
+  def sign( self, msg ):
+    r = int.from_bytes( hashlib.sha512( self.prefix + msg ).digest(), 'little' ) % Q
+    rs = _compress( _mul( r, G ) )
+    h = int.from_bytes( hashlib.sha512( rs + self.pub + msg ).digest(), 'little' ) % Q
+    return rs + int.to_bytes( ( r + h * self.a ) % Q, 32, 'little' )
+
+# --- keys ---------------------------------------------------------------------
+
+B58 = '123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz'
+
+
+def b58encode( data ):
+  num = int.from_bytes( data, 'big' )
+  out = ''
+  while num:
+    num, rem = divmod( num, 58 )
+    out = B58[ rem ] + out
+  return '1' * ( len( data ) - len( data.lstrip( b'\0' ) ) ) + out
+
+
+def b58decode( text ):
+  num = 0
+  for c in text:
+    num = num * 58 + B58.index( c )
+  pad = len( text ) - len( text.lstrip( '1' ) )
+  return ( b'\0' * pad + num.to_bytes( ( num.bit_length() + 7 ) // 8, 'big' ) ).rjust( 32, b'\0' )
+
+
+# Programs, as deployed by bench-validator.sh and used by the crank.
+SERUM_PROG = b58decode( '9xQeWvG816bUx9EPjHmaT23yvVM2ZWbrrpZb9PusVFin' )
+PYTH_PROG = b58decode( '3mPtGfRCBMQxvgGk7xG9RvYUH32ugb44AtMnjuPWWReo' )
+SP_PROG = b58decode( 'CLs66NQrh6MWYzkgxrC79tfepMt5neTTCgguzpYo1LCW' )
+SYSTEM_PROG = bytes( 32 )
+TOKEN_PROG = b58decode( 'TokenkegQfeZyiNwAJbNbGKPFXCWuBvf9Ss623VQ5DA' )
+SYSVAR_RENT = b58decode( 'SysvarRent111111111111111111111111111111111' )
+
+
+def create_program_address( seeds, program ):
+  addr = hashlib.sha256( b''.join( seeds ) + program + b'ProgramDerivedAddress' ).digest()
+  return None if on_curve( addr ) else addr
+
+# --- transactions -------------------------------------------------------------
+
+def compact_u16( n ):
+  out = b''
+  while True:
+    byte = n & 0x7f
+    n >>= 7
+    if n:
+      out += bytes( [ byte | 0x80 ] )
+    else:
+      return out + bytes( [ byte ] )
+
+
+class Ix:
+
+  def __init__( self, program, metas, data ):
+    self.program = program
+    self.metas = metas    # [ ( key, is_signer, is_writable ) ]
+    self.data = data
+
+
+def build_tx( payer, signers, ixs, blockhash ):
+  """Legacy transaction paid by payer, also signed by signers."""
+  keys = { payer.pub: [ True, True ] }
+  order = [ payer.pub ]
+  for ix in ixs:
+    for key, signer, writable in ix.metas + [ ( ix.program, False, False ) ]:
+      if key not in keys:
+        keys[ key ] = [ False, False ]
+        order.append( key )
+      keys[ key ][ 0 ] |= signer
+      keys[ key ][ 1 ] |= writable
+  rank = lambda k: ( k != payer.pub, not keys[ k ][ 0 ], not keys[ k ][ 1 ] )
+  order.sort( key=rank )
+  num_signed = sum( 1 for k in order if keys[ k ][ 0 ] )
+  ro_signed = sum( 1 for k in order if keys[ k ][ 0 ] and not keys[ k ][ 1 ] )
+  ro_unsigned = sum( 1 for k in order if not keys[ k ][ 0 ] and not keys[ k ][ 1 ] )
+  index = { k: i for i, k in enumerate( order ) }
+
+  msg = bytes( [ num_signed, ro_signed, ro_unsigned ] ) + compact_u16( len( order ) ) + b''.join( order )
+  msg += blockhash + compact_u16( len( ixs ) )
+  for ix in ixs:
+    msg += bytes( [ index[ ix.program ] ] ) + compact_u16( len( ix.metas ) )
+    msg += bytes( index[ m[ 0 ] ] for m in ix.metas )
+    msg += compact_u16( len( ix.data ) ) + ix.data
+
+  by_pub = { kp.pub: kp for kp in [ payer ] + signers }
+  sigs = [ by_pub[ k ].sign( msg ) for k in order[ :num_signed ] ]
+  return compact_u16( len( sigs ) ) + b''.join( sigs ) + msg
+
+
+def create_account( payer, new, lamports, space, owner ):
+  return Ix( SYSTEM_PROG, [ ( payer.pub, True, True ), ( new, True, True ) ],
+             struct.pack( '<IQQ', 0, lamports, space ) + owner )
+
+
+# SPL token
+MINT_SIZE = 82
+TOKEN_ACCOUNT_SIZE = 165
+
+
+def init_mint( mint, decimals, authority ):
+  return Ix( TOKEN_PROG, [ ( mint, False, True ), ( SYSVAR_RENT, False, False ) ],
+             bytes( [ 0, decimals ] ) + authority + b'\0' )
+
+
+def init_token_account( account, mint, owner ):
+  return Ix( TOKEN_PROG, [
+    ( account, False, True ), ( mint, False, False ), ( owner, False, False ), ( SYSVAR_RENT, False, False )
+  ], b'\x01' )
+
+
+def mint_to( mint, dest, authority, amount ):
+  return Ix( TOKEN_PROG, [ ( mint, False, True ), ( dest, False, True ), ( authority, True, False ) ],
+             struct.pack( '<BQ', 7, amount ) )
+
+
+# serum-dex v3: version byte, u32 tag, fields
+MARKET_SIZE = 388
+REQ_QUEUE_SIZE = 5120 + 12
+EVENT_QUEUE_SIZE = 12 + 32 + 88 * 512
+OPEN_ORDERS_SIZE = 3228
+SIDE_BID = 0
+SIDE_ASK = 1
+ORDER_POST_ONLY = 2
+
+
+def slab_size( nodes ):
+  return 12 + 8 + 32 + 72 * nodes
+
+
+def init_market( m ):
+  data = struct.pack( '<BIQQHQQ', 0, 0, m[ 'base_lot' ], m[ 'quote_lot' ], 0, m[ 'nonce' ], 100 )
+  return Ix( SERUM_PROG, [
+    ( k( m, 'market' ), False, True ),
+    ( k( m, 'req_q' ), False, True ),
+    ( k( m, 'event_q' ), False, True ),
+    ( k( m, 'bids' ), False, True ),
+    ( k( m, 'asks' ), False, True ),
+    ( k( m, 'base_vault' ), False, True ),
+    ( k( m, 'quote_vault' ), False, True ),
+    ( k( m, 'base_mint' ), False, False ),
+    ( k( m, 'quote_mint' ), False, False ),
+    ( SYSVAR_RENT, False, False ),
+  ], data )
+
+
+def new_order( m, owner, side, price, qty, client_id ):
+  payer_acct = k( m, 'trader_quote' if side == SIDE_BID else 'trader_base' )
+  max_quote = price * qty * m[ 'quote_lot' ] * 2
+  data = struct.pack( '<BIIQQQIIQH', 0, 10, side, price, qty, max_quote, 0, ORDER_POST_ONLY, client_id, 65535 )
+  return Ix( SERUM_PROG, [
+    ( k( m, 'market' ), False, True ),
+    ( k( m, 'open_orders' ), False, True ),
+    ( k( m, 'req_q' ), False, True ),
+    ( k( m, 'event_q' ), False, True ),
+    ( k( m, 'bids' ), False, True ),
+    ( k( m, 'asks' ), False, True ),
+    ( payer_acct, False, True ),
+    ( owner, True, False ),
+    ( k( m, 'base_vault' ), False, True ),
+    ( k( m, 'quote_vault' ), False, True ),
+    ( TOKEN_PROG, False, False ),
+    ( SYSVAR_RENT, False, False ),
+  ], data )
+
+
+def cancel_by_client_id( m, owner, client_id ):
+  return Ix( SERUM_PROG, [
+    ( k( m, 'market' ), False, False ),
+    ( k( m, 'bids' ), False, True ),
+    ( k( m, 'asks' ), False, True ),
+    ( k( m, 'open_orders' ), False, True ),
+    ( owner, True, False ),
+    ( k( m, 'event_q' ), False, True ),
+  ], struct.pack( '<BIQ', 0, 12, client_id ) )
+
+
+# pyth oracle v2: cmd_hdr { u32 ver_, i32 cmd_ }, then the command's fields
+PC_VERSION = 2
+PC_MAPPING_SIZE = 20536
+PC_PRODUCT_SIZE = 512
+PC_PRICE_SIZE = 3312
+PC_MAP_MAX = 640
+PC_EXPO = -5
+PC_PTYPE_PRICE = 1
+CMD_INIT_MAPPING = 0
+CMD_ADD_MAPPING = 1
+CMD_ADD_PRODUCT = 2
+CMD_ADD_PRICE = 4
+CMD_ADD_PUBLISHER = 5
+
+
+def pyth_ix( funding, accounts, cmd, fields=b'' ):
+  return Ix( PYTH_PROG, [ ( funding, True, True ) ] + [ ( a, True, True ) for a in accounts ],
+             struct.pack( '<Ii', PC_VERSION, cmd ) + fields )
+
+# --- rpc ----------------------------------------------------------------------
+
+class Rpc:
+
+  def __init__( self, url ):
+    self.url = url
+
+  def call( self, method, *params ):
+    req = urllib.request.Request(
+      self.url,
+      json.dumps( { 'jsonrpc': '2.0', 'id': 1, 'method': method, 'params': list( params ) } ).encode(),
+      { 'Content-Type': 'application/json' },
+    )
+    with urllib.request.urlopen( req, timeout=60 ) as res:
+      out = json.loads( res.read() )
+    if 'error' in out:
+      raise RuntimeError( '%s: %s' % ( method, out[ 'error' ] ) )
+    return out[ 'result' ]
+
+  def blockhash( self ):
+    try:
+      res = self.call( 'getLatestBlockhash', { 'commitment': 'confirmed' } )
+    except RuntimeError:
+      res = self.call( 'getRecentBlockhash', { 'commitment': 'confirmed' } )
+    return b58decode( res[ 'value' ][ 'blockhash' ] )
+
+  def rent( self, size ):
+    return self.call( 'getMinimumBalanceForRentExemption', size )
+
+  def send( self, tx, preflight=True ):
+    return self.call( 'sendTransaction', base64.b64encode( tx ).decode(), {
+      'encoding': 'base64', 'skipPreflight': not preflight, 'preflightCommitment': 'confirmed'
+    } )
+
+  def confirm( self, sigs, timeout=90 ):
+    """Wait for every signature to be confirmed; raise on failures."""
+    left = list( sigs )
+    end = time.time() + timeout
+    while left:
+      if time.time() > end:
+        raise RuntimeError( '%d transactions unconfirmed' % len( left ) )
+      time.sleep( 0.4 )
+      pending = []
+      for i in range( 0, len( left ), 256 ):
+        chunk = left[ i:i + 256 ]
+        for sig, st in zip( chunk, self.call( 'getSignatureStatuses', chunk )[ 'value' ] ):
+          if st is None or st.get( 'confirmationStatus' ) not in ( 'confirmed', 'finalized' ):
+            pending.append( sig )
+          elif st[ 'err' ]:
+            raise RuntimeError( 'transaction %s failed: %s' % ( sig, st[ 'err' ] ) )
+      left = pending
+
+
+def run_phase( rpc, name, txs ):
+  """Send ( payer, signers, ixs ) transactions and wait for all of them."""
+  if not txs:
+    return
+  t0 = time.time()
+  bh = rpc.blockhash()
+  sigs = [ rpc.send( build_tx( payer, signers, ixs, bh ) ) for payer, signers, ixs in txs ]
+  rpc.confirm( sigs )
+  print( 'seed: %-14s %5d transactions in %.1fs' % ( name, len( txs ), time.time() - t0 ), flush=True )
+
+# --- seed ---------------------------------------------------------------------
+
+def k( m, name ):
+  return b58decode( m[ name ] )
+
+
+def seed( args ):
+  rpc = Rpc( args.url )
+  payer = Keypair.load( args.keypair )
+  rng = random.Random( args.seed )
+  nodes = max( 64, 4 * args.depth )
+  if args.depth > 60:
+    raise SystemExit( 'bench-validator: --depth above 60 needs more than one open orders account' )
+
+  # enough lamports for every account, with room for fees
+  per_market = sum( rpc.rent( s ) for s in (
+    MARKET_SIZE, REQ_QUEUE_SIZE, EVENT_QUEUE_SIZE, slab_size( nodes ), slab_size( nodes ),
+    TOKEN_ACCOUNT_SIZE, TOKEN_ACCOUNT_SIZE, TOKEN_ACCOUNT_SIZE, MINT_SIZE, OPEN_ORDERS_SIZE,
+    PC_PRODUCT_SIZE, PC_PRICE_SIZE,
+  ) )
+  need = per_market * args.markets + rpc.rent( PC_MAPPING_SIZE ) * ( args.markets // PC_MAP_MAX + 1 ) + 10 ** 11
+  rpc.confirm( [ rpc.call( 'requestAirdrop', b58encode( payer.pub ), need ) ] )
+
+  # quote mints shared by the markets, and the trader's accounts in them
+  quotes = []
+  txs = []
+  for _ in range( max( 1, args.quote_mints ) ):
+    mint, acct = Keypair(), Keypair()
+    quotes.append( ( mint.pub, acct.pub ) )
+    txs.append( ( payer, [ mint, acct ], [
+      create_account( payer, mint.pub, rpc.rent( MINT_SIZE ), MINT_SIZE, TOKEN_PROG ),
+      init_mint( mint.pub, 6, payer.pub ),
+      create_account( payer, acct.pub, rpc.rent( TOKEN_ACCOUNT_SIZE ), TOKEN_ACCOUNT_SIZE, TOKEN_PROG ),
+      init_token_account( acct.pub, mint.pub, payer.pub ),
+      mint_to( mint.pub, acct.pub, payer.pub, 2 ** 62 ),
+    ] ) )
+  run_phase( rpc, 'quote mints', txs )
+
+  # pyth mapping accounts, PC_MAP_MAX products each, chained
+  maps = [ Keypair() for _ in range( ( args.markets + PC_MAP_MAX - 1 ) // PC_MAP_MAX or 1 ) ]
+  for i, mp in enumerate( maps ):
+    ixs = [ create_account( payer, mp.pub, rpc.rent( PC_MAPPING_SIZE ), PC_MAPPING_SIZE, PYTH_PROG ) ]
+    if i == 0:
+      ixs.append( pyth_ix( payer.pub, [ mp.pub ], CMD_INIT_MAPPING ) )
+    else:
+      ixs.append( pyth_ix( payer.pub, [ maps[ i - 1 ].pub, mp.pub ], CMD_ADD_MAPPING ) )
+    run_phase( rpc, 'pyth mapping', [ ( payer, [ mp ] + ( [ maps[ i - 1 ] ] if i else [] ), ixs ) ] )
+
+  mkts = []
+  kps = []
+  for i in range( args.markets ):
+    kp = { n: Keypair() for n in (
+      'market', 'req_q', 'event_q', 'bids', 'asks', 'base_vault', 'quote_vault',
+      'base_mint', 'trader_base', 'open_orders', 'product', 'price',
+    ) }
+    nonce = 0
+    while create_program_address( [ kp[ 'market' ].pub, struct.pack( '<Q', nonce ) ], SERUM_PROG ) is None:
+      nonce += 1
+    quote_mint, trader_quote = quotes[ i % len( quotes ) ]
+    m = { n: b58encode( v.pub ) for n, v in kp.items() }
+    m.update( {
+      'quote_mint': b58encode( quote_mint ),
+      'trader_quote': b58encode( trader_quote ),
+      'vault_signer': b58encode( create_program_address( [ kp[ 'market' ].pub, struct.pack( '<Q', nonce ) ], SERUM_PROG ) ),
+      'nonce': nonce,
+      'base_lot': 100000,
+      'quote_lot': 10,
+      'mid': rng.randrange( 1000, 100000 ),
+      'mapping': b58encode( maps[ i // PC_MAP_MAX ].pub ),
+    } )
+    mkts.append( m )
+    kps.append( kp )
+
+  def per_market( name, build ):
+    run_phase( rpc, name, [ build( m, kp ) for m, kp in zip( mkts, kps ) ] )
+
+  per_market( 'base mints', lambda m, kp: ( payer, [ kp[ 'base_mint' ], kp[ 'trader_base' ] ], [
+    create_account( payer, kp[ 'base_mint' ].pub, rpc.rent( MINT_SIZE ), MINT_SIZE, TOKEN_PROG ),
+    init_mint( kp[ 'base_mint' ].pub, 6, payer.pub ),
+    create_account( payer, kp[ 'trader_base' ].pub, rpc.rent( TOKEN_ACCOUNT_SIZE ), TOKEN_ACCOUNT_SIZE, TOKEN_PROG ),
+    init_token_account( kp[ 'trader_base' ].pub, kp[ 'base_mint' ].pub, payer.pub ),
+    mint_to( kp[ 'base_mint' ].pub, kp[ 'trader_base' ].pub, payer.pub, 2 ** 62 ),
+  ] ) )
+  per_market( 'market queues', lambda m, kp: ( payer, [ kp[ 'market' ], kp[ 'req_q' ], kp[ 'event_q' ] ], [
+    create_account( payer, kp[ 'market' ].pub, rpc.rent( MARKET_SIZE ), MARKET_SIZE, SERUM_PROG ),
+    create_account( payer, kp[ 'req_q' ].pub, rpc.rent( REQ_QUEUE_SIZE ), REQ_QUEUE_SIZE, SERUM_PROG ),
+    create_account( payer, kp[ 'event_q' ].pub, rpc.rent( EVENT_QUEUE_SIZE ), EVENT_QUEUE_SIZE, SERUM_PROG ),
+  ] ) )
+  per_market( 'market books', lambda m, kp: ( payer, [ kp[ 'bids' ], kp[ 'asks' ], kp[ 'open_orders' ] ], [
+    create_account( payer, kp[ 'bids' ].pub, rpc.rent( slab_size( nodes ) ), slab_size( nodes ), SERUM_PROG ),
+    create_account( payer, kp[ 'asks' ].pub, rpc.rent( slab_size( nodes ) ), slab_size( nodes ), SERUM_PROG ),
+    create_account( payer, kp[ 'open_orders' ].pub, rpc.rent( OPEN_ORDERS_SIZE ), OPEN_ORDERS_SIZE, SERUM_PROG ),
+  ] ) )
+  per_market( 'init markets', lambda m, kp: ( payer, [ kp[ 'base_vault' ], kp[ 'quote_vault' ] ], [
+    create_account( payer, kp[ 'base_vault' ].pub, rpc.rent( TOKEN_ACCOUNT_SIZE ), TOKEN_ACCOUNT_SIZE, TOKEN_PROG ),
+    init_token_account( kp[ 'base_vault' ].pub, k( m, 'base_mint' ), k( m, 'vault_signer' ) ),
+    create_account( payer, kp[ 'quote_vault' ].pub, rpc.rent( TOKEN_ACCOUNT_SIZE ), TOKEN_ACCOUNT_SIZE, TOKEN_PROG ),
+    init_token_account( kp[ 'quote_vault' ].pub, k( m, 'quote_mint' ), k( m, 'vault_signer' ) ),
+    init_market( m ),
+  ] ) )
+
+  # books: depth post-only orders a side around mid, a few per transaction
+  for level in range( 0, args.depth, args.orders_per_tx ):
+    txs = []
+    for m in mkts:
+      ixs = []
+      for lvl in range( level, min( args.depth, level + args.orders_per_tx ) ):
+        qty = rng.randrange( 1, 100 )
+        ixs.append( new_order( m, payer.pub, SIDE_BID, m[ 'mid' ] - 1 - lvl, qty, 1000 + lvl ) )
+        ixs.append( new_order( m, payer.pub, SIDE_ASK, m[ 'mid' ] + 1 + lvl, qty, 2000 + lvl ) )
+      txs.append( ( payer, [], ixs ) )
+    run_phase( rpc, 'orders', txs )
+
+  per_market( 'pyth products', lambda m, kp: ( payer, [ maps[ mkts.index( m ) // PC_MAP_MAX ], kp[ 'product' ] ], [
+    create_account( payer, kp[ 'product' ].pub, rpc.rent( PC_PRODUCT_SIZE ), PC_PRODUCT_SIZE, PYTH_PROG ),
+    pyth_ix( payer.pub, [ k( m, 'mapping' ), kp[ 'product' ].pub ], CMD_ADD_PRODUCT ),
+  ] ) )
+  per_market( 'pyth prices', lambda m, kp: ( payer, [ kp[ 'product' ], kp[ 'price' ] ], [
+    create_account( payer, kp[ 'price' ].pub, rpc.rent( PC_PRICE_SIZE ), PC_PRICE_SIZE, PYTH_PROG ),
+    pyth_ix( payer.pub, [ kp[ 'product' ].pub, kp[ 'price' ].pub ], CMD_ADD_PRICE,
+             struct.pack( '<iI', PC_EXPO, PC_PTYPE_PRICE ) ),
+    pyth_ix( payer.pub, [ kp[ 'price' ].pub ], CMD_ADD_PUBLISHER, payer.pub ),
+  ] ) )
+
+  os.makedirs( args.out, exist_ok=True )
+  with open( os.path.join( args.out, 'markets.txt' ), 'w' ) as f:
+    f.write( '# market bids asks quote_mint base_mint price\n' )
+    for m in mkts:
+      f.write( ' '.join( m[ n ] for n in ( 'market', 'bids', 'asks', 'quote_mint', 'base_mint', 'price' ) ) + '\n' )
+  with open( os.path.join( args.out, 'state.json' ), 'w' ) as f:
+    json.dump( { 'depth': args.depth, 'markets': mkts }, f, indent=1 )
+  print( 'seed: %d markets in %s' % ( len( mkts ), args.out ) )
+
+# --- move ---------------------------------------------------------------------
+
+MOVE_CLIENT_ID = 1
+
+
+def move( args ):
+  """Place, then cancel, a bid at mid on each market in turn."""
+  rpc = Rpc( args.url )
+  payer = Keypair.load( args.keypair )
+  with open( args.state ) as f:
+    mkts = json.load( f )[ 'markets' ]
+  placed = [ False ] * len( mkts )
+  end = time.time() + args.duration
+  bh, bh_ts = rpc.blockhash(), time.time()
+  sent = failed = 0
+  i = 0
+  next_ts = time.time()
+  while time.time() < end:
+    if time.time() - bh_ts > 1.:
+      bh, bh_ts = rpc.blockhash(), time.time()
+    idx = i % len( mkts )
+    m = mkts[ idx ]
+    if placed[ idx ]:
+      ix = cancel_by_client_id( m, payer.pub, MOVE_CLIENT_ID )
+    else:
+      ix = new_order( m, payer.pub, SIDE_BID, m[ 'mid' ], 1 + ( i // len( mkts ) ) % 50, MOVE_CLIENT_ID )
+    placed[ idx ] = not placed[ idx ]
+    try:
+      rpc.send( build_tx( payer, [], [ ix ], bh ), preflight=False )
+      sent += 1
+    except RuntimeError:
+      failed += 1
+    i += 1
+    next_ts += 1. / args.rate
+    time.sleep( max( 0., next_ts - time.time() ) )
+  print( 'move: %d book changes sent, %d rejected' % ( sent, failed ) )
+
+# --- report -------------------------------------------------------------------
+
+def pct( vals ):
+  if not vals:
+    return { 'count': 0 }
+  s = sorted( vals )
+  return {
+    'count': len( s ),
+    'p50': s[ len( s ) // 2 ],
+    'p90': s[ len( s ) * 9 // 10 ],
+    'p99': s[ len( s ) * 99 // 100 ],
+    'max': s[ -1 ],
+  }
+
+
+def report( args ):
+  rpc = Rpc( args.url )
+  sp_id = b58encode( SP_PROG )
+  consumed = 'Program %s consumed ' % sp_id
+
+  # blockhashes from before the range too, for transactions signed early
+  hashes = {}
+  slots = rpc.call( 'getBlocks', max( 0, args.start_slot - 150 ), args.end_slot )
+  txs = landed = failed = 0
+  ix_units, tx_units, delay = [], [], []
+  per_market = {}
+  for slot in slots:
+    in_range = slot >= args.start_slot
+    blk = rpc.call( 'getBlock', slot, {
+      'encoding': 'json',
+      'transactionDetails': 'full' if in_range else 'none',
+      'rewards': False,
+      'maxSupportedTransactionVersion': 0,
+      'commitment': 'confirmed',
+    } )
+    if blk is None:
+      continue
+    hashes[ blk[ 'blockhash' ] ] = slot
+    if not in_range:
+      continue
+    for tx in blk.get( 'transactions', [] ):
+      msg = tx[ 'transaction' ][ 'message' ]
+      meta = tx[ 'meta' ] or {}
+      keys = msg[ 'accountKeys' ] + meta.get( 'loadedAddresses', {} ).get( 'writable', [] ) \
+        + meta.get( 'loadedAddresses', {} ).get( 'readonly', [] )
+      sp_ixs = [ ix for ix in msg[ 'instructions' ] if keys[ ix[ 'programIdIndex' ] ] == sp_id ]
+      if not sp_ixs:
+        continue
+      txs += 1
+      if meta.get( 'err' ):
+        failed += 1
+        continue
+      landed += len( sp_ixs )
+      for ix in sp_ixs:
+        price = keys[ ix[ 'accounts' ][ 1 ] ]
+        per_market[ price ] = per_market.get( price, 0 ) + 1
+      if 'computeUnitsConsumed' in meta:
+        tx_units.append( meta[ 'computeUnitsConsumed' ] )
+      for line in meta.get( 'logMessages' ) or []:
+        if line.startswith( consumed ):
+          ix_units.append( int( line[ len( consumed ): ].split()[ 0 ] ) )
+      bh_slot = hashes.get( msg[ 'recentBlockhash' ] )
+      if bh_slot is not None:
+        delay.append( slot - bh_slot )
+
+  counts = sorted( per_market.values() )
+  hist = {}
+  for u in ix_units:
+    bucket = u // args.bucket * args.bucket
+    hist[ bucket ] = hist.get( bucket, 0 ) + 1
+  rep = {
+    'slots': args.end_slot - args.start_slot,
+    'seconds': args.seconds,
+    'transactions': txs,
+    'failed_transactions': failed,
+    'landed_updates': landed,
+    'landed_updates_per_s': landed / args.seconds if args.seconds else None,
+    'markets_updated': len( counts ),
+    'updates_per_market': { 'min': counts[ 0 ], 'max': counts[ -1 ] } if counts else {},
+    'ix_units': pct( ix_units ),
+    'ix_units_hist': { str( b ): n for b, n in sorted( hist.items() ) },
+    'tx_units': pct( tx_units ),
+    'slot_latency': pct( delay ),
+  }
+  if args.json:
+    with open( args.json, 'w' ) as f:
+      json.dump( rep, f, indent=2 )
+
+  print( 'slots %d-%d (%d), %.0fs' % ( args.start_slot, args.end_slot, rep[ 'slots' ], args.seconds ) )
+  print( 'transactions    %d, failed %d' % ( txs, failed ) )
+  print( 'landed updates  %d, %.1f/s, %d markets' % ( landed, rep[ 'landed_updates_per_s' ] or 0, len( counts ) ) )
+  for name, key in ( ( 'CU/instruction', 'ix_units' ), ( 'CU/transaction', 'tx_units' ), ( 'slot latency', 'slot_latency' ) ):
+    d = rep[ key ]
+    if d[ 'count' ]:
+      print( '%-15s p50 %d  p90 %d  p99 %d  max %d' % ( name, d[ 'p50' ], d[ 'p90' ], d[ 'p99' ], d[ 'max' ] ) )
+  for b, n in sorted( hist.items() ):
+    print( '  %6d-%-6d %s %d' % ( b, b + args.bucket - 1, '#' * max( 1, 50 * n // len( ix_units ) ), n ) )
+
+
+def main():
+  p = argparse.ArgumentParser( description=__doc__.strip().split( '\n\n' )[ 0 ] )
+  p.add_argument( '--url', default='http://127.0.0.1:8899' )
+  p.add_argument( '--keypair', help='payer and publisher, a solana-keygen file' )
+  sub = p.add_subparsers( dest='cmd', required=True )
+
+  s = sub.add_parser( 'seed' )
+  s.add_argument( '--markets', type=int, default=10 )
+  s.add_argument( '--depth', type=int, default=8, help='orders per book side' )
+  s.add_argument( '--orders-per-tx', type=int, default=2, help='levels (a bid and an ask each) per transaction' )
+  s.add_argument( '--quote-mints', type=int, default=2 )
+  s.add_argument( '--seed', type=int, default=1 )
+  s.add_argument( '--out', required=True )
+
+  s = sub.add_parser( 'move' )
+  s.add_argument( '--state', required=True )
+  s.add_argument( '--rate', type=float, default=10., help='book changes per second over all markets' )
+  s.add_argument( '--duration', type=float, required=True )
+
+  s = sub.add_parser( 'report' )
+  s.add_argument( '--start-slot', type=int, required=True )
+  s.add_argument( '--end-slot', type=int, required=True )
+  s.add_argument( '--seconds', type=float, default=0. )
+  s.add_argument( '--bucket', type=int, default=1000, help='CU histogram bucket' )
+  s.add_argument( '--json' )
+
+  args = p.parse_args()
+  { 'seed': seed, 'move': move, 'report': report }[ args.cmd ]( args )
+
+
+if __name__ == '__main__':
+  main()
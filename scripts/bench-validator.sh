@@ -0,0 +1,117 @@
+#!/usr/bin/env bash
+#
+# End-to-end benchmark: a solana-test-validator with serum-dex, the pyth
+# oracle and serum-pyth deployed, NUM_MARKETS seeded markets with books
+# of DEPTH orders a side, and serum-pyth-crank publishing them for
+# DURATION seconds while BOOK_RATE book changes a second are sent.
+# Reports landed updates per second, compute units per instruction and
+# slots from blockhash to landing.
+#
+# Defaults match the docker image (docker/Dockerfile), e.g.:
+#   docker run --rm serum-pyth:<tag> serum-pyth/scripts/bench-validator.sh
+#
+# Extra arguments go to the crank, e.g. -k to pack markets.
+
+set -eu
+
+SP_DIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )/.." && pwd )"
+TOP_DIR="$( dirname "${SP_DIR}" )"
+
+NUM_MARKETS="${NUM_MARKETS:-10}"
+DEPTH="${DEPTH:-8}"
+DURATION="${DURATION:-60}"
+BOOK_RATE="${BOOK_RATE:-10}"
+WORK_DIR="${WORK_DIR:-$( mktemp -d /tmp/sp-bench.XXXXXX )}"
+
+SERUM_SO="${SERUM_SO:-${TOP_DIR}/serum-dex/dex/target/bpfel-unknown-unknown/release/serum_dex.so}"
+PYTH_SO="${PYTH_SO:-${TOP_DIR}/pyth-client/target/oracle.so}"
+SP_SO="${SP_SO:-${SP_DIR}/target/serum-pyth.so}"
+CRANK="${CRANK:-${SP_DIR}/build/test-crank/serum-pyth-crank}"
+
+# Addresses the crank expects (test-crank/main.cpp).
+SERUM_PID=9xQeWvG816bUx9EPjHmaT23yvVM2ZWbrrpZb9PusVFin
+PYTH_PID=3mPtGfRCBMQxvgGk7xG9RvYUH32ugb44AtMnjuPWWReo
+SP_PID=CLs66NQrh6MWYzkgxrC79tfepMt5neTTCgguzpYo1LCW
+
+URL=http://127.0.0.1:8899
+BENCH=( python3 "${SP_DIR}/scripts/bench-validator.py" --url "${URL}"
+  --keypair "${WORK_DIR}/publish_key_pair.json" )
+
+PIDS=()
+function cleanup() {
+  for pid in "${PIDS[@]}"
+  do
+    kill "${pid}" &> /dev/null || true
+  done
+  wait &> /dev/null || true
+}
+trap cleanup EXIT
+
+function get_slot() {
+  curl -s "${URL}" -H 'Content-Type: application/json' \
+    -d '{"jsonrpc":"2.0","id":1,"method":"getSlot","params":[{"commitment":"confirmed"}]}' \
+    | jq .result
+}
+
+for so in "${SERUM_SO}" "${PYTH_SO}" "${SP_SO}" "${CRANK}"
+do
+  if [ ! -f "${so}" ]
+  then
+    echo "bench-validator: missing ${so}" >&2
+    exit 1
+  fi
+done
+
+echo "bench-validator: ${NUM_MARKETS} markets, depth ${DEPTH}, ${DURATION}s in ${WORK_DIR}"
+solana-keygen new --no-bip39-passphrase --silent --force \
+  --outfile "${WORK_DIR}/publish_key_pair.json"
+
+solana-test-validator \
+  --reset \
+  --quiet \
+  --ledger "${WORK_DIR}/ledger" \
+  --bpf-program "${SERUM_PID}" "${SERUM_SO}" \
+  --bpf-program "${PYTH_PID}" "${PYTH_SO}" \
+  --bpf-program "${SP_PID}" "${SP_SO}" \
+  &> "${WORK_DIR}/validator.log" &
+PIDS+=( $! )
+
+for _ in $( seq 60 )
+do
+  if [ "$( get_slot 2> /dev/null )" -gt 1 ] 2> /dev/null
+  then
+    break
+  fi
+  sleep 1
+done
+
+"${BENCH[@]}" seed \
+  --markets "${NUM_MARKETS}" \
+  --depth "${DEPTH}" \
+  --out "${WORK_DIR}"
+
+START_SLOT="$( get_slot )"
+"${CRANK}" \
+  -r localhost \
+  -d "${WORK_DIR}" \
+  -F "${WORK_DIR}/markets.txt" \
+  -L \
+  "$@" \
+  &> "${WORK_DIR}/crank.log" &
+CRANK_PID=$!
+PIDS+=( "${CRANK_PID}" )
+
+"${BENCH[@]}" move \
+  --state "${WORK_DIR}/state.json" \
+  --rate "${BOOK_RATE}" \
+  --duration "${DURATION}"
+
+kill -INT "${CRANK_PID}"
+wait "${CRANK_PID}" || true
+END_SLOT="$( get_slot )"
+
+"${BENCH[@]}" report \
+  --start-slot "${START_SLOT}" \
+  --end-slot "${END_SLOT}" \
+  --seconds "${DURATION}" \
+  --json "${WORK_DIR}/report.json"
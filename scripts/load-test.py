@@ -0,0 +1,184 @@
+#!/usr/bin/env python3
+"""
+Run serum-pyth-crank against mock-cluster.py at growing market counts
+and report, per count: crank CPU and memory, transactions and market
+updates per second, publish latency (book change to the transaction
+publishing it) and slots to land.
+
+  scripts/load-test.py --markets 1,10,100,1000,10000 -- -b 500 -s 200
+
+Arguments after -- go to the crank; --mock-args to the mock.
+"""
+
+import argparse
+import json
+import os
+import random
+import shlex
+import signal
+import subprocess
+import sys
+import tempfile
+import time
+import urllib.request
+
+SCRIPTS = os.path.dirname( os.path.abspath( __file__ ) )
+REPO = os.path.dirname( SCRIPTS )
+
+
+def rpc( port, method, params=None ):
+  req = urllib.request.Request(
+    'http://127.0.0.1:%d' % port,
+    json.dumps( { 'jsonrpc': '2.0', 'id': 1, 'method': method, 'params': params or [] } ).encode(),
+    { 'Content-Type': 'application/json' },
+  )
+  with urllib.request.urlopen( req, timeout=30 ) as res:
+    return json.loads( res.read() )[ 'result' ]
+
+
+def cpu_seconds( pid ):
+  with open( '/proc/%d/stat' % pid ) as f:
+    fields = f.read().rsplit( ')', 1 )[ 1 ].split()
+  # utime and stime, fields 14 and 15 of proc(5)
+  return ( int( fields[ 11 ] ) + int( fields[ 12 ] ) ) / os.sysconf( 'SC_CLK_TCK' )
+
+
+def rss_mb( pid ):
+  with open( '/proc/%d/status' % pid ) as f:
+    for line in f:
+      if line.startswith( 'VmRSS:' ):
+        return int( line.split()[ 1 ] ) / 1024.
+  return 0.
+
+
+def wait_for( proc, text, timeout ):
+  """Wait for a line starting with text on proc's stdout."""
+  end = time.time() + timeout
+  while time.time() < end:
+    line = proc.stdout.readline()
+    if not line:
+      break
+    if line.startswith( text ):
+      return True
+  return False
+
+
+def run( args, num_markets, crank_args ):
+  work = tempfile.mkdtemp( prefix='sp-load-%d-' % num_markets )
+
+  # The mock doesn't verify signatures, so any key pair will do.
+  with open( os.path.join( work, 'publish_key_pair.json' ), 'w' ) as f:
+    json.dump( [ random.randrange( 256 ) for _ in range( 64 ) ], f )
+
+  mkts_file = os.path.join( work, 'markets.txt' )
+  mock_cmd = [
+    sys.executable, os.path.join( SCRIPTS, 'mock-cluster.py' ),
+    '--markets', str( num_markets ),
+    '--markets-file', mkts_file,
+    '--book-rate', str( args.book_rate ),
+    '--rpc-port', str( args.rpc_port ),
+    '--tx-port', str( args.tx_port ),
+    '--tpu-port', str( args.tpu_port ),
+  ] + shlex.split( args.mock_args )
+  mock = subprocess.Popen( mock_cmd, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True )
+  crank = None
+  try:
+    if not wait_for( mock, 'mock-cluster:', 60 + num_markets / 100 ):
+      raise RuntimeError( 'mock-cluster did not start' )
+
+    crank_cmd = [
+      args.crank,
+      '-r', args.host,
+      '-y', args.host,
+      '-d', work,
+      '-F', mkts_file,
+    ]
+    if args.tpu:
+      crank_cmd += [ '-T', '%s:%d' % ( args.host, args.tpu_port ) ]
+    crank_cmd += crank_args
+    with open( os.path.join( work, 'crank.log' ), 'w' ) as log:
+      crank = subprocess.Popen( crank_cmd, stdout=log, stderr=subprocess.STDOUT, cwd=work )
+
+    time.sleep( args.warmup )
+    if crank.poll() is not None:
+      raise RuntimeError( 'crank exited with %d, see %s/crank.log' % ( crank.returncode, work ) )
+    rpc( args.rpc_port, 'mock_resetStats' )
+    cpu0, ts0 = cpu_seconds( crank.pid ), time.time()
+
+    time.sleep( args.duration )
+    stats = rpc( args.rpc_port, 'mock_getStats' )
+    cpu1, ts1 = cpu_seconds( crank.pid ), time.time()
+    rss = rss_mb( crank.pid )
+  finally:
+    if crank and crank.poll() is None:
+      crank.send_signal( signal.SIGINT )
+      try:
+        crank.wait( 10 )
+      except subprocess.TimeoutExpired:
+        crank.kill()
+    mock.terminate()
+    mock.wait()
+
+  secs = stats[ 'elapsed_s' ]
+  count = stats[ 'counters' ]
+  received = sum( v for k, v in count.items() if k in ( 'tx_pyth_tx', 'tx_tpu', 'tx_rpc' ) )
+  return {
+    'markets': num_markets,
+    'crank_cpu_pct': 100. * ( cpu1 - cpu0 ) / ( ts1 - ts0 ),
+    'crank_rss_mb': rss,
+    'tx_per_s': received / secs,
+    'landed_per_s': count.get( 'tx_landed', 0 ) / secs,
+    'updates_per_s': count.get( 'markets_published', 0 ) / secs,
+    'book_updates_per_s': count.get( 'book_updates', 0 ) / secs,
+    'latency_ms': stats[ 'publish_latency_ms' ],
+    'land_slots': stats[ 'land_slots' ],
+    'unknown_methods': stats[ 'unknown_methods' ],
+    'mock': stats,
+    'work_dir': work,
+  }
+
+
+def main():
+  argv = sys.argv[ 1: ]
+  crank_args = []
+  if '--' in argv:
+    crank_args = argv[ argv.index( '--' ) + 1: ]
+    argv = argv[ :argv.index( '--' ) ]
+  p = argparse.ArgumentParser( description=__doc__.strip().split( '\n\n' )[ 0 ] )
+  p.add_argument( '--crank', default=os.path.join( REPO, 'build', 'test-crank', 'serum-pyth-crank' ) )
+  p.add_argument( '--markets', default='1,10,100,1000,10000', help='comma-separated market counts' )
+  p.add_argument( '--duration', type=float, default=60., help='seconds measured per count' )
+  p.add_argument( '--warmup', type=float, default=10., help='seconds before measuring' )
+  p.add_argument( '--book-rate', type=float, default=1., help='book updates per second per market' )
+  p.add_argument( '--tpu', action='store_true', help='send to the mock TPU (-T) instead of pyth_tx' )
+  p.add_argument( '--host', default='localhost' )
+  p.add_argument( '--rpc-port', type=int, default=8899, help='the crank only connects to the default ports' )
+  p.add_argument( '--tx-port', type=int, default=8898 )
+  p.add_argument( '--tpu-port', type=int, default=8003 )
+  p.add_argument( '--mock-args', default='', help='extra mock-cluster.py arguments, e.g. "--drop 0.1"' )
+  p.add_argument( '--json', help='write every result here' )
+  args = p.parse_args( argv )
+
+  results = []
+  print( '%8s %8s %8s %9s %9s %9s %9s %9s %9s %6s' % (
+    'markets', 'cpu %', 'rss MB', 'tx/s', 'landed/s', 'upd/s', 'lat p50', 'lat p90', 'lat p99', 'slots'
+  ) )
+  for num in [ int( n ) for n in args.markets.split( ',' ) ]:
+    res = run( args, num, crank_args )
+    results.append( res )
+    lat = res[ 'latency_ms' ]
+    print( '%8d %8.1f %8.1f %9.1f %9.1f %9.1f %9.0f %9.0f %9.0f %6s' % (
+      num, res[ 'crank_cpu_pct' ], res[ 'crank_rss_mb' ], res[ 'tx_per_s' ],
+      res[ 'landed_per_s' ], res[ 'updates_per_s' ],
+      lat.get( 'p50', 0 ), lat.get( 'p90', 0 ), lat.get( 'p99', 0 ),
+      res[ 'land_slots' ].get( 'p50', '-' ),
+    ), flush=True )
+    if res[ 'unknown_methods' ]:
+      print( '         unsupported rpc methods: %s' % res[ 'unknown_methods' ] )
+  if args.json:
+    with open( args.json, 'w' ) as f:
+      json.dump( results, f, indent=2 )
+
+
+if __name__ == '__main__':
+  main()
@@ -0,0 +1,957 @@
+#!/usr/bin/env python3
+"""
+Local stand-in for the parts of a Solana cluster serum-pyth-crank talks
+to, for load tests without a validator:
+
+- JSON-RPC over HTTP on --rpc-port and websocket subscriptions on the
+  port above it, as pc::manager expects (slot, account, blockhash,
+  signature status, transaction and leader schedule requests).
+- Transactions from pyth_tx clients (--tx-port, pc::tx_hdr framing) and
+  raw datagrams to a TPU (--tpu-port, for the crank's -L/-T).
+
+It serves N synthetic markets: serum market, bids and asks accounts,
+SPL mints and pyth price accounts, with books that move at --book-rate
+updates per second per market. Transactions aren't executed or verified:
+each serum-pyth instruction that lands sets the signer's component
+pub_slot_ in its price account, like upd_price would, and the signature
+reports the slot it landed in. Address lookup table create and extend
+instructions are applied, so the crank's -t works too.
+
+Faults: --latency-ms delays every RPC response, --land-slots delays
+inclusion, --drop and --fail lose or fail that share of transactions,
+--rpc-error fails that share of requests and --disconnect-s drops every
+websocket periodically.
+
+--markets-file writes the markets for the crank's -F. The custom method
+mock_getStats returns counters and publish latency (book change to first
+transaction publishing it); mock_resetStats clears them.
+"""
+
+import argparse
+import asyncio
+import base64
+import hashlib
+import json
+import random
+import struct
+import sys
+import time
+
+# --- base58 and keys ----------------------------------------------------------
+
+B58 = '123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz'
+
+
+def b58encode( data ):
+  num = int.from_bytes( data, 'big' )
+  out = ''
+  while num:
+    num, rem = divmod( num, 58 )
+    out = B58[ rem ] + out
+  pad = len( data ) - len( data.lstrip( b'\0' ) )
+  return '1' * pad + out
+
+
+def b58decode( text, size=32 ):
+  num = 0
+  for c in text:
+    num = num * 58 + B58.index( c )
+  pad = len( text ) - len( text.lstrip( '1' ) )
+  body = num.to_bytes( ( num.bit_length() + 7 ) // 8, 'big' )
+  out = b'\0' * pad + body
+  return out.rjust( size, b'\0' )
+
+
+def mock_key( *parts ):
+  return hashlib.sha256( '/'.join( [ 'mock-cluster' ] + [ str( p ) for p in parts ] ).encode() ).digest()
+
+
+SERUM_PROG = b58decode( '9xQeWvG816bUx9EPjHmaT23yvVM2ZWbrrpZb9PusVFin' )
+SP_PROG = b58decode( 'CLs66NQrh6MWYzkgxrC79tfepMt5neTTCgguzpYo1LCW' )
+PYTH_PROG = b58decode( '3mPtGfRCBMQxvgGk7xG9RvYUH32ugb44AtMnjuPWWReo' )
+TOKEN_PROG = b58decode( 'TokenkegQfeZyiNwAJbNbGKPFXCWuBvf9Ss623VQ5DA' )
+BUDGET_PROG = b58decode( 'ComputeBudget111111111111111111111111111111' )
+ALT_PROG = b58decode( 'AddressLookupTab1e1111111111111111111111111' )
+IDENTITY = mock_key( 'identity' )
+
+# --- ed25519 curve check, for lookup table addresses --------------------------
+
+P25519 = 2 ** 255 - 19
+D25519 = -121665 * pow( 121666, P25519 - 2, P25519 ) % P25519
+
+
+def on_curve( key ):
+  y = int.from_bytes( key, 'little' ) & ( ( 1 << 255 ) - 1 )
+  if y >= P25519:
+    return False
+  u = ( y * y - 1 ) % P25519
+  v = ( D25519 * y * y + 1 ) % P25519
+  x2 = u * pow( v, P25519 - 2, P25519 ) % P25519
+  return x2 == 0 or pow( x2, ( P25519 - 1 ) // 2, P25519 ) == 1
+
+
+def find_program_address( seeds, program ):
+  for bump in range( 255, -1, -1 ):
+    addr = hashlib.sha256( b''.join( seeds ) + bytes( [ bump ] ) + program + b'ProgramDerivedAddress' ).digest()
+    if not on_curve( addr ):
+      return addr
+  return None
+
+# --- account layouts (serum-pyth.h, pyth-client oracle.h) ---------------------
+
+SERUM_HEADER = b'serum'
+SERUM_FOOTER = b'padding'
+FLAG_INIT = 1 << 0
+FLAG_MARKET = 1 << 1
+FLAG_BIDS = 1 << 5
+FLAG_ASKS = 1 << 6
+NODE_SIZE = 72
+
+PC_MAGIC = 0xa1b2c3d4
+PC_VERSION = 2
+PC_ACCTYPE_PRICE = 3
+PC_PRICE_SIZE = 3312
+PC_COMP_OFFSET = 240
+PC_COMP_SIZE = 96
+PC_COMP_MAX = 32
+PC_EXPO = -5
+
+QUOTE_DECIMALS = 6
+BASE_DECIMALS = 6
+BASE_LOT = 100000
+QUOTE_LOT = 10
+
+ALT_META_SIZE = 56
+
+
+def mint_data( decimals ):
+  data = bytearray( 82 )
+  data[ 44 ] = decimals
+  data[ 45 ] = 1
+  return bytes( data )
+
+
+def market_data( addr, base_mint, quote_mint, bids, asks ):
+  mkt = bytearray( 368 )
+  mkt[ 0:32 ] = addr
+  mkt[ 40:72 ] = base_mint
+  mkt[ 72:104 ] = quote_mint
+  mkt[ 272:304 ] = bids
+  mkt[ 304:336 ] = asks
+  struct.pack_into( '<QQ', mkt, 336, BASE_LOT, QUOTE_LOT )
+  return SERUM_HEADER + struct.pack( '<Q', FLAG_INIT | FLAG_MARKET ) + bytes( mkt ) + SERUM_FOOTER
+
+
+def price_data():
+  data = bytearray( PC_PRICE_SIZE )
+  struct.pack_into( '<IIIIIiI', data, 0, PC_MAGIC, PC_VERSION, PC_ACCTYPE_PRICE, PC_COMP_OFFSET, 1, PC_EXPO, 0 )
+  return data
+
+
+def slab_data( orders, side_flag, capacity ):
+  """
+  Critbit slab of orders, [(key, quantity)] with key = price << 64 | seq.
+  Inner nodes split on the highest differing bit, so PrefixLen grows on
+  the way down as serum-dex's does.
+  """
+  nodes = []
+
+  def build( items ):
+    idx = len( nodes )
+    nodes.append( None )
+    if len( items ) == 1:
+      key, qty = items[ 0 ]
+      nodes[ idx ] = struct.pack(
+        '<IBB2xQQ32sQQ', 2, 0, 0, key & ( 2 ** 64 - 1 ), key >> 64, b'\0' * 32, qty, 0
+      )
+      return idx
+    lo, hi = items[ 0 ][ 0 ], items[ -1 ][ 0 ]
+    prefix = 128 - ( lo ^ hi ).bit_length()
+    bit = 1 << ( 127 - prefix )
+    split = next( i for i, it in enumerate( items ) if it[ 0 ] & bit )
+    a = build( items[ :split ] )
+    b = build( items[ split: ] )
+    key = lo & ~( ( 1 << ( 128 - prefix ) ) - 1 )
+    nodes[ idx ] = struct.pack(
+      '<IIQQII', 1, prefix, key & ( 2 ** 64 - 1 ), key >> 64, a, b
+    ).ljust( NODE_SIZE, b'\0' )
+    return idx
+
+  items = sorted( orders )
+  if items:
+    build( items )
+  body = b''.join( nodes ).ljust( capacity * NODE_SIZE, b'\0' )
+  head = struct.pack( '<QQQIIQ', FLAG_INIT | side_flag, len( nodes ), 0, 0, 0, len( items ) )
+  return SERUM_HEADER + head + body + SERUM_FOOTER
+
+
+# --- transactions -------------------------------------------------------------
+
+def compact_u16( buf, pos ):
+  val = 0
+  for shift in ( 0, 7, 14 ):
+    byte = buf[ pos ]
+    pos += 1
+    val |= ( byte & 0x7f ) << shift
+    if not byte & 0x80:
+      break
+  return val, pos
+
+
+class Tx:
+  """Signatures, accounts (lookup tables resolved) and instructions."""
+
+  def __init__( self, buf, tables ):
+    nsig, p = compact_u16( buf, 0 )
+    self.sigs = [ bytes( buf[ p + 64 * i:p + 64 * i + 64 ] ) for i in range( nsig ) ]
+    p += 64 * nsig
+    self.version = None
+    if buf[ p ] & 0x80:
+      self.version = buf[ p ] & 0x7f
+      p += 1
+    p += 3
+    nkeys, p = compact_u16( buf, p )
+    self.keys = [ bytes( buf[ p + 32 * i:p + 32 * i + 32 ] ) for i in range( nkeys ) ]
+    p += 32 * nkeys
+    self.blockhash = bytes( buf[ p:p + 32 ] )
+    p += 32
+    nix, p = compact_u16( buf, p )
+    self.ixs = []
+    for _ in range( nix ):
+      prog = buf[ p ]
+      nacc, p = compact_u16( buf, p + 1 )
+      accs = list( buf[ p:p + nacc ] )
+      p += nacc
+      dlen, p = compact_u16( buf, p )
+      self.ixs.append( ( prog, accs, bytes( buf[ p:p + dlen ] ) ) )
+      p += dlen
+    self.missing_table = False
+    if self.version == 0:
+      writable, readonly = [], []
+      nlook, p = compact_u16( buf, p )
+      for _ in range( nlook ):
+        table = tables.get( bytes( buf[ p:p + 32 ] ) )
+        p += 32
+        for dest in ( writable, readonly ):
+          num, p = compact_u16( buf, p )
+          for idx in buf[ p:p + num ]:
+            if table is None or idx >= len( table.keys ):
+              self.missing_table = True
+            else:
+              dest.append( table.keys[ idx ] )
+          p += num
+      self.keys += writable + readonly
+
+  def program( self, ix ):
+    return self.keys[ ix[ 0 ] ]
+
+  def account( self, ix, i ):
+    return self.keys[ ix[ 1 ][ i ] ]
+
+
+# --- websocket ----------------------------------------------------------------
+
+WS_GUID = b'258EAFA5-E914-47DA-95CA-C5AB0DC85B11'
+
+
+def ws_frame( text ):
+  data = text.encode()
+  n = len( data )
+  if n < 126:
+    head = struct.pack( '!BB', 0x81, n )
+  elif n < 65536:
+    head = struct.pack( '!BBH', 0x81, 126, n )
+  else:
+    head = struct.pack( '!BBQ', 0x81, 127, n )
+  return head + data
+
+
+async def ws_read( reader ):
+  """Next text message, or None once the client closes."""
+  message = b''
+  while True:
+    b0, b1 = await reader.readexactly( 2 )
+    n = b1 & 0x7f
+    if n == 126:
+      n, = struct.unpack( '!H', await reader.readexactly( 2 ) )
+    elif n == 127:
+      n, = struct.unpack( '!Q', await reader.readexactly( 8 ) )
+    mask = await reader.readexactly( 4 ) if b1 & 0x80 else b'\0' * 4
+    data = bytearray( await reader.readexactly( n ) )
+    for i in range( n ):
+      data[ i ] ^= mask[ i & 3 ]
+    opcode = b0 & 0x0f
+    if opcode == 0x8:
+      return None
+    if opcode in ( 0x9, 0xa ):
+      continue
+    message += data
+    if b0 & 0x80:
+      return message.decode()
+
+
+async def http_head( reader ):
+  """Request line and headers, or None at end of stream."""
+  try:
+    raw = await reader.readuntil( b'\r\n\r\n' )
+  except ( asyncio.IncompleteReadError, ConnectionError ):
+    return None
+  lines = raw.decode( 'latin-1' ).split( '\r\n' )
+  headers = {}
+  for line in lines[ 1: ]:
+    if ':' in line:
+      name, val = line.split( ':', 1 )
+      headers[ name.strip().lower() ] = val.strip()
+  return lines[ 0 ], headers
+
+
+def zstd_raw( data ):
+  """A zstd frame of raw (uncompressed) blocks, for base64+zstd."""
+  out = struct.pack( '<IBI', 0xFD2FB528, 0xA0, len( data ) )
+  pos = 0
+  while True:
+    block = data[ pos:pos + 0x20000 ]
+    pos += len( block )
+    last = pos >= len( data )
+    out += struct.pack( '<I', ( len( block ) << 3 ) | last )[ :3 ] + block
+    if last:
+      return out
+
+
+def encode_data( data, encoding ):
+  if encoding == 'base64+zstd':
+    return [ base64.b64encode( zstd_raw( data ) ).decode(), encoding ]
+  return [ base64.b64encode( data ).decode(), 'base64' ]
+
+
+# --- cluster ------------------------------------------------------------------
+
+class Account:
+
+  def __init__( self, data, owner ):
+    self.data = data
+    self.owner = owner
+    self.subs = {}    # subscription id -> (connection, encoding)
+
+
+class Table:
+
+  def __init__( self, authority ):
+    self.authority = authority
+    self.keys = []
+    self.last_slot = 0
+    self.last_start = 0
+
+  def data( self ):
+    meta = bytearray( ALT_META_SIZE )
+    struct.pack_into( '<IQQB', meta, 0, 1, 2 ** 64 - 1, self.last_slot, self.last_start )
+    meta[ 21 ] = 1
+    meta[ 22:54 ] = self.authority
+    return bytes( meta ) + b''.join( self.keys )
+
+
+class Market:
+
+  def __init__( self, idx, quote_mint, depth, rng ):
+    self.addr = mock_key( idx, 'market' )
+    self.bids = mock_key( idx, 'bids' )
+    self.asks = mock_key( idx, 'asks' )
+    self.base_mint = mock_key( idx, 'base_mint' )
+    self.quote_mint = quote_mint
+    self.price = mock_key( idx, 'price' )
+    self.depth = depth
+    self.mid = rng.randrange( 1000, 1000000 )
+    self.seq = 0
+    self.changed_at = None  # book change not published yet
+
+  def book( self, rng ):
+    """Bids and asks slabs around a mid that takes a random step."""
+    self.mid = max( self.depth + 2, self.mid + rng.randint( -2, 2 ) )
+    bids, asks = [], []
+    for lvl in range( self.depth ):
+      self.seq += 2
+      bids.append( ( ( self.mid - 1 - lvl ) << 64 | ( 2 ** 64 - 1 - self.seq ), rng.randrange( 1, 1000 ) ) )
+      asks.append( ( ( self.mid + 1 + lvl ) << 64 | ( self.seq + 1 ), rng.randrange( 1, 1000 ) ) )
+    cap = max( 2 * self.depth, 2 )
+    return slab_data( bids, FLAG_BIDS, cap ), slab_data( asks, FLAG_ASKS, cap )
+
+  def line( self ):
+    return ' '.join( b58encode( k ) for k in (
+      self.addr, self.bids, self.asks, self.quote_mint, self.base_mint, self.price
+    ) )
+
+
+class Stats:
+
+  def __init__( self ):
+    self.reset()
+
+  def reset( self ):
+    self.start = time.time()
+    self.count = {}
+    self.methods = {}
+    self.unknown = {}
+    self.latency = []     # ms, book change to first publishing transaction
+    self.land_slots = []
+
+  def add( self, name, num=1 ):
+    self.count[ name ] = self.count.get( name, 0 ) + num
+
+  def sample( self, lst, val ):
+    if len( lst ) < 200000:
+      lst.append( val )
+    else:
+      lst[ random.randrange( len( lst ) ) ] = val
+
+  def report( self ):
+    def pct( lst ):
+      if not lst:
+        return {}
+      s = sorted( lst )
+      return {
+        'count': len( s ),
+        'p50': s[ len( s ) // 2 ],
+        'p90': s[ len( s ) * 9 // 10 ],
+        'p99': s[ len( s ) * 99 // 100 ],
+        'max': s[ -1 ],
+      }
+    return {
+      'elapsed_s': time.time() - self.start,
+      'counters': self.count,
+      'rpc_methods': self.methods,
+      'unknown_methods': self.unknown,
+      'publish_latency_ms': pct( self.latency ),
+      'land_slots': pct( self.land_slots ),
+    }
+
+
+class Cluster:
+
+  def __init__( self, args ):
+    self.args = args
+    self.rng = random.Random( args.seed )
+    self.slot = 1
+    self.stats = Stats()
+    self.accounts = {}
+    self.tables = {}
+    self.conns = set()
+    self.next_sub = 1
+    self.slot_subs = {}
+    self.hashes = {}      # blockhash -> slot
+    self.statuses = {}    # signature -> (slot, err, units, logs)
+    self.pending = []     # (land slot, arrival slot, tx)
+    self.changed = set()
+    self.blockhash = self.make_hash()
+
+    quotes = [ mock_key( 'quote_mint', q ) for q in range( max( 1, args.quote_mints ) ) ]
+    for q in quotes:
+      self.add_account( q, mint_data( QUOTE_DECIMALS ), TOKEN_PROG )
+    self.markets = []
+    self.by_price = {}
+    for i in range( args.markets ):
+      m = Market( i, quotes[ i % len( quotes ) ], args.depth, self.rng )
+      bids, asks = m.book( self.rng )
+      self.add_account( m.addr, market_data( m.addr, m.base_mint, m.quote_mint, m.bids, m.asks ), SERUM_PROG )
+      self.add_account( m.bids, bids, SERUM_PROG )
+      self.add_account( m.asks, asks, SERUM_PROG )
+      self.add_account( m.base_mint, mint_data( BASE_DECIMALS ), TOKEN_PROG )
+      self.add_account( m.price, price_data(), PYTH_PROG )
+      self.markets.append( m )
+      self.by_price[ m.price ] = m
+
+  def add_account( self, key, data, owner ):
+    self.accounts[ key ] = Account( data, owner )
+
+  def make_hash( self ):
+    bh = hashlib.sha256( b'blockhash' + struct.pack( '<Q', self.slot ) ).digest()
+    self.hashes[ bh ] = self.slot
+    for old in [ h for h, s in self.hashes.items() if s + 300 < self.slot ]:
+      del self.hashes[ old ]
+    return bh
+
+  # --- slots
+
+  async def run_slots( self ):
+    next_ts = time.time()
+    last_drop = time.time()
+    p_book = self.args.book_rate * self.args.slot_ms / 1000.
+    while True:
+      next_ts += self.args.slot_ms / 1000.
+      await asyncio.sleep( max( 0., next_ts - time.time() ) )
+      self.slot += 1
+      self.blockhash = self.make_hash()
+      now = time.time()
+
+      # books that move this slot
+      for m in self.markets:
+        if self.rng.random() < p_book:
+          bids, asks = m.book( self.rng )
+          self.accounts[ m.bids ].data = bids
+          self.accounts[ m.asks ].data = asks
+          self.changed.update( ( m.bids, m.asks ) )
+          if m.changed_at is None:
+            m.changed_at = now
+          self.stats.add( 'book_updates' )
+
+      # transactions due to land
+      due = [ p for p in self.pending if p[ 0 ] <= self.slot ]
+      self.pending = [ p for p in self.pending if p[ 0 ] > self.slot ]
+      for _, arrived, tx in due:
+        self.land( tx, arrived )
+
+      for sub, conn in list( self.slot_subs.items() ):
+        self.notify( conn, 'slotNotification', sub, {
+          'parent': self.slot - 1, 'root': max( 0, self.slot - 32 ), 'slot': self.slot
+        } )
+      for key in self.changed:
+        acct = self.accounts[ key ]
+        for sub, ( conn, enc ) in list( acct.subs.items() ):
+          self.notify( conn, 'accountNotification', sub, {
+            'context': { 'slot': self.slot }, 'value': self.account_value( acct, enc )
+          } )
+      self.changed.clear()
+
+      for sig in list( self.statuses )[ :max( 0, len( self.statuses ) - 200000 ) ]:
+        del self.statuses[ sig ]
+
+      if self.args.disconnect_s and now - last_drop > self.args.disconnect_s:
+        last_drop = now
+        for conn in list( self.conns ):
+          conn.close()
+        self.stats.add( 'disconnects' )
+
+  # --- transactions
+
+  def on_tx( self, buf, source ):
+    self.stats.add( 'tx_' + source )
+    try:
+      tx = Tx( buf, self.tables )
+    except ( IndexError, ValueError, struct.error ):
+      self.stats.add( 'tx_malformed' )
+      return
+    sig = b58encode( tx.sigs[ 0 ] ) if tx.sigs else ''
+    if sig in self.statuses or any( sig == p[ 2 ].sig for p in self.pending[ -64: ] ):
+      self.stats.add( 'tx_duplicate' )
+      return
+    tx.sig = sig
+    if tx.blockhash not in self.hashes or self.hashes[ tx.blockhash ] + 150 < self.slot:
+      self.stats.add( 'tx_expired' )
+      return
+    if self.rng.random() < self.args.drop:
+      self.stats.add( 'tx_dropped' )
+      return
+
+    # latency of what this publishes
+    now = time.time()
+    for ix in tx.ixs:
+      if tx.program( ix ) == SP_PROG and len( ix[ 1 ] ) > 1:
+        m = self.by_price.get( tx.account( ix, 1 ) )
+        if m and m.changed_at is not None:
+          self.stats.sample( self.stats.latency, ( now - m.changed_at ) * 1000. )
+          m.changed_at = None
+    self.pending.append( ( self.slot + self.args.land_slots, self.slot, tx ) )
+
+  def land( self, tx, arrived ):
+    err = None
+    sp_ixs = [ i for i, ix in enumerate( tx.ixs ) if tx.program( ix ) == SP_PROG ]
+    if tx.missing_table:
+      err = 'AddressLookupTableNotFound'
+    elif sp_ixs and self.rng.random() < self.args.fail:
+      err = { 'InstructionError': [ self.rng.choice( sp_ixs ), { 'Custom': self.args.fail_code } ] }
+
+    units, logs = 0, []
+    for i, ix in enumerate( tx.ixs ):
+      prog = tx.program( ix )
+      name = b58encode( prog )
+      logs.append( 'Program %s invoke [1]' % name )
+      if prog == BUDGET_PROG:
+        units += 150
+      else:
+        used = 0
+        if prog == SP_PROG:
+          used = self.args.ix_units + self.rng.randrange( 0, 2000 )
+          logs.append( 'Program %s invoke [2]' % b58encode( PYTH_PROG ) )
+          logs.append( 'Program %s consumed %d of %d compute units' % ( b58encode( PYTH_PROG ), used // 2, 200000 ) )
+          logs.append( 'Program %s success' % b58encode( PYTH_PROG ) )
+        elif prog == ALT_PROG:
+          used = 1200
+        logs.append( 'Program %s consumed %d of %d compute units' % ( name, used, 200000 ) )
+        units += used
+      if err and isinstance( err, dict ) and err[ 'InstructionError' ][ 0 ] == i:
+        logs.append( 'Program %s failed: custom program error: 0x%x' % ( name, self.args.fail_code ) )
+        break
+      logs.append( 'Program %s success' % name )
+
+    self.statuses[ tx.sig ] = ( self.slot, err, units, logs )
+    self.stats.sample( self.stats.land_slots, self.slot - arrived )
+    if err:
+      self.stats.add( 'tx_failed' )
+      return
+    self.stats.add( 'tx_landed' )
+
+    signer = tx.keys[ 0 ]
+    for i in sp_ixs:
+      ix = tx.ixs[ i ]
+      if len( ix[ 1 ] ) > 1:
+        self.publish( tx.account( ix, 1 ), signer )
+    for ix in tx.ixs:
+      if tx.program( ix ) == ALT_PROG:
+        self.apply_alt( tx, ix, signer )
+
+  def publish( self, price_key, signer ):
+    acct = self.accounts.get( price_key )
+    if acct is None:
+      self.stats.add( 'publish_unknown_price' )
+      return
+    data = acct.data
+    num, = struct.unpack_from( '<I', data, 24 )
+    for i in range( num ):
+      off = PC_COMP_OFFSET + i * PC_COMP_SIZE
+      if data[ off:off + 32 ] == signer:
+        break
+    else:
+      if num == PC_COMP_MAX:
+        return
+      i = num
+      off = PC_COMP_OFFSET + i * PC_COMP_SIZE
+      data[ off:off + 32 ] = signer
+      struct.pack_into( '<I', data, 12, PC_COMP_OFFSET + ( num + 1 ) * PC_COMP_SIZE )
+      struct.pack_into( '<I', data, 24, num + 1 )
+    struct.pack_into( '<IIQ', data, off + 80, 1, 0, self.slot )
+    struct.pack_into( '<Q', data, 32, self.slot )
+    self.changed.add( price_key )
+    self.stats.add( 'markets_published' )
+
+  def apply_alt( self, tx, ix, signer ):
+    kind, = struct.unpack_from( '<I', ix[ 2 ], 0 )
+    if kind == 0 and len( ix[ 1 ] ) >= 2:
+      recent, = struct.unpack_from( '<Q', ix[ 2 ], 4 )
+      addr = find_program_address( [ signer, struct.pack( '<Q', recent ) ], ALT_PROG )
+      if addr == tx.account( ix, 0 ) and addr not in self.tables:
+        self.tables[ addr ] = Table( signer )
+        self.add_account( addr, self.tables[ addr ].data(), ALT_PROG )
+        self.changed.add( addr )
+        self.stats.add( 'tables_created' )
+    elif kind == 2 and len( ix[ 1 ] ) >= 1:
+      addr = tx.account( ix, 0 )
+      table = self.tables.get( addr )
+      if table is None:
+        return
+      num, = struct.unpack_from( '<Q', ix[ 2 ], 4 )
+      if table.last_slot != self.slot:
+        table.last_start = len( table.keys )
+        table.last_slot = self.slot
+      for k in range( num ):
+        table.keys.append( ix[ 2 ][ 12 + 32 * k:44 + 32 * k ] )
+      self.accounts[ addr ].data = table.data()
+      self.changed.add( addr )
+
+  # --- rpc
+
+  def account_value( self, acct, enc ):
+    return {
+      'data': encode_data( bytes( acct.data ), enc ),
+      'executable': False,
+      'lamports': 1000000000,
+      'owner': b58encode( acct.owner ),
+      'rentEpoch': 0,
+    }
+
+  def context( self, value ):
+    return { 'context': { 'slot': self.slot }, 'value': value }
+
+  def call( self, method, params, conn ):
+    """Result of a JSON-RPC method, or raises KeyError if unknown."""
+    params = params or []
+    if method == 'getSlot':
+      return self.slot
+    if method == 'getHealth':
+      return 'ok'
+    if method == 'getVersion':
+      return { 'solana-core': '1.10.0', 'feature-set': 0 }
+    if method in ( 'getRecentBlockhash', 'getLatestBlockhash' ):
+      value = { 'blockhash': b58encode( self.blockhash ) }
+      if method == 'getRecentBlockhash':
+        value[ 'feeCalculator' ] = { 'lamportsPerSignature': 5000 }
+      else:
+        value[ 'lastValidBlockHeight' ] = self.slot + 150
+      return self.context( value )
+    if method == 'getFeeCalculatorForBlockhash':
+      return self.context( { 'feeCalculator': { 'lamportsPerSignature': 5000 } } )
+    if method == 'getMinimumBalanceForRentExemption':
+      return 1000000
+    if method == 'getBalance':
+      return self.context( 1000000000 )
+    if method == 'getAccountInfo':
+      acct = self.accounts.get( b58decode( params[ 0 ] ) )
+      enc = ( params[ 1 ] if len( params ) > 1 else {} ).get( 'encoding', 'base64' )
+      return self.context( self.account_value( acct, enc ) if acct else None )
+    if method == 'getSignatureStatuses':
+      out = []
+      for sig in params[ 0 ]:
+        st = self.statuses.get( sig )
+        out.append( None if st is None else {
+          'slot': st[ 0 ],
+          'confirmations': 0,
+          'err': st[ 1 ],
+          'status': { 'Ok': None } if st[ 1 ] is None else { 'Err': st[ 1 ] },
+          'confirmationStatus': 'confirmed',
+        } )
+      return self.context( out )
+    if method == 'getTransaction':
+      st = self.statuses.get( params[ 0 ] )
+      if st is None:
+        return None
+      return {
+        'slot': st[ 0 ],
+        'meta': {
+          'err': st[ 1 ],
+          'fee': 5000,
+          'computeUnitsConsumed': st[ 2 ],
+          'logMessages': st[ 3 ],
+        },
+        'blockTime': int( time.time() ),
+      }
+    if method == 'getSlotLeaders':
+      return [ b58encode( IDENTITY ) ] * int( params[ 1 ] if len( params ) > 1 else 1 )
+    if method == 'getClusterNodes':
+      return [ {
+        'pubkey': b58encode( IDENTITY ),
+        'gossip': '127.0.0.1:8001',
+        'tpu': '127.0.0.1:%d' % self.args.tpu_port,
+        'rpc': '127.0.0.1:%d' % self.args.rpc_port,
+        'version': '1.10.0',
+      } ]
+    if method == 'sendTransaction':
+      self.on_tx( base64.b64decode( params[ 0 ] ), 'rpc' )
+      return b58encode( base64.b64decode( params[ 0 ] )[ 1:65 ] )
+    if method == 'slotSubscribe' and conn:
+      sub = self.subscribe( conn )
+      self.slot_subs[ sub ] = conn
+      return sub
+    if method == 'accountSubscribe' and conn:
+      key = b58decode( params[ 0 ] )
+      enc = ( params[ 1 ] if len( params ) > 1 else {} ).get( 'encoding', 'base64' )
+      if key not in self.accounts:
+        self.add_account( key, b'', SERUM_PROG )
+      sub = self.subscribe( conn )
+      self.accounts[ key ].subs[ sub ] = ( conn, enc )
+      conn.accounts[ sub ] = key
+      # current contents once the client knows the subscription
+      conn.after.append( lambda: self.notify( conn, 'accountNotification', sub, self.context(
+        self.account_value( self.accounts[ key ], enc )
+      ) ) )
+      return sub
+    if method in ( 'slotUnsubscribe', 'accountUnsubscribe' ) and conn:
+      self.unsubscribe( conn, params[ 0 ] )
+      return True
+    if method == 'mock_getStats':
+      rep = self.stats.report()
+      rep[ 'slot' ] = self.slot
+      rep[ 'markets' ] = len( self.markets )
+      rep[ 'subscriptions' ] = sum( len( c.accounts ) for c in self.conns )
+      return rep
+    if method == 'mock_resetStats':
+      self.stats.reset()
+      return True
+    raise KeyError( method )
+
+  def subscribe( self, conn ):
+    sub = self.next_sub
+    self.next_sub += 1
+    return sub
+
+  def unsubscribe( self, conn, sub ):
+    self.slot_subs.pop( sub, None )
+    key = conn.accounts.pop( sub, None )
+    if key is not None:
+      self.accounts[ key ].subs.pop( sub, None )
+
+  def drop_conn( self, conn ):
+    self.conns.discard( conn )
+    for sub in list( conn.accounts ):
+      self.unsubscribe( conn, sub )
+    for sub in [ s for s, c in self.slot_subs.items() if c is conn ]:
+      del self.slot_subs[ sub ]
+
+  def notify( self, conn, method, sub, result ):
+    conn.send( json.dumps( {
+      'jsonrpc': '2.0', 'method': method, 'params': { 'result': result, 'subscription': sub }
+    } ) )
+    self.stats.add( 'notifications' )
+
+  async def handle( self, text, conn=None ):
+    """Response to a JSON-RPC request or batch."""
+    if self.args.latency_ms:
+      await asyncio.sleep( self.args.latency_ms / 1000. )
+    try:
+      req = json.loads( text )
+    except ValueError:
+      return json.dumps( { 'jsonrpc': '2.0', 'id': None, 'error': { 'code': -32700, 'message': 'Parse error' } } )
+    batch = isinstance( req, list )
+    out = [ self.handle_one( r, conn ) for r in ( req if batch else [ req ] ) ]
+    return json.dumps( out if batch else out[ 0 ] )
+
+  def handle_one( self, req, conn ):
+    method = req.get( 'method', '' )
+    rid = req.get( 'id' )
+    self.stats.methods[ method ] = self.stats.methods.get( method, 0 ) + 1
+    if self.args.rpc_error and not method.startswith( 'mock_' ) and self.rng.random() < self.args.rpc_error:
+      self.stats.add( 'rpc_errors' )
+      return { 'jsonrpc': '2.0', 'id': rid, 'error': { 'code': -32005, 'message': 'Node is behind' } }
+    try:
+      return { 'jsonrpc': '2.0', 'id': rid, 'result': self.call( method, req.get( 'params' ), conn ) }
+    except KeyError:
+      self.stats.unknown[ method ] = self.stats.unknown.get( method, 0 ) + 1
+      return { 'jsonrpc': '2.0', 'id': rid, 'error': { 'code': -32601, 'message': 'Method not found' } }
+    except ( IndexError, TypeError, ValueError, AttributeError ):
+      return { 'jsonrpc': '2.0', 'id': rid, 'error': { 'code': -32602, 'message': 'Invalid params' } }
+
+
+class WsConn:
+
+  def __init__( self, writer ):
+    self.writer = writer
+    self.accounts = {}
+    self.after = []   # notifications due once a response is sent
+
+  def send( self, text ):
+    if not self.writer.is_closing():
+      self.writer.write( ws_frame( text ) )
+
+  def close( self ):
+    self.writer.close()
+
+
+# --- servers ------------------------------------------------------------------
+
+async def serve_http( cluster, reader, writer ):
+  # Responses go back in request order, each after its own delay.
+  queue = asyncio.Queue()
+
+  async def write_loop():
+    while True:
+      fut = await queue.get()
+      if fut is None:
+        return
+      body = ( await fut ).encode()
+      writer.write( b'HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n'
+                    b'Content-Length: %d\r\n\r\n' % len( body ) + body )
+      await writer.drain()
+
+  wtask = asyncio.ensure_future( write_loop() )
+  try:
+    while True:
+      head = await http_head( reader )
+      if head is None:
+        break
+      body = await reader.readexactly( int( head[ 1 ].get( 'content-length', 0 ) ) )
+      queue.put_nowait( asyncio.ensure_future( cluster.handle( body.decode() ) ) )
+  except ( asyncio.IncompleteReadError, ConnectionError ):
+    pass
+  finally:
+    queue.put_nowait( None )
+    try:
+      await wtask
+    except ConnectionError:
+      pass
+    writer.close()
+
+
+async def serve_ws( cluster, reader, writer ):
+  head = await http_head( reader )
+  if head is None or 'sec-websocket-key' not in head[ 1 ]:
+    writer.close()
+    return
+  accept = base64.b64encode( hashlib.sha1( head[ 1 ][ 'sec-websocket-key' ].encode() + WS_GUID ).digest() )
+  writer.write( b'HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\n'
+                b'Connection: Upgrade\r\nSec-WebSocket-Accept: ' + accept + b'\r\n\r\n' )
+  conn = WsConn( writer )
+  cluster.conns.add( conn )
+
+  async def reply( text ):
+    conn.send( await cluster.handle( text, conn ) )
+    after, conn.after = conn.after, []
+    for fn in after:
+      fn()
+
+  try:
+    while True:
+      text = await ws_read( reader )
+      if text is None:
+        break
+      asyncio.ensure_future( reply( text ) )
+  except ( asyncio.IncompleteReadError, ConnectionError ):
+    pass
+  finally:
+    cluster.drop_conn( conn )
+    writer.close()
+
+
+async def serve_tx( cluster, reader, writer ):
+  # pc::tx_hdr: u16 protocol id, u16 size including the header
+  try:
+    while True:
+      _, size = struct.unpack( '<HH', await reader.readexactly( 4 ) )
+      cluster.on_tx( await reader.readexactly( size - 4 ), 'pyth_tx' )
+  except ( asyncio.IncompleteReadError, ConnectionError, struct.error ):
+    pass
+  writer.close()
+
+
+class TpuProtocol( asyncio.DatagramProtocol ):
+
+  def __init__( self, cluster ):
+    self.cluster = cluster
+
+  def datagram_received( self, data, addr ):
+    self.cluster.on_tx( data, 'tpu' )
+
+
+async def main( args ):
+  cluster = Cluster( args )
+  if args.markets_file:
+    with open( args.markets_file, 'w' ) as out:
+      out.write( '# %d mock-cluster markets: market bids asks quote_mint base_mint price\n' % len( cluster.markets ) )
+      for m in cluster.markets:
+        out.write( m.line() + '\n' )
+  loop = asyncio.get_running_loop()
+  await asyncio.start_server( lambda r, w: serve_http( cluster, r, w ), args.host, args.rpc_port )
+  await asyncio.start_server( lambda r, w: serve_ws( cluster, r, w ), args.host, args.rpc_port + 1 )
+  await asyncio.start_server( lambda r, w: serve_tx( cluster, r, w ), args.host, args.tx_port )
+  await loop.create_datagram_endpoint( lambda: TpuProtocol( cluster ), local_addr=( args.host, args.tpu_port ) )
+  print( 'mock-cluster: %d markets, rpc %d, ws %d, pyth_tx %d, tpu %d' % (
+    len( cluster.markets ), args.rpc_port, args.rpc_port + 1, args.tx_port, args.tpu_port
+  ), flush=True )
+  await cluster.run_slots()
+
+
+def parse_args( argv ):
+  p = argparse.ArgumentParser( description=__doc__.strip().split( '\n\n' )[ 0 ] )
+  p.add_argument( '--host', default='127.0.0.1' )
+  p.add_argument( '--rpc-port', type=int, default=8899, help='http; websocket on the next port' )
+  p.add_argument( '--tx-port', type=int, default=8898, help='pyth_tx' )
+  p.add_argument( '--tpu-port', type=int, default=8003 )
+  p.add_argument( '--markets', type=int, default=1 )
+  p.add_argument( '--markets-file', help='write markets for the crank\'s -F' )
+  p.add_argument( '--quote-mints', type=int, default=2, help='shared by the markets' )
+  p.add_argument( '--depth', type=int, default=8, help='orders per book side' )
+  p.add_argument( '--book-rate', type=float, default=1., help='book updates per second per market' )
+  p.add_argument( '--slot-ms', type=int, default=400 )
+  p.add_argument( '--land-slots', type=int, default=1, help='slots from arrival to landing' )
+  p.add_argument( '--latency-ms', type=float, default=0., help='added to every rpc response' )
+  p.add_argument( '--drop', type=float, default=0., help='share of transactions lost' )
+  p.add_argument( '--fail', type=float, default=0., help='share of transactions failing' )
+  p.add_argument( '--fail-code', type=int, default=307, help='custom error of failures (sp-error.h)' )
+  p.add_argument( '--rpc-error', type=float, default=0., help='share of rpc requests failing' )
+  p.add_argument( '--disconnect-s', type=float, default=0., help='drop websockets every n seconds' )
+  p.add_argument( '--ix-units', type=int, default=18000, help='compute units per serum-pyth instruction' )
+  p.add_argument( '--seed', type=int, default=1 )
+  return p.parse_args( argv )
+
+
+if __name__ == '__main__':
+  try:
+    asyncio.run( main( parse_args( sys.argv[ 1: ] ) ) )
+  except KeyboardInterrupt:
+    pass
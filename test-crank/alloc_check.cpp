@@ -0,0 +1,178 @@
+#include "alloc_check.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+using namespace sp;
+
+namespace
+{
+  thread_local bool checked_ = false;
+  std::atomic<uint64_t> count_( 0 );
+}
+
+alloc_scope::alloc_scope( bool check )
+: prev_( checked_ )
+{
+  checked_ = check;
+}
+
+alloc_scope::~alloc_scope()
+{
+  checked_ = prev_;
+}
+
+uint64_t alloc_scope::get_count()
+{
+  return count_.load( std::memory_order_relaxed );
+}
+
+void alloc_scope::reset_count()
+{
+  count_.store( 0, std::memory_order_relaxed );
+}
+
+bool alloc_scope::is_enabled()
+{
+#ifdef SP_ALLOC_CHECK
+  return true;
+#else
+  return false;
+#endif
+}
+
+#ifdef SP_ALLOC_CHECK
+
+// Replacements of the global allocation functions, on malloc. Every
+// other operator new and delete overload forwards to these.
+
+static void *alloc( size_t len, size_t align )
+{
+  if ( checked_ ) {
+    count_.fetch_add( 1, std::memory_order_relaxed );
+  }
+  if ( len == 0 ) {
+    len = 1;
+  }
+  if ( align <= alignof( std::max_align_t ) ) {
+    return std::malloc( len );
+  }
+  // aligned_alloc() wants a multiple of the alignment.
+  return std::aligned_alloc( align, ( len + align - 1 ) & ~( align - 1 ) );
+}
+
+void *operator new( size_t len )
+{
+  void *ptr = alloc( len, 0 );
+  if ( !ptr ) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void *operator new( size_t len, std::align_val_t align )
+{
+  void *ptr = alloc( len, ( size_t )align );
+  if ( !ptr ) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void *operator new( size_t len, const std::nothrow_t& ) noexcept
+{
+  return alloc( len, 0 );
+}
+
+void *operator new(
+  size_t len, std::align_val_t align, const std::nothrow_t&
+) noexcept {
+  return alloc( len, ( size_t )align );
+}
+
+void *operator new[]( size_t len )
+{
+  return operator new( len );
+}
+
+void *operator new[]( size_t len, std::align_val_t align )
+{
+  return operator new( len, align );
+}
+
+void *operator new[]( size_t len, const std::nothrow_t& tag ) noexcept
+{
+  return operator new( len, tag );
+}
+
+void *operator new[](
+  size_t len, std::align_val_t align, const std::nothrow_t& tag
+) noexcept {
+  return operator new( len, align, tag );
+}
+
+void operator delete( void *ptr ) noexcept
+{
+  std::free( ptr );
+}
+
+void operator delete( void *ptr, size_t ) noexcept
+{
+  std::free( ptr );
+}
+
+void operator delete( void *ptr, std::align_val_t ) noexcept
+{
+  std::free( ptr );
+}
+
+void operator delete( void *ptr, size_t, std::align_val_t ) noexcept
+{
+  std::free( ptr );
+}
+
+void operator delete( void *ptr, const std::nothrow_t& ) noexcept
+{
+  std::free( ptr );
+}
+
+void operator delete(
+  void *ptr, std::align_val_t, const std::nothrow_t&
+) noexcept {
+  std::free( ptr );
+}
+
+void operator delete[]( void *ptr ) noexcept
+{
+  std::free( ptr );
+}
+
+void operator delete[]( void *ptr, size_t ) noexcept
+{
+  std::free( ptr );
+}
+
+void operator delete[]( void *ptr, std::align_val_t ) noexcept
+{
+  std::free( ptr );
+}
+
+void operator delete[]( void *ptr, size_t, std::align_val_t ) noexcept
+{
+  std::free( ptr );
+}
+
+void operator delete[]( void *ptr, const std::nothrow_t& ) noexcept
+{
+  std::free( ptr );
+}
+
+void operator delete[](
+  void *ptr, std::align_val_t, const std::nothrow_t&
+) noexcept {
+  std::free( ptr );
+}
+
+#endif
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+
+namespace sp
+{
+
+  // Counts heap allocations made on the current thread while a checked
+  // scope is open. The global operator new is only replaced, and the
+  // count only moves, in builds with SP_ALLOC_CHECK defined; elsewhere
+  // a scope costs a thread-local store.
+  //
+  // Open one around steady-state work that must not allocate, and a
+  // nested alloc_scope( false ) around calls into code that may, e.g.
+  // pc::manager's rpc and tx paths.
+  class alloc_scope
+  {
+  public:
+
+    explicit alloc_scope( bool check = true );
+    ~alloc_scope();
+
+    alloc_scope( const alloc_scope& ) = delete;
+    alloc_scope& operator=( const alloc_scope& ) = delete;
+
+    // Allocations in checked scopes, over every thread.
+    static uint64_t get_count();
+    static void reset_count();
+
+    // True in builds that count.
+    static bool is_enabled();
+
+  private:
+
+    bool prev_;
+  };
+
+}
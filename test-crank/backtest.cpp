@@ -0,0 +1,278 @@
+#include "backtest.hpp"
+#include "batch.hpp"
+#include "history.hpp"
+
+#include <serum-pyth/sp-util.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <sys/stat.h>
+#include <thread>
+
+using namespace sp;
+
+void bt_stats::merge( const bt_stats& rhs )
+{
+  rows_ += rhs.rows_;
+  priced_ += rhs.priced_;
+  trading_ += rhs.trading_;
+  flips_ += rhs.flips_;
+  publishes_ += rhs.publishes_;
+  useful_ += rhs.useful_;
+  err_cnt_ += rhs.err_cnt_;
+  err_sum_ += rhs.err_sum_;
+  err_max_ = std::max( err_max_, rhs.err_max_ );
+}
+
+namespace
+{
+
+  // Shard indices owned by one worker. The owner pops from the back,
+  // thieves take from the front.
+  struct shard_deque
+  {
+    std::mutex         mtx_;
+    std::deque<size_t> shards_;
+
+    bool pop( size_t& shard ) {
+      std::lock_guard<std::mutex> lock( mtx_ );
+      if ( shards_.empty() ) {
+        return false;
+      }
+      shard = shards_.back();
+      shards_.pop_back();
+      return true;
+    }
+
+    bool steal( size_t& shard ) {
+      std::lock_guard<std::mutex> lock( mtx_ );
+      if ( shards_.empty() ) {
+        return false;
+      }
+      shard = shards_.front();
+      shards_.pop_front();
+      return true;
+    }
+  };
+
+  // Replay state of one parameter set within a shard.
+  struct bt_state
+  {
+    bool    seen_    = false;
+    bool    trading_ = false;
+    bool    held_    = false;
+    int64_t price_   = 0;  // last TRADING price published
+  };
+
+}
+
+backtest::backtest()
+: threads_( std::max( 1U, std::thread::hardware_concurrency() ) ),
+  steals_( 0 )
+{
+}
+
+void backtest::add_params( const bt_params& params )
+{
+  params_.push_back( params );
+}
+
+void backtest::add_file( const std::string& path )
+{
+  files_.push_back( path );
+}
+
+void backtest::set_threads( unsigned threads )
+{
+  threads_ = std::max( 1U, threads );
+}
+
+size_t backtest::get_num_params() const
+{
+  return params_.size();
+}
+
+const bt_params& backtest::get_params( size_t i ) const
+{
+  return params_[ i ];
+}
+
+const bt_stats& backtest::get_stats( size_t i ) const
+{
+  return stats_[ i ];
+}
+
+uint64_t backtest::get_num_steals() const
+{
+  return steals_;
+}
+
+const std::string& backtest::get_err_msg() const
+{
+  return err_;
+}
+
+bool backtest::run()
+{
+  // Deal shards largest first so the long ones start early.
+  std::vector<std::pair<int64_t, size_t>> order;
+  for ( size_t i = 0; i != files_.size(); ++i ) {
+    struct stat st;
+    const int64_t len = ::stat( files_[ i ].c_str(), &st ) == 0
+      ? ( int64_t )st.st_size : 0;
+    order.emplace_back( -len, i );
+  }
+  std::sort( order.begin(), order.end() );
+
+  const unsigned num_workers = std::min(
+    threads_, std::max( 1U, ( unsigned )files_.size() )
+  );
+  std::unique_ptr<shard_deque[]> queues( new shard_deque[ num_workers ] );
+  for ( size_t i = 0; i != order.size(); ++i ) {
+    queues[ i % num_workers ].shards_.push_front( order[ i ].second );
+  }
+
+  std::vector<std::vector<bt_stats>> results(
+    num_workers, std::vector<bt_stats>( params_.size() )
+  );
+  std::vector<std::string> errs( num_workers );
+  std::atomic<uint64_t> steals( 0 );
+
+  auto work = [&]( unsigned id ) {
+    std::string err;
+    for ( ;; ) {
+      size_t shard;
+      bool found = queues[ id ].pop( shard );
+      for ( unsigned j = 1; !found && j != num_workers; ++j ) {
+        found = queues[ ( id + j ) % num_workers ].steal( shard );
+        if ( found ) {
+          steals.fetch_add( 1, std::memory_order_relaxed );
+        }
+      }
+      if ( !found ) {
+        break;
+      }
+      if ( !run_shard( files_[ shard ], results[ id ], err ) ) {
+        errs[ id ] = err;
+      }
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for ( unsigned id = 1; id < num_workers; ++id ) {
+    workers.emplace_back( work, id );
+  }
+  work( 0 );
+  for ( std::thread& thr : workers ) {
+    thr.join();
+  }
+
+  stats_.assign( params_.size(), bt_stats() );
+  err_.clear();
+  for ( unsigned id = 0; id != num_workers; ++id ) {
+    for ( size_t p = 0; p != params_.size(); ++p ) {
+      stats_[ p ].merge( results[ id ][ p ] );
+    }
+    if ( err_.empty() ) {
+      err_ = errs[ id ];
+    }
+  }
+  steals_ = steals.load();
+  return err_.empty();
+}
+
+bool backtest::run_shard(
+  const std::string& path,
+  std::vector<bt_stats>& stats,
+  std::string& err
+) const {
+  history_reader rdr;
+  if ( !rdr.open( path ) ) {
+    err = rdr.get_err_msg();
+    return false;
+  }
+
+  // Confidence depends only on the fee, so price each block once per
+  // distinct fee rather than once per parameter set.
+  std::vector<uint64_t> fees;
+  std::vector<size_t> fee_idx( params_.size() );
+  for ( size_t p = 0; p != params_.size(); ++p ) {
+    const uint64_t fee = params_[ p ].fee_bps_;
+    auto it = std::find( fees.begin(), fees.end(), fee );
+    fee_idx[ p ] = ( size_t )( it - fees.begin() );
+    if ( it == fees.end() ) {
+      fees.push_back( fee );
+    }
+  }
+
+  std::vector<bt_state> state( params_.size() );
+  std::vector<uint64_t> bids, asks, s2ps;
+  std::vector<uint8_t> outcomes;
+  std::vector<int64_t> mids;
+  std::vector<uint64_t> confs;
+  for ( size_t blk = 0; blk != rdr.get_num_blocks(); ++blk ) {
+    if ( !rdr.read_column( blk, e_hist_bid, bids )
+      || !rdr.read_column( blk, e_hist_ask, asks )
+      || !rdr.read_column( blk, e_hist_s2p, s2ps )
+      || !rdr.read_column( blk, e_hist_outcome, outcomes ) ) {
+      err = path + ": " + rdr.get_err_msg();
+      return false;
+    }
+
+    const size_t num = bids.size();
+    mids.resize( num );
+    confs.resize( num * fees.size() );
+    const batch_books books = { bids.data(), asks.data(), s2ps.data(), num };
+    for ( size_t f = 0; f != fees.size(); ++f ) {
+      batch_prices out = { mids.data(), confs.data() + f * num };
+      batch_price( books, fees[ f ], out );
+    }
+
+    for ( size_t r = 0; r != num; ++r ) {
+      const bool submitted = outcomes[ r ] & HIST_SUBMITTED;
+      const bool priced = bids[ r ] && asks[ r ] && s2ps[ r ];
+      const int64_t mid = priced ? mids[ r ] : 0;
+
+      for ( size_t p = 0; p != params_.size(); ++p ) {
+        const bt_params& prm = params_[ p ];
+        bt_stats& st = stats[ p ];
+        bt_state& ss = state[ p ];
+        ++st.rows_;
+
+        bool trading = false;
+        if ( priced ) {
+          ++st.priced_;
+          const uint64_t conf = confs[ fee_idx[ p ] * num + r ];
+          trading = sp_conf_within( mid, conf, prm.threshold_ );
+        }
+        st.trading_ += trading;
+        st.flips_ += ss.seen_ && trading != ss.trading_;
+        ss.seen_ = true;
+        ss.trading_ = trading;
+
+        if ( submitted ) {
+          ++st.publishes_;
+          if ( trading ) {
+            ++st.useful_;
+            ss.held_ = true;
+            ss.price_ = mid;
+          }
+        }
+
+        if ( priced && ss.held_ && mid != 0 ) {
+          const double err_bps = 1e4 * std::fabs(
+            ( double )ss.price_ - ( double )mid
+          ) / std::fabs( ( double )mid );
+          ++st.err_cnt_;
+          st.err_sum_ += err_bps;
+          st.err_max_ = std::max( st.err_max_, err_bps );
+        }
+      }
+    }
+  }
+  return true;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace sp
+{
+
+  // Candidate pricing constants.
+  struct bt_params
+  {
+    int64_t  threshold_ = 20;  // PRICE_CONF_THRESHOLD
+    uint64_t fee_bps_   = 10;  // sp_confidence() fee
+  };
+
+  // Outcome of one parameter set over some history.
+  struct bt_stats
+  {
+    uint64_t rows_      = 0;
+    uint64_t priced_    = 0;   // rows with a two-sided book
+    uint64_t trading_   = 0;   // rows that would publish TRADING
+    uint64_t flips_     = 0;   // status changes
+    uint64_t publishes_ = 0;   // recorded submissions
+    uint64_t useful_    = 0;   // submissions that would publish TRADING
+    uint64_t err_cnt_   = 0;
+    double   err_sum_   = 0.;  // bps
+    double   err_max_   = 0.;  // bps
+
+    void merge( const bt_stats& );
+  };
+
+  // Replays recorded history (see history.hpp) through the on-chain
+  // pricing functions for a grid of parameters.
+  //
+  // Each file is one (market, day) shard. Shards are spread over worker
+  // threads, largest first, and idle workers steal from the others.
+  //
+  // Price error is the distance in bps between the last price each
+  // parameter set would have published as TRADING and the current book
+  // midpoint, sampled every slot: a tight threshold shows up as stale
+  // prices, a loose one as wide confidence being published.
+  class backtest
+  {
+  public:
+
+    backtest();
+
+    void add_params( const bt_params& );
+    void add_file( const std::string& );
+
+    // Worker threads (default: hardware concurrency).
+    void set_threads( unsigned );
+
+    // Returns false if any shard could not be read; stats of the other
+    // shards are still complete.
+    bool run();
+
+    size_t get_num_params() const;
+    const bt_params& get_params( size_t ) const;
+    const bt_stats& get_stats( size_t ) const;
+    uint64_t get_num_steals() const;
+
+    const std::string& get_err_msg() const;
+
+  private:
+
+    bool run_shard(
+      const std::string& path,
+      std::vector<bt_stats>& stats,
+      std::string& err
+    ) const;
+
+    std::vector<bt_params>   params_;
+    std::vector<bt_stats>    stats_;
+    std::vector<std::string> files_;
+    unsigned    threads_;
+    uint64_t    steals_;
+    std::string err_;
+  };
+
+}
@@ -0,0 +1,104 @@
+#include "backtest.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <unistd.h>
+
+// Parse a comma separated list of integers.
+template<class T>
+static bool parse_list( const char *arg, std::vector<T>& vals )
+{
+  vals.clear();
+  std::stringstream ss( arg );
+  std::string tok;
+  while ( std::getline( ss, tok, ',' ) ) {
+    char *end;
+    const long long val = ::strtoll( tok.c_str(), &end, 10 );
+    if ( tok.empty() || *end != '\0' || val < 0 ) {
+      return false;
+    }
+    vals.push_back( (T)val );
+  }
+  return !vals.empty();
+}
+
+int usage()
+{
+  std::cerr << "usage: serum-pyth-backtest [options] <history files>"
+            << std::endl;
+  std::cerr << "options include:" << std::endl;
+  std::cerr << "  -c <conf thresholds, e.g. 10,20,40 (default 20)>"
+            << std::endl;
+  std::cerr << "  -f <fees in bps, e.g. 0,10,20 (default 10)>" << std::endl;
+  std::cerr << "  -t <worker threads (default all cores)>" << std::endl;
+  return 1;
+}
+
+int main(int argc, char** argv)
+{
+  sp::backtest bt;
+  std::vector<int64_t> thresholds = { 20 };
+  std::vector<uint64_t> fees = { 10 };
+  int opt = 0;
+  while( (opt = ::getopt(argc, argv, "c:f:t:h")) != -1 ) {
+    switch(opt) {
+      case 'c':
+        if ( !parse_list( optarg, thresholds ) ) return usage();
+        break;
+      case 'f':
+        if ( !parse_list( optarg, fees ) ) return usage();
+        break;
+      case 't': bt.set_threads( (unsigned)::atoi(optarg) ); break;
+      default: return usage();
+    }
+  }
+  if ( optind >= argc ) {
+    return usage();
+  }
+  for ( int64_t threshold : thresholds ) {
+    if ( threshold <= 1 ) {
+      std::cerr << "backtest: thresholds must be > 1" << std::endl;
+      return 1;
+    }
+    for ( uint64_t fee : fees ) {
+      sp::bt_params params;
+      params.threshold_ = threshold;
+      params.fee_bps_ = fee;
+      bt.add_params( params );
+    }
+  }
+  for ( int i = optind; i < argc; ++i ) {
+    bt.add_file( argv[i] );
+  }
+
+  int retcode = 0;
+  if ( !bt.run() ) {
+    std::cerr << "backtest: " << bt.get_err_msg() << std::endl;
+    retcode = 1;
+  }
+
+  ::printf(
+    "%9s %7s %12s %8s %10s %10s %8s %10s %10s\n",
+    "threshold", "fee_bps", "rows", "trading%", "flips",
+    "publishes", "useful%", "err_bps", "max_bps"
+  );
+  for ( size_t i = 0; i != bt.get_num_params(); ++i ) {
+    const sp::bt_params& prm = bt.get_params( i );
+    const sp::bt_stats& st = bt.get_stats( i );
+    ::printf(
+      "%9ld %7lu %12lu %8.2f %10lu %10lu %8.2f %10.3f %10.3f\n",
+      prm.threshold_,
+      prm.fee_bps_,
+      st.rows_,
+      st.priced_ ? 100. * (double)st.trading_ / (double)st.priced_ : 0.,
+      st.flips_,
+      st.publishes_,
+      st.publishes_ ? 100. * (double)st.useful_ / (double)st.publishes_ : 0.,
+      st.err_cnt_ ? st.err_sum_ / (double)st.err_cnt_ : 0.,
+      st.err_max_
+    );
+  }
+  return retcode;
+}
@@ -0,0 +1,245 @@
+#include "batch.hpp"
+
+#include <serum-pyth/sp-util.h>
+
+#include <immintrin.h>
+
+using namespace sp;
+
+// x / 10000 == mulhi( x >> 4, FEE_DIV_MAGIC ) >> 7 for every uint64 x.
+static const uint64_t FEE_DIV_MAGIC = 0x346DC5D63886594BUL;
+
+static void price_scalar(
+  const batch_books& in,
+  uint64_t fee_bps,
+  batch_prices& out,
+  size_t i
+) {
+  for ( ; i < in.num_; ++i ) {
+    const sp_size_t bid = in.bid_[ i ] * in.s2p_[ i ];
+    const sp_size_t ask = in.ask_[ i ] * in.s2p_[ i ];
+    out.price_[ i ] = ( int64_t )sp_midpt( bid, ask );
+    out.conf_[ i ] = sp_confidence_fee( bid, ask, fee_bps );
+  }
+}
+
+// AVX2 has no 64-bit multiply: build it from 32x32->64 products.
+
+__attribute__(( target( "avx2" ) ))
+static inline __m256i mullo64_avx2( __m256i a, __m256i b )
+{
+  const __m256i cross = _mm256_mullo_epi32( a, _mm256_shuffle_epi32( b, 0xb1 ) );
+  const __m256i sum = _mm256_add_epi32( cross, _mm256_srli_epi64( cross, 32 ) );
+  return _mm256_add_epi64(
+    _mm256_mul_epu32( a, b ), _mm256_slli_epi64( sum, 32 )
+  );
+}
+
+__attribute__(( target( "avx2" ) ))
+static inline __m256i mulhi64_avx2( __m256i a, __m256i b )
+{
+  const __m256i lo32 = _mm256_set1_epi64x( 0xffffffffL );
+  const __m256i a_hi = _mm256_srli_epi64( a, 32 );
+  const __m256i b_hi = _mm256_srli_epi64( b, 32 );
+  const __m256i ll = _mm256_mul_epu32( a, b );
+  const __m256i lh = _mm256_mul_epu32( a, b_hi );
+  const __m256i hl = _mm256_mul_epu32( a_hi, b );
+  const __m256i hh = _mm256_mul_epu32( a_hi, b_hi );
+  __m256i mid = _mm256_add_epi64(
+    _mm256_srli_epi64( ll, 32 ), _mm256_and_si256( lh, lo32 )
+  );
+  mid = _mm256_add_epi64( mid, _mm256_and_si256( hl, lo32 ) );
+  __m256i hi = _mm256_add_epi64( hh, _mm256_srli_epi64( lh, 32 ) );
+  hi = _mm256_add_epi64( hi, _mm256_srli_epi64( hl, 32 ) );
+  return _mm256_add_epi64( hi, _mm256_srli_epi64( mid, 32 ) );
+}
+
+__attribute__(( target( "avx2" ) ))
+static void price_avx2(
+  const batch_books& in,
+  uint64_t fee_bps,
+  batch_prices& out
+) {
+  const __m256i one = _mm256_set1_epi64x( 1 );
+  const __m256i sign = _mm256_set1_epi64x( INT64_MIN );
+  const __m256i fee = _mm256_set1_epi64x( ( long long )fee_bps );
+  const __m256i magic = _mm256_set1_epi64x( ( long long )FEE_DIV_MAGIC );
+  size_t i = 0;
+  for ( ; i + 4 <= in.num_; i += 4 ) {
+    const __m256i s2p = _mm256_loadu_si256( ( const __m256i* )( in.s2p_ + i ) );
+    const __m256i bid = mullo64_avx2(
+      _mm256_loadu_si256( ( const __m256i* )( in.bid_ + i ) ), s2p
+    );
+    const __m256i ask = mullo64_avx2(
+      _mm256_loadu_si256( ( const __m256i* )( in.ask_ + i ) ), s2p
+    );
+
+    // sp_midpt
+    const __m256i odd = _mm256_add_epi64(
+      _mm256_and_si256( bid, one ), _mm256_and_si256( ask, one )
+    );
+    const __m256i mid = _mm256_add_epi64(
+      _mm256_add_epi64( _mm256_srli_epi64( bid, 1 ), _mm256_srli_epi64( ask, 1 ) ),
+      _mm256_srli_epi64( odd, 1 )
+    );
+
+    // sp_confidence_fee
+    const __m256i bid_gt = _mm256_cmpgt_epi64(
+      _mm256_xor_si256( bid, sign ), _mm256_xor_si256( ask, sign )
+    );
+    __m256i spread = _mm256_blendv_epi8(
+      _mm256_sub_epi64( ask, bid ), _mm256_sub_epi64( bid, ask ), bid_gt
+    );
+    const __m256i fees = mullo64_avx2( _mm256_add_epi64( bid, ask ), fee );
+    spread = _mm256_add_epi64(
+      spread,
+      _mm256_srli_epi64( mulhi64_avx2( _mm256_srli_epi64( fees, 4 ), magic ), 7 )
+    );
+
+    _mm256_storeu_si256( ( __m256i* )( out.price_ + i ), mid );
+    _mm256_storeu_si256(
+      ( __m256i* )( out.conf_ + i ), _mm256_srli_epi64( spread, 1 )
+    );
+  }
+  price_scalar( in, fee_bps, out, i );
+}
+
+// GCC's avx512fintrin.h trips -Wmaybe-uninitialized on its own
+// _mm512_undefined_epi32() placeholders.
+#if defined( __GNUC__ ) && !defined( __clang__ )
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+__attribute__(( target( "avx512f,avx512dq" ) ))
+static inline __m512i mulhi64_avx512( __m512i a, __m512i b )
+{
+  const __m512i lo32 = _mm512_set1_epi64( 0xffffffffL );
+  const __m512i a_hi = _mm512_srli_epi64( a, 32 );
+  const __m512i b_hi = _mm512_srli_epi64( b, 32 );
+  const __m512i ll = _mm512_mul_epu32( a, b );
+  const __m512i lh = _mm512_mul_epu32( a, b_hi );
+  const __m512i hl = _mm512_mul_epu32( a_hi, b );
+  const __m512i hh = _mm512_mul_epu32( a_hi, b_hi );
+  __m512i mid = _mm512_add_epi64(
+    _mm512_srli_epi64( ll, 32 ), _mm512_and_si512( lh, lo32 )
+  );
+  mid = _mm512_add_epi64( mid, _mm512_and_si512( hl, lo32 ) );
+  __m512i hi = _mm512_add_epi64( hh, _mm512_srli_epi64( lh, 32 ) );
+  hi = _mm512_add_epi64( hi, _mm512_srli_epi64( hl, 32 ) );
+  return _mm512_add_epi64( hi, _mm512_srli_epi64( mid, 32 ) );
+}
+
+__attribute__(( target( "avx512f,avx512dq" ) ))
+static void price_avx512(
+  const batch_books& in,
+  uint64_t fee_bps,
+  batch_prices& out
+) {
+  const __m512i one = _mm512_set1_epi64( 1 );
+  const __m512i fee = _mm512_set1_epi64( ( long long )fee_bps );
+  const __m512i magic = _mm512_set1_epi64( ( long long )FEE_DIV_MAGIC );
+  size_t i = 0;
+  for ( ; i + 8 <= in.num_; i += 8 ) {
+    const __m512i s2p = _mm512_loadu_si512( in.s2p_ + i );
+    const __m512i bid = _mm512_mullo_epi64( _mm512_loadu_si512( in.bid_ + i ), s2p );
+    const __m512i ask = _mm512_mullo_epi64( _mm512_loadu_si512( in.ask_ + i ), s2p );
+
+    // sp_midpt
+    const __m512i odd = _mm512_add_epi64(
+      _mm512_and_si512( bid, one ), _mm512_and_si512( ask, one )
+    );
+    const __m512i mid = _mm512_add_epi64(
+      _mm512_add_epi64( _mm512_srli_epi64( bid, 1 ), _mm512_srli_epi64( ask, 1 ) ),
+      _mm512_srli_epi64( odd, 1 )
+    );
+
+    // sp_confidence_fee
+    __m512i spread = _mm512_sub_epi64(
+      _mm512_max_epu64( bid, ask ), _mm512_min_epu64( bid, ask )
+    );
+    const __m512i fees = _mm512_mullo_epi64( _mm512_add_epi64( bid, ask ), fee );
+    spread = _mm512_add_epi64(
+      spread,
+      _mm512_srli_epi64( mulhi64_avx512( _mm512_srli_epi64( fees, 4 ), magic ), 7 )
+    );
+
+    _mm512_storeu_si512( out.price_ + i, mid );
+    _mm512_storeu_si512( out.conf_ + i, _mm512_srli_epi64( spread, 1 ) );
+  }
+  price_scalar( in, fee_bps, out, i );
+}
+
+#if defined( __GNUC__ ) && !defined( __clang__ )
+#pragma GCC diagnostic pop
+#endif
+
+batch_isa sp::get_batch_isa()
+{
+  static const batch_isa isa = []() {
+    __builtin_cpu_init();
+    if ( __builtin_cpu_supports( "avx512f" )
+      && __builtin_cpu_supports( "avx512dq" ) ) {
+      return batch_isa::avx512;
+    }
+    if ( __builtin_cpu_supports( "avx2" ) ) {
+      return batch_isa::avx2;
+    }
+    return batch_isa::scalar;
+  }();
+  return isa;
+}
+
+const char *sp::to_str( batch_isa isa )
+{
+  switch ( isa ) {
+    case batch_isa::scalar: return "scalar";
+    case batch_isa::avx2:   return "avx2";
+    case batch_isa::avx512: return "avx512";
+  }
+  return "unknown";
+}
+
+void sp::batch_price(
+  const batch_books& in,
+  uint64_t fee_bps,
+  batch_prices& out,
+  batch_isa isa
+) {
+  if ( isa > get_batch_isa() ) {
+    isa = get_batch_isa();
+  }
+  switch ( isa ) {
+    case batch_isa::avx512: price_avx512( in, fee_bps, out ); break;
+    case batch_isa::avx2:   price_avx2( in, fee_bps, out ); break;
+    default:                price_scalar( in, fee_bps, out, 0 ); break;
+  }
+}
+
+void sp::batch_status(
+  const int64_t *price,
+  const uint64_t *conf,
+  size_t num,
+  int64_t threshold,
+  uint8_t *trading
+) {
+  for ( size_t i = 0; i != num; ++i ) {
+    trading[ i ] = sp_conf_within( price[ i ], conf[ i ], threshold );
+  }
+}
+
+void sp::batch_serum_to_pyth(
+  const int32_t *pyth_exp,
+  const int32_t *quote_exp,
+  const int32_t *base_exp,
+  const uint64_t *quote_lot,
+  const uint64_t *base_lot,
+  size_t num,
+  uint64_t *s2p
+) {
+  for ( size_t i = 0; i != num; ++i ) {
+    s2p[ i ] = sp_serum_to_pyth(
+      pyth_exp[ i ], quote_exp[ i ], base_exp[ i ], quote_lot[ i ], base_lot[ i ]
+    );
+  }
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace sp
+{
+
+  // Structure-of-arrays versions of the sp-util.h pricing functions for
+  // off-chain paths that price many books at once (backtests, feeds).
+  //
+  // Every kernel returns exactly what the scalar on-chain functions
+  // return, including wraparound on overflow, so results can be compared
+  // bit for bit with published prices.
+
+  enum class batch_isa { scalar, avx2, avx512 };
+
+  // Best kernel supported by this CPU.
+  batch_isa get_batch_isa();
+  const char *to_str( batch_isa );
+
+  // Books in serum units with their serum to pyth multipliers.
+  struct batch_books
+  {
+    const uint64_t *bid_;
+    const uint64_t *ask_;
+    const uint64_t *s2p_;
+    size_t          num_;
+  };
+
+  // Outputs, num_ entries each.
+  struct batch_prices
+  {
+    int64_t  *price_;  // sp_midpt( bid * s2p, ask * s2p )
+    uint64_t *conf_;   // sp_confidence_fee( bid * s2p, ask * s2p, fee )
+  };
+
+  // Price and confidence of every book. Falls back to the best kernel
+  // this CPU supports if isa isn't.
+  void batch_price(
+    const batch_books&,
+    uint64_t fee_bps,
+    batch_prices&,
+    batch_isa = get_batch_isa()
+  );
+
+  // sp_conf_within() of every entry. Scalar: the signed division by a
+  // runtime threshold has no exact SIMD form worth the complexity.
+  void batch_status(
+    const int64_t *price,
+    const uint64_t *conf,
+    size_t num,
+    int64_t threshold,
+    uint8_t *trading
+  );
+
+  // sp_serum_to_pyth() per market. Scalar: it is a per-market constant
+  // with data-dependent loops, computed far less often than prices.
+  void batch_serum_to_pyth(
+    const int32_t *pyth_exp,
+    const int32_t *quote_exp,
+    const int32_t *base_exp,
+    const uint64_t *quote_lot,
+    const uint64_t *base_lot,
+    size_t num,
+    uint64_t *s2p
+  );
+
+}
@@ -0,0 +1,390 @@
+#include "book.hpp"
+
+#include <serum-pyth/serum-pyth.h>
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+using namespace sp;
+
+namespace
+{
+
+  // Node array of a bids/asks account that passed the slab checks.
+  struct slab
+  {
+    const serum_book_t     *book_;
+    const serum_node_any_t *nodes_;
+    uint64_t                max_nodes_;
+  };
+
+}
+
+static bool get_slab(
+  const uint8_t *data,
+  size_t len,
+  book_side side,
+  slab& sl
+) {
+  uint8_t *iter = (uint8_t*)data;
+  uint64_t left = len;
+  if ( !trim_serum_padding( &iter, &left ) ) {
+    return false;
+  }
+  if ( left < sizeof( serum_flags_t ) + sizeof( serum_book_t ) ) {
+    return false;
+  }
+
+  const serum_flags_t *flags = (serum_flags_t*)iter;
+  const uint64_t field = side == book_side::bids ? flags->Bids : flags->Asks;
+  if ( !sp_flags_valid( flags, field ) ) {
+    return false;
+  }
+  iter += sizeof( serum_flags_t );
+  left -= sizeof( serum_flags_t );
+
+  sl.book_ = (serum_book_t*)iter;
+  iter += sizeof( serum_book_t );
+  left -= sizeof( serum_book_t );
+
+  sl.nodes_ = (serum_node_any_t*)iter;
+  sl.max_nodes_ = left / sizeof( serum_node_any_t );
+  return sl.book_->LeafCount <= sl.max_nodes_;
+}
+
+bool sp::get_book_top(
+  const uint8_t *data,
+  size_t len,
+  book_side side,
+  book_top& top
+) {
+  top = book_top();
+
+  slab sl;
+  if ( !get_slab( data, len, side, sl ) ) {
+    return false;
+  }
+  if ( sl.book_->LeafCount == 0 ) {
+    return true;
+  }
+
+  // Larger prices to the right.
+  const serum_node_leaf_t *leaf = nullptr;
+  if ( sp_find_extreme_leaf(
+    sl.book_, sl.nodes_, sl.max_nodes_, side == book_side::bids, &leaf
+  ) != SP_DESCENT_LEAF ) {
+    return false;
+  }
+  top.price_ = leaf->Key1;
+  top.qty_ = leaf->Quantity;
+  return true;
+}
+
+static const size_t NODE_SIZE = sizeof( serum_node_any_t );
+
+// Nodes compared per memcmp before narrowing down to single nodes.
+static const size_t DIFF_BLOCK_NODES = 32;
+
+slab_diff::slab_diff()
+: side_( book_side::bids ),
+  num_leaves_( 0 ),
+  reset_( true )
+{
+}
+
+void slab_diff::clear()
+{
+  prev_.clear();
+  changes_.clear();
+  num_leaves_ = 0;
+  reset_ = true;
+}
+
+bool slab_diff::update( const uint8_t *data, size_t len, book_side side )
+{
+  changes_.clear();
+
+  slab sl;
+  if ( !get_slab( data, len, side, sl ) ) {
+    clear();
+    return false;
+  }
+  num_leaves_ = sl.book_->LeafCount;
+
+  const uint8_t *cur = (const uint8_t*)sl.nodes_;
+  const size_t num_nodes = sl.max_nodes_;
+  if ( prev_.empty() || side != side_
+    || prev_.size() != num_nodes * NODE_SIZE ) {
+    prev_.assign( cur, cur + num_nodes * NODE_SIZE );
+    side_ = side;
+    reset_ = true;
+    return true;
+  }
+  reset_ = false;
+
+  for ( size_t i = 0; i < num_nodes; i += DIFF_BLOCK_NODES ) {
+    const size_t n = std::min( DIFF_BLOCK_NODES, num_nodes - i );
+    uint8_t *old = &prev_[ i * NODE_SIZE ];
+    const uint8_t *now = cur + i * NODE_SIZE;
+    if ( !std::memcmp( old, now, n * NODE_SIZE ) ) {
+      continue;
+    }
+    for ( size_t j = 0; j != n; ++j, old += NODE_SIZE, now += NODE_SIZE ) {
+      if ( !std::memcmp( old, now, NODE_SIZE ) ) {
+        continue;
+      }
+      const serum_node_leaf_t *was = (const serum_node_leaf_t*)old;
+      const serum_node_leaf_t *is = (const serum_node_leaf_t*)now;
+      const bool was_leaf = was->Tag == SERUM_NODE_TYPE_LEAF;
+      const bool is_leaf = is->Tag == SERUM_NODE_TYPE_LEAF;
+      if ( was_leaf && is_leaf
+        && was->Key0 == is->Key0 && was->Key1 == is->Key1 ) {
+        if ( was->Quantity != is->Quantity ) {
+          changes_.push_back( { book_change::modified,
+            is->Key1, is->Quantity, was->Quantity } );
+        }
+      } else {
+        if ( was_leaf ) {
+          changes_.push_back( { book_change::removed,
+            was->Key1, was->Quantity, 0 } );
+        }
+        if ( is_leaf ) {
+          changes_.push_back( { book_change::inserted,
+            is->Key1, is->Quantity, 0 } );
+        }
+      }
+      std::memcpy( old, now, NODE_SIZE );
+    }
+  }
+  return true;
+}
+
+bool slab_diff::is_reset() const
+{
+  return reset_;
+}
+
+book_side slab_diff::get_side() const
+{
+  return side_;
+}
+
+uint64_t slab_diff::get_num_leaves() const
+{
+  return num_leaves_;
+}
+
+size_t slab_diff::get_num_changes() const
+{
+  return changes_.size();
+}
+
+const book_change& slab_diff::get_change( size_t i ) const
+{
+  return changes_[ i ];
+}
+
+l2_book::l2_book()
+: side_( book_side::bids ),
+  s2p_( 0 ),
+  base_lot_( 0 ),
+  num_orders_( 0 )
+{
+}
+
+void l2_book::clear()
+{
+  levels_.clear();
+  keys_.clear();
+  stack_.clear();
+  num_orders_ = 0;
+}
+
+bool l2_book::decode(
+  const uint8_t *data,
+  size_t len,
+  book_side side,
+  uint64_t s2p,
+  uint64_t base_lot
+) {
+  clear();
+  side_ = side;
+  s2p_ = s2p;
+  base_lot_ = base_lot;
+
+  slab sl;
+  if ( !get_slab( data, len, side, sl ) ) {
+    return false;
+  }
+  const uint64_t num_leaves = sl.book_->LeafCount;
+  if ( num_leaves == 0 ) {
+    return true;
+  }
+
+  // n leaves hang off n - 1 inner nodes: visiting more nodes than that
+  // means the slab has a cycle or shared subtrees.
+  const uint64_t max_visits = 2 * num_leaves - 1;
+  uint64_t visits = 0;
+  uint64_t last_key = 0;
+
+  // Depth first, best child on top of the stack, so leaves come out in
+  // price order.
+  stack_.push_back( sl.book_->Root );
+  while ( !stack_.empty() ) {
+    const uint32_t idx = stack_.back();
+    stack_.pop_back();
+    if ( idx >= sl.max_nodes_ || ++visits > max_visits ) {
+      clear();
+      return false;
+    }
+    const serum_node_any_t *node = &sl.nodes_[ idx ];
+    if ( node->Tag == SERUM_NODE_TYPE_INNER ) {
+      const serum_node_inner_t *inner = (const serum_node_inner_t*)node;
+      if ( side == book_side::bids ) {
+        stack_.push_back( inner->ChildA );
+        stack_.push_back( inner->ChildB );
+      } else {
+        stack_.push_back( inner->ChildB );
+        stack_.push_back( inner->ChildA );
+      }
+      continue;
+    }
+    if ( node->Tag != SERUM_NODE_TYPE_LEAF ) {
+      clear();
+      return false;
+    }
+
+    const serum_node_leaf_t *leaf = (const serum_node_leaf_t*)node;
+    const uint64_t qty = leaf->Quantity * base_lot;
+    if ( levels_.empty() || leaf->Key1 != last_key ) {
+      book_level lvl;
+      lvl.price_ = (int64_t)( leaf->Key1 * s2p );
+      lvl.qty_ = qty;
+      lvl.orders_ = 1;
+      levels_.push_back( lvl );
+      keys_.push_back( leaf->Key1 );
+      last_key = leaf->Key1;
+    } else {
+      book_level& lvl = levels_.back();
+      lvl.qty_ += qty;
+      ++lvl.orders_;
+    }
+    ++num_orders_;
+  }
+
+  if ( num_orders_ != num_leaves ) {
+    clear();
+    return false;
+  }
+  return true;
+}
+
+bool l2_book::apply( const slab_diff& diff )
+{
+  if ( diff.is_reset() || diff.get_side() != side_ ) {
+    clear();
+    return false;
+  }
+  for ( size_t i = 0; i != diff.get_num_changes(); ++i ) {
+    const book_change& chg = diff.get_change( i );
+    bool ok = true;
+    switch ( chg.kind_ ) {
+      case book_change::inserted: {
+        add( chg.price_, chg.qty_ );
+        break;
+      }
+      case book_change::removed: {
+        ok = remove( chg.price_, chg.qty_ );
+        break;
+      }
+      case book_change::modified: {
+        const size_t idx = find( chg.price_ );
+        ok = idx != keys_.size() && keys_[ idx ] == chg.price_;
+        if ( ok ) {
+          book_level& lvl = levels_[ idx ];
+          lvl.qty_ += ( chg.qty_ - chg.prev_qty_ ) * base_lot_;
+        }
+        break;
+      }
+    }
+    if ( !ok ) {
+      clear();
+      return false;
+    }
+  }
+  if ( num_orders_ != diff.get_num_leaves() ) {
+    clear();
+    return false;
+  }
+  return true;
+}
+
+// First level at or behind key in book order.
+size_t l2_book::find( uint64_t key ) const
+{
+  const auto it = side_ == book_side::bids
+    ? std::lower_bound( keys_.begin(), keys_.end(), key, std::greater<uint64_t>() )
+    : std::lower_bound( keys_.begin(), keys_.end(), key );
+  return (size_t)( it - keys_.begin() );
+}
+
+void l2_book::add( uint64_t key, uint64_t qty )
+{
+  const size_t idx = find( key );
+  if ( idx != keys_.size() && keys_[ idx ] == key ) {
+    book_level& lvl = levels_[ idx ];
+    lvl.qty_ += qty * base_lot_;
+    ++lvl.orders_;
+  } else {
+    book_level lvl;
+    lvl.price_ = (int64_t)( key * s2p_ );
+    lvl.qty_ = qty * base_lot_;
+    lvl.orders_ = 1;
+    levels_.insert( levels_.begin() + (ptrdiff_t)idx, lvl );
+    keys_.insert( keys_.begin() + (ptrdiff_t)idx, key );
+  }
+  ++num_orders_;
+}
+
+bool l2_book::remove( uint64_t key, uint64_t qty )
+{
+  const size_t idx = find( key );
+  if ( idx == keys_.size() || keys_[ idx ] != key || num_orders_ == 0 ) {
+    return false;
+  }
+  book_level& lvl = levels_[ idx ];
+  if ( --lvl.orders_ == 0 ) {
+    levels_.erase( levels_.begin() + (ptrdiff_t)idx );
+    keys_.erase( keys_.begin() + (ptrdiff_t)idx );
+  } else {
+    lvl.qty_ -= qty * base_lot_;
+  }
+  --num_orders_;
+  return true;
+}
+
+book_side l2_book::get_side() const
+{
+  return side_;
+}
+
+size_t l2_book::get_num_levels() const
+{
+  return levels_.size();
+}
+
+uint64_t l2_book::get_num_orders() const
+{
+  return num_orders_;
+}
+
+const book_level *l2_book::get_levels() const
+{
+  return levels_.data();
+}
+
+const book_level& l2_book::get_level( size_t i ) const
+{
+  return levels_[ i ];
+}
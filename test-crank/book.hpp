@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace sp
+{
+
+  enum class book_side { bids, asks };
+
+  // Best order on one side of a Serum order book, in serum units.
+  struct book_top
+  {
+    uint64_t price_ = 0;  // QuoteLot/BaseLot, 0 if the book is empty
+    uint64_t qty_   = 0;  // BaseLots
+  };
+
+  // Decode a bids/asks account the same way serum-pyth.c does.
+  // Returns false if data isn't a valid slab for side.
+  bool get_book_top(
+    const uint8_t *data,
+    size_t len,
+    book_side side,
+    book_top& top
+  );
+
+  // Orders at one price, in pyth units.
+  struct book_level
+  {
+    int64_t  price_;   // serum price * serum to pyth multiplier
+    uint64_t qty_;     // base lots * base lot size
+    uint32_t orders_;
+  };
+
+  // One order that differs between two snapshots of a slab, in serum
+  // units.
+  struct book_change
+  {
+    enum kind_t { inserted, removed, modified };
+
+    kind_t   kind_;
+    uint64_t price_;     // QuoteLot/BaseLot
+    uint64_t qty_;       // BaseLots: new size, or size removed
+    uint64_t prev_qty_;  // BaseLots before a modification
+  };
+
+  // Orders inserted, removed or resized between consecutive snapshots of
+  // one bids/asks account.
+  //
+  // Serum frees a leaf by retagging its node, so every node tagged as a
+  // leaf is a live order and the tree itself never needs walking: nodes
+  // are compared in place at their fixed stride, with runs of identical
+  // nodes skipped a block at a time. The previous snapshot is patched
+  // with the changed nodes only, so an update costs a compare of the
+  // account plus work proportional to the changes.
+  class slab_diff
+  {
+  public:
+
+    slab_diff();
+
+    // Compare data with the previous snapshot and keep it as the next
+    // one. Returns false, and forgets the snapshot, if data isn't a valid
+    // slab for side.
+    bool update( const uint8_t *data, size_t len, book_side side );
+
+    // True if the last update had nothing to compare against (first
+    // snapshot, or the account changed size): rebuild from scratch.
+    bool is_reset() const;
+
+    book_side get_side() const;
+    uint64_t get_num_leaves() const;
+    size_t get_num_changes() const;
+    const book_change& get_change( size_t ) const;
+
+    void clear();
+
+  private:
+
+    std::vector<uint8_t>     prev_;
+    std::vector<book_change> changes_;
+    book_side                side_;
+    uint64_t                 num_leaves_;
+    bool                     reset_;
+  };
+
+  // Every level of one side of a Serum order book, best first.
+  //
+  // Decodes the whole critbit slab with an iterative in-order walk
+  // (descending keys for bids, ascending for asks), so orders at one
+  // price are adjacent and merge into a single level. Storage is kept
+  // across calls: once warm, decoding a book of similar depth doesn't
+  // allocate.
+  class l2_book
+  {
+  public:
+
+    l2_book();
+
+    // Replace the contents with the book in data. s2p is the market's
+    // serum to pyth multiplier and base_lot its base lot size. Returns
+    // false, leaving the book empty, if data isn't a valid slab for side.
+    bool decode(
+      const uint8_t *data,
+      size_t len,
+      book_side side,
+      uint64_t s2p,
+      uint64_t base_lot
+    );
+
+    // Patch the book with the changes between the snapshot it was
+    // decoded from (or last patched to) and the next one. Returns false,
+    // leaving the book empty, if the changes don't match the book or are
+    // for the other side: decode the snapshot instead.
+    bool apply( const slab_diff& );
+
+    void clear();
+
+    book_side get_side() const;
+    size_t get_num_levels() const;
+    uint64_t get_num_orders() const;
+    const book_level *get_levels() const;
+    const book_level& get_level( size_t ) const;
+
+  private:
+
+    size_t find( uint64_t key ) const;
+    void add( uint64_t key, uint64_t qty );
+    bool remove( uint64_t key, uint64_t qty );
+
+    std::vector<book_level> levels_;
+    std::vector<uint64_t>   keys_;  // serum price of each level
+    std::vector<uint32_t>   stack_;
+    book_side               side_;
+    uint64_t                s2p_;
+    uint64_t                base_lot_;
+    uint64_t                num_orders_;
+  };
+
+}
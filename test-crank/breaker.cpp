@@ -0,0 +1,117 @@
+#include "breaker.hpp"
+
+#include <algorithm>
+#include <limits>
+
+using namespace sp;
+
+static const int64_t NEVER = std::numeric_limits<int64_t>::max();
+
+breaker_sub::~breaker_sub()
+{
+}
+
+void breaker_sub::on_breaker( unsigned, bool )
+{
+}
+
+breaker::breaker()
+: sub_( nullptr ),
+  threshold_( 3 ),
+  min_backoff_( 5000000000L ),
+  max_backoff_( 600000000000L ),
+  next_ts_( NEVER ),
+  num_trips_( 0 )
+{
+}
+
+void breaker::set_sub( breaker_sub *sub )
+{
+  sub_ = sub;
+}
+
+void breaker::set_threshold( unsigned threshold )
+{
+  threshold_ = threshold;
+}
+
+void breaker::set_backoff( int64_t min, int64_t max )
+{
+  min_backoff_ = min;
+  max_backoff_ = max;
+}
+
+void breaker::add_market()
+{
+  mkts_.emplace_back();
+}
+
+bool breaker::get_is_open( unsigned mkt ) const
+{
+  return mkts_[ mkt ].open_;
+}
+
+void breaker::on_success( unsigned mkt )
+{
+  state& st = mkts_[ mkt ];
+  st.fails_ = 0;
+  st.trips_ = 0;
+  st.probe_ = false;
+}
+
+void breaker::on_failure( unsigned mkt, int64_t now )
+{
+  state& st = mkts_[ mkt ];
+  if ( st.open_ ) {
+    return;
+  }
+  ++st.fails_;
+  if ( !st.probe_ && st.fails_ < threshold_ ) {
+    return;
+  }
+
+  // Trip: back off 2^trips * min, capped.
+  int64_t backoff = min_backoff_;
+  for ( unsigned i = 0; i < st.trips_ && backoff < max_backoff_; ++i ) {
+    backoff *= 2;
+  }
+  backoff = std::min( backoff, max_backoff_ );
+  ++st.trips_;
+  ++num_trips_;
+  st.fails_ = 0;
+  st.probe_ = false;
+  st.open_ = true;
+  st.until_ = now + backoff;
+  next_ts_ = std::min( next_ts_, st.until_ );
+  if ( sub_ ) {
+    sub_->on_breaker( mkt, true );
+  }
+}
+
+void breaker::poll( int64_t now )
+{
+  if ( now < next_ts_ ) {
+    return;
+  }
+  next_ts_ = NEVER;
+  for ( unsigned i = 0; i < mkts_.size(); ++i ) {
+    state& st = mkts_[ i ];
+    if ( !st.open_ ) {
+      continue;
+    }
+    if ( now < st.until_ ) {
+      next_ts_ = std::min( next_ts_, st.until_ );
+      continue;
+    }
+    st.open_ = false;
+    st.probe_ = true;
+    if ( sub_ ) {
+      sub_->on_breaker( i, false );
+    }
+  }
+}
+
+uint64_t breaker::get_num_trips() const
+{
+  return num_trips_;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace sp
+{
+
+  // Circuit breaker callbacks.
+  class breaker_sub
+  {
+  public:
+    virtual ~breaker_sub();
+
+    // Market isolated (open) or allowed to probe again (half-open).
+    virtual void on_breaker( unsigned mkt, bool is_open );
+  };
+
+  // Per-market circuit breaker with exponential backoff. A market that
+  // fails repeatedly is isolated for a backoff period, then allowed one
+  // probe: success closes the breaker, failure doubles the backoff.
+  //
+  // All times are nanoseconds from pc::get_now().
+  class breaker
+  {
+  public:
+
+    breaker();
+
+    void set_sub( breaker_sub * );
+
+    // Consecutive failures that trip the breaker (default 3).
+    void set_threshold( unsigned );
+
+    // First and max backoff (default 5s and 10min).
+    void set_backoff( int64_t min, int64_t max );
+
+    void add_market();
+
+    bool get_is_open( unsigned mkt ) const;
+
+    void on_success( unsigned mkt );
+    void on_failure( unsigned mkt, int64_t now );
+
+    // Move expired open breakers to half-open.
+    void poll( int64_t now );
+
+    uint64_t get_num_trips() const;
+
+  private:
+
+    struct state
+    {
+      unsigned fails_  = 0;
+      unsigned trips_  = 0;     // consecutive, drives the backoff
+      bool     open_   = false;
+      bool     probe_  = false; // half-open
+      int64_t  until_  = 0;
+    };
+
+    breaker_sub *sub_;
+    unsigned     threshold_;
+    int64_t      min_backoff_;
+    int64_t      max_backoff_;
+    int64_t      next_ts_;      // earliest until_ among open breakers
+    uint64_t     num_trips_;
+    std::vector<state> mkts_;
+  };
+
+}
@@ -0,0 +1,174 @@
+#include "budget.hpp"
+#include "tx_limits.hpp"
+
+#include <algorithm>
+
+using namespace sp;
+
+// Limits are rounded up to this many units so small swings in usage
+// don't change the transaction (and invalidate pre-signed copies).
+static const uint64_t CU_ROUND = 1000;
+
+// Weight of each new outcome in the land rate and delay averages.
+static const double FEE_ALPHA = 0.1;
+
+cu_limits::cu_limits()
+: headroom_( 20 ),
+  window_( 16 ),
+  min_( 1000 ),
+  max_( 1400000 )
+{
+}
+
+void cu_limits::set_headroom( unsigned pct )
+{
+  headroom_ = pct;
+}
+
+void cu_limits::set_window( unsigned window )
+{
+  window_ = std::max( window, 1U );
+}
+
+void cu_limits::set_bounds( uint32_t min, uint32_t max )
+{
+  min_ = min;
+  max_ = max;
+}
+
+void cu_limits::add_market()
+{
+  mkts_.emplace_back();
+}
+
+void cu_limits::on_usage( unsigned mkt, uint64_t units )
+{
+  state& st = mkts_[ mkt ];
+  const uint32_t used = ( uint32_t )std::min( units, ( uint64_t )max_ );
+  if ( st.seen_.size() < window_ ) {
+    st.seen_.push_back( used );
+  }
+  else {
+    st.seen_[ st.pos_ ] = used;
+    st.pos_ = ( st.pos_ + 1 ) % window_;
+  }
+  uint64_t limit = *std::max_element( st.seen_.begin(), st.seen_.end() );
+  limit += limit * headroom_ / 100;
+  limit = ( limit + CU_ROUND - 1 ) / CU_ROUND * CU_ROUND;
+  st.limit_ = ( uint32_t )std::max(
+    std::min( limit, ( uint64_t )max_ ), ( uint64_t )min_
+  );
+}
+
+bool cu_limits::on_exceeded( unsigned mkt )
+{
+  state& st = mkts_[ mkt ];
+  if ( st.limit_ >= max_ ) {
+    return false;
+  }
+  const uint64_t limit = 2 * ( st.limit_ ? st.limit_ : TX_DEFAULT_IX_UNITS );
+  st.limit_ = ( uint32_t )std::max(
+    std::min( limit, ( uint64_t )max_ ), ( uint64_t )min_
+  );
+  st.seen_.clear();
+  st.pos_ = 0;
+  return true;
+}
+
+uint32_t cu_limits::get_limit( unsigned mkt ) const
+{
+  return mkts_[ mkt ].limit_;
+}
+
+fee_tuner::fee_tuner()
+: min_( 0 ),
+  max_( 100000 ),
+  step_( 1000 ),
+  target_rate_( 0.9 ),
+  target_delay_( 4. ),
+  interval_( 10 ),
+  price_( 0 ),
+  next_slot_( 0 ),
+  num_done_( 0 ),
+  rate_( 1. ),
+  delay_( 0. )
+{
+}
+
+void fee_tuner::set_bounds( uint64_t min, uint64_t max )
+{
+  min_ = min;
+  max_ = std::max( min, max );
+  price_ = min_;
+}
+
+void fee_tuner::set_step( uint64_t step )
+{
+  step_ = std::max( step, ( uint64_t )1 );
+}
+
+void fee_tuner::set_target_rate( double rate )
+{
+  target_rate_ = rate;
+}
+
+void fee_tuner::set_target_delay( double slots )
+{
+  target_delay_ = slots;
+}
+
+void fee_tuner::set_interval( uint64_t slots )
+{
+  interval_ = std::max( slots, ( uint64_t )1 );
+}
+
+void fee_tuner::on_done( bool landed, uint64_t slots )
+{
+  ++num_done_;
+  rate_ += FEE_ALPHA * ( ( landed ? 1. : 0. ) - rate_ );
+  if ( landed ) {
+    delay_ += FEE_ALPHA * ( ( double )slots - delay_ );
+  }
+}
+
+bool fee_tuner::on_slot( uint64_t slot )
+{
+  if ( slot < next_slot_ ) {
+    return false;
+  }
+  next_slot_ = slot + interval_;
+
+  // Nothing finished: no evidence either way, e.g. every market idle.
+  if ( !num_done_ ) {
+    return false;
+  }
+  num_done_ = 0;
+
+  const uint64_t prev = price_;
+  if ( rate_ < target_rate_ || delay_ > target_delay_ ) {
+    price_ = std::max( price_ * 2, step_ );
+  }
+  else {
+    price_ -= price_ / 4;
+    if ( price_ < step_ ) {
+      price_ = 0;
+    }
+  }
+  price_ = std::max( std::min( price_, max_ ), min_ );
+  return price_ != prev;
+}
+
+uint64_t fee_tuner::get_price() const
+{
+  return price_;
+}
+
+double fee_tuner::get_land_rate() const
+{
+  return rate_;
+}
+
+double fee_tuner::get_delay() const
+{
+  return delay_;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace sp
+{
+
+  // ComputeBudget111111111111111111111111111111 instruction discriminators.
+  static const uint8_t CU_SET_LIMIT = 2;  // u32 compute units
+  static const uint8_t CU_SET_PRICE = 3;  // u64 micro-lamports per unit
+
+  // Per-market compute unit limit: the largest consumption seen in the
+  // last few landed transactions plus headroom, so a deeper book doesn't
+  // exhaust a tight limit. Zero (runtime default) until usage is known.
+  // A book that outgrows the headroom fails every transaction, so those
+  // failures raise the limit instead.
+  class cu_limits
+  {
+  public:
+
+    cu_limits();
+
+    // Headroom over observed usage in percent (default 20).
+    void set_headroom( unsigned pct );
+
+    // Landed transactions remembered per market (default 16).
+    void set_window( unsigned );
+
+    // Clamp for the limit (default 1000 and 1400000, the runtime max).
+    void set_bounds( uint32_t min, uint32_t max );
+
+    void add_market();
+
+    // Compute units consumed by a landed transaction for mkt.
+    void on_usage( unsigned mkt, uint64_t units );
+
+    // A transaction for mkt ran out of compute units in its instruction:
+    // double its limit, from the runtime's per-instruction default if it
+    // has none, and forget the usage it came from. False if the limit is
+    // already at the max.
+    bool on_exceeded( unsigned mkt );
+
+    // Limit to request for mkt, or 0 if none observed yet.
+    uint32_t get_limit( unsigned mkt ) const;
+
+  private:
+
+    struct state
+    {
+      std::vector<uint32_t> seen_;  // ring of recent usage
+      unsigned pos_   = 0;
+      uint32_t limit_ = 0;
+    };
+
+    unsigned headroom_;
+    unsigned window_;
+    uint32_t min_;
+    uint32_t max_;
+    std::vector<state> mkts_;
+  };
+
+  // Priority fee shared by every market, in micro-lamports per compute
+  // unit. Raised multiplicatively while the land rate is under target or
+  // transactions take too many slots to land, decayed while both are
+  // met, so the crank pays for congestion only while it lasts.
+  class fee_tuner
+  {
+  public:
+
+    fee_tuner();
+
+    // Fee bounds (default 0 and 100000). The fee starts at min.
+    void set_bounds( uint64_t min, uint64_t max );
+
+    // Smallest nonzero fee, the first step up from 0 (default 1000).
+    void set_step( uint64_t );
+
+    // Targets: share of transactions landing (default 0.9) and mean
+    // slots from submission to confirmation (default 4).
+    void set_target_rate( double );
+    void set_target_delay( double slots );
+
+    // Slots between adjustments (default 10).
+    void set_interval( uint64_t slots );
+
+    // A transaction landed (after slots) or expired.
+    void on_done( bool landed, uint64_t slots );
+
+    // Returns true if the fee changed.
+    bool on_slot( uint64_t slot );
+
+    uint64_t get_price() const;
+    double get_land_rate() const;
+    double get_delay() const;
+
+  private:
+
+    uint64_t min_;
+    uint64_t max_;
+    uint64_t step_;
+    double   target_rate_;
+    double   target_delay_;
+    uint64_t interval_;
+    uint64_t price_;
+    uint64_t next_slot_;
+    uint64_t num_done_;      // since the last adjustment
+    double   rate_;          // EWMA of landed (1) or expired (0)
+    double   delay_;         // EWMA of slots to land
+  };
+
+}
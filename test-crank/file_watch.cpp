@@ -0,0 +1,63 @@
+#include "file_watch.hpp"
+
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+
+using namespace sp;
+
+file_watch::file_watch()
+: fd_( -1 )
+{
+}
+
+file_watch::~file_watch()
+{
+  if ( fd_ >= 0 ) {
+    ::close( fd_ );
+  }
+}
+
+bool file_watch::init( const std::string& path )
+{
+  // Watch the directory: a rename onto the file replaces the inode a
+  // watch on the file itself would follow.
+  const size_t pos = path.rfind( '/' );
+  const std::string dir = pos == std::string::npos ? "." : path.substr( 0, pos + 1 );
+  name_ = pos == std::string::npos ? path : path.substr( pos + 1 );
+  fd_ = ::inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+  if ( fd_ < 0 ) {
+    err_msg_ = std::string( "inotify_init1: " ) + std::strerror( errno );
+    return false;
+  }
+  if ( ::inotify_add_watch( fd_, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO ) < 0 ) {
+    err_msg_ = "inotify_add_watch " + dir + ": " + std::strerror( errno );
+    return false;
+  }
+  return true;
+}
+
+bool file_watch::poll()
+{
+  bool is_changed = false;
+  alignas( inotify_event ) char buf[ 16 * ( sizeof( inotify_event ) + NAME_MAX + 1 ) ];
+  ssize_t len;
+  while ( ( len = ::read( fd_, buf, sizeof( buf ) ) ) > 0 ) {
+    for ( ssize_t off = 0; off < len; ) {
+      const inotify_event *ev = ( const inotify_event* )( buf + off );
+      if ( ev->len && name_ == ev->name ) {
+        is_changed = true;
+      }
+      off += ( ssize_t )( sizeof( inotify_event ) + ev->len );
+    }
+  }
+  return is_changed;
+}
+
+const std::string& file_watch::get_err_msg() const
+{
+  return err_msg_;
+}
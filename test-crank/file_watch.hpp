@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+
+namespace sp
+{
+
+  // Reports when a file is rewritten in place or replaced by a rename,
+  // as editors and config management do, via inotify on its directory.
+  // Polled without blocking from the event loop.
+  class file_watch
+  {
+  public:
+
+    file_watch();
+    ~file_watch();
+
+    bool init( const std::string& path );
+
+    // Whether the file changed since the last call.
+    bool poll();
+
+    const std::string& get_err_msg() const;
+
+  private:
+
+    int         fd_;
+    std::string name_;
+    std::string err_msg_;
+  };
+
+}
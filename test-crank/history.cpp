@@ -0,0 +1,535 @@
+#include "history.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zstd.h>
+
+using namespace sp;
+
+static const int64_t NS_PER_DAY = 86400L * 1000000000L;
+
+size_t sp::get_col_width( history_col col )
+{
+  switch ( col ) {
+    case e_hist_status:
+    case e_hist_outcome:
+      return 1;
+    default:
+      return 8;
+  }
+}
+
+static bool is_delta_col( uint32_t col )
+{
+  return col == e_hist_slot || col == e_hist_ts;
+}
+
+// Value of one row's column as little-endian bytes.
+static const void *get_field( const history_row& row, uint32_t col )
+{
+  switch ( col ) {
+    case e_hist_slot:    return &row.slot_;
+    case e_hist_ts:      return &row.ts_;
+    case e_hist_bid:     return &row.bid_;
+    case e_hist_ask:     return &row.ask_;
+    case e_hist_bid_qty: return &row.bid_qty_;
+    case e_hist_ask_qty: return &row.ask_qty_;
+    case e_hist_price:   return &row.price_;
+    case e_hist_conf:    return &row.conf_;
+    case e_hist_s2p:     return &row.s2p_;
+    case e_hist_status:  return &row.status_;
+    default:             return &row.outcome_;
+  }
+}
+
+size_t sp::scan_history(
+  const uint8_t *data,
+  size_t len,
+  std::vector<history_block> *blks
+) {
+  if ( len < sizeof( history_file_hdr ) ) {
+    return 0;
+  }
+  history_file_hdr fhdr;
+  std::memcpy( &fhdr, data, sizeof( fhdr ) );
+  if ( fhdr.magic_ != HIST_MAGIC || fhdr.version_ != HIST_VERSION
+    || fhdr.num_cols_ != e_hist_num_cols ) {
+    return 0;
+  }
+  size_t off = sizeof( history_file_hdr );
+  while ( len - off >= sizeof( history_block_hdr ) ) {
+    history_block_hdr bhdr;
+    std::memcpy( &bhdr, data + off, sizeof( bhdr ) );
+    if ( bhdr.magic_ != HIST_BLK_MAGIC ) {
+      break;
+    }
+    size_t size = sizeof( bhdr );
+    for ( uint32_t c = 0; c != e_hist_num_cols; ++c ) {
+      size += bhdr.col_size_[ c ];
+    }
+    if ( len - off < size ) {
+      break;
+    }
+    if ( blks ) {
+      history_block blk;
+      blk.first_slot_ = bhdr.first_slot_;
+      blk.last_slot_ = bhdr.last_slot_;
+      blk.first_ts_ = bhdr.first_ts_;
+      blk.last_ts_ = bhdr.last_ts_;
+      blk.num_rows_ = bhdr.num_rows_;
+      blk.offset_ = off;
+      blks->push_back( blk );
+    }
+    off += size;
+  }
+  return off;
+}
+
+history_writer::history_writer()
+: dir_( "." ),
+  block_rows_( 4096 ),
+  level_( 3 ),
+  do_run_( false ),
+  is_busy_( false ),
+  has_err_( false ),
+  is_failed_( false ),
+  cctx_( ZSTD_createCCtx() )
+{
+}
+
+history_writer::~history_writer()
+{
+  flush();
+  {
+    std::lock_guard<std::mutex> lck( mtx_ );
+    do_run_ = false;
+  }
+  cv_.notify_one();
+  if ( thrd_.joinable() ) {
+    thrd_.join();
+  }
+  ZSTD_freeCCtx( ( ZSTD_CCtx* )cctx_ );
+}
+
+void history_writer::set_dir( const std::string& dir )
+{
+  dir_ = dir;
+}
+
+void history_writer::set_block_rows( uint32_t rows )
+{
+  block_rows_ = std::max( 1U, rows );
+}
+
+void history_writer::set_level( int level )
+{
+  level_ = level;
+}
+
+unsigned history_writer::add_market(
+  const std::string& name,
+  const uint8_t *pyth_price
+) {
+  std::lock_guard<std::mutex> lck( mtx_ );
+  const unsigned idx = ( unsigned )mkts_.size();
+  mkts_.emplace_back();
+  market_log& m = mkts_.back();
+  m.name_ = name;
+  std::memcpy( m.pyth_price_, pyth_price, sizeof( m.pyth_price_ ) );
+  m.rows_.reserve( block_rows_ );
+  pending_.reserve( 2 * mkts_.size() );
+  if ( !thrd_.joinable() ) {
+    do_run_ = true;
+    thrd_ = std::thread( &history_writer::run, this );
+  }
+  return idx;
+}
+
+bool history_writer::add( unsigned idx, const history_row& row )
+{
+  market_log& m = mkts_[ idx ];
+  const int64_t day = row.ts_ / NS_PER_DAY;
+  if ( day != m.day_ ) {
+    queue_block( idx );
+    m.day_ = day;
+    m.limit_ = block_rows_ - ( uint32_t )( idx % block_rows_ );
+  }
+  m.rows_.push_back( row );
+  if ( m.rows_.size() >= m.limit_ ) {
+    queue_block( idx );
+    m.limit_ = block_rows_;
+  }
+  return take_err();
+}
+
+bool history_writer::flush()
+{
+  for ( unsigned idx = 0; idx != mkts_.size(); ++idx ) {
+    queue_block( idx );
+  }
+  {
+    std::unique_lock<std::mutex> lck( mtx_ );
+    done_cv_.wait( lck, [&]{ return pending_.empty() && !is_busy_; } );
+  }
+  take_err();
+  std::lock_guard<std::mutex> lck( mtx_ );
+  const bool ok = !is_failed_;
+  is_failed_ = false;
+  return ok;
+}
+
+const std::string& history_writer::get_err_msg() const
+{
+  return err_;
+}
+
+// Hand the market's rows to the writer thread, taking a spare buffer in
+// their place.
+void history_writer::queue_block( unsigned idx )
+{
+  market_log& m = mkts_[ idx ];
+  if ( m.rows_.empty() ) {
+    return;
+  }
+  std::vector<history_row> rows;
+  {
+    std::lock_guard<std::mutex> lck( mtx_ );
+    if ( !spare_.empty() ) {
+      rows.swap( spare_.back() );
+      spare_.pop_back();
+    }
+    pending_.push_back( block_job{ idx, m.day_, std::move( m.rows_ ) } );
+  }
+  cv_.notify_one();
+  rows.reserve( block_rows_ );
+  m.rows_.swap( rows );
+}
+
+// Latest writer error, if any since the last call.
+bool history_writer::take_err()
+{
+  if ( !has_err_.load( std::memory_order_acquire ) ) {
+    return true;
+  }
+  std::lock_guard<std::mutex> lck( mtx_ );
+  err_ = werr_;
+  has_err_.store( false, std::memory_order_relaxed );
+  return false;
+}
+
+void history_writer::set_err( const std::string& err )
+{
+  std::lock_guard<std::mutex> lck( mtx_ );
+  werr_ = err;
+  is_failed_ = true;
+  has_err_.store( true, std::memory_order_release );
+}
+
+void history_writer::run()
+{
+  std::vector<block_job> work;
+  std::unique_lock<std::mutex> lck( mtx_ );
+  while ( true ) {
+    cv_.wait( lck, [&]{ return !do_run_ || !pending_.empty(); } );
+    if ( pending_.empty() ) {
+      break;
+    }
+    work.swap( pending_ );
+    is_busy_ = true;
+    lck.unlock();
+    for ( const block_job& job : work ) {
+      write_block( job );
+    }
+    lck.lock();
+    for ( block_job& job : work ) {
+      job.rows_.clear();
+      spare_.push_back( std::move( job.rows_ ) );
+    }
+    work.clear();
+    is_busy_ = false;
+    done_cv_.notify_all();
+  }
+}
+
+// Open for one append. The first time in a run, keep the complete blocks
+// of an existing file and drop a torn tail, or write the file header.
+int history_writer::open_file(
+  unsigned idx,
+  int64_t day,
+  const std::string& path,
+  const uint8_t *pyth_price
+) {
+  const int fd = ::open( path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644 );
+  if ( fd < 0 ) {
+    set_err( "open " + path + ": " + std::strerror( errno ) );
+    return -1;
+  }
+  if ( file_day_.size() <= idx ) {
+    file_day_.resize( idx + 1, -1 );
+  }
+  if ( file_day_[ idx ] == day ) {
+    return fd;
+  }
+  struct stat st;
+  if ( ::fstat( fd, &st ) != 0 ) {
+    set_err( "stat " + path + ": " + std::strerror( errno ) );
+    ::close( fd );
+    return -1;
+  }
+  if ( st.st_size > 0 ) {
+    const size_t len = ( size_t )st.st_size;
+    size_t end = 0;
+    void *data = ::mmap( nullptr, len, PROT_READ, MAP_SHARED, fd, 0 );
+    if ( data != MAP_FAILED ) {
+      end = scan_history( ( const uint8_t* )data, len, nullptr );
+      ::munmap( data, len );
+    }
+    if ( end == 0 ) {
+      set_err( "not a history file: " + path );
+      ::close( fd );
+      return -1;
+    }
+    if ( end != len && ::ftruncate( fd, ( off_t )end ) != 0 ) {
+      set_err( "ftruncate " + path + ": " + std::strerror( errno ) );
+      ::close( fd );
+      return -1;
+    }
+  }
+  else {
+    history_file_hdr fhdr = history_file_hdr();
+    fhdr.magic_ = HIST_MAGIC;
+    fhdr.version_ = HIST_VERSION;
+    fhdr.num_cols_ = e_hist_num_cols;
+    std::memcpy( fhdr.pyth_price_, pyth_price, sizeof( fhdr.pyth_price_ ) );
+    if ( ::write( fd, &fhdr, sizeof( fhdr ) ) != ( ssize_t )sizeof( fhdr ) ) {
+      set_err( "write " + path + ": " + std::strerror( errno ) );
+      ::close( fd );
+      return -1;
+    }
+  }
+  file_day_[ idx ] = day;
+  return fd;
+}
+
+bool history_writer::write_block( const block_job& job )
+{
+  std::string path;
+  uint8_t pyth_price[32];
+  {
+    std::lock_guard<std::mutex> lck( mtx_ );
+    const market_log& m = mkts_[ job.idx_ ];
+    const time_t secs = ( time_t )( job.day_ * 86400L );
+    struct tm tm;
+    ::gmtime_r( &secs, &tm );
+    char date[16];
+    std::strftime( date, sizeof( date ), "%Y%m%d", &tm );
+    path = dir_ + "/" + m.name_ + "-" + date + ".sph";
+    std::memcpy( pyth_price, m.pyth_price_, sizeof( pyth_price ) );
+  }
+
+  const std::vector<history_row>& rows = job.rows_;
+  const size_t num_rows = rows.size();
+  history_block_hdr bhdr = history_block_hdr();
+  bhdr.magic_ = HIST_BLK_MAGIC;
+  bhdr.num_rows_ = ( uint32_t )num_rows;
+  bhdr.first_slot_ = rows.front().slot_;
+  bhdr.last_slot_ = rows.back().slot_;
+  bhdr.first_ts_ = rows.front().ts_;
+  bhdr.last_ts_ = rows.back().ts_;
+
+  out_.resize( sizeof( bhdr ) );
+  for ( uint32_t c = 0; c != e_hist_num_cols; ++c ) {
+    const size_t width = get_col_width( ( history_col )c );
+    raw_.resize( num_rows * width );
+    uint8_t *dst = raw_.data();
+    uint64_t prev = 0;
+    for ( const history_row& row : rows ) {
+      if ( is_delta_col( c ) ) {
+        uint64_t val;
+        std::memcpy( &val, get_field( row, c ), sizeof( val ) );
+        const uint64_t delta = val - prev;
+        std::memcpy( dst, &delta, sizeof( delta ) );
+        prev = val;
+      }
+      else {
+        std::memcpy( dst, get_field( row, c ), width );
+      }
+      dst += width;
+    }
+
+    const size_t off = out_.size();
+    const size_t bound = ZSTD_compressBound( raw_.size() );
+    out_.resize( off + bound );
+    const size_t len = ZSTD_compressCCtx(
+      ( ZSTD_CCtx* )cctx_,
+      out_.data() + off, bound,
+      raw_.data(), raw_.size(),
+      level_
+    );
+    if ( ZSTD_isError( len ) ) {
+      set_err( std::string( "zstd: " ) + ZSTD_getErrorName( len ) );
+      return false;
+    }
+    out_.resize( off + len );
+    bhdr.col_size_[ c ] = ( uint32_t )len;
+  }
+  std::memcpy( out_.data(), &bhdr, sizeof( bhdr ) );
+
+  const int fd = open_file( job.idx_, job.day_, path, pyth_price );
+  if ( fd < 0 ) {
+    return false;
+  }
+  // A short write leaves a torn block that the next run drops.
+  const ssize_t len = ::write( fd, out_.data(), out_.size() );
+  const int err = errno;
+  ::close( fd );
+  if ( len != ( ssize_t )out_.size() ) {
+    set_err( "write " + path + ": " + std::strerror( err ) );
+    return false;
+  }
+  return true;
+}
+
+history_reader::history_reader()
+: base_( nullptr ),
+  len_( 0 ),
+  dctx_( ZSTD_createDCtx() ),
+  num_rows_( 0 )
+{
+}
+
+history_reader::~history_reader()
+{
+  close();
+  ZSTD_freeDCtx( ( ZSTD_DCtx* )dctx_ );
+}
+
+bool history_reader::open( const std::string& path )
+{
+  close();
+  const int fd = ::open( path.c_str(), O_RDONLY );
+  struct stat st;
+  if ( fd < 0 || ::fstat( fd, &st ) != 0 ) {
+    err_ = "open " + path + ": " + std::strerror( errno );
+    if ( fd >= 0 ) {
+      ::close( fd );
+    }
+    return false;
+  }
+  len_ = ( size_t )st.st_size;
+  void *data = len_ ? ::mmap( nullptr, len_, PROT_READ, MAP_SHARED, fd, 0 )
+                    : MAP_FAILED;
+  ::close( fd );
+  if ( data == MAP_FAILED ) {
+    err_ = "mmap " + path + ": " + std::strerror( errno );
+    len_ = 0;
+    return false;
+  }
+  base_ = ( uint8_t* )data;
+  if ( scan_history( base_, len_, &blks_ ) == 0 ) {
+    err_ = "not a history file: " + path;
+    close();
+    return false;
+  }
+  for ( const history_block& blk : blks_ ) {
+    num_rows_ += blk.num_rows_;
+  }
+  return true;
+}
+
+void history_reader::close()
+{
+  if ( base_ ) {
+    ::munmap( base_, len_ );
+  }
+  base_ = nullptr;
+  len_ = 0;
+  num_rows_ = 0;
+  blks_.clear();
+}
+
+const uint8_t *history_reader::get_pyth_price() const
+{
+  return base_ ? ( ( const history_file_hdr* )base_ )->pyth_price_ : nullptr;
+}
+
+uint64_t history_reader::get_num_rows() const
+{
+  return num_rows_;
+}
+
+size_t history_reader::get_num_blocks() const
+{
+  return blks_.size();
+}
+
+const history_block& history_reader::get_block( size_t blk ) const
+{
+  return blks_[ blk ];
+}
+
+size_t history_reader::find_slot( uint64_t slot ) const
+{
+  return ( size_t )( std::lower_bound(
+    blks_.begin(), blks_.end(), slot,
+    []( const history_block& blk, uint64_t s ) { return blk.last_slot_ < s; }
+  ) - blks_.begin() );
+}
+
+size_t history_reader::find_time( int64_t ts ) const
+{
+  return ( size_t )( std::lower_bound(
+    blks_.begin(), blks_.end(), ts,
+    []( const history_block& blk, int64_t t ) { return blk.last_ts_ < t; }
+  ) - blks_.begin() );
+}
+
+bool history_reader::read_column(
+  size_t blk,
+  history_col col,
+  std::vector<uint8_t>& out
+) {
+  if ( blk >= blks_.size() || col >= e_hist_num_cols ) {
+    err_ = "invalid block or column";
+    return false;
+  }
+  const history_block& b = blks_[ blk ];
+  history_block_hdr bhdr;
+  std::memcpy( &bhdr, base_ + b.offset_, sizeof( bhdr ) );
+  size_t off = b.offset_ + sizeof( bhdr );
+  for ( uint32_t c = 0; c != col; ++c ) {
+    off += bhdr.col_size_[ c ];
+  }
+
+  const size_t width = get_col_width( col );
+  out.resize( b.num_rows_ * width );
+  const size_t len = ZSTD_decompressDCtx(
+    ( ZSTD_DCtx* )dctx_,
+    out.data(), out.size(),
+    base_ + off, bhdr.col_size_[ col ]
+  );
+  if ( ZSTD_isError( len ) || len != out.size() ) {
+    err_ = "corrupt column";
+    return false;
+  }
+  if ( is_delta_col( col ) ) {
+    uint64_t prev = 0;
+    for ( size_t i = 0; i != b.num_rows_; ++i ) {
+      uint64_t val;
+      std::memcpy( &val, out.data() + i * width, sizeof( val ) );
+      prev += val;
+      std::memcpy( out.data() + i * width, &prev, sizeof( prev ) );
+    }
+  }
+  return true;
+}
+
+const std::string& history_reader::get_err_msg() const
+{
+  return err_;
+}
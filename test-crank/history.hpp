@@ -0,0 +1,263 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace sp
+{
+
+  // Append-only, columnar history of each market's top of book, computed
+  // price and publish outcome, one row per market per slot. The serum to
+  // pyth multiplier is kept so prices can be recomputed offline.
+  //
+  // One file per market per UTC day, named <name>-<YYYYMMDD>.sph:
+  //
+  //   history_file_hdr | block | block | ...
+  //   block = history_block_hdr | column 0 | ... | column N-1
+  //
+  // Each column of a block is zstd-compressed on its own, so a reader only
+  // decompresses the columns it asks for. slot and ts are delta-encoded.
+  // Block headers hold the block's slot and time range and double as a
+  // sparse index. A torn block at the tail is dropped on reopen.
+
+  enum history_col : uint32_t
+  {
+    e_hist_slot,
+    e_hist_ts,
+    e_hist_bid,
+    e_hist_ask,
+    e_hist_bid_qty,
+    e_hist_ask_qty,
+    e_hist_price,
+    e_hist_conf,
+    e_hist_s2p,
+    e_hist_status,
+    e_hist_outcome,
+    e_hist_num_cols
+  };
+
+  // Publish outcome bits.
+  static const uint8_t HIST_SUBMITTED = 1;  // transaction sent this slot
+  static const uint8_t HIST_LANDED    = 2;  // an update landed
+  static const uint8_t HIST_DROPPED   = 4;  // an update expired
+  static const uint8_t HIST_FAILED    = 8;  // an update failed on chain
+
+  struct history_row
+  {
+    uint64_t slot_     = 0;
+    int64_t  ts_       = 0;  // ns
+    uint64_t bid_      = 0;  // QuoteLot/BaseLot
+    uint64_t ask_      = 0;
+    uint64_t bid_qty_  = 0;  // BaseLots
+    uint64_t ask_qty_  = 0;
+    int64_t  price_    = 0;  // pyth units
+    uint64_t conf_     = 0;
+    uint64_t s2p_      = 0;  // serum to pyth price multiplier
+    uint8_t  status_   = 0;  // 1 if trading
+    uint8_t  outcome_  = 0;  // HIST_* bits
+  };
+
+  static const uint64_t HIST_MAGIC     = 0x3130545349485053UL;  // SPHIST01
+  static const uint32_t HIST_BLK_MAGIC = 0x4b4c4253;            // SBLK
+  static const uint32_t HIST_VERSION   = 1;
+
+  struct history_file_hdr
+  {
+    uint64_t magic_;
+    uint32_t version_;
+    uint32_t num_cols_;
+    uint8_t  pyth_price_[32];
+    uint8_t  unused_[16];
+  };
+
+  struct history_block_hdr
+  {
+    uint32_t magic_;
+    uint32_t num_rows_;
+    uint64_t first_slot_;
+    uint64_t last_slot_;
+    int64_t  first_ts_;
+    int64_t  last_ts_;
+    uint32_t col_size_[ e_hist_num_cols ];  // compressed bytes
+    uint32_t unused_;
+  };
+
+  // Width in bytes of a decoded column value.
+  size_t get_col_width( history_col );
+
+  // Writes one file per market per day. Full blocks are compressed and
+  // appended on a background thread, opening the file for each block, so
+  // neither the caller nor the descriptor limit scales with the number of
+  // markets. Each market's first block of a day is shortened by an offset
+  // of its own, so markets don't all fill their blocks in the same slot.
+  class history_writer
+  {
+  public:
+
+    history_writer();
+    ~history_writer();
+
+    void set_dir( const std::string& );
+
+    // Rows per block (default 4096) and zstd level (default 3). Call
+    // before adding markets.
+    void set_block_rows( uint32_t );
+    void set_level( int );
+
+    // Name is used for file names, e.g. the base58 price account key.
+    unsigned add_market( const std::string& name, const uint8_t *pyth_price );
+
+    // Buffer a row, queueing a block when full or the day changes.
+    // Returns false if a block failed to write since the last call.
+    bool add( unsigned idx, const history_row& );
+
+    // Write all buffered rows and wait for them. Returns false if any
+    // block failed.
+    bool flush();
+
+    const std::string& get_err_msg() const;
+
+  private:
+
+    struct market_log
+    {
+      std::string name_;
+      uint8_t     pyth_price_[32];
+      int64_t     day_   = -1;  // of rows_
+      uint32_t    limit_ = 0;   // rows in the current block
+      std::vector<history_row> rows_;
+    };
+
+    struct block_job
+    {
+      unsigned idx_;
+      int64_t  day_;
+      std::vector<history_row> rows_;
+    };
+
+    void queue_block( unsigned idx );
+    bool take_err();
+
+    // Writer thread.
+    void run();
+    bool write_block( const block_job& );
+    int open_file( unsigned idx, int64_t day, const std::string& path,
+                   const uint8_t *pyth_price );
+    void set_err( const std::string& );
+
+    std::string dir_;
+    std::string err_;
+    uint32_t    block_rows_;
+    int         level_;
+    std::vector<market_log> mkts_;
+
+    // Shared with the writer thread under mtx_.
+    std::mutex              mtx_;
+    std::condition_variable cv_;
+    std::condition_variable done_cv_;
+    std::thread             thrd_;
+    bool                    do_run_;
+    bool                    is_busy_;
+    std::vector<block_job>  pending_;
+    std::vector<std::vector<history_row>> spare_;
+    std::string             werr_;
+    std::atomic<bool>       has_err_;
+    bool                    is_failed_;
+
+    // Writer thread only.
+    void       *cctx_;
+    std::vector<uint8_t> raw_;
+    std::vector<uint8_t> out_;
+    std::vector<int64_t> file_day_;  // day whose file tail was checked
+  };
+
+  // Block index entry.
+  struct history_block
+  {
+    uint64_t first_slot_;
+    uint64_t last_slot_;
+    int64_t  first_ts_;
+    int64_t  last_ts_;
+    uint32_t num_rows_;
+    size_t   offset_;  // of the block header
+  };
+
+  // Reads a history file through a read-only mapping.
+  class history_reader
+  {
+  public:
+
+    history_reader();
+    ~history_reader();
+
+    bool open( const std::string& path );
+    void close();
+
+    const uint8_t *get_pyth_price() const;
+    uint64_t get_num_rows() const;
+
+    size_t get_num_blocks() const;
+    const history_block& get_block( size_t ) const;
+
+    // First block ending at or after slot (or ts), get_num_blocks() if none.
+    size_t find_slot( uint64_t slot ) const;
+    size_t find_time( int64_t ts ) const;
+
+    // Decode one column of a block into little-endian values of
+    // get_col_width( col ) bytes each.
+    bool read_column( size_t blk, history_col, std::vector<uint8_t>& );
+
+    // Same, as values of type T where sizeof( T ) matches the column.
+    template<class T>
+    bool read_column( size_t blk, history_col, std::vector<T>& );
+
+    const std::string& get_err_msg() const;
+
+  private:
+
+    std::string err_;
+    uint8_t    *base_;
+    size_t      len_;
+    void       *dctx_;
+    uint64_t    num_rows_;
+    std::vector<history_block> blks_;
+    std::vector<uint8_t> raw_;
+  };
+
+  // Walk blocks from the file header, appending complete blocks to blks
+  // if not null. Returns the end offset of the last complete block, or 0
+  // if the header is invalid.
+  size_t scan_history(
+    const uint8_t *data,
+    size_t len,
+    std::vector<history_block> *blks
+  );
+
+  template<class T>
+  bool history_reader::read_column(
+    size_t blk,
+    history_col col,
+    std::vector<T>& out
+  ) {
+    if ( sizeof( T ) != get_col_width( col ) ) {
+      err_ = "column width mismatch";
+      return false;
+    }
+    if ( !read_column( blk, col, raw_ ) ) {
+      return false;
+    }
+    out.resize( raw_.size() / sizeof( T ) );
+    if ( !raw_.empty() ) {
+      std::memcpy( out.data(), raw_.data(), raw_.size() );
+    }
+    return true;
+  }
+
+}
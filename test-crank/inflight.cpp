@@ -0,0 +1,346 @@
+#include "inflight.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace sp;
+
+// Signatures are uniformly distributed.
+size_t tx_sig_hash::operator()( const tx_sig& sig ) const
+{
+  size_t h;
+  std::memcpy( &h, sig.data(), sizeof( h ) );
+  return h;
+}
+
+inflight_sub::~inflight_sub()
+{
+}
+
+void inflight_sub::on_resend( unsigned, const uint8_t *, size_t )
+{
+}
+
+void inflight_sub::on_done( unsigned, const tx_sig&, tx_outcome, uint64_t )
+{
+}
+
+inflight::inflight()
+: sub_( nullptr ),
+  max_per_mkt_( 1 ),
+  valid_slots_( TX_VALID_SLOTS ),
+  retry_slots_( 2 ),
+  max_retries_( 3 ),
+  slot_( 0 ),
+  num_submitted_( 0 ),
+  num_resent_( 0 ),
+  num_landed_( 0 ),
+  num_failed_( 0 ),
+  num_expired_( 0 )
+{
+}
+
+void inflight::set_sub( inflight_sub *sub )
+{
+  sub_ = sub;
+}
+
+void inflight::set_max_per_market( unsigned max_per_mkt )
+{
+  max_per_mkt_ = max_per_mkt;
+}
+
+void inflight::set_valid_slots( uint64_t slots )
+{
+  valid_slots_ = std::max( slots, TX_VALID_SLOTS );
+}
+
+void inflight::set_retry_slots( uint64_t slots )
+{
+  retry_slots_ = slots;
+}
+
+void inflight::set_max_retries( unsigned retries )
+{
+  max_retries_ = retries;
+}
+
+void inflight::add_market()
+{
+  num_per_mkt_.push_back( 0 );
+
+  // grow the shared pool, new entries taken lowest index first
+  const uint32_t first = ( uint32_t )txs_.size();
+  txs_.resize( txs_.size() + max_per_mkt_ );
+  for ( uint32_t i = ( uint32_t )txs_.size(); i-- != first; ) {
+    free_.push_back( i );
+  }
+  live_.reserve( txs_.size() );
+  rehash();
+}
+
+bool inflight::can_submit( unsigned mkt ) const
+{
+  return num_per_mkt_[ mkt ] < max_per_mkt_;
+}
+
+void inflight::on_submit(
+  unsigned mkt,
+  const uint8_t *buf,
+  size_t len,
+  uint64_t slot
+) {
+  on_submit( &mkt, 1, 0, buf, len, slot );
+}
+
+void inflight::on_submit(
+  const unsigned *mkts,
+  size_t num,
+  unsigned first_ix,
+  const uint8_t *buf,
+  size_t len,
+  uint64_t slot
+) {
+  // Signatures section: compact-u16 count (1 byte) then signatures.
+  if ( len < 1 + sizeof( tx_sig ) || len > TX_MAX_SIZE
+    || num == 0 || num > TX_MAX_MARKETS || free_.empty() ) {
+    return;
+  }
+  tx_sig sig;
+  std::memcpy( sig.data(), buf + 1, sizeof( sig ) );
+  if ( find( sig ) != NONE ) {
+    return; // duplicate
+  }
+  const uint32_t idx = free_.back();
+  free_.pop_back();
+  entry& tx = txs_[ idx ];
+  tx.sig_ = sig;
+  std::copy( mkts, mkts + num, tx.mkts_ );
+  tx.num_mkts_ = ( unsigned )num;
+  tx.first_ix_ = first_ix;
+  tx.sent_slot_ = slot;
+  tx.last_slot_ = slot;
+  tx.retries_ = 0;
+  tx.len_ = len;
+  std::memcpy( tx.buf_, buf, len );
+  tx.live_pos_ = ( uint32_t )live_.size();
+  live_.push_back( idx );
+  insert( idx );
+  for ( size_t i = 0; i != num; ++i ) {
+    ++num_per_mkt_[ mkts[ i ] ];
+  }
+  ++num_submitted_;
+}
+
+void inflight::on_pub_slot( unsigned mkt, uint64_t pub_slot )
+{
+  uint32_t oldest = NONE;
+  for ( const uint32_t idx : live_ ) {
+    const entry& tx = txs_[ idx ];
+    if ( tx.has_market( mkt ) && tx.sent_slot_ <= pub_slot && (
+        oldest == NONE || tx.sent_slot_ < txs_[ oldest ].sent_slot_ ) ) {
+      oldest = idx;
+    }
+  }
+  if ( oldest != NONE ) {
+    remove( oldest, tx_outcome::landed );
+  }
+}
+
+void inflight::on_confirm( const tx_sig& sig, bool landed )
+{
+  const uint32_t idx = find( sig );
+  if ( idx != NONE ) {
+    remove( idx, landed ? tx_outcome::landed : tx_outcome::failed );
+  }
+}
+
+void inflight::on_slot( uint64_t slot )
+{
+  if ( slot <= slot_ ) {
+    return;
+  }
+  slot_ = slot;
+  for ( size_t i = 0; i < live_.size(); ) {
+    entry& tx = txs_[ live_[ i ] ];
+    if ( slot >= tx.sent_slot_ + valid_slots_ ) {
+      remove( live_[ i ], tx_outcome::expired );
+      continue; // i now holds the last entry
+    }
+    if ( tx.retries_ < max_retries_ && slot >= tx.last_slot_ + retry_slots_ ) {
+      ++tx.retries_;
+      ++num_resent_;
+      tx.last_slot_ = slot;
+      if ( sub_ ) {
+        sub_->on_resend( tx.mkts_[ 0 ], tx.buf_, tx.len_ );
+      }
+    }
+    ++i;
+  }
+}
+
+unsigned inflight::get_num_inflight( unsigned mkt ) const
+{
+  return num_per_mkt_[ mkt ];
+}
+
+void inflight::get_sigs( std::vector<tx_sig>& sigs, size_t max ) const
+{
+  sigs.clear();
+  for ( const uint32_t idx : live_ ) {
+    if ( sigs.size() == max ) {
+      break;
+    }
+    sigs.push_back( txs_[ idx ].sig_ );
+  }
+}
+
+bool inflight::get_market( const tx_sig& sig, unsigned& mkt ) const
+{
+  const uint32_t idx = find( sig );
+  if ( idx == NONE ) {
+    return false;
+  }
+  mkt = txs_[ idx ].mkts_[ 0 ];
+  return true;
+}
+
+bool inflight::get_market( const tx_sig& sig, uint32_t ix, unsigned& mkt ) const
+{
+  const uint32_t idx = find( sig );
+  if ( idx == NONE ) {
+    return false;
+  }
+  const entry& tx = txs_[ idx ];
+  if ( ix < tx.first_ix_ || ix - tx.first_ix_ >= tx.num_mkts_ ) {
+    return false;
+  }
+  mkt = tx.mkts_[ ix - tx.first_ix_ ];
+  return true;
+}
+
+bool inflight::entry::has_market( unsigned mkt ) const
+{
+  return std::find( mkts_, mkts_ + num_mkts_, mkt ) != mkts_ + num_mkts_;
+}
+
+uint64_t inflight::get_num_submitted() const
+{
+  return num_submitted_;
+}
+
+uint64_t inflight::get_num_resent() const
+{
+  return num_resent_;
+}
+
+uint64_t inflight::get_num_landed() const
+{
+  return num_landed_;
+}
+
+uint64_t inflight::get_num_failed() const
+{
+  return num_failed_;
+}
+
+uint64_t inflight::get_num_expired() const
+{
+  return num_expired_;
+}
+
+// Swap-remove from the live list and return the entry to its slab.
+void inflight::remove( uint32_t idx, tx_outcome outcome )
+{
+  const entry& tx = txs_[ idx ];
+  unsigned mkts[ TX_MAX_MARKETS ];
+  const unsigned num = tx.num_mkts_;
+  std::copy( tx.mkts_, tx.mkts_ + num, mkts );
+  const uint64_t sent = tx.sent_slot_;
+  const tx_sig sig = tx.sig_;
+  erase( sig );
+  const uint32_t last = live_.back();
+  live_[ tx.live_pos_ ] = last;
+  txs_[ last ].live_pos_ = tx.live_pos_;
+  live_.pop_back();
+  free_.push_back( idx );
+  for ( unsigned i = 0; i != num; ++i ) {
+    --num_per_mkt_[ mkts[ i ] ];
+  }
+  switch ( outcome ) {
+    case tx_outcome::landed: ++num_landed_; break;
+    case tx_outcome::failed: ++num_failed_; break;
+    case tx_outcome::expired: ++num_expired_; break;
+  }
+  if ( sub_ ) {
+    for ( unsigned i = 0; i != num; ++i ) {
+      sub_->on_done( mkts[ i ], sig, outcome, slot_ > sent ? slot_ - sent : 0 );
+    }
+  }
+}
+
+uint32_t inflight::find( const tx_sig& sig ) const
+{
+  if ( index_.empty() ) {
+    return NONE;
+  }
+  const size_t mask = index_.size() - 1;
+  for ( size_t i = tx_sig_hash()( sig ) & mask; ; i = ( i + 1 ) & mask ) {
+    const uint32_t idx = index_[ i ];
+    if ( idx == NONE || txs_[ idx ].sig_ == sig ) {
+      return idx;
+    }
+  }
+}
+
+void inflight::insert( uint32_t idx )
+{
+  const size_t mask = index_.size() - 1;
+  size_t i = tx_sig_hash()( txs_[ idx ].sig_ ) & mask;
+  while ( index_[ i ] != NONE ) {
+    i = ( i + 1 ) & mask;
+  }
+  index_[ i ] = idx;
+}
+
+// Backward-shift deletion: no tombstones, so lookups stay short.
+void inflight::erase( const tx_sig& sig )
+{
+  const size_t mask = index_.size() - 1;
+  size_t i = tx_sig_hash()( sig ) & mask;
+  for ( ; index_[ i ] != NONE; i = ( i + 1 ) & mask ) {
+    if ( txs_[ index_[ i ] ].sig_ == sig ) {
+      break;
+    }
+  }
+  if ( index_[ i ] == NONE ) {
+    return;
+  }
+  index_[ i ] = NONE;
+  for ( size_t j = ( i + 1 ) & mask; index_[ j ] != NONE; j = ( j + 1 ) & mask ) {
+    // entries whose home slot lies cyclically in (i, j] stay put
+    const size_t k = tx_sig_hash()( txs_[ index_[ j ] ].sig_ ) & mask;
+    const bool stays = i <= j ? ( i < k && k <= j ) : ( i < k || k <= j );
+    if ( !stays ) {
+      index_[ i ] = index_[ j ];
+      index_[ j ] = NONE;
+      i = j;
+    }
+  }
+}
+
+// At most half full, grown while markets are added.
+void inflight::rehash()
+{
+  size_t size = 16;
+  while ( size < 2 * txs_.size() ) {
+    size <<= 1;
+  }
+  if ( size == index_.size() ) {
+    return;
+  }
+  index_.assign( size, NONE );
+  for ( const uint32_t idx : live_ ) {
+    insert( idx );
+  }
+}
@@ -0,0 +1,170 @@
+#pragma once
+
+#include "tx_limits.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace sp
+{
+
+  // Transaction signature (first signature in the transaction).
+  typedef std::array<uint8_t, 64> tx_sig;
+
+  struct tx_sig_hash
+  {
+    size_t operator()( const tx_sig& ) const;
+  };
+
+  // How a transaction left the in-flight table: landed, executed but
+  // failed, or never seen before its blockhash expired.
+  enum class tx_outcome { landed, failed, expired };
+
+  // In-flight table callbacks.
+  class inflight_sub
+  {
+  public:
+    virtual ~inflight_sub();
+
+    // Rebroadcast the same signed transaction.
+    virtual void on_resend( unsigned mkt, const uint8_t *buf, size_t len );
+
+    // A transaction for mkt is done, slots after submission.
+    virtual void on_done(
+      unsigned mkt, const tx_sig&, tx_outcome, uint64_t slots
+    );
+  };
+
+  // Tracks submitted transactions by signature and by market (i.e. pyth
+  // price account) until they land or their blockhash expires.
+  // Unconfirmed transactions are rebroadcast a bounded number of times,
+  // and the number in flight per price account is capped.
+  //
+  // Entries, each holding a copy of its transaction, come from one pool
+  // with a shared free list. Each market grows the pool by max-per-market
+  // entries, and a transaction takes any free entry whatever its
+  // markets. The signature index is an open addressing table sized for
+  // the whole pool, so nothing is allocated once the markets are added.
+  class inflight
+  {
+  public:
+
+    inflight();
+
+    void set_sub( inflight_sub * );
+
+    // Max transactions in flight per market (default 1). Call before
+    // adding markets.
+    void set_max_per_market( unsigned );
+
+    // Slots after submission before a transaction counts as expired
+    // (default and minimum TX_VALID_SLOTS). Its blockhash is no newer
+    // than the submission, so it can't land after that; expiring it any
+    // sooner would free its markets for a duplicate while it still can.
+    void set_valid_slots( uint64_t );
+
+    // Slots between rebroadcasts, and max rebroadcasts per transaction.
+    void set_retry_slots( uint64_t );
+    void set_max_retries( unsigned );
+
+    void add_market();
+
+    // Whether another transaction for mkt may be submitted.
+    bool can_submit( unsigned mkt ) const;
+
+    // Record a signed transaction submitted at slot.
+    void on_submit(
+      unsigned mkt, const uint8_t *buf, size_t len, uint64_t slot
+    );
+
+    // Record one publishing several markets (up to TX_MAX_MARKETS), whose
+    // serum-pyth instructions start at instruction index first_ix. It
+    // lands or expires as a whole.
+    void on_submit(
+      const unsigned *mkts,
+      size_t num,
+      unsigned first_ix,
+      const uint8_t *buf,
+      size_t len,
+      uint64_t slot
+    );
+
+    // Our component's pub_slot_ in the price account advanced: the oldest
+    // transaction for mkt submitted at or before pub_slot landed.
+    void on_pub_slot( unsigned mkt, uint64_t pub_slot );
+
+    // A transaction was confirmed by signature, having executed
+    // successfully (landed) or with an error.
+    void on_confirm( const tx_sig&, bool landed );
+
+    // Rebroadcast or expire transactions as the cluster advances.
+    void on_slot( uint64_t slot );
+
+    unsigned get_num_inflight( unsigned mkt ) const;
+
+    // Up to max signatures in flight.
+    void get_sigs( std::vector<tx_sig>&, size_t max ) const;
+
+    // Market of an in-flight signature (the first, if several).
+    bool get_market( const tx_sig&, unsigned& mkt ) const;
+
+    // Market whose serum-pyth instruction is ix, e.g. the one that
+    // failed. False if sig isn't in flight or ix is none of them.
+    bool get_market( const tx_sig&, uint32_t ix, unsigned& mkt ) const;
+
+    // Totals for land-rate reporting.
+    uint64_t get_num_submitted() const;
+    uint64_t get_num_resent() const;
+    uint64_t get_num_landed() const;
+    uint64_t get_num_failed() const;
+    uint64_t get_num_expired() const;
+
+  private:
+
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    struct entry
+    {
+      bool has_market( unsigned ) const;
+
+      tx_sig   sig_;
+      unsigned mkts_[ TX_MAX_MARKETS ];  // in instruction order
+      unsigned num_mkts_;
+      unsigned first_ix_;
+      uint64_t sent_slot_;
+      uint64_t last_slot_;
+      unsigned retries_;
+      uint32_t live_pos_;  // position in live_
+      size_t   len_;
+      uint8_t  buf_[ TX_MAX_SIZE ];
+    };
+
+    void remove( uint32_t idx, tx_outcome );
+
+    // Signature index: entry of sig, or NONE.
+    uint32_t find( const tx_sig& ) const;
+    void insert( uint32_t idx );
+    void erase( const tx_sig& );
+    void rehash();
+
+    inflight_sub *sub_;
+    unsigned      max_per_mkt_;
+    uint64_t      valid_slots_;
+    uint64_t      retry_slots_;
+    unsigned      max_retries_;
+    uint64_t      slot_;
+    std::vector<entry>    txs_;    // pool, max_per_mkt_ per market
+    std::vector<uint32_t> free_;   // unused entries, shared
+    std::vector<uint32_t> live_;   // entries in flight
+    std::vector<uint32_t> index_;  // by signature hash, linear probing
+    std::vector<unsigned> num_per_mkt_;
+    uint64_t      num_submitted_;
+    uint64_t      num_resent_;
+    uint64_t      num_landed_;
+    uint64_t      num_failed_;
+    uint64_t      num_expired_;
+  };
+
+}
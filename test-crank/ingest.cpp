@@ -0,0 +1,348 @@
+#include "ingest.hpp"
+
+#include <pc/log.hpp>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+using namespace sp;
+
+// Bytes read per poll before yielding to the event loop.
+static const size_t READ_BATCH = 4UL << 20;
+
+// Initial buffer; grows to the largest record.
+static const size_t INIT_BUF = 1UL << 20;
+
+// Base64 of the largest account plus the rest of the notification.
+static const size_t JSON_MAX_LINE = UPDATE_MAX_DATA / 3 * 4 + ( 64UL << 10 );
+
+static const int64_t RETRY_WAIT = 1000000000L;
+
+account_sink::~account_sink()
+{
+}
+
+account_source::~account_source()
+{
+}
+
+fd_source::fd_source()
+: fd_( -1 ),
+  is_err_( false ),
+  buf_( INIT_BUF ),
+  head_( 0 ),
+  tail_( 0 ),
+  num_updates_( 0 ),
+  json_( false ),
+  json_version_( 0 ),
+  num_skipped_( 0 )
+{
+}
+
+fd_source::~fd_source()
+{
+  close();
+}
+
+bool fd_source::get_is_err() const
+{
+  return is_err_;
+}
+
+const std::string& fd_source::get_err_msg() const
+{
+  return err_msg_;
+}
+
+uint64_t fd_source::get_num_updates() const
+{
+  return num_updates_;
+}
+
+uint64_t fd_source::get_num_skipped() const
+{
+  return num_skipped_;
+}
+
+void fd_source::set_json( bool json )
+{
+  json_ = json;
+}
+
+void fd_source::close()
+{
+  if ( fd_ >= 0 ) {
+    ::close( fd_ );
+    fd_ = -1;
+  }
+  head_ = tail_ = 0;
+}
+
+fd_source::read_status fd_source::read_updates( account_sink& sink, size_t& num )
+{
+  num = 0;
+  for ( size_t total = 0; total < READ_BATCH; ) {
+    // Deliver complete records, then make room for the rest of the next.
+    if ( !( json_ ? deliver_lines( sink, num ) : deliver_records( sink, num ) ) ) {
+      is_err_ = true;
+      return read_status::err;
+    }
+    if ( head_ == tail_ ) {
+      head_ = tail_ = 0;
+    }
+    else if ( tail_ == buf_.size() || head_ > buf_.size() / 2 ) {
+      std::memmove( &buf_[ 0 ], &buf_[ head_ ], tail_ - head_ );
+      tail_ -= head_;
+      head_ = 0;
+    }
+
+    const ssize_t len = ::read( fd_, &buf_[ tail_ ], buf_.size() - tail_ );
+    if ( len > 0 ) {
+      tail_ += ( size_t )len;
+      total += ( size_t )len;
+    }
+    else if ( len == 0 ) {
+      return read_status::eof;
+    }
+    else if ( errno == EAGAIN || errno == EWOULDBLOCK ) {
+      return read_status::again;
+    }
+    else if ( errno != EINTR ) {
+      err_msg_ = std::string( "read: " ) + std::strerror( errno );
+      return read_status::err;
+    }
+  }
+  return read_status::ok;
+}
+
+bool fd_source::deliver_records( account_sink& sink, size_t& num )
+{
+  while ( tail_ - head_ >= sizeof( update_hdr ) ) {
+    update_hdr hdr;
+    std::memcpy( &hdr, &buf_[ head_ ], sizeof( hdr ) );
+    if ( hdr.data_len_ > UPDATE_MAX_DATA ) {
+      err_msg_ = "account update too large";
+      return false;
+    }
+    const size_t len = sizeof( hdr ) + hdr.data_len_;
+    if ( tail_ - head_ < len ) {
+      if ( len > buf_.size() ) {
+        buf_.resize( len );
+      }
+      break;
+    }
+    account_update upd;
+    upd.key_ = &buf_[ head_ ];
+    upd.slot_ = hdr.slot_;
+    upd.write_version_ = hdr.write_version_;
+    upd.data_ = &buf_[ head_ + sizeof( hdr ) ];
+    upd.len_ = hdr.data_len_;
+    sink.on_update( upd );
+    head_ += len;
+    ++num;
+    ++num_updates_;
+  }
+  return true;
+}
+
+bool fd_source::deliver_lines( account_sink& sink, size_t& num )
+{
+  while ( head_ != tail_ ) {
+    const char *line = ( const char* )&buf_[ head_ ];
+    const char *eol = ( const char* )std::memchr( line, '\n', tail_ - head_ );
+    if ( !eol ) {
+      if ( tail_ - head_ == buf_.size() ) {
+        if ( buf_.size() >= JSON_MAX_LINE ) {
+          err_msg_ = "account notification too large";
+          return false;
+        }
+        buf_.resize( std::min( 2 * buf_.size(), JSON_MAX_LINE ) );
+      }
+      break;
+    }
+    const size_t len = ( size_t )( eol - line );
+    head_ += len + 1;
+    const notify_fields& f = decoder_.get_fields();
+    uint8_t key[ 32 ];
+    if ( !decoder_.decode( line, len ) || !f.pubkey_
+        || !base58_decode32( f.pubkey_, f.pubkey_len_, key ) ) {
+      ++num_skipped_;
+      continue;
+    }
+    // Notifications carry no write version; they arrive in order.
+    account_update upd;
+    upd.key_ = key;
+    upd.slot_ = f.slot_;
+    upd.write_version_ = ++json_version_;
+    upd.data_ = decoder_.get_data();
+    upd.len_ = decoder_.get_len();
+    sink.on_update( upd );
+    ++num;
+    ++num_updates_;
+  }
+  return true;
+}
+
+stream_source::stream_source()
+: retry_ts_( 0 )
+{
+}
+
+void stream_source::set_path( const std::string& path )
+{
+  path_ = path;
+}
+
+bool stream_source::get_is_connected() const
+{
+  return fd_ >= 0;
+}
+
+size_t stream_source::poll( account_sink& sink )
+{
+  if ( is_err_ || ( fd_ < 0 && !connect( pc::get_now() ) ) ) {
+    return 0;
+  }
+  size_t num;
+  const read_status st = read_updates( sink, num );
+  if ( st == read_status::eof || ( st == read_status::err && !is_err_ ) ) {
+    PC_LOG_ERR( "account stream disconnected" )
+      .add( "path", path_ )
+      .add( "error", st == read_status::eof ? "eof" : err_msg_ )
+      .end();
+    close();
+  }
+  return num;
+}
+
+bool stream_source::connect( int64_t now )
+{
+  if ( now < retry_ts_ ) {
+    return false;
+  }
+  retry_ts_ = now + RETRY_WAIT;
+  sockaddr_un addr;
+  std::memset( &addr, 0, sizeof( addr ) );
+  addr.sun_family = AF_UNIX;
+  if ( path_.size() >= sizeof( addr.sun_path ) ) {
+    err_msg_ = "socket path too long: " + path_;
+    is_err_ = true;
+    return false;
+  }
+  std::memcpy( addr.sun_path, path_.c_str(), path_.size() );
+  fd_ = ::socket( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+  if ( fd_ < 0 ) {
+    return false;
+  }
+  // A local connect completes or fails at once.
+  if ( ::connect( fd_, ( const sockaddr* )&addr, sizeof( addr ) ) != 0 ) {
+    close();
+    return false;
+  }
+  PC_LOG_INF( "account stream connected" ).add( "path", path_ ).end();
+  return true;
+}
+
+bool file_source::init( const std::string& path )
+{
+  fd_ = ::open( path.c_str(), O_RDONLY | O_CLOEXEC );
+  if ( fd_ < 0 ) {
+    err_msg_ = "open " + path + ": " + std::strerror( errno );
+    return false;
+  }
+  return true;
+}
+
+size_t file_source::poll( account_sink& sink )
+{
+  if ( is_done_ || is_err_ ) {
+    return 0;
+  }
+  size_t num;
+  const read_status st = read_updates( sink, num );
+  if ( st == read_status::err ) {
+    is_err_ = true;
+  }
+  else if ( st == read_status::eof ) {
+    is_done_ = true;
+    close();
+  }
+  return num;
+}
+
+bool file_source::get_is_done() const
+{
+  return is_done_;
+}
+
+bool account_router::key32::operator==( const key32& rhs ) const
+{
+  return std::memcmp( k_, rhs.k_, sizeof( k_ ) ) == 0;
+}
+
+// Keys are uniformly distributed.
+size_t account_router::key32_hash::operator()( const key32& key ) const
+{
+  size_t h;
+  std::memcpy( &h, key.k_, sizeof( h ) );
+  return h;
+}
+
+void account_router::add_market( market *mkt )
+{
+  add( mkt->get_serum_market(), mkt, market_acct::market );
+  add( mkt->get_spl_quote_mint(), mkt, market_acct::quote_mint );
+  add( mkt->get_spl_base_mint(), mkt, market_acct::base_mint );
+  add( mkt->get_serum_bids(), mkt, market_acct::bids );
+  add( mkt->get_serum_asks(), mkt, market_acct::asks );
+  add( mkt->get_pyth_price(), mkt, market_acct::price );
+}
+
+void account_router::add(
+  const pc::pub_key *key,
+  market *mkt,
+  market_acct acct
+) {
+  key32 k;
+  std::memcpy( k.k_, key->data(), sizeof( k.k_ ) );
+  routes_[ k ].targets_.push_back( target{ mkt, acct } );
+}
+
+void account_router::on_update( const account_update& upd )
+{
+  key32 k;
+  std::memcpy( k.k_, upd.key_, sizeof( k.k_ ) );
+  const auto it = routes_.find( k );
+  if ( it == routes_.end() ) {
+    ++num_unknown_;
+    return;
+  }
+  route& r = it->second;
+  if ( r.is_seen_ && ( upd.slot_ < r.slot_ || ( upd.slot_ == r.slot_
+      && upd.write_version_ <= r.write_version_ ) ) ) {
+    ++num_stale_;
+    return;
+  }
+  r.is_seen_ = true;
+  r.slot_ = upd.slot_;
+  r.write_version_ = upd.write_version_;
+  for ( const target& t : r.targets_ ) {
+    t.mkt_->on_update( t.acct_, upd.data_, upd.len_, upd.slot_ );
+  }
+}
+
+uint64_t account_router::get_num_stale() const
+{
+  return num_stale_;
+}
+
+uint64_t account_router::get_num_unknown() const
+{
+  return num_unknown_;
+}
@@ -0,0 +1,203 @@
+#pragma once
+
+#include "market.hpp"
+#include "notify.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace sp
+{
+
+  // Raw account updates from a local stream, e.g. fed by a validator
+  // plugin, in place of RPC websocket notifications. Each record is an
+  // update_hdr, host byte order, followed by data_len_ bytes of account
+  // data.
+  struct update_hdr
+  {
+    uint8_t  key_[ 32 ];
+    uint64_t slot_;
+    uint64_t write_version_;
+    uint32_t data_len_;
+    uint32_t reserved_;
+  };
+
+  // Largest account data accepted (solana's account size limit).
+  static const size_t UPDATE_MAX_DATA = 10UL << 20;
+
+  // One update; the pointers are only valid during the call.
+  struct account_update
+  {
+    const uint8_t *key_;
+    uint64_t       slot_;
+    uint64_t       write_version_;
+    const uint8_t *data_;
+    size_t         len_;
+  };
+
+  class account_sink
+  {
+  public:
+    virtual ~account_sink();
+    virtual void on_update( const account_update& ) = 0;
+  };
+
+  // A source of account updates, polled from the event loop.
+  class account_source
+  {
+  public:
+    virtual ~account_source();
+
+    // Deliver the updates available now, up to an internal batch limit.
+    // Returns the number delivered.
+    virtual size_t poll( account_sink& ) = 0;
+
+    // Whether the source failed for good, e.g. a malformed record.
+    virtual bool get_is_err() const = 0;
+    virtual const std::string& get_err_msg() const = 0;
+  };
+
+  // Parses records read from a non-blocking descriptor. The buffer
+  // grows to the largest record seen and is reused after that.
+  // Alternatively the stream is newline-delimited RPC programNotification
+  // messages, e.g. from a websocket relay, whose data is decoded in place
+  // by a notify_decoder.
+  class fd_source : public account_source
+  {
+  public:
+
+    fd_source();
+    ~fd_source();
+
+    bool get_is_err() const override;
+    const std::string& get_err_msg() const override;
+
+    // Read newline-delimited JSON notifications instead of records.
+    void set_json( bool );
+
+    uint64_t get_num_updates() const;
+
+    // JSON lines without a pubkey, slot or base64 data, e.g. replies to
+    // subscribe requests.
+    uint64_t get_num_skipped() const;
+
+  protected:
+
+    enum class read_status { ok, again, eof, err };
+
+    // Read what's available and deliver complete records.
+    read_status read_updates( account_sink&, size_t& num );
+    void close();
+
+    int         fd_;
+    bool        is_err_;
+    std::string err_msg_;
+
+  private:
+
+    bool deliver_records( account_sink&, size_t& num );
+    bool deliver_lines( account_sink&, size_t& num );
+
+    std::vector<uint8_t> buf_;
+    size_t      head_;
+    size_t      tail_;
+    uint64_t    num_updates_;
+    bool        json_;
+    uint64_t    json_version_;
+    uint64_t    num_skipped_;
+    notify_decoder decoder_;
+  };
+
+  // Client of a Unix-domain stream socket, reconnecting once a second
+  // while the feed is down.
+  class stream_source : public fd_source
+  {
+  public:
+
+    stream_source();
+
+    void set_path( const std::string& );
+
+    size_t poll( account_sink& ) override;
+
+    bool get_is_connected() const;
+
+  private:
+
+    bool connect( int64_t now );
+
+    std::string path_;
+    int64_t     retry_ts_;
+  };
+
+  // Replays a recorded stream from a file, as fast as it is polled, for
+  // tests and benchmarks. Done at end of file.
+  class file_source : public fd_source
+  {
+  public:
+
+    bool init( const std::string& path );
+
+    size_t poll( account_sink& ) override;
+
+    bool get_is_done() const;
+
+  private:
+
+    bool is_done_ = false;
+  };
+
+  // Routes updates by account key to the markets' decoders, dropping
+  // any not newer, by (slot, write version), than the last one routed
+  // for that account.
+  class account_router : public account_sink
+  {
+  public:
+
+    // Route the market's six accounts to it.
+    void add_market( market * );
+
+    void on_update( const account_update& ) override;
+
+    uint64_t get_num_stale() const;
+    uint64_t get_num_unknown() const;
+
+  private:
+
+    struct key32
+    {
+      uint8_t k_[ 32 ];
+      bool operator==( const key32& ) const;
+    };
+
+    struct key32_hash
+    {
+      size_t operator()( const key32& ) const;
+    };
+
+    struct target
+    {
+      market     *mkt_;
+      market_acct acct_;
+    };
+
+    // Mints and the like can be shared by several markets.
+    struct route
+    {
+      uint64_t    slot_ = 0;
+      uint64_t    write_version_ = 0;
+      bool        is_seen_ = false;
+      std::vector<target> targets_;
+    };
+
+    void add( const pc::pub_key *, market *, market_acct );
+
+    std::unordered_map<key32, route, key32_hash> routes_;
+    uint64_t num_stale_ = 0;
+    uint64_t num_unknown_ = 0;
+  };
+
+}
@@ -0,0 +1,198 @@
+#include "lease.hpp"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+using namespace sp;
+
+lease::~lease()
+{
+}
+
+file_lease::file_lease()
+: fd_( -1 )
+{
+  char host[ 256 ] = {};
+  ::gethostname( host, sizeof( host ) - 1 );
+  owner_ = std::string( host ) + ":" + std::to_string( ::getpid() );
+}
+
+file_lease::~file_lease()
+{
+  if ( fd_ >= 0 ) {
+    ::close( fd_ );
+  }
+}
+
+void file_lease::set_owner( const std::string& owner )
+{
+  owner_ = owner;
+}
+
+const std::string& file_lease::get_owner() const
+{
+  return owner_;
+}
+
+bool file_lease::init( const std::string& path )
+{
+  fd_ = ::open( path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644 );
+  if ( fd_ < 0 ) {
+    err_msg_ = "open " + path + ": " + std::strerror( errno );
+    return false;
+  }
+  return true;
+}
+
+bool file_lease::acquire( int64_t now, int64_t ttl, bool steal )
+{
+  if ( ::flock( fd_, LOCK_EX ) != 0 ) {
+    err_msg_ = std::string( "flock: " ) + std::strerror( errno );
+    return false;
+  }
+  std::string owner;
+  int64_t expiry;
+  bool is_held = read( owner, expiry );
+  if ( is_held ) {
+    holder_ = owner;
+    is_held = owner.empty() || owner == owner_ || expiry <= now || steal;
+    if ( is_held && write( owner_, now + ttl ) ) {
+      holder_ = owner_;
+    }
+    else {
+      is_held = false;
+    }
+  }
+  ::flock( fd_, LOCK_UN );
+  return is_held;
+}
+
+void file_lease::release()
+{
+  if ( ::flock( fd_, LOCK_EX ) != 0 ) {
+    return;
+  }
+  std::string owner;
+  int64_t expiry;
+  if ( read( owner, expiry ) && owner == owner_ ) {
+    write( std::string(), 0 );
+    holder_.clear();
+  }
+  ::flock( fd_, LOCK_UN );
+}
+
+const std::string& file_lease::get_holder() const
+{
+  return holder_;
+}
+
+const std::string& file_lease::get_err_msg() const
+{
+  return err_msg_;
+}
+
+// An empty or unparsable file is a free lease.
+bool file_lease::read( std::string& owner, int64_t& expiry )
+{
+  char buf[ 512 ];
+  const ssize_t len = ::pread( fd_, buf, sizeof( buf ) - 1, 0 );
+  if ( len < 0 ) {
+    err_msg_ = std::string( "read lease: " ) + std::strerror( errno );
+    return false;
+  }
+  buf[ len ] = '\0';
+  owner.clear();
+  expiry = 0;
+  const char *sep = std::strchr( buf, ' ' );
+  if ( sep ) {
+    owner.assign( buf, ( size_t )( sep - buf ) );
+    expiry = std::strtoll( sep + 1, nullptr, 10 );
+  }
+  return true;
+}
+
+bool file_lease::write( const std::string& owner, int64_t expiry )
+{
+  const std::string line = owner.empty() ? std::string() :
+    owner + " " + std::to_string( expiry ) + "\n";
+  if ( ::ftruncate( fd_, 0 ) != 0 || ::pwrite(
+      fd_, line.data(), line.size(), 0 ) != ( ssize_t )line.size() ) {
+    err_msg_ = std::string( "write lease: " ) + std::strerror( errno );
+    return false;
+  }
+  return true;
+}
+
+failover::failover()
+: lease_( nullptr ),
+  ttl_( 500000000L ),
+  renew_( 100000000L ),
+  stall_( 10000000000L ),
+  poll_ts_( 0 ),
+  landed_ts_( 0 ),
+  is_active_( false ),
+  num_takeovers_( 0 )
+{
+}
+
+void failover::set_lease( lease *ls )
+{
+  lease_ = ls;
+}
+
+void failover::set_ttl( int64_t ttl )
+{
+  ttl_ = ttl;
+}
+
+void failover::set_renew_interval( int64_t renew )
+{
+  renew_ = renew;
+}
+
+void failover::set_stall( int64_t stall )
+{
+  stall_ = stall;
+}
+
+bool failover::poll( int64_t now )
+{
+  if ( !lease_ || ( poll_ts_ && now - poll_ts_ < renew_ ) ) {
+    return false;
+  }
+  if ( !landed_ts_ ) {
+    landed_ts_ = now;
+  }
+  poll_ts_ = now;
+  const bool was_active = is_active_;
+  const bool steal = !is_active_ && stall_ && now - landed_ts_ > stall_;
+  is_active_ = lease_->acquire( now, ttl_, steal );
+  if ( steal && is_active_ ) {
+    ++num_takeovers_;
+  }
+  if ( steal || is_active_ != was_active ) {
+    // Give whoever now publishes a full stall period to land updates.
+    landed_ts_ = now;
+  }
+  return is_active_ != was_active;
+}
+
+void failover::on_landed( int64_t now )
+{
+  landed_ts_ = now;
+}
+
+bool failover::is_active() const
+{
+  return is_active_;
+}
+
+uint64_t failover::get_num_takeovers() const
+{
+  return num_takeovers_;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace sp
+{
+
+  // Exclusive, time-limited right to publish, shared by paired cranks.
+  class lease
+  {
+  public:
+    virtual ~lease();
+
+    // Take or extend the lease until now + ttl if it is free, expired or
+    // already ours, or regardless if steal. Returns whether we hold it.
+    virtual bool acquire( int64_t now, int64_t ttl, bool steal ) = 0;
+
+    // Give the lease up now if we hold it.
+    virtual void release() = 0;
+
+    // Holder seen by the last acquire().
+    virtual const std::string& get_holder() const = 0;
+  };
+
+  // Lease in a file on a filesystem both cranks share, e.g. the local
+  // one: "<owner> <expiry>\n", read and rewritten under flock(). Times
+  // are wall-clock nanoseconds, so hosts' clocks must agree to well
+  // within the ttl.
+  class file_lease : public lease
+  {
+  public:
+
+    file_lease();
+    ~file_lease();
+
+    // Our name in the file (default hostname:pid).
+    void set_owner( const std::string& );
+    const std::string& get_owner() const;
+
+    // Open or create the file.
+    bool init( const std::string& path );
+
+    bool acquire( int64_t now, int64_t ttl, bool steal ) override;
+    void release() override;
+    const std::string& get_holder() const override;
+
+    const std::string& get_err_msg() const;
+
+  private:
+
+    bool read( std::string& owner, int64_t& expiry );
+    bool write( const std::string& owner, int64_t expiry );
+
+    int         fd_;
+    std::string owner_;
+    std::string holder_;
+    std::string err_msg_;
+  };
+
+  // Active/passive coordination over a lease. The active crank renews
+  // it well within its ttl; the standby keeps its state warm and takes
+  // the lease when it lapses, or takes it over when none of our updates
+  // have landed for a while although the lease is held, e.g. because
+  // the active crank's transactions stopped reaching the leaders.
+  //
+  // Times are nanoseconds.
+  class failover
+  {
+  public:
+
+    failover();
+
+    void set_lease( lease * );
+
+    // Lease duration (default 500ms) and renewal period (default 100ms).
+    void set_ttl( int64_t );
+    void set_renew_interval( int64_t );
+
+    // Time without a landed update before the standby takes over
+    // (default 10s, 0 never).
+    void set_stall( int64_t );
+
+    // Renew or try to take the lease if due. Returns whether is_active()
+    // changed.
+    bool poll( int64_t now );
+
+    // An update from our publisher landed, whichever crank sent it.
+    void on_landed( int64_t now );
+
+    // Whether we hold the lease and should publish.
+    bool is_active() const;
+
+    uint64_t get_num_takeovers() const;
+
+  private:
+
+    lease   *lease_;
+    int64_t  ttl_;
+    int64_t  renew_;
+    int64_t  stall_;
+    int64_t  poll_ts_;
+    int64_t  landed_ts_;
+    bool     is_active_;
+    uint64_t num_takeovers_;
+  };
+
+}
@@ -0,0 +1,499 @@
+#include "lookup.hpp"
+
+#include <pc/log.hpp>
+
+#include <openssl/bn.h>
+#include <openssl/evp.h>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <memory>
+
+using namespace sp;
+
+static const char PDA_MARKER[] = "ProgramDerivedAddress";
+
+// solana_program::pubkey::MAX_SEEDS, MAX_SEED_LEN
+static const size_t MAX_SEEDS = 16;
+static const size_t MAX_SEED_LEN = 32;
+
+// LookupTableMeta fields after the u32 ProgramState discriminant.
+static const uint32_t ALT_STATE_TABLE = 1;
+static const size_t ALT_OFF_DEACTIVATION = 4;
+static const size_t ALT_OFF_LAST_SLOT = 12;
+static const size_t ALT_OFF_LAST_START = 20;
+
+size_t pub_key_hash::operator()( const pc::pub_key& key ) const
+{
+  size_t h;
+  std::memcpy( &h, key.data(), sizeof( h ) );
+  return h;
+}
+
+namespace
+{
+  struct bn_ctx_del
+  {
+    void operator()( BN_CTX *ctx ) const { BN_CTX_end( ctx ); BN_CTX_free( ctx ); }
+  };
+}
+
+// Whether 32 bytes decompress to an ed25519 point, as curve25519-dalek
+// decides it: x^2 = ( y^2 - 1 ) / ( d y^2 + 1 ) must have a root mod p.
+static bool is_on_curve( const uint8_t *pt )
+{
+  std::unique_ptr<BN_CTX, bn_ctx_del> ctx( BN_CTX_new() );
+  if ( !ctx ) {
+    return true; // no address rather than a wrong one
+  }
+  BN_CTX_start( ctx.get() );
+  BIGNUM *p = BN_CTX_get( ctx.get() );
+  BIGNUM *d = BN_CTX_get( ctx.get() );
+  BIGNUM *y = BN_CTX_get( ctx.get() );
+  BIGNUM *u = BN_CTX_get( ctx.get() );
+  BIGNUM *v = BN_CTX_get( ctx.get() );
+  BIGNUM *t = BN_CTX_get( ctx.get() );
+  if ( !t ) {
+    return true;
+  }
+
+  // p = 2^255 - 19, d = -121665 / 121666
+  BN_zero( p );
+  BN_set_bit( p, 255 );
+  BN_sub_word( p, 19 );
+  BN_set_word( t, 121666 );
+  BN_mod_inverse( t, t, p, ctx.get() );
+  BN_set_word( d, 121665 );
+  BN_mod_mul( d, d, t, p, ctx.get() );
+  BN_sub( d, p, d );
+
+  // y: little endian, sign bit of x cleared
+  uint8_t be[ 32 ];
+  for ( size_t i = 0; i != sizeof( be ); ++i ) {
+    be[ i ] = pt[ sizeof( be ) - 1 - i ];
+  }
+  be[ 0 ] &= 0x7f;
+  BN_bin2bn( be, sizeof( be ), y );
+  BN_nnmod( y, y, p, ctx.get() );
+
+  BN_mod_sqr( t, y, p, ctx.get() );           // y^2
+  BN_copy( u, t );
+  BN_sub_word( u, 1 );
+  BN_nnmod( u, u, p, ctx.get() );             // y^2 - 1
+  BN_mod_mul( v, d, t, p, ctx.get() );
+  BN_add_word( v, 1 );
+  BN_nnmod( v, v, p, ctx.get() );             // d y^2 + 1, never 0
+  BN_mod_inverse( v, v, p, ctx.get() );
+  BN_mod_mul( u, u, v, p, ctx.get() );        // x^2
+  if ( BN_is_zero( u ) ) {
+    return true;
+  }
+
+  // Euler's criterion: x^2 is a square iff x^2^((p-1)/2) == 1
+  BN_copy( t, p );
+  BN_sub_word( t, 1 );
+  BN_rshift1( t, t );
+  BN_mod_exp( v, u, t, p, ctx.get() );
+  return BN_is_one( v );
+}
+
+bool sp::find_program_address(
+  const std::vector<std::pair<const uint8_t*, size_t>>& seeds,
+  const pc::pub_key& program,
+  pc::pub_key& addr,
+  uint8_t& bump
+) {
+  uint8_t buf[ MAX_SEEDS * MAX_SEED_LEN + 1 + 32 + sizeof( PDA_MARKER ) ];
+  if ( seeds.size() >= MAX_SEEDS ) {
+    return false;
+  }
+  size_t len = 0;
+  for ( const auto& seed : seeds ) {
+    if ( seed.second > MAX_SEED_LEN ) {
+      return false;
+    }
+    std::memcpy( buf + len, seed.first, seed.second );
+    len += seed.second;
+  }
+  const size_t bump_pos = len++;
+  std::memcpy( buf + len, program.data(), 32 );
+  len += 32;
+  std::memcpy( buf + len, PDA_MARKER, sizeof( PDA_MARKER ) - 1 );
+  len += sizeof( PDA_MARKER ) - 1;
+
+  for ( unsigned b = 256; b-- > 0; ) {
+    buf[ bump_pos ] = ( uint8_t )b;
+    uint8_t hash[ EVP_MAX_MD_SIZE ];
+    unsigned hash_len;
+    if ( !EVP_Digest( buf, len, hash, &hash_len, EVP_sha256(), nullptr ) ) {
+      return false;
+    }
+    if ( !is_on_curve( hash ) ) {
+      addr.init_from_buf( hash );
+      bump = ( uint8_t )b;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool sp::get_lookup_table_address(
+  const pc::pub_key& authority,
+  uint64_t recent_slot,
+  const pc::pub_key& alt_prog,
+  pc::pub_key& addr,
+  uint8_t& bump
+) {
+  uint8_t slot[ sizeof( recent_slot ) ];
+  std::memcpy( slot, &recent_slot, sizeof( slot ) ); // little endian
+  return find_program_address(
+    { { authority.data(), 32 }, { slot, sizeof( slot ) } },
+    alt_prog, addr, bump
+  );
+}
+
+lookup_table::lookup_table()
+: valid_( false ),
+  last_slot_( 0 ),
+  last_start_( 0 ),
+  num_usable_( 0 )
+{
+}
+
+void lookup_table::set_address( const pc::pub_key& addr )
+{
+  addr_ = addr;
+}
+
+const pc::pub_key& lookup_table::get_address() const
+{
+  return addr_;
+}
+
+bool lookup_table::update( const uint8_t *data, size_t len, uint64_t slot )
+{
+  uint32_t state;
+  uint64_t deactivation;
+  valid_ = false;
+  if ( len < ALT_META_SIZE || ( len - ALT_META_SIZE ) % 32 != 0
+    || ( len - ALT_META_SIZE ) / 32 > ALT_MAX_KEYS ) {
+    return false;
+  }
+  std::memcpy( &state, data, sizeof( state ) );
+  std::memcpy( &deactivation, data + ALT_OFF_DEACTIVATION, sizeof( deactivation ) );
+  if ( state != ALT_STATE_TABLE
+    || deactivation != std::numeric_limits<uint64_t>::max() ) {
+    return false;
+  }
+  std::memcpy( &last_slot_, data + ALT_OFF_LAST_SLOT, sizeof( last_slot_ ) );
+  last_start_ = data[ ALT_OFF_LAST_START ];
+
+  const size_t num = ( len - ALT_META_SIZE ) / 32;
+  keys_.resize( num );
+  idx_.clear();
+  for ( size_t i = 0; i != num; ++i ) {
+    keys_[ i ].init_from_buf( data + ALT_META_SIZE + 32 * i );
+    idx_.emplace( keys_[ i ], ( uint8_t )i );
+    pending_.erase( keys_[ i ] );
+  }
+  valid_ = true;
+  num_usable_ = last_start_;
+  on_slot( slot );
+  return true;
+}
+
+void lookup_table::on_slot( uint64_t slot )
+{
+  if ( slot > last_slot_ ) {
+    num_usable_ = keys_.size();
+  }
+  for ( slot_map_t::iterator it = pending_.begin(); it != pending_.end(); ) {
+    if ( slot > it->second + ALT_RETRY_SLOTS ) {
+      it = pending_.erase( it );
+    }
+    else {
+      ++it;
+    }
+  }
+}
+
+bool lookup_table::get_is_valid() const
+{
+  return valid_;
+}
+
+size_t lookup_table::get_num_keys() const
+{
+  return keys_.size();
+}
+
+size_t lookup_table::get_num_pending() const
+{
+  return pending_.size();
+}
+
+bool lookup_table::find( const pc::pub_key& key, uint8_t& idx ) const
+{
+  key_map_t::const_iterator it = idx_.find( key );
+  if ( it == idx_.end() || it->second >= num_usable_ ) {
+    return false;
+  }
+  idx = it->second;
+  return true;
+}
+
+bool lookup_table::has( const pc::pub_key& key ) const
+{
+  return idx_.count( key ) || pending_.count( key );
+}
+
+void lookup_table::on_extend(
+  const pc::pub_key *keys,
+  size_t num,
+  uint64_t slot
+) {
+  for ( size_t i = 0; i != num; ++i ) {
+    pending_[ keys[ i ] ] = slot;
+  }
+}
+
+// Lengths over 127 take two bytes.
+static void add_compact_u16( pc::bincode& tx, size_t len )
+{
+  if ( len < 0x80 ) {
+    tx.add( ( uint8_t )len );
+  }
+  else {
+    tx.add( ( uint8_t )( ( len & 0x7f ) | 0x80 ) );
+    tx.add( ( uint8_t )( len >> 7 ) );
+  }
+}
+
+// Accounts: publisher (authority and payer), table, system program, then
+// the lookup table program.
+static void build_table_tx(
+  pc::bincode& tx,
+  const pc::key_pair& publisher,
+  const pc::hash& block_hash,
+  const pc::pub_key& alt_prog,
+  const pc::pub_key& sys_prog,
+  const pc::pub_key& table,
+  const uint8_t *data,
+  size_t len
+) {
+  tx.add_len<1>();
+  size_t pub_idx = tx.reserve_sign();
+  size_t tx_idx = tx.get_pos();
+  tx.add( (uint8_t)1 );
+  tx.add( (uint8_t)0 );
+  tx.add( (uint8_t)2 );
+  tx.add_len<4>();
+  tx.add( publisher );
+  tx.add( table );
+  tx.add( sys_prog );
+  tx.add( alt_prog );
+  tx.add( block_hash );
+  tx.add_len<1>();
+  tx.add( (uint8_t)3 );
+  tx.add_len<4>();
+  tx.add( (uint8_t)1 );   // table
+  tx.add( (uint8_t)0 );   // authority
+  tx.add( (uint8_t)0 );   // payer
+  tx.add( (uint8_t)2 );   // system program
+  add_compact_u16( tx, len );
+  tx.add( data, len );
+  tx.sign( pub_idx, tx_idx, publisher );
+}
+
+void sp::build_create_lookup_table(
+  pc::bincode& tx,
+  const pc::key_pair& publisher,
+  const pc::hash& block_hash,
+  const pc::pub_key& alt_prog,
+  const pc::pub_key& sys_prog,
+  uint64_t recent_slot,
+  pc::pub_key& table
+) {
+  pc::pub_key authority;
+  publisher.get_pub_key( authority );
+  uint8_t bump = 0;
+  get_lookup_table_address( authority, recent_slot, alt_prog, table, bump );
+
+  uint8_t data[ sizeof( ALT_CREATE ) + sizeof( recent_slot ) + 1 ];
+  std::memcpy( data, &ALT_CREATE, sizeof( ALT_CREATE ) );
+  std::memcpy( data + 4, &recent_slot, sizeof( recent_slot ) );
+  data[ 12 ] = bump;
+  build_table_tx(
+    tx, publisher, block_hash, alt_prog, sys_prog, table, data, sizeof( data )
+  );
+}
+
+void sp::build_extend_lookup_table(
+  pc::bincode& tx,
+  const pc::key_pair& publisher,
+  const pc::hash& block_hash,
+  const pc::pub_key& alt_prog,
+  const pc::pub_key& sys_prog,
+  const pc::pub_key& table,
+  const pc::pub_key *keys,
+  size_t num
+) {
+  uint8_t data[ sizeof( ALT_EXTEND ) + sizeof( uint64_t ) + ALT_EXTEND_MAX * 32 ];
+  if ( num > ALT_EXTEND_MAX ) {
+    num = ALT_EXTEND_MAX;
+  }
+  const uint64_t count = num;
+  std::memcpy( data, &ALT_EXTEND, sizeof( ALT_EXTEND ) );
+  std::memcpy( data + 4, &count, sizeof( count ) );
+  for ( size_t i = 0; i != num; ++i ) {
+    std::memcpy( data + 12 + 32 * i, keys[ i ].data(), 32 );
+  }
+  build_table_tx(
+    tx, publisher, block_hash, alt_prog, sys_prog, table, data, 12 + 32 * num
+  );
+}
+
+lookup_sync::lookup_sync()
+: has_addr_( false ),
+  is_created_( false ),
+  is_full_( false ),
+  sent_slot_( 0 )
+{
+  alt_prog_.init_from_text( std::string( "AddressLookupTab1e1111111111111111111111111" ) );
+  sys_prog_.init_from_text( std::string( "11111111111111111111111111111111" ) );
+}
+
+void lookup_sync::set_table( const pc::pub_key& addr )
+{
+  addr_ = addr;
+  has_addr_ = true;
+  table_.set_address( addr );
+}
+
+void lookup_sync::add_keys( const pc::pub_key *keys, size_t num )
+{
+  for ( size_t i = 0; i != num; ++i ) {
+    bool is_dup = false;
+    for ( const pc::pub_key& key : want_ ) {
+      is_dup = is_dup || key == keys[ i ];
+    }
+    if ( !is_dup ) {
+      want_.push_back( keys[ i ] );
+    }
+  }
+}
+
+const lookup_table *lookup_sync::get_table() const
+{
+  return &table_;
+}
+
+void lookup_sync::subscribe( pc::manager& mgr )
+{
+  if ( has_addr_ ) {
+    req_->set_account( &addr_ );
+    req_->set_sub( this );
+    mgr.get_rpc_client()->send( req_ );
+  }
+}
+
+size_t lookup_sync::poll( pc::manager& mgr, uint64_t slot, char *buf )
+{
+  table_.on_slot( slot );
+  if ( sent_slot_ && slot < sent_slot_ + 1 ) {
+    return 0;
+  }
+  const pc::hash *bhash = mgr.get_recent_block_hash();
+  const pc::key_pair *pkey = mgr.get_publish_key_pair();
+  if ( !bhash || !pkey || slot == 0 ) {
+    return 0;
+  }
+
+  // Our table never showed up: make another.
+  if ( is_created_ && !table_.get_is_valid()
+    && slot > sent_slot_ + ALT_RETRY_SLOTS ) {
+    has_addr_ = false;
+  }
+
+  pc::bincode tx;
+  tx.attach( buf );
+  if ( !has_addr_ ) {
+    // The recent slot must be in SlotHashes, i.e. already rooted enough.
+    build_create_lookup_table(
+      tx, *pkey, *bhash, alt_prog_, sys_prog_, slot - 1, addr_
+    );
+    std::string name;
+    addr_.enc_base58( name );
+    PC_LOG_INF( "creating lookup table" ).add( "address", name ).end();
+    table_ = lookup_table();
+    table_.set_address( addr_ );
+    has_addr_ = true;
+    is_created_ = true;
+    is_full_ = false;
+    sent_slot_ = slot;
+    subscribe( mgr );
+    return tx.size();
+  }
+  if ( !table_.get_is_valid() ) {
+    return 0;
+  }
+
+  pc::pub_key keys[ ALT_EXTEND_MAX ];
+  size_t num = 0;
+  // An extend still in flight takes room too, or the next one overfills
+  // the table and fails.
+  const size_t num_taken = table_.get_num_keys() + table_.get_num_pending();
+  const size_t room = ALT_MAX_KEYS - std::min( num_taken, ALT_MAX_KEYS );
+  for ( size_t i = 0; i != want_.size() && num != ALT_EXTEND_MAX && num != room; ++i ) {
+    if ( !table_.has( want_[ i ] ) ) {
+      keys[ num++ ] = want_[ i ];
+    }
+  }
+  if ( !room && !is_full_ ) {
+    size_t num_left = 0;
+    for ( const pc::pub_key& key : want_ ) {
+      num_left += !table_.has( key );
+    }
+    if ( num_left ) {
+      PC_LOG_ERR( "lookup table full, accounts stay in the message" )
+        .add( "max_keys", (uint64_t)ALT_MAX_KEYS )
+        .add( "num_left", (uint64_t)num_left )
+        .end();
+      is_full_ = true;
+    }
+  }
+  if ( !num ) {
+    return 0;
+  }
+  build_extend_lookup_table(
+    tx, *pkey, *bhash, alt_prog_, sys_prog_, addr_, keys, num
+  );
+  table_.on_extend( keys, num, slot );
+  sent_slot_ = slot;
+  return tx.size();
+}
+
+void lookup_sync::on_response( pc::rpc::account_subscribe *res )
+{
+  if ( res->get_is_err() ) {
+    PC_LOG_ERR( "lookup table subscription error" )
+      .add( "error", res->get_err_msg() )
+      .end();
+    return;
+  }
+  const uint8_t *data;
+  const size_t len = res->get_data( data );
+  const bool was_valid = table_.get_is_valid();
+  if ( !table_.update( data, len, res->get_slot() ) ) {
+    if ( was_valid ) {
+      PC_LOG_ERR( "invalid or deactivated lookup table" ).end();
+    }
+    return;
+  }
+  if ( !was_valid ) {
+    PC_LOG_INF( "lookup table ready" )
+      .add( "keys", ( uint64_t )table_.get_num_keys() )
+      .end();
+  }
+}
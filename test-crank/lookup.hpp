@@ -0,0 +1,170 @@
+#pragma once
+
+#include <pc/bincode.hpp>
+#include <pc/manager.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace sp
+{
+
+  // Address lookup table program (AddressLookupTab1e1111111111111111111111111)
+  // instruction discriminators, bincode u32.
+  static const uint32_t ALT_CREATE = 0;  // u64 recent_slot, u8 bump
+  static const uint32_t ALT_EXTEND = 2;  // u64 count, keys
+
+  // Table account: 56-byte LookupTableMeta, then keys.
+  static const size_t ALT_META_SIZE = 56;
+  static const size_t ALT_MAX_KEYS = 256;
+
+  // Keys per ExtendLookupTable transaction that fit in a packet.
+  static const size_t ALT_EXTEND_MAX = 30;
+
+  // Slots before a create or extend that didn't show up is sent again,
+  // past its blockhash's validity.
+  static const uint64_t ALT_RETRY_SLOTS = 150;
+
+  struct pub_key_hash
+  {
+    size_t operator()( const pc::pub_key& ) const;
+  };
+
+  // Program derived address of seeds: the first SHA-256 of seeds, bump,
+  // program and "ProgramDerivedAddress" that is off the ed25519 curve,
+  // trying bumps from 255 down. False if none is.
+  bool find_program_address(
+    const std::vector<std::pair<const uint8_t*, size_t>>& seeds,
+    const pc::pub_key& program,
+    pc::pub_key& addr,
+    uint8_t& bump
+  );
+
+  // Contents of an address lookup table account, kept current through
+  // an account subscription. Keys appended in a slot become usable in
+  // the next one.
+  class lookup_table
+  {
+  public:
+
+    lookup_table();
+
+    void set_address( const pc::pub_key& );
+    const pc::pub_key& get_address() const;
+
+    // Account data as of slot. False if it isn't a live lookup table.
+    bool update( const uint8_t *data, size_t len, uint64_t slot );
+
+    // Make keys extended in an earlier slot usable, and forget extends
+    // that should have landed by now.
+    void on_slot( uint64_t slot );
+
+    bool get_is_valid() const;
+    size_t get_num_keys() const;
+
+    // Keys sent to be appended that aren't in the table yet.
+    size_t get_num_pending() const;
+
+    // Table index of key, if usable.
+    bool find( const pc::pub_key&, uint8_t& idx ) const;
+
+    // Whether key is in the table or was recently sent to be appended.
+    bool has( const pc::pub_key& ) const;
+
+    // Remember keys sent to be appended at slot, so they are not sent
+    // twice.
+    void on_extend( const pc::pub_key *keys, size_t num, uint64_t slot );
+
+  private:
+
+    typedef std::unordered_map<pc::pub_key, uint8_t, pub_key_hash> key_map_t;
+    typedef std::unordered_map<pc::pub_key, uint64_t, pub_key_hash> slot_map_t;
+
+    pc::pub_key addr_;
+    bool        valid_;
+    uint64_t    last_slot_;     // LookupTableMeta::last_extended_slot
+    size_t      last_start_;    // ...last_extended_slot_start_index
+    size_t      num_usable_;
+    std::vector<pc::pub_key> keys_;
+    key_map_t   idx_;
+    slot_map_t  pending_;       // slot each key was sent
+  };
+
+  // Address of the table CreateLookupTable makes for authority at
+  // recent_slot.
+  bool get_lookup_table_address(
+    const pc::pub_key& authority,
+    uint64_t recent_slot,
+    const pc::pub_key& alt_prog,
+    pc::pub_key& addr,
+    uint8_t& bump
+  );
+
+  // Legacy transactions managing a table whose authority and payer is
+  // the publisher.
+  void build_create_lookup_table(
+    pc::bincode&,
+    const pc::key_pair& publisher,
+    const pc::hash& block_hash,
+    const pc::pub_key& alt_prog,
+    const pc::pub_key& sys_prog,
+    uint64_t recent_slot,
+    pc::pub_key& table
+  );
+
+  void build_extend_lookup_table(
+    pc::bincode&,
+    const pc::key_pair& publisher,
+    const pc::hash& block_hash,
+    const pc::pub_key& alt_prog,
+    const pc::pub_key& sys_prog,
+    const pc::pub_key& table,
+    const pc::pub_key *keys,
+    size_t num
+  );
+
+  // Keeps an address lookup table holding every market's keys: creates
+  // one if given no address, follows it through an account subscription
+  // and appends the keys it's missing, one transaction per slot. There is
+  // one table, so past ALT_MAX_KEYS keys the rest stay in the message,
+  // which is logged once.
+  class lookup_sync : public pc::rpc_sub_i<pc::rpc::account_subscribe>
+  {
+  public:
+
+    lookup_sync();
+
+    // Use an existing table, with the publisher as authority.
+    void set_table( const pc::pub_key& );
+
+    // Keys the table should hold.
+    void add_keys( const pc::pub_key *keys, size_t num );
+
+    const lookup_table *get_table() const;
+
+    // (Re)subscribe to the table, once it has an address.
+    void subscribe( pc::manager& );
+
+    // A create or extend transaction, if one is due: returns its length
+    // (at most TX_MAX_SIZE) or 0.
+    size_t poll( pc::manager&, uint64_t slot, char *buf );
+
+    void on_response( pc::rpc::account_subscribe * ) override;
+
+  private:
+
+    pc::pub_key  alt_prog_;
+    pc::pub_key  sys_prog_;
+    pc::pub_key  addr_;
+    bool         has_addr_;
+    bool         is_created_;   // by us, so retry if it never shows up
+    bool         is_full_;      // and logged
+    uint64_t     sent_slot_;
+    std::vector<pc::pub_key> want_;
+    lookup_table table_;
+    pc::rpc::account_subscribe req_[1];
+  };
+
+}
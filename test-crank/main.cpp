@@ -1,9 +1,41 @@
-#include <pc/bincode.hpp>
 #include <pc/log.hpp>
 #include <pc/manager.hpp>
+#include <serum-pyth/serum-pyth.h>
+#include <serum-pyth/sp-error.h>
 
+#include "alloc_check.hpp"
+#include "breaker.hpp"
+#include "budget.hpp"
+#include "file_watch.hpp"
+#include "history.hpp"
+#include "inflight.hpp"
+#include "ingest.hpp"
+#include "lease.hpp"
+#include "lookup.hpp"
+#include "market.hpp"
+#include "packer.hpp"
+#include "presigner.hpp"
+#include "scheduler.hpp"
+#include "serum_pyth.hpp"
+#include "shard.hpp"
+#include "shm_feed.hpp"
+#include "sig_status.hpp"
+#include "slot_clock.hpp"
+#include "tpu_sender.hpp"
+
+#include <algorithm>
 #include <csignal>
+#include <cstring>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
 
 bool do_run = true;
 void sig_handle( int )
@@ -11,113 +43,631 @@ void sig_handle( int )
   do_run = false;
 }
 
-class tx_wtr : public pc::net_wtr
+// Serum markets and the pyth price accounts they publish to.
+struct market_cfg
 {
-public:
-  void init( pc::bincode& tx ) {
-    tx.attach( hd_->buf_ );
-    tx.add( (uint16_t)PC_TPU_PROTO_ID );
-    tx.add( (uint16_t)0 );
-  }
-  void commit( pc::bincode& tx ) {
-    pc::tx_hdr *hdr = (pc::tx_hdr*)hd_->buf_;
-    hd_->size_ = tx.size();
-    hdr->size_ = tx.size();
+  std::string serum_market_;
+  std::string serum_bids_;
+  std::string serum_asks_;
+  std::string quote_mint_;
+  std::string base_mint_;
+  std::string pyth_price_;
+  uint8_t     mode_ = SP_MODE_MIDPT;
+
+  // Identifies the market across reloads.
+  std::string get_key() const {
+    return serum_market_ + " " + serum_bids_ + " " + serum_asks_ + " "
+      + quote_mint_ + " " + base_mint_ + " " + pyth_price_;
   }
 };
 
-class serum_pyth : public pc::tx_request
+// With -W, the shared-memory feed has a spare slot per starting market,
+// and at least this many, for markets added later.
+static const unsigned FEED_SPARE = 256;
+
+static const market_cfg MARKETS[] = {
+  { // SRM/USDT
+    "C1EuT9VokAKLiW7i2ASnZUvxDoKuKkCpDDeNxAptuNe4",
+    "2e2bd5NtEGs6pb758QHUArNxt6X9TTC5abuE1Tao6fhS",
+    "F1tDtTDNzusig3kJwhKwGWspSu8z2nRwNXFWc6wJowjM",
+    "Es9vMFrzaCERmJfrF4H2FYD4KCoNkY11McCe8BenwNYB",
+    "9n4nbM75f5Ui33ZbPYXn59EwSgE8CGsHtAeTH5YFeJ9E",
+    "7aeFDevae3EJ9efijjEb2oCUQxLD8GnnvzPngKVwx11u",
+  },
+};
+
+// Markets from a file instead: one per line, the six accounts above in
+// order, separated by whitespace, then optionally "midpt" or "microprice"
+// (default mode otherwise). Blank lines and '#' comments skipped.
+static bool load_markets(
+  const char *path, uint8_t mode, std::vector<market_cfg>& cfgs
+) {
+  std::ifstream in( path );
+  if ( !in ) {
+    std::cerr << "test_publish: can't open " << path << std::endl;
+    return false;
+  }
+  std::string line;
+  for ( unsigned num = 1; std::getline( in, line ); ++num ) {
+    line = line.substr( 0, line.find( '#' ) );
+    std::istringstream fields( line );
+    market_cfg cfg;
+    if ( !( fields >> cfg.serum_market_ ) ) {
+      continue;
+    }
+    std::string extra;
+    if ( !( fields >> cfg.serum_bids_ >> cfg.serum_asks_ >> cfg.quote_mint_
+        >> cfg.base_mint_ >> cfg.pyth_price_ ) ) {
+      std::cerr << "test_publish: " << path << ":" << num
+                << ": expected 6 accounts" << std::endl;
+      return false;
+    }
+    cfg.mode_ = mode;
+    if ( fields >> extra ) {
+      if ( extra == "midpt" ) {
+        cfg.mode_ = SP_MODE_MIDPT;
+      }
+      else if ( extra == "microprice" ) {
+        cfg.mode_ = SP_MODE_MICROPRICE;
+      }
+      else {
+        std::cerr << "test_publish: " << path << ":" << num
+                  << ": unknown mode " << extra << std::endl;
+        return false;
+      }
+    }
+    if ( fields >> extra ) {
+      std::cerr << "test_publish: " << path << ":" << num
+                << ": unexpected " << extra << std::endl;
+      return false;
+    }
+    cfgs.emplace_back( std::move( cfg ) );
+  }
+  return true;
+}
+
+// Name of a serum-pyth program error, e.g. "MARKET_BIDS".
+static const char *custom_reason( sp::tx_error err, uint32_t code )
+{
+  const char *name = nullptr;
+  if ( err == sp::tx_error::custom ) {
+    name = sp_error_name( code );
+  }
+  return name ? name : "";
+}
+
+// Wires market updates, the publish scheduler, the in-flight table,
+// per-market circuit breakers, compute budget tuning and transaction
+// routing together.
+class crank :
+  public sp::market_sub,
+  public sp::inflight_sub,
+  public sp::breaker_sub,
+  public pc::rpc_sub_i<sp::sig_status>,
+  public pc::rpc_sub_i<sp::tx_units>
 {
 public:
-  void set_block_hash( pc::hash *bhash ) { bhash_ = bhash; }
-  void set_publish( pc::key_pair *kp ) { pkey_ = kp; }
-  void set_pubcache( pc::key_cache *kc ) { ckey_ = kc; }
-  void set_program( pc::pub_key *pk ) { gkey_ = pk; }
-  void set_serum_prog( pc::pub_key *pk ) { serum_prog_ = pk; }
-  void set_serum_market( pc::pub_key *pk ) { serum_market_ = pk; }
-  void set_serum_bids( pc::pub_key *pk ) { serum_bids_ = pk; }
-  void set_serum_asks( pc::pub_key *pk ) { serum_asks_ = pk; }
-  void set_spl_quote_mint( pc::pub_key *pk ) { spl_quote_mint_ = pk; }
-  void set_spl_base_mint( pc::pub_key *pk ) { spl_base_mint_ = pk; }
-  void set_sysvar_clock( pc::pub_key *pk ) { sysvar_clock_ = pk; }
-  void set_pyth_prog( pc::pub_key *pk ) { pyth_prog_ = pk; }
-  void set_pyth_price( pc::pub_key *pk ) { pyth_price_ = pk; }
-  void build( pc::net_wtr& ) override;
+  crank(
+    pc::manager& mgr,
+    sp::scheduler& sched,
+    sp::slot_clock& clock,
+    sp::inflight& infl,
+    sp::breaker& brk
+  ) : mgr_( mgr ), sched_( sched ), clock_( clock ), infl_( infl ),
+      brk_( brk ) {}
+
+  void set_tpu( sp::tpu_sender *tpu ) { tpu_ = tpu; }
+  void set_feed( sp::shm_feed *feed ) { feed_ = feed; }
+  void set_history( sp::history_writer *hist ) { hist_ = hist; }
+  void set_cu_limits( sp::cu_limits *lims ) { lims_ = lims; }
+  void set_fee_tuner( sp::fee_tuner *fees ) { fees_ = fees; }
+  void set_failover( sp::failover *ha ) { ha_ = ha; }
+
+  // Our program, for per-instruction compute units in transaction logs.
+  void set_program( const pc::pub_key& prog ) { ureq_->set_program( prog ); }
+
+  // Stop or resume publishing a market taken out of the markets file.
+  // Transactions already in flight still land or expire.
+  void set_removed( unsigned mkt, bool removed ) {
+    if ( mkt >= removed_.size() ) {
+      removed_.resize( mkt + 1 );
+    }
+    removed_[ mkt ] = removed;
+    update_blocked( mkt );
+  }
+
+  bool get_removed( unsigned mkt ) const {
+    return mkt < removed_.size() && removed_[ mkt ];
+  }
+
+  void on_book( sp::market *mkt ) override {
+    if ( get_removed( mkt->get_index() ) ) {
+      return;
+    }
+    const int64_t now = pc::get_now();
+    sched_.on_book(
+      mkt->get_index(),
+      mkt->get_bid().price_,
+      mkt->get_ask().price_,
+      now
+    );
+    if ( feed_ ) {
+      update_feed( mkt, now );
+    }
+  }
+
+  void on_price( sp::market *mkt ) override {
+    if ( ha_ ) {
+      ha_->on_landed( pc::get_now() );
+    }
+    sched_.on_price( mkt->get_index(), mkt->get_pub_slot() );
+    infl_.on_pub_slot( mkt->get_index(), mkt->get_pub_slot() );
+  }
+
+  void on_resend( unsigned, const uint8_t *buf, size_t len ) override {
+    send( buf, len );
+  }
+
+  void on_done(
+    unsigned mkt, const sp::tx_sig& sig, sp::tx_outcome outcome, uint64_t slots
+  ) override {
+    const bool landed = outcome == sp::tx_outcome::landed;
+    add_outcome( mkt, landed ? sp::HIST_LANDED
+      : outcome == sp::tx_outcome::failed ? sp::HIST_FAILED : sp::HIST_DROPPED );
+    if ( landed ) {
+      brk_.on_success( mkt );
+    }
+    // Only expiry says the fee was too low; a failed transaction landed
+    // and is the breaker's business.
+    if ( fees_ && outcome != sp::tx_outcome::failed ) {
+      fees_->on_done( landed, slots );
+    }
+    // Sample one landed transaction at a time for its compute units.
+    // A packed one reports each of its markets in instruction order.
+    if ( landed && lims_ && !units_pending_ ) {
+      units_pending_ = true;
+      units_tries_ = 0;
+      units_mkts_.clear();
+      ureq_->set_sig( sig );
+    }
+    if ( landed && lims_ && !units_sent_ && sig == ureq_->get_sig() ) {
+      units_mkts_.push_back( mkt );
+    }
+    update_blocked( mkt );
+  }
+
+  void on_breaker( unsigned mkt, bool is_open ) override {
+    PC_LOG_INF( is_open ? "market isolated" : "market probing" )
+      .add( "market", (uint64_t)mkt )
+      .end();
+    update_blocked( mkt );
+  }
+
+  // Poll statuses of in-flight transactions once per slot.
+  void poll_status() {
+    if ( status_sent_ || clock_.get_slot() == status_slot_ ) {
+      return;
+    }
+    infl_.get_sigs( sigs_, sp::sig_status::MAX_SIGS );
+    if ( sigs_.empty() ) {
+      return;
+    }
+    sreq_->clear();
+    for ( const sp::tx_sig& sig : sigs_ ) {
+      sreq_->add( sig );
+    }
+    sreq_->set_sub( this );
+    mgr_.get_rpc_client()->send( sreq_ );
+    status_sent_ = true;
+    status_slot_ = clock_.get_slot();
+  }
+
+  // Fetch compute units of the sampled transaction, retrying once per
+  // slot until the node has it at confirmed commitment.
+  void poll_units() {
+    if ( !units_pending_ || units_sent_ || clock_.get_slot() == units_slot_ ) {
+      return;
+    }
+    ureq_->set_sub( this );
+    mgr_.get_rpc_client()->send( ureq_ );
+    units_sent_ = true;
+    units_slot_ = clock_.get_slot();
+  }
+
+  void on_response( sp::tx_units *res ) override {
+    units_sent_ = false;
+    if ( !res->get_is_err() && res->get_is_found() ) {
+      const size_t num = units_mkts_.size();
+      for ( size_t i = 0; i != num; ++i ) {
+        lims_->on_usage(
+          units_mkts_[ i ],
+          res->get_num_ix() == num ? res->get_ix_units( i )
+                                   : res->get_units() / num
+        );
+      }
+      units_pending_ = false;
+    }
+    else if ( ++units_tries_ >= MAX_UNITS_TRIES ) {
+      units_pending_ = false;
+    }
+  }
+
+  void on_response( sp::sig_status *res ) override {
+    status_sent_ = false;
+    if ( res->get_is_err() ) {
+      PC_LOG_ERR( "failed to get signature statuses" )
+        .add( "error", res->get_err_msg() )
+        .end();
+      return;
+    }
+    const int64_t now = pc::get_now();
+    for ( size_t i = 0; i != res->get_num(); ++i ) {
+      unsigned mkt;
+      const sp::tx_sig& sig = res->get_sig( i );
+      if ( res->get_status( i ) == sp::sig_status::e_pending
+        || !infl_.get_market( sig, mkt ) ) {
+        continue;
+      }
+      if ( res->get_status( i ) == sp::sig_status::e_landed ) {
+        infl_.on_confirm( sig, true );
+        continue;
+      }
+      // Only an error in a market's own instruction is its fault; one in
+      // a compute budget instruction or the transaction as a whole isn't.
+      // on_done() records the failure for each of its markets.
+      const sp::tx_error err = res->get_error( i );
+      const bool is_mkt = infl_.get_market( sig, res->get_instruction( i ), mkt );
+      PC_LOG_ERR( "transaction failed" )
+        .add( "market", is_mkt ? (int64_t)mkt : -1L )
+        .add( "error", sp::to_str( err ) )
+        .add( "code", (uint64_t)res->get_custom_code( i ) )
+        .add( "reason", custom_reason( err, res->get_custom_code( i ) ) )
+        .end();
+      // Running out of compute units only counts once the limit is maxed.
+      if ( is_mkt && err == sp::tx_error::compute_budget && lims_
+        && lims_->on_exceeded( mkt ) ) {
+        PC_LOG_INF( "raised compute unit limit" )
+          .add( "market", (uint64_t)mkt )
+          .add( "units", (uint64_t)lims_->get_limit( mkt ) )
+          .end();
+      }
+      else if ( is_mkt && sp::get_error_class( err ) == sp::tx_error_class::market ) {
+        brk_.on_failure( mkt, now );
+      }
+      infl_.on_confirm( sig, false );
+    }
+  }
+
+  // Track and send a newly signed transaction.
+  void submit( unsigned mkt, const uint8_t *buf, size_t len ) {
+    submit( &mkt, 1, 0, buf, len );
+  }
+
+  // One publishing several markets, see sp::inflight::on_submit().
+  void submit(
+    const unsigned *mkts,
+    size_t num,
+    unsigned first_ix,
+    const uint8_t *buf,
+    size_t len
+  ) {
+    infl_.on_submit( mkts, num, first_ix, buf, len, clock_.get_slot() );
+    for ( size_t i = 0; i != num; ++i ) {
+      add_outcome( mkts[ i ], sp::HIST_SUBMITTED );
+      update_blocked( mkts[ i ] );
+    }
+    send( buf, len );
+  }
+
+  // Send to leaders' TPUs directly or through the pyth_tx proxy.
+  void send( const uint8_t *buf, size_t len ) {
+    if ( tpu_ ) {
+      tpu_->send( clock_.get_arrival_slot( pc::get_now() ), (const char*)buf, len );
+    }
+    else {
+      // pc::manager's tx connection buffers on the heap
+      sp::alloc_scope unchecked( false );
+      sp::raw_tx req[1];
+      req->set_tx( buf, len );
+      mgr_.submit( req );
+    }
+  }
+
+  // Record each market's state and publish outcomes of the slot that
+  // just ended.
+  void record(
+    const std::vector<std::unique_ptr<sp::market>>& mkts,
+    uint64_t slot,
+    int64_t now
+  ) {
+    if ( !hist_ || slot == 0 ) {
+      return;
+    }
+    for ( const auto& mkt : mkts ) {
+      const unsigned idx = mkt->get_index();
+      if ( get_removed( idx ) ) {
+        continue;
+      }
+      sp::history_row row;
+      bool trading;
+      mkt->get_price( row.price_, row.conf_, trading );
+      row.slot_ = slot;
+      row.ts_ = now;
+      row.bid_ = mkt->get_bid().price_;
+      row.ask_ = mkt->get_ask().price_;
+      row.bid_qty_ = mkt->get_bid().qty_;
+      row.ask_qty_ = mkt->get_ask().qty_;
+      row.s2p_ = mkt->get_serum_to_pyth();
+      row.status_ = trading;
+      if ( idx < outcome_.size() ) {
+        row.outcome_ = outcome_[ idx ];
+        outcome_[ idx ] = 0;
+      }
+      if ( !hist_->add( idx, row ) ) {
+        PC_LOG_ERR( "history write failed" )
+          .add( "error", hist_->get_err_msg() )
+          .end();
+      }
+    }
+  }
 
 private:
-  pc::hash         *bhash_ = nullptr;
-  pc::key_pair     *pkey_ = nullptr;
-  pc::key_cache    *ckey_ = nullptr;
-  pc::pub_key      *gkey_ = nullptr;
-  pc::pub_key      *serum_prog_ = nullptr;
-  pc::pub_key      *serum_market_ = nullptr;
-  pc::pub_key      *serum_bids_ = nullptr;
-  pc::pub_key      *serum_asks_ = nullptr;
-  pc::pub_key      *spl_quote_mint_ = nullptr;
-  pc::pub_key      *spl_base_mint_ = nullptr;
-  pc::pub_key      *sysvar_clock_ = nullptr;
-  pc::pub_key      *pyth_prog_ = nullptr;
-  pc::pub_key      *pyth_price_ = nullptr;
+  static const unsigned MAX_UNITS_TRIES = 8;
+
+  void add_outcome( unsigned mkt, uint8_t bits ) {
+    if ( hist_ ) {
+      if ( mkt >= outcome_.size() ) {
+        outcome_.resize( mkt + 1 );
+      }
+      outcome_[ mkt ] |= bits;
+    }
+  }
+
+  // Share the price we'd publish with local readers.
+  void update_feed( sp::market *mkt, int64_t now ) {
+    sp::shm_quote quote;
+    bool trading;
+    if ( !mkt->get_price( quote.price_, quote.conf_, trading ) ) {
+      return;
+    }
+    std::memcpy(
+      quote.pyth_price_,
+      mkt->get_pyth_price()->data(),
+      sizeof( quote.pyth_price_ )
+    );
+    quote.bid_ = mkt->get_bid().price_;
+    quote.ask_ = mkt->get_ask().price_;
+    quote.expo_ = mkt->get_pyth_expo();
+    quote.trading_ = trading;
+    quote.book_slot_ = mkt->get_book_slot();
+    quote.ts_ = now;
+    feed_->update( mkt->get_index(), quote );
+  }
+
+  void update_blocked( unsigned mkt ) {
+    sched_.set_blocked(
+      mkt,
+      !infl_.can_submit( mkt ) || brk_.get_is_open( mkt ) || get_removed( mkt )
+    );
+  }
+
+  pc::manager&    mgr_;
+  sp::scheduler&  sched_;
+  sp::slot_clock& clock_;
+  sp::inflight&   infl_;
+  sp::breaker&    brk_;
+  sp::tpu_sender *tpu_ = nullptr;
+  sp::shm_feed   *feed_ = nullptr;
+  sp::history_writer *hist_ = nullptr;
+  std::vector<uint8_t> outcome_;
+  std::vector<uint8_t> removed_;
+  sp::sig_status  sreq_[1];
+  bool            status_sent_ = false;
+  uint64_t        status_slot_ = 0;
+  std::vector<sp::tx_sig> sigs_;
+  sp::cu_limits  *lims_ = nullptr;
+  sp::fee_tuner  *fees_ = nullptr;
+  sp::failover   *ha_ = nullptr;
+  sp::tx_units    ureq_[1];
+  bool            units_pending_ = false;
+  bool            units_sent_ = false;
+  unsigned        units_tries_ = 0;
+  std::vector<unsigned> units_mkts_;
+  uint64_t        units_slot_ = 0;
 };
 
-void serum_pyth::build( pc::net_wtr& wtr )
+int usage()
 {
-  // construct binary transaction and add header
-  pc::bincode tx;
-  ((tx_wtr&)wtr).init( tx );
-
-  // signatures section
-  tx.add_len<1>();      // one signature (publish)
-  size_t pub_idx = tx.reserve_sign();
-
-  // message header
-  size_t tx_idx = tx.get_pos();
-  tx.add( (uint8_t)1 ); // pub is only signing account
-  tx.add( (uint8_t)0 ); // read-only signed accounts
-  tx.add( (uint8_t)9 ); // read-only unsigned accounts
-
-  // accounts
-  tx.add_len<11>();
-  tx.add( *pkey_ );
-  tx.add( *pyth_price_ );
-  tx.add( *serum_prog_ );
-  tx.add( *serum_market_ );
-  tx.add( *serum_bids_ );
-  tx.add( *serum_asks_ );
-  tx.add( *spl_quote_mint_ );
-  tx.add( *spl_base_mint_ );
-  tx.add( *sysvar_clock_ );
-  tx.add( *pyth_prog_ );
-  tx.add( *gkey_ );
-
-  // recent block hash
-  tx.add( *bhash_ );    // recent block hash
-
-  // instructions section
-  tx.add_len<1>();      // one instruction
-  tx.add( (uint8_t)10);  // program_id index
-  tx.add_len<10>();
-  tx.add( (uint8_t)0 );
-  tx.add( (uint8_t)1 );
-  tx.add( (uint8_t)2 );
-  tx.add( (uint8_t)3 );
-  tx.add( (uint8_t)4 );
-  tx.add( (uint8_t)5 );
-  tx.add( (uint8_t)6 );
-  tx.add( (uint8_t)7 );
-  tx.add( (uint8_t)8 );
-  tx.add( (uint8_t)9 );
-
-  // instruction parameter section
-  tx.add_len<0>();
-
-  // all accounts need to sign transaction
-  tx.sign( pub_idx, tx_idx, *ckey_ );
-  ((tx_wtr&)wtr).commit( tx );
+  std::cerr << "usage: serum-pyth-crank [options]" << std::endl;
+  std::cerr << "options include:" << std::endl;
+  std::cerr << "  -b <max transactions per second (default 50)>" << std::endl;
+  std::cerr << "  -s <max transactions per slot (default 20)>" << std::endl;
+  std::cerr << "  -i <min publish interval in ms (default 400)>" << std::endl;
+  std::cerr << "  -x <max publish interval in ms (default 5000)>" << std::endl;
+  std::cerr << "  -a <submit only in first n ms of a slot (default off)>"
+            << std::endl;
+  std::cerr << "  -A <expected submit-to-leader latency in ms (default 0)>"
+            << std::endl;
+  std::cerr << "  -L send directly to current and next leaders' TPU"
+            << std::endl;
+  std::cerr << "  -T <host:port of a fixed TPU, e.g. a local validator>"
+            << std::endl;
+  std::cerr << "  -f <max transactions in flight per market (default 1)>"
+            << std::endl;
+  std::cerr << "  -R <max rebroadcasts per transaction (default 3)>"
+            << std::endl;
+  std::cerr << "  -P pre-sign transactions against recent blockhashes"
+            << std::endl;
+  std::cerr << "  -e <consecutive failures to isolate a market (default 3, "
+               "not with -j)>" << std::endl;
+  std::cerr << "  -m <shared-memory name for local price readers, e.g. "
+               "/serum-pyth>" << std::endl;
+  std::cerr << "  -M <shared-memory update ring entries (default 0, off)>"
+            << std::endl;
+  std::cerr << "  -w publish the size-weighted microprice of the best orders"
+            << std::endl;
+  std::cerr << "  -c <compute unit limit headroom over observed usage in %, "
+               "e.g. 20 (default off)>" << std::endl;
+  std::cerr << "  -p <max priority fee in micro-lamports per compute unit, "
+               "tuned to land rate (default off)>" << std::endl;
+  std::cerr << "  -k pack due markets into shared transactions (not with -P)"
+            << std::endl;
+  std::cerr << "  -t <address lookup table to send v0 transactions with, "
+               "or 'new' to create one (not with -P)>" << std::endl;
+  std::cerr << "  -H <directory to record per-slot book and publish history>"
+            << std::endl;
+  std::cerr << "  -F <markets file, one 'market bids asks quote_mint "
+               "base_mint price [midpt|microprice]' per line (default "
+               "built-in list)>" << std::endl;
+  std::cerr << "  -W apply changes to the -F file live: add, remove and "
+               "retune markets (not with -j)" << std::endl;
+  std::cerr << "  -r <rpc host (default api.mainnet-beta.solana.com)>"
+            << std::endl;
+  std::cerr << "  -y <pyth_tx host (default localhost)>" << std::endl;
+  std::cerr << "  -d <key store directory (default current)>" << std::endl;
+  std::cerr << "  -g <lease file shared with a standby crank publishing "
+               "with the same key; publish only while holding it (not "
+               "with -j)>" << std::endl;
+  std::cerr << "  -G <ms without our updates landing before the standby "
+               "takes over (default 10000, 0 never)>" << std::endl;
+  std::cerr << "  -u <unix socket streaming raw account updates, in place "
+               "of RPC bids/asks subscriptions>" << std::endl;
+  std::cerr << "  -U <file of recorded account updates to replay, as -u>"
+            << std::endl;
+  std::cerr << "  -J -u/-U carry newline-delimited programNotification JSON "
+               "instead of raw records" << std::endl;
+  std::cerr << "  -j <worker threads to partition markets over, sending to "
+               "the TPU from one more (with -L or -T; not with -P, -k, -t, "
+               "-c, -p, -a, -H or -m)>" << std::endl;
+  return 1;
 }
 
-int main(int /*argc*/, char** /*argv*/)
+int main(int argc, char** argv)
 {
+  sp::scheduler sched;
+  sp::slot_clock clock;
+  sp::tpu_sender tpu;
+  sp::inflight infl;
+  sp::presigner pre;
+  sp::breaker brk;
+  sp::shm_feed feed;
+  sp::history_writer hist;
+  sp::cu_limits lims;
+  sp::fee_tuner fees;
+  sp::lookup_sync sync;
+  sp::shard_set shards;
+  sp::file_lease lease;
+  sp::failover ha;
+  sp::stream_source stream;
+  sp::file_source replay;
+  sp::account_router router;
+  sp::account_source *src = nullptr;
+  bool do_align = false;
+  bool do_alt = false;
+  bool do_brk = false;
+  bool do_cu = false;
+  bool do_fee = false;
+  bool do_feed = false;
+  bool do_ha = false;
+  bool do_hist = false;
+  bool do_pack = false;
+  bool do_presign = false;
+  bool do_shard = false;
+  bool do_tpu = false;
+  bool do_watch = false;
+  uint8_t mode = SP_MODE_MIDPT;
+  std::string rpc_host = "api.mainnet-beta.solana.com";
+  std::string tx_host = "localhost";
+  std::string key_dir;
+  const char *mkts_file = nullptr;
+  const char *lease_file = nullptr;
+  const char *replay_file = nullptr;
+  int opt = 0;
+  while( (opt = ::getopt(argc, argv, "b:s:i:x:a:A:LT:f:R:Pe:m:M:H:wc:p:kt:F:Wr:y:d:g:G:u:U:Jj:h")) != -1 ) {
+    switch(opt) {
+      case 'b': sched.set_max_tx_per_sec( ::atof(optarg) ); break;
+      case 's': sched.set_max_tx_per_slot( (unsigned)::atoi(optarg) ); break;
+      case 'i': sched.set_min_interval( ::atol(optarg) * 1000000L ); break;
+      case 'x': sched.set_max_interval( ::atol(optarg) * 1000000L ); break;
+      case 'a':
+        clock.set_window( ::atol(optarg) * 1000000L );
+        do_align = true;
+        break;
+      case 'A': clock.set_latency( ::atol(optarg) * 1000000L ); break;
+      case 'L': do_tpu = true; break;
+      case 'T': tpu.set_fixed_tpu( optarg ); do_tpu = true; break;
+      case 'f': infl.set_max_per_market( (unsigned)::atoi(optarg) ); break;
+      case 'R': infl.set_max_retries( (unsigned)::atoi(optarg) ); break;
+      case 'P': do_presign = true; break;
+      case 'e':
+        brk.set_threshold( (unsigned)::atoi(optarg) );
+        do_brk = true;
+        break;
+      case 'm': feed.set_name( optarg ); do_feed = true; break;
+      case 'M': feed.set_ring_size( (uint32_t)::atoi(optarg) ); break;
+      case 'H': hist.set_dir( optarg ); do_hist = true; break;
+      case 'w': mode = SP_MODE_MICROPRICE; break;
+      case 'c':
+        lims.set_headroom( (unsigned)::atoi(optarg) );
+        do_cu = true;
+        break;
+      case 'p':
+        fees.set_bounds( 0, (uint64_t)::atol(optarg) );
+        do_fee = true;
+        break;
+      case 'k': do_pack = true; break;
+      case 't':
+        if ( std::string( optarg ) != "new" ) {
+          pc::pub_key addr;
+          addr.init_from_text( std::string( optarg ) );
+          sync.set_table( addr );
+        }
+        do_alt = true;
+        break;
+      case 'F': mkts_file = optarg; break;
+      case 'W': do_watch = true; break;
+      case 'r': rpc_host = optarg; break;
+      case 'y': tx_host = optarg; break;
+      case 'd': key_dir = optarg; break;
+      case 'g': lease_file = optarg; do_ha = true; break;
+      case 'G': ha.set_stall( ::atol(optarg) * 1000000L ); break;
+      case 'u': stream.set_path( optarg ); src = &stream; break;
+      case 'U': replay_file = optarg; src = &replay; break;
+      case 'J': stream.set_json( true ); replay.set_json( true ); break;
+      case 'j':
+        shards.set_num_shards( (unsigned)::atoi(optarg) );
+        do_shard = true;
+        break;
+      default: return usage();
+    }
+  }
+
+  if ( do_shard && ( do_presign || do_pack || do_alt || do_cu || do_fee
+      || do_align || do_hist || do_feed || do_brk ) ) {
+    std::cerr << "test_publish: -j can't be combined with -P, -k, -t, -c, "
+                 "-p, -a, -H, -m or -e" << std::endl;
+    return 1;
+  }
+  if ( do_presign && ( do_pack || do_alt ) ) {
+    std::cerr << "test_publish: -P can't be combined with -k or -t"
+              << std::endl;
+    return 1;
+  }
+  if ( do_watch && ( !mkts_file || do_shard ) ) {
+    std::cerr << "test_publish: -W watches the -F file and can't be "
+                 "combined with -j" << std::endl;
+    return 1;
+  }
+  if ( do_ha && do_shard ) {
+    std::cerr << "test_publish: -g can't be combined with -j" << std::endl;
+    return 1;
+  }
+  if ( do_shard && !do_tpu ) {
+    std::cerr << "test_publish: -j sends to the TPU, add -L or -T"
+              << std::endl;
+    return 1;
+  }
+
   signal( SIGPIPE, SIG_IGN );
   signal( SIGINT, sig_handle );
   signal( SIGHUP, sig_handle );
@@ -126,76 +676,496 @@ int main(int /*argc*/, char** /*argv*/)
   pc::log::set_level(PC_LOG_DBG_LVL);
 
   pc::manager mgr;
-  mgr.set_rpc_host("api.mainnet-beta.solana.com");
-  mgr.set_tx_host("localhost");
-  mgr.set_dir("");
+  mgr.set_rpc_host( rpc_host );
+  mgr.set_tx_host( tx_host );
+  mgr.set_dir( key_dir );
   mgr.set_do_capture(false);
   if (!mgr.init()) {
     std::cerr << "test_publish: " << mgr.get_err_msg() << std::endl;
     return 1;
   }
+  if ( do_tpu && !tpu.init() ) {
+    std::cerr << "test_publish: " << tpu.get_err_msg() << std::endl;
+    return 1;
+  }
+  const bool do_stream = src != nullptr;
+  if ( replay_file && !replay.init( replay_file ) ) {
+    std::cerr << "test_publish: " << replay.get_err_msg() << std::endl;
+    return 1;
+  }
+  if ( do_ha && !lease.init( lease_file ) ) {
+    std::cerr << "test_publish: " << lease.get_err_msg() << std::endl;
+    return 1;
+  }
+  ha.set_lease( &lease );
 
   pc::pub_key serumPID;
   serumPID.init_from_text(std::string("9xQeWvG816bUx9EPjHmaT23yvVM2ZWbrrpZb9PusVFin"));
-  pc::pub_key market;
-  market.init_from_text(std::string("C1EuT9VokAKLiW7i2ASnZUvxDoKuKkCpDDeNxAptuNe4"));
-  pc::pub_key bids;
-  bids.init_from_text(std::string("2e2bd5NtEGs6pb758QHUArNxt6X9TTC5abuE1Tao6fhS"));
-  pc::pub_key asks;
-  asks.init_from_text(std::string("F1tDtTDNzusig3kJwhKwGWspSu8z2nRwNXFWc6wJowjM"));
   pc::pub_key thisPID;
   thisPID.init_from_text(std::string("CLs66NQrh6MWYzkgxrC79tfepMt5neTTCgguzpYo1LCW"));
-  pc::pub_key quoteMint;
-  quoteMint.init_from_text(std::string("Es9vMFrzaCERmJfrF4H2FYD4KCoNkY11McCe8BenwNYB"));
-  pc::pub_key baseMint;
-  baseMint.init_from_text(std::string("9n4nbM75f5Ui33ZbPYXn59EwSgE8CGsHtAeTH5YFeJ9E"));
   pc::pub_key sysvarClock;
   sysvarClock.init_from_text(std::string("SysvarC1ock11111111111111111111111111111111"));
   pc::pub_key pythPID;
   pythPID.init_from_text(std::string("3mPtGfRCBMQxvgGk7xG9RvYUH32ugb44AtMnjuPWWReo"));
-  pc::pub_key pythPrice;
-  pythPrice.init_from_text(std::string("7aeFDevae3EJ9efijjEb2oCUQxLD8GnnvzPngKVwx11u"));
+  pc::pub_key budgetPID;
+  budgetPID.init_from_text(std::string("ComputeBudget111111111111111111111111111111"));
+  pc::pub_key *budget_prog = do_cu || do_fee ? &budgetPID : nullptr;
+
+  crank crk( mgr, sched, clock, infl, brk );
+  if ( do_tpu ) {
+    crk.set_tpu( &tpu );
+  }
+  infl.set_sub( &crk );
+  brk.set_sub( &crk );
+  if ( do_cu ) {
+    crk.set_cu_limits( &lims );
+  }
+  if ( do_fee ) {
+    crk.set_fee_tuner( &fees );
+  }
+  if ( do_ha ) {
+    crk.set_failover( &ha );
+  }
+  crk.set_program( thisPID );
+  if ( do_shard ) {
+    shards.init( sched, infl, mgr.get_publish_pub_key() );
+  }
+  // Markets by index, shared with every component by that index, and by
+  // market_cfg::get_key(). Removed markets keep their index.
+  std::vector<std::unique_ptr<sp::market>> mkts;
+  std::unordered_map<std::string, unsigned> mkt_keys;
+  auto add_market = [&]( const market_cfg& cfg ) {
+    std::unique_ptr<sp::market> mkt( new sp::market );
+    mkt->init(
+      cfg.serum_market_,
+      cfg.serum_bids_,
+      cfg.serum_asks_,
+      cfg.quote_mint_,
+      cfg.base_mint_,
+      cfg.pyth_price_
+    );
+    mkt->set_index( sched.add_market( pc::get_now() ) );
+    mkt->set_sub( &crk );
+    mkt->set_mode( cfg.mode_ );
+    mkt->set_book_subs( !do_stream );
+    router.add_market( mkt.get() );
+    infl.add_market();
+    brk.add_market();
+    lims.add_market();
+    if ( do_alt ) {
+      const pc::pub_key keys[] = {
+        *mkt->get_pyth_price(),
+        *mkt->get_serum_market(),
+        *mkt->get_serum_bids(),
+        *mkt->get_serum_asks(),
+        *mkt->get_spl_quote_mint(),
+        *mkt->get_spl_base_mint()
+      };
+      sync.add_keys( keys, sizeof( keys ) / sizeof( keys[0] ) );
+    }
+
+    sp::serum_pyth tmpl;
+    tmpl.set_publish(mgr.get_publish_key_pair());
+    tmpl.set_program(&thisPID);
+    tmpl.set_serum_prog(&serumPID);
+    tmpl.set_serum_market(mkt->get_serum_market());
+    tmpl.set_serum_bids(mkt->get_serum_bids());
+    tmpl.set_serum_asks(mkt->get_serum_asks());
+    tmpl.set_spl_quote_mint(mkt->get_spl_quote_mint());
+    tmpl.set_spl_base_mint(mkt->get_spl_base_mint());
+    tmpl.set_sysvar_clock(&sysvarClock);
+    tmpl.set_pyth_prog(&pythPID);
+    tmpl.set_pyth_price(mkt->get_pyth_price());
+    tmpl.set_mode(cfg.mode_);
+    tmpl.set_budget_prog(budget_prog);
+    pre.add_market( tmpl );
+    if ( do_shard ) {
+      shards.add_market( *mkt, tmpl );
+    }
+
+    std::string name;
+    mkt->get_pyth_price()->enc_base58( name );
+    hist.add_market( name, mkt->get_pyth_price()->data() );
+    if ( feed.get_is_init() && mkt->get_index() >= feed.get_num_slots() ) {
+      PC_LOG_ERR( "no shared-memory feed slot left for market" )
+        .add( "market", (uint64_t)mkt->get_index() )
+        .add( "price_account", name )
+        .end();
+    }
+
+    mkt_keys[ cfg.get_key() ] = mkt->get_index();
+    mkts.emplace_back( std::move( mkt ) );
+  };
+  std::vector<market_cfg> cfgs( std::begin( MARKETS ), std::end( MARKETS ) );
+  for ( market_cfg& cfg : cfgs ) {
+    cfg.mode_ = mode;
+  }
+  if ( mkts_file ) {
+    cfgs.clear();
+    if ( !load_markets( mkts_file, mode, cfgs ) ) {
+      return 1;
+    }
+  }
+  for ( const market_cfg& cfg : cfgs ) {
+    if ( mkt_keys.find( cfg.get_key() ) == mkt_keys.end() ) {
+      add_market( cfg );
+    }
+  }
+  sp::file_watch watch;
+  if ( do_watch && !watch.init( mkts_file ) ) {
+    std::cerr << "test_publish: " << watch.get_err_msg() << std::endl;
+    return 1;
+  }
+  if ( do_alt ) {
+    // shared by every market; the programs invoked stay in the message
+    const pc::pub_key keys[] = { serumPID, sysvarClock, pythPID };
+    sync.add_keys( keys, sizeof( keys ) / sizeof( keys[0] ) );
+  }
+  if ( do_presign ) {
+    pre.start();
+  }
+  if ( do_shard && !shards.start() ) {
+    std::cerr << "test_publish: " << shards.get_err_msg() << std::endl;
+    return 1;
+  }
+  if ( do_feed ) {
+    // room for markets -W adds later, which readers see as never written
+    unsigned num_slots = (unsigned)mkts.size();
+    if ( do_watch ) {
+      num_slots += std::max( num_slots, FEED_SPARE );
+    }
+    if ( !feed.init( num_slots ) ) {
+      std::cerr << "test_publish: " << feed.get_err_msg() << std::endl;
+      return 1;
+    }
+    crk.set_feed( &feed );
+  }
+  if ( do_hist ) {
+    crk.set_history( &hist );
+  }
+
+  // Publish request for a market against the latest blockhash and budget.
+  auto init_req = [&]( sp::serum_pyth& req, unsigned idx ) {
+    sp::market *mkt = mkts[ idx ].get();
+    req.set_publish(mgr.get_publish_key_pair());
+    req.set_pubcache(mgr.get_publish_key_cache());
+    req.set_program(&thisPID);
+    req.set_block_hash(mgr.get_recent_block_hash());
+    req.set_serum_prog(&serumPID);
+    req.set_serum_market(mkt->get_serum_market());
+    req.set_serum_bids(mkt->get_serum_bids());
+    req.set_serum_asks(mkt->get_serum_asks());
+    req.set_spl_quote_mint(mkt->get_spl_quote_mint());
+    req.set_spl_base_mint(mkt->get_spl_base_mint());
+    req.set_sysvar_clock(&sysvarClock);
+    req.set_pyth_prog(&pythPID);
+    req.set_pyth_price(mkt->get_pyth_price());
+    req.set_mode(mkt->get_mode());
+    req.set_budget_prog(budget_prog);
+    req.set_cu_limit(lims.get_limit( idx ));
+    req.set_cu_price(fees.get_price());
+    req.set_lookup(do_alt ? sync.get_table() : nullptr);
+  };
+  // in-flight tracking holds up to TX_MAX_MARKETS markets per transaction
+  sp::tx_packer packer;
+  packer.set_max_per_tx( sp::TX_MAX_MARKETS );
+  // one request per market, reused by every publish
+  std::vector<sp::serum_pyth> due( mkts.size() );
 
-  int64_t last = pc::get_now();
+  // Subscribed since the last reconnect, by market.
+  std::vector<uint8_t> subscribed( mkts.size() );
+  bool is_subscribed = false;
+  auto subscribe = [&]( unsigned idx ) {
+    if ( is_subscribed && !subscribed[ idx ] ) {
+      mkts[ idx ]->subscribe( mgr );
+      subscribed[ idx ] = true;
+    }
+  };
+
+  // Bring the markets in line with the -F file, touching only the
+  // markets that changed. Removed markets stop publishing and are
+  // skipped on resubscribe; their index is kept in case they return.
+  auto reload_markets = [&]() {
+    std::vector<market_cfg> next;
+    if ( !load_markets( mkts_file, mode, next ) ) {
+      PC_LOG_ERR( "markets file rejected, keeping current markets" ).end();
+      return;
+    }
+    uint64_t num_added = 0, num_removed = 0, num_retuned = 0;
+    std::vector<uint8_t> listed( mkts.size() );
+    for ( const market_cfg& cfg : next ) {
+      const auto it = mkt_keys.find( cfg.get_key() );
+      unsigned idx;
+      if ( it == mkt_keys.end() ) {
+        add_market( cfg );
+        idx = mkts.back()->get_index();
+        due.emplace_back();
+        subscribed.push_back( false );
+        listed.push_back( true );
+        ++num_added;
+      }
+      else {
+        idx = it->second;
+        if ( listed[ idx ] ) {
+          continue;
+        }
+        listed[ idx ] = true;
+        if ( crk.get_removed( idx ) ) {
+          crk.set_removed( idx, false );
+          pre.set_active( idx, true );
+          ++num_added;
+        }
+        if ( mkts[ idx ]->get_mode() != cfg.mode_ ) {
+          mkts[ idx ]->set_mode( cfg.mode_ );
+          pre.set_mode( idx, cfg.mode_ );
+          ++num_retuned;
+        }
+      }
+      subscribe( idx );
+    }
+    for ( unsigned idx = 0; idx != listed.size(); ++idx ) {
+      if ( !listed[ idx ] && !crk.get_removed( idx ) ) {
+        crk.set_removed( idx, true );
+        pre.set_active( idx, false );
+        ++num_removed;
+      }
+    }
+    PC_LOG_INF( "markets reloaded" )
+      .add( "added", num_added )
+      .add( "removed", num_removed )
+      .add( "retuned", num_retuned )
+      .add( "total", (uint64_t)mkts.size() )
+      .end();
+  };
+  int64_t stats_ts = pc::get_now();
+  pc::hash last_bhash;
+  last_bhash.zero();
 
-  // run event loop and wait for product updates, price updates
-  // and requests to submit price
+  // run event loop and wait for book updates, price updates
+  // and markets due to publish
   while( do_run && !mgr.get_is_err() ) {
+    mgr.poll(false);
+
+    // local account updates flow regardless of the RPC connection
+    if ( src ) {
+      src->poll( router );
+      if ( src->get_is_err() ) {
+        break;
+      }
+      if ( src == &replay && replay.get_is_done() ) {
+        PC_LOG_INF( "account replay done" )
+          .add( "updates", replay.get_num_updates() )
+          .add( "skipped", replay.get_num_skipped() )
+          .add( "stale", router.get_num_stale() )
+          .add( "unknown", router.get_num_unknown() )
+          .end();
+        src = nullptr;
+      }
+    }
+
+    // subscriptions are dropped on reconnect
+    if ( !mgr.has_status( PC_PYTH_RPC_CONNECTED ) ) {
+      is_subscribed = false;
+      std::fill( subscribed.begin(), subscribed.end(), 0 );
+      continue;
+    }
+    if ( !is_subscribed ) {
+      is_subscribed = true;
+      for ( unsigned idx = 0; idx != mkts.size(); ++idx ) {
+        if ( !crk.get_removed( idx ) ) {
+          subscribe( idx );
+        }
+      }
+      if ( do_alt ) {
+        sync.subscribe( mgr );
+      }
+    }
+    if ( do_watch && watch.poll() ) {
+      reload_markets();
+    }
+
+    if (mgr.get_recent_block_hash() == nullptr)
+      continue;
+
+    if ( do_presign && !( *mgr.get_recent_block_hash() == last_bhash ) ) {
+      last_bhash = *mgr.get_recent_block_hash();
+      pre.on_block_hash( last_bhash );
+    }
+
     int64_t now = pc::get_now();
+    const uint64_t prev_slot = clock.get_slot();
+    clock.on_slot( mgr.get_slot(), now );
+    if ( clock.get_slot() != prev_slot ) {
+      crk.record( mkts, prev_slot, now );
+      if ( do_fee && fees.on_slot( clock.get_slot() ) ) {
+        PC_LOG_DBG( "priority fee" )
+          .add( "price", fees.get_price() )
+          .add( "land_pct", (uint64_t)( fees.get_land_rate() * 100. ) )
+          .add( "delay_slots", (uint64_t)fees.get_delay() )
+          .end();
+      }
+      if ( do_presign ) {
+        for ( unsigned idx = 0; idx != mkts.size(); ++idx ) {
+          pre.set_budget( idx, lims.get_limit( idx ), fees.get_price() );
+        }
+      }
+      if ( do_alt && ( !do_ha || ha.is_active() ) ) {
+        char buf[sp::TX_MAX_SIZE];
+        const size_t len = sync.poll( mgr, clock.get_slot(), buf );
+        if ( len ) {
+          crk.send( (const uint8_t*)buf, len );
+        }
+      }
+    }
+    {
+      sp::alloc_scope checked;
+      sched.on_slot( clock.get_slot(), now );
+      infl.on_slot( clock.get_slot() );
+      brk.poll( now );
+    }
+    crk.poll_status();
+    crk.poll_units();
+    if ( do_ha && ha.poll( now ) ) {
+      PC_LOG_INF( ha.is_active() ? "lease acquired" : "lease lost" )
+        .add( "holder", lease.get_holder() )
+        .add( "takeovers", ha.get_num_takeovers() )
+        .add( "error", lease.get_err_msg() )
+        .end();
+    }
+    if ( do_tpu ) {
+      tpu.poll( mgr, clock.get_slot() );
+    }
+    if ( do_shard ) {
+      shards.on_chain(
+        clock.get_slot(),
+        *mgr.get_recent_block_hash(),
+        tpu,
+        clock.get_arrival_slot( now )
+      );
+    }
 
-    mgr.poll(false);
+    if ( do_shard && now - stats_ts > int64_t(1e10) ) {
+      stats_ts = now;
+      PC_LOG_INF( "land rate" )
+        .add( "submitted", shards.get_num_submitted() )
+        .add( "resent", shards.get_num_resent() )
+        .add( "landed", shards.get_num_landed() )
+        .add( "expired", shards.get_num_expired() )
+        .add( "sent", shards.get_num_sent() )
+        .add( "updates_dropped", shards.get_num_dropped() )
+        .add( "tx_dropped", shards.get_num_tx_dropped() )
+        .end();
+    }
+    if ( now - stats_ts > int64_t(1e10) ) {
+      stats_ts = now;
+      if ( sp::alloc_scope::get_count() ) {
+        PC_LOG_ERR( "heap allocations in publish loop" )
+          .add( "count", sp::alloc_scope::get_count() )
+          .end();
+        sp::alloc_scope::reset_count();
+      }
+      PC_LOG_INF( "land rate" )
+        .add( "submitted", infl.get_num_submitted() )
+        .add( "resent", infl.get_num_resent() )
+        .add( "landed", infl.get_num_landed() )
+        .add( "failed", infl.get_num_failed() )
+        .add( "expired", infl.get_num_expired() )
+        .add( "presigned", pre.get_num_ready() )
+        .add( "signed_inline", pre.get_num_inline() )
+        .add( "breaker_trips", brk.get_num_trips() )
+        .add( "cu_price", fees.get_price() )
+        .end();
+    }
 
-    if (now - last > int64_t(5e8)) {
-      if (mgr.get_recent_block_hash() == nullptr)
-        continue;
+    // sharded markets publish from their own threads
+    if ( do_shard ) {
+      continue;
+    }
 
-      last = now;
+    // a standby keeps subscriptions, templates and schedule warm but
+    // leaves publishing to the lease holder
+    if ( do_ha && !ha.is_active() ) {
+      continue;
+    }
+
+    // hold due markets until a submission would land early in a slot
+    if ( do_align && !clock.is_send_window( now ) ) {
+      continue;
+    }
+
+    // gather every due market, then publish them in shared transactions
+    sp::alloc_scope checked;
+    if ( do_pack && !do_presign ) {
+      size_t num_due = 0;
+      packer.clear();
+      for ( int idx; num_due != due.size() && ( idx = sched.next( now ) ) >= 0; ) {
+        init_req( due[ num_due ], (unsigned)idx );
+        packer.add( (unsigned)idx, &due[ num_due++ ] );
+      }
+      const size_t num_tx = packer.pack();
+      for ( size_t t = 0; t != num_tx; ++t ) {
+        const sp::serum_pyth *const *reqs = packer.get_reqs( t );
+        const size_t num = packer.get_num( t );
+        char buf[sp::TX_MAX_SIZE];
+        pc::bincode tx;
+        tx.attach( buf );
+        sp::serum_pyth::build_tx( tx, reqs, num );
+        crk.submit(
+          packer.get_markets( t ),
+          num,
+          sp::serum_pyth::get_first_ix( reqs, num ),
+          (const uint8_t*)buf,
+          tx.size()
+        );
+      }
+      continue;
+    }
 
-      serum_pyth req[1];
-      req->set_publish(mgr.get_publish_key_pair());
-      req->set_pubcache(mgr.get_publish_key_cache());
-      req->set_program(&thisPID);
-      req->set_block_hash(mgr.get_recent_block_hash());
-      req->set_serum_prog(&serumPID);
-      req->set_serum_market(&market);
-      req->set_serum_bids(&bids);
-      req->set_serum_asks(&asks);
-      req->set_spl_quote_mint(&quoteMint);
-      req->set_spl_base_mint(&baseMint);
-      req->set_sysvar_clock(&sysvarClock);
-      req->set_pyth_prog(&pythPID);
-      req->set_pyth_price(&pythPrice);
-      mgr.submit(req);
+    for ( int idx; ( idx = sched.next( now ) ) >= 0; ) {
+      char buf[sp::TX_MAX_SIZE];
+      size_t len;
+      if ( do_presign ) {
+        len = pre.get_tx( (unsigned)idx, buf );
+        if ( len == 0 ) {
+          // already published against every known blockhash
+          sched.refund();
+          continue;
+        }
+      }
+      else {
+        sp::serum_pyth& req = due[ (unsigned)idx ];
+        init_req( req, (unsigned)idx );
+        pc::bincode tx;
+        tx.attach( buf );
+        req.build_tx( tx );
+        len = tx.size();
+      }
+      crk.submit( (unsigned)idx, (const uint8_t*)buf, len );
     }
   }
 
+  pre.stop();
+  shards.stop();
+  if ( do_ha ) {
+    // hand over to the standby without waiting for expiry
+    lease.release();
+  }
+  if ( do_hist && !hist.flush() ) {
+    std::cerr << "test_publish: " << hist.get_err_msg() << std::endl;
+  }
+
   // report any errors on exit
-  // please note that manager exits in error if error submitting price
+  // please note that manager exits in error if error submitting to pyth_tx;
+  // transaction failures on chain only isolate the failing market
   int retcode = 0;
   if ( mgr.get_is_err() ) {
     std::cerr << "test_publish: " << mgr.get_err_msg() << std::endl;
     retcode = 1;
   }
+  if ( src && src->get_is_err() ) {
+    std::cerr << "test_publish: " << src->get_err_msg() << std::endl;
+    retcode = 1;
+  }
 
   return retcode;
 }
@@ -0,0 +1,408 @@
+#include "market.hpp"
+#include "alloc_check.hpp"
+
+#include <pc/log.hpp>
+#include <serum-pyth/serum-pyth.h>
+
+#include <algorithm>
+
+using namespace sp;
+
+market_sub::~market_sub()
+{
+}
+
+void market_sub::on_book( market * )
+{
+}
+
+void market_sub::on_price( market * )
+{
+}
+
+market_fwd::~market_fwd()
+{
+}
+
+market::market()
+: idx_( 0 ),
+  sub_( nullptr ),
+  fwd_( nullptr ),
+  pub_( nullptr ),
+  book_slot_( 0 ),
+  pub_slot_( 0 ),
+  quote_lot_( 0 ),
+  base_lot_( 0 ),
+  quote_expo_( -1 ),
+  base_expo_( -1 ),
+  pyth_expo_( 0 ),
+  mode_( SP_MODE_MIDPT ),
+  has_expo_( false ),
+  book_subs_( true ),
+  acct_slot_()
+{
+}
+
+void market::init(
+  const std::string& serum_market,
+  const std::string& serum_bids,
+  const std::string& serum_asks,
+  const std::string& quote_mint,
+  const std::string& base_mint,
+  const std::string& pyth_price
+) {
+  serum_market_.init_from_text( serum_market );
+  serum_bids_.init_from_text( serum_bids );
+  serum_asks_.init_from_text( serum_asks );
+  spl_quote_mint_.init_from_text( quote_mint );
+  spl_base_mint_.init_from_text( base_mint );
+  pyth_price_.init_from_text( pyth_price );
+}
+
+void market::init( const market& mkt )
+{
+  serum_market_ = mkt.serum_market_;
+  serum_bids_ = mkt.serum_bids_;
+  serum_asks_ = mkt.serum_asks_;
+  spl_quote_mint_ = mkt.spl_quote_mint_;
+  spl_base_mint_ = mkt.spl_base_mint_;
+  pyth_price_ = mkt.pyth_price_;
+  idx_ = mkt.idx_;
+  mode_ = mkt.mode_;
+}
+
+void market::set_index( unsigned idx )
+{
+  idx_ = idx;
+}
+
+unsigned market::get_index() const
+{
+  return idx_;
+}
+
+void market::set_sub( market_sub *sub )
+{
+  sub_ = sub;
+}
+
+void market::set_fwd( market_fwd *fwd )
+{
+  fwd_ = fwd;
+}
+
+void market::set_pub_key( pc::pub_key *pub )
+{
+  pub_ = pub;
+}
+
+void market::set_mode( uint8_t mode )
+{
+  mode_ = mode;
+}
+
+uint8_t market::get_mode() const
+{
+  return mode_;
+}
+
+void market::set_book_subs( bool book_subs )
+{
+  book_subs_ = book_subs;
+}
+
+pc::pub_key *market::get_serum_market()
+{
+  return &serum_market_;
+}
+
+pc::pub_key *market::get_serum_bids()
+{
+  return &serum_bids_;
+}
+
+pc::pub_key *market::get_serum_asks()
+{
+  return &serum_asks_;
+}
+
+pc::pub_key *market::get_spl_quote_mint()
+{
+  return &spl_quote_mint_;
+}
+
+pc::pub_key *market::get_spl_base_mint()
+{
+  return &spl_base_mint_;
+}
+
+pc::pub_key *market::get_pyth_price()
+{
+  return &pyth_price_;
+}
+
+const book_top& market::get_bid() const
+{
+  return bid_;
+}
+
+const book_top& market::get_ask() const
+{
+  return ask_;
+}
+
+uint64_t market::get_book_slot() const
+{
+  return book_slot_;
+}
+
+uint64_t market::get_pub_slot() const
+{
+  return pub_slot_;
+}
+
+int32_t market::get_pyth_expo() const
+{
+  return pyth_expo_;
+}
+
+uint64_t market::get_serum_to_pyth() const
+{
+  if ( quote_lot_ == 0 || base_lot_ == 0 || quote_expo_ < 0
+    || base_expo_ < 0 || !has_expo_ ) {
+    return 0;
+  }
+  const sp_size_t s2p = sp_serum_to_pyth(
+    -pyth_expo_, quote_expo_, base_expo_, quote_lot_, base_lot_
+  );
+  return s2p == SP_SIZE_OVERFLOW ? 0 : s2p;
+}
+
+bool market::get_price(
+  int64_t& price,
+  uint64_t& conf,
+  bool& trading
+) const {
+  // Same conversion and status rule as sp_get_pyth_instruction().
+  price = 0;
+  conf = 0;
+  trading = false;
+  const sp_size_t s2p = get_serum_to_pyth();
+  if ( s2p == 0 ) {
+    return false;
+  }
+  trading = bid_.price_ != 0 && ask_.price_ != 0;
+  if ( !trading ) {
+    return true;
+  }
+  const sp_size_t bid = bid_.price_ * s2p;
+  const sp_size_t ask = ask_.price_ * s2p;
+  if ( mode_ == SP_MODE_MICROPRICE ) {
+    const sp_size_t micro = sp_microprice( bid, ask, bid_.qty_, ask_.qty_ );
+    price = ( int64_t )micro;
+    conf = sp_confidence_at( bid, ask, micro, SP_FEE_BPS );
+  }
+  else {
+    price = ( int64_t )sp_midpt( bid, ask );
+    conf = sp_confidence( bid, ask );
+  }
+  trading = sp_conf_within( price, conf, PRICE_CONF_THRESHOLD );
+  return true;
+}
+
+void market::subscribe( pc::manager& mgr )
+{
+  pub_ = mgr.get_publish_pub_key();
+  pc::rpc_client *clnt = mgr.get_rpc_client();
+
+  market_req_->set_account( &serum_market_ );
+  market_req_->set_sub( this );
+  clnt->send( market_req_ );
+
+  quote_req_->set_account( &spl_quote_mint_ );
+  quote_req_->set_sub( this );
+  clnt->send( quote_req_ );
+
+  base_req_->set_account( &spl_base_mint_ );
+  base_req_->set_sub( this );
+  clnt->send( base_req_ );
+
+  if ( book_subs_ ) {
+    bids_req_->set_account( &serum_bids_ );
+    bids_req_->set_sub( this );
+    clnt->send( bids_req_ );
+
+    asks_req_->set_account( &serum_asks_ );
+    asks_req_->set_sub( this );
+    clnt->send( asks_req_ );
+  }
+
+  price_req_->set_account( &pyth_price_ );
+  price_req_->set_sub( this );
+  clnt->send( price_req_ );
+}
+
+void market::on_response( pc::rpc::account_subscribe *res )
+{
+  if ( res->get_is_err() ) {
+    PC_LOG_ERR( "account subscription error" )
+      .add( "market", ( uint64_t )idx_ )
+      .add( "error", res->get_err_msg() )
+      .end();
+    return;
+  }
+  market_acct acct;
+  if ( res == bids_req_ ) {
+    acct = market_acct::bids;
+  }
+  else if ( res == asks_req_ ) {
+    acct = market_acct::asks;
+  }
+  else if ( res == price_req_ ) {
+    acct = market_acct::price;
+  }
+  else if ( res == market_req_ ) {
+    acct = market_acct::market;
+  }
+  else if ( res == quote_req_ ) {
+    acct = market_acct::quote_mint;
+  }
+  else if ( res == base_req_ ) {
+    acct = market_acct::base_mint;
+  }
+  else {
+    return;
+  }
+  const uint8_t *data;
+  const size_t len = res->get_data( data );
+  on_update( acct, data, len, res->get_slot() );
+}
+
+void market::on_update(
+  market_acct acct,
+  const uint8_t *data,
+  size_t len,
+  uint64_t slot
+) {
+  // Sources race, e.g. a local stream and RPC after a reconnect.
+  uint64_t& last = acct_slot_[ ( unsigned )acct ];
+  if ( slot < last ) {
+    return;
+  }
+  last = slot;
+  if ( fwd_ ) {
+    fwd_->on_account( this, acct, data, len, slot );
+  }
+  else {
+    on_account( acct, data, len, slot );
+  }
+}
+
+void market::on_account(
+  market_acct acct,
+  const uint8_t *data,
+  size_t len,
+  uint64_t slot
+) {
+  alloc_scope checked;
+  switch ( acct ) {
+    case market_acct::bids:
+      on_book_data( data, len, slot, book_side::bids, bid_ );
+      break;
+    case market_acct::asks:
+      on_book_data( data, len, slot, book_side::asks, ask_ );
+      break;
+    case market_acct::price:
+      on_price_data( data, len );
+      break;
+    case market_acct::market:
+      on_market_data( data, len );
+      break;
+    case market_acct::quote_mint:
+      on_mint_data( data, len, quote_expo_ );
+      break;
+    case market_acct::base_mint:
+      on_mint_data( data, len, base_expo_ );
+      break;
+  }
+}
+
+void market::on_book_data(
+  const uint8_t *data,
+  size_t len,
+  uint64_t slot,
+  book_side side,
+  book_top& top
+) {
+  book_top upd;
+  if ( !get_book_top( data, len, side, upd ) ) {
+    PC_LOG_ERR( "invalid serum book" )
+      .add( "market", ( uint64_t )idx_ )
+      .add( "side", side == book_side::bids ? "bids" : "asks" )
+      .end();
+    return;
+  }
+  book_slot_ = slot;
+  if ( upd.price_ != top.price_ || upd.qty_ != top.qty_ ) {
+    top = upd;
+    if ( sub_ ) {
+      sub_->on_book( this );
+    }
+  }
+}
+
+void market::on_price_data( const uint8_t *data, size_t len )
+{
+  const pc_price_t *price = ( const pc_price_t* )data;
+  if ( len < sizeof( pc_price_t ) ) {
+    return;
+  }
+  pyth_expo_ = price->expo_;
+  has_expo_ = true;
+  if ( !pub_ ) {
+    return;
+  }
+  // num_ comes from the account, which may be malformed.
+  const uint32_t num = std::min( price->num_, ( uint32_t )PC_COMP_SIZE );
+  for ( uint32_t i = 0; i < num; ++i ) {
+    const pc_price_comp_t& comp = price->comp_[ i ];
+    if ( *pub_ == *( const pc::pub_key* )&comp.pub_ ) {
+      // Ignore updates from other publishers.
+      if ( comp.latest_.pub_slot_ != pub_slot_ ) {
+        pub_slot_ = comp.latest_.pub_slot_;
+        if ( sub_ ) {
+          sub_->on_price( this );
+        }
+      }
+      break;
+    }
+  }
+}
+
+void market::on_market_data( const uint8_t *data, size_t len )
+{
+  uint8_t *iter = (uint8_t*)data;
+  uint64_t left = len;
+  if ( !trim_serum_padding( &iter, &left )
+    || left < sizeof( serum_flags_t ) + sizeof( serum_market_t ) ) {
+    PC_LOG_ERR( "invalid serum market" )
+      .add( "market", ( uint64_t )idx_ )
+      .end();
+    return;
+  }
+  const serum_market_t *mkt = (serum_market_t*)( iter + sizeof( serum_flags_t ) );
+  quote_lot_ = mkt->QuoteLotSize;
+  base_lot_ = mkt->BaseLotSize;
+}
+
+void market::on_mint_data( const uint8_t *data, size_t len, int32_t& expo )
+{
+  const spl_mint_t *mint = ( const spl_mint_t* )data;
+  if ( len != sizeof( spl_mint_t ) ) {
+    PC_LOG_ERR( "invalid spl mint" )
+      .add( "market", ( uint64_t )idx_ )
+      .end();
+    return;
+  }
+  expo = mint->Decimals;
+}
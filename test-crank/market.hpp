@@ -0,0 +1,177 @@
+#pragma once
+
+#include "book.hpp"
+
+#include <pc/manager.hpp>
+
+#include <string>
+
+namespace sp
+{
+
+  class market;
+
+  // Accounts of a market, in subscription order.
+  enum class market_acct : uint8_t
+  {
+    market,
+    quote_mint,
+    base_mint,
+    bids,
+    asks,
+    price
+  };
+
+  // Market update callbacks.
+  class market_sub
+  {
+  public:
+    virtual ~market_sub();
+
+    // Best bid or ask changed.
+    virtual void on_book( market * );
+
+    // Our component's pub_slot_ in the pyth price account changed.
+    virtual void on_price( market * );
+  };
+
+  // Receives raw account notifications in place of the market decoding
+  // them, e.g. to decode them on another thread. data is only valid
+  // during the call.
+  class market_fwd
+  {
+  public:
+    virtual ~market_fwd();
+
+    virtual void on_account(
+      market *,
+      market_acct,
+      const uint8_t *data,
+      size_t len,
+      uint64_t slot
+    ) = 0;
+  };
+
+  // Accounts of one Serum market and the pyth price it publishes to,
+  // plus subscriptions tracking the live book and on-chain price.
+  class market : public pc::rpc_sub_i<pc::rpc::account_subscribe>
+  {
+  public:
+
+    market();
+
+    // Base58 account keys.
+    void init(
+      const std::string& serum_market,
+      const std::string& serum_bids,
+      const std::string& serum_asks,
+      const std::string& quote_mint,
+      const std::string& base_mint,
+      const std::string& pyth_price
+    );
+
+    // Same accounts, index and mode as another market, e.g. a copy that
+    // decodes its forwarded updates on another thread.
+    void init( const market& );
+
+    void set_index( unsigned );
+    unsigned get_index() const;
+
+    void set_sub( market_sub * );
+    void set_fwd( market_fwd * );
+
+    // Publisher whose component pub_slot_ is tracked. Set by subscribe().
+    void set_pub_key( pc::pub_key * );
+
+    // sp_mode_t the program is invoked with (default SP_MODE_MIDPT).
+    void set_mode( uint8_t );
+    uint8_t get_mode() const;
+
+    pc::pub_key *get_serum_market();
+    pc::pub_key *get_serum_bids();
+    pc::pub_key *get_serum_asks();
+    pc::pub_key *get_spl_quote_mint();
+    pc::pub_key *get_spl_base_mint();
+    pc::pub_key *get_pyth_price();
+
+    const book_top& get_bid() const;
+    const book_top& get_ask() const;
+
+    // Slot of the last bids/asks notification.
+    uint64_t get_book_slot() const;
+
+    // pub_slot_ of our own component in the pyth price account.
+    uint64_t get_pub_slot() const;
+
+    // Exponent of the pyth price account.
+    int32_t get_pyth_expo() const;
+
+    // Multiplier from serum to pyth prices, 0 until the market, mints and
+    // price account have been read or if it overflows.
+    uint64_t get_serum_to_pyth() const;
+
+    // Price and confidence the program would publish for the current
+    // book, in pyth units. Returns false until the market, mints and
+    // price account have been read or if the conversion overflows.
+    bool get_price( int64_t& price, uint64_t& conf, bool& trading ) const;
+
+    // Subscribe to bids and asks over RPC (default true), e.g. false
+    // while a local account stream delivers them.
+    void set_book_subs( bool );
+
+    // (Re)subscribe to the market, mints, bids, asks and price accounts.
+    void subscribe( pc::manager& );
+
+    void on_response( pc::rpc::account_subscribe * ) override;
+
+    // An account update from any source: forwarded if set_fwd(), else
+    // decoded. Updates older than the account's last one are dropped.
+    void on_update(
+      market_acct, const uint8_t *data, size_t len, uint64_t slot
+    );
+
+    // Decode an account notification, as received or forwarded.
+    void on_account(
+      market_acct, const uint8_t *data, size_t len, uint64_t slot
+    );
+
+  private:
+
+    void on_book_data( const uint8_t *, size_t, uint64_t, book_side, book_top& );
+    void on_price_data( const uint8_t *, size_t );
+    void on_market_data( const uint8_t *, size_t );
+    void on_mint_data( const uint8_t *, size_t, int32_t& );
+
+    unsigned     idx_;
+    market_sub  *sub_;
+    market_fwd  *fwd_;
+    pc::pub_key *pub_;
+    pc::pub_key  serum_market_;
+    pc::pub_key  serum_bids_;
+    pc::pub_key  serum_asks_;
+    pc::pub_key  spl_quote_mint_;
+    pc::pub_key  spl_base_mint_;
+    pc::pub_key  pyth_price_;
+    book_top     bid_;
+    book_top     ask_;
+    uint64_t     book_slot_;
+    uint64_t     pub_slot_;
+    uint64_t     quote_lot_;
+    uint64_t     base_lot_;
+    int32_t      quote_expo_;
+    int32_t      base_expo_;
+    int32_t      pyth_expo_;
+    uint8_t      mode_;
+    bool         has_expo_;
+    bool         book_subs_;
+    uint64_t     acct_slot_[ 6 ];  // last update, by market_acct
+
+    pc::rpc::account_subscribe market_req_[1];
+    pc::rpc::account_subscribe quote_req_[1];
+    pc::rpc::account_subscribe base_req_[1];
+    pc::rpc::account_subscribe bids_req_[1];
+    pc::rpc::account_subscribe asks_req_[1];
+    pc::rpc::account_subscribe price_req_[1];
+  };
+
+}
@@ -0,0 +1,300 @@
+#include "notify.hpp"
+
+#include <immintrin.h>
+
+#include <array>
+#include <cstring>
+
+using namespace sp;
+
+// 6-bit value of each base64 character, -1 for the rest.
+static constexpr std::array<int8_t, 256> make_b64_table()
+{
+  std::array<int8_t, 256> t{};
+  for ( unsigned i = 0; i != 256; ++i ) {
+    t[ i ] = -1;
+  }
+  for ( unsigned i = 0; i != 26; ++i ) {
+    t[ 'A' + i ] = ( int8_t )i;
+    t[ 'a' + i ] = ( int8_t )( 26 + i );
+  }
+  for ( unsigned i = 0; i != 10; ++i ) {
+    t[ '0' + i ] = ( int8_t )( 52 + i );
+  }
+  t[ ( unsigned )'+' ] = 62;
+  t[ ( unsigned )'/' ] = 63;
+  return t;
+}
+
+static constexpr std::array<int8_t, 256> B64 = make_b64_table();
+
+// Whole quads from src, the last one with optional padding.
+static size_t base64_scalar( const char *src, size_t len, uint8_t *dst )
+{
+  const uint8_t *in = ( const uint8_t* )src;
+  uint8_t *out = dst;
+  for ( size_t i = 0; i + 4 < len; i += 4 ) {
+    const int a = B64[ in[ i ] ], b = B64[ in[ i + 1 ] ];
+    const int c = B64[ in[ i + 2 ] ], d = B64[ in[ i + 3 ] ];
+    if ( ( a | b | c | d ) < 0 ) {
+      return BASE64_ERR;
+    }
+    const uint32_t v = ( uint32_t )( a << 18 | b << 12 | c << 6 | d );
+    *out++ = ( uint8_t )( v >> 16 );
+    *out++ = ( uint8_t )( v >> 8 );
+    *out++ = ( uint8_t )v;
+  }
+  if ( len == 0 ) {
+    return 0;
+  }
+  const uint8_t *q = in + len - 4;
+  const int a = B64[ q[ 0 ] ], b = B64[ q[ 1 ] ];
+  const int c = q[ 2 ] == '=' && q[ 3 ] == '=' ? 0 : B64[ q[ 2 ] ];
+  const int d = q[ 3 ] == '=' ? 0 : B64[ q[ 3 ] ];
+  if ( ( a | b | c | d ) < 0 ) {
+    return BASE64_ERR;
+  }
+  const uint32_t v = ( uint32_t )( a << 18 | b << 12 | c << 6 | d );
+  *out++ = ( uint8_t )( v >> 16 );
+  if ( q[ 2 ] != '=' ) {
+    *out++ = ( uint8_t )( v >> 8 );
+  }
+  if ( q[ 3 ] != '=' ) {
+    *out++ = ( uint8_t )v;
+  }
+  return ( size_t )( out - dst );
+}
+
+// 32 characters to 24 bytes per step (W. Muła, D. Lemire, "Faster
+// Base64 Encoding and Decoding Using AVX2 Instructions"): classify by
+// nibble lookups, add a per-range offset, then pack 6-bit fields with
+// multiply-adds. Stops 16 characters short of the end, so the padded
+// last quad is decoded by the scalar code and the 32-byte stores stay
+// inside the output.
+__attribute__(( target( "avx2" ) ))
+static size_t base64_avx2( const char *src, size_t len, uint8_t *dst )
+{
+  const __m256i lut_lo = _mm256_setr_epi8(
+    0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+    0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a,
+    0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+    0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a
+  );
+  const __m256i lut_hi = _mm256_setr_epi8(
+    0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+    0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+    0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+    0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10
+  );
+  const __m256i lut_roll = _mm256_setr_epi8(
+    0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0
+  );
+  const __m256i mask_2f = _mm256_set1_epi8( 0x2f );
+  const __m256i pack_ab = _mm256_set1_epi32( 0x01400140 );
+  const __m256i pack_abc = _mm256_set1_epi32( 0x00011000 );
+  const __m256i order = _mm256_setr_epi8(
+    2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+    2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1
+  );
+  const __m256i lanes = _mm256_setr_epi32( 0, 1, 2, 4, 5, 6, -1, -1 );
+  size_t i = 0;
+  uint8_t *out = dst;
+  for ( ; i + 48 <= len; i += 32, out += 24 ) {
+    __m256i in = _mm256_loadu_si256( ( const __m256i* )( src + i ) );
+    const __m256i hi_nib = _mm256_and_si256( _mm256_srli_epi32( in, 4 ), mask_2f );
+    const __m256i lo_nib = _mm256_and_si256( in, mask_2f );
+    const __m256i hi = _mm256_shuffle_epi8( lut_hi, hi_nib );
+    const __m256i lo = _mm256_shuffle_epi8( lut_lo, lo_nib );
+    if ( !_mm256_testz_si256( lo, hi ) ) {
+      return BASE64_ERR;
+    }
+    const __m256i eq_2f = _mm256_cmpeq_epi8( in, mask_2f );
+    const __m256i roll = _mm256_shuffle_epi8(
+      lut_roll, _mm256_add_epi8( eq_2f, hi_nib )
+    );
+    in = _mm256_add_epi8( in, roll );
+    in = _mm256_madd_epi16( _mm256_maddubs_epi16( in, pack_ab ), pack_abc );
+    in = _mm256_permutevar8x32_epi32( _mm256_shuffle_epi8( in, order ), lanes );
+    _mm256_storeu_si256( ( __m256i* )out, in );
+  }
+  const size_t num = base64_scalar( src + i, len - i, out );
+  return num == BASE64_ERR ? num : ( size_t )( out - dst ) + num;
+}
+
+size_t sp::base64_decode(
+  const char *src,
+  size_t len,
+  uint8_t *dst,
+  batch_isa isa
+) {
+  if ( len % 4 != 0 ) {
+    return BASE64_ERR;
+  }
+  if ( isa > get_batch_isa() ) {
+    isa = get_batch_isa();
+  }
+  if ( isa != batch_isa::scalar ) {
+    return base64_avx2( src, len, dst );
+  }
+  return base64_scalar( src, len, dst );
+}
+
+bool sp::base58_decode32( const char *src, size_t len, uint8_t dst[ 32 ] )
+{
+  static const char ALPHABET[] =
+    "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
+  if ( len == 0 || len > 44 ) {
+    return false;
+  }
+  std::memset( dst, 0, 32 );
+  for ( size_t i = 0; i != len; ++i ) {
+    const char *pos = std::strchr( ALPHABET, src[ i ] );
+    if ( !pos || !src[ i ] ) {
+      return false;
+    }
+    uint32_t carry = ( uint32_t )( pos - ALPHABET );
+    for ( int j = 31; j >= 0; --j ) {
+      carry += 58U * dst[ j ];
+      dst[ j ] = ( uint8_t )carry;
+      carry >>= 8;
+    }
+    if ( carry ) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static const char *skip_ws( const char *p, const char *end )
+{
+  while ( p < end && ( *p == ' ' || *p == '\t' || *p == '\r' || *p == '\n' ) ) {
+    ++p;
+  }
+  return p;
+}
+
+// Closing quote of the string whose contents start at p.
+static const char *find_quote( const char *p, const char *end )
+{
+  for ( ;; ) {
+    const char *q = ( const char* )std::memchr( p, '"', ( size_t )( end - p ) );
+    if ( !q ) {
+      return nullptr;
+    }
+    size_t num_bs = 0;
+    for ( const char *b = q; b > p && b[ -1 ] == '\\'; --b ) {
+      ++num_bs;
+    }
+    if ( num_bs % 2 == 0 ) {
+      return q;
+    }
+    p = q + 1;
+  }
+}
+
+static bool is_key( const char *s, const char *e, const char *key )
+{
+  const size_t len = std::strlen( key );
+  return ( size_t )( e - s ) == len && std::memcmp( s, key, len ) == 0;
+}
+
+bool sp::scan_notify( const char *msg, size_t len, notify_fields& f )
+{
+  f = notify_fields();
+  bool has_slot = false;
+  const char *end = msg + len;
+  for ( const char *p = msg; p < end; ) {
+    p = ( const char* )std::memchr( p, '"', ( size_t )( end - p ) );
+    if ( !p ) {
+      break;
+    }
+    const char *s = p + 1;
+    const char *e = find_quote( s, end );
+    if ( !e ) {
+      return false;
+    }
+    p = e + 1;
+    const char *v = skip_ws( p, end );
+    if ( v == end || *v != ':' ) {
+      continue; // a value, not a key
+    }
+    v = skip_ws( v + 1, end );
+    if ( v == end ) {
+      break;
+    }
+    if ( !has_slot && is_key( s, e, "slot" ) ) {
+      uint64_t slot = 0;
+      const char *d = v;
+      for ( ; d < end && *d >= '0' && *d <= '9'; ++d ) {
+        slot = slot * 10 + ( uint64_t )( *d - '0' );
+      }
+      has_slot = d != v;
+      f.slot_ = slot;
+      p = d;
+    }
+    else if ( !f.pubkey_ && *v == '"' && is_key( s, e, "pubkey" ) ) {
+      const char *q = find_quote( v + 1, end );
+      if ( !q ) {
+        return false;
+      }
+      f.pubkey_ = v + 1;
+      f.pubkey_len_ = ( size_t )( q - v - 1 );
+      p = q + 1;
+    }
+    else if ( !f.data_ && *v == '[' && is_key( s, e, "data" ) ) {
+      // [ "<base64>", "base64" ]; base64 has no escapes.
+      const char *b = skip_ws( v + 1, end );
+      if ( b == end || *b != '"' ) {
+        continue;
+      }
+      const char *q = ( const char* )std::memchr( b + 1, '"', ( size_t )( end - b - 1 ) );
+      if ( !q ) {
+        return false;
+      }
+      const char *n = skip_ws( q + 1, end );
+      if ( n != end && *n == ',' ) {
+        n = skip_ws( n + 1, end );
+      }
+      if ( end - n >= 8 && std::memcmp( n, "\"base64\"", 8 ) == 0 ) {
+        f.data_ = b + 1;
+        f.data_len_ = ( size_t )( q - b - 1 );
+      }
+      p = q + 1;
+    }
+  }
+  return has_slot && f.data_;
+}
+
+bool notify_decoder::decode( const char *msg, size_t len )
+{
+  len_ = 0;
+  if ( !scan_notify( msg, len, fields_ ) ) {
+    return false;
+  }
+  const size_t max = base64_max_len( fields_.data_len_ );
+  if ( buf_.size() < max ) {
+    buf_.resize( max );
+  }
+  const size_t num = base64_decode( fields_.data_, fields_.data_len_, buf_.data() );
+  if ( num == BASE64_ERR ) {
+    return false;
+  }
+  len_ = num;
+  return true;
+}
+
+const notify_fields& notify_decoder::get_fields() const
+{
+  return fields_;
+}
+
+const uint8_t *notify_decoder::get_data() const
+{
+  return buf_.data();
+}
+
+size_t notify_decoder::get_len() const
+{
+  return len_;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "batch.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace sp
+{
+
+  // Decoding of RPC account and program notifications without a DOM:
+  // one pass locating the fields we use, then a SIMD base64 decode of
+  // the account data into a reused buffer.
+
+  // Returned by base64_decode() for malformed input.
+  static const size_t BASE64_ERR = SIZE_MAX;
+
+  // Upper bound of the decoded length of len base64 characters.
+  inline size_t base64_max_len( size_t len ) { return len / 4 * 3 + 3; }
+
+  // Standard base64 with padding, as RPC encodes account data. Writes at
+  // most base64_max_len( len ) bytes to dst and returns the number
+  // decoded, or BASE64_ERR. Falls back to the best kernel this CPU
+  // supports if isa isn't; AVX-512 uses the AVX2 kernel.
+  size_t base64_decode(
+    const char *src,
+    size_t len,
+    uint8_t *dst,
+    batch_isa = get_batch_isa()
+  );
+
+  // 32-byte base58 key, e.g. a pubkey. Returns false if malformed.
+  bool base58_decode32( const char *src, size_t len, uint8_t dst[ 32 ] );
+
+  // Fields of a notification, pointing into the message.
+  struct notify_fields
+  {
+    uint64_t    slot_;        // context slot
+    const char *pubkey_;      // programNotification only, else nullptr
+    size_t      pubkey_len_;
+    const char *data_;        // base64 account data
+    size_t      data_len_;
+  };
+
+  // Find the first "slot", "pubkey" and "data": [ "...", "base64" ]
+  // values of an accountNotification or programNotification. Strings
+  // are skipped with memchr(); nothing is copied. Returns false if the
+  // slot or base64 data is missing.
+  bool scan_notify( const char *msg, size_t len, notify_fields& );
+
+  // Decodes notifications' data into a buffer that grows to the largest
+  // account seen and is reused after that.
+  class notify_decoder
+  {
+  public:
+
+    // Scan msg and decode its data. Returns false if malformed.
+    bool decode( const char *msg, size_t len );
+
+    const notify_fields& get_fields() const;
+    const uint8_t *get_data() const;
+    size_t get_len() const;
+
+  private:
+
+    notify_fields fields_ = {};
+    std::vector<uint8_t> buf_;
+    size_t len_ = 0;
+  };
+
+}
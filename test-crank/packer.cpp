@@ -0,0 +1,243 @@
+#include "packer.hpp"
+#include "lookup.hpp"
+
+#include <algorithm>
+
+using namespace sp;
+
+tx_packer::tx_packer()
+: max_per_tx_( 0 ),
+  min_growth_( 0 ),
+  num_bins_( 0 )
+{
+}
+
+void tx_packer::set_max_per_tx( unsigned max )
+{
+  max_per_tx_ = max;
+}
+
+void tx_packer::clear()
+{
+  items_.clear();
+  for ( size_t i = 0; i != num_bins_; ++i ) {
+    bins_[ i ].mkts_.clear();
+    bins_[ i ].reqs_.clear();
+    bins_[ i ].keys_.clear();
+    bins_[ i ].tags_.clear();
+  }
+  num_bins_ = 0;
+  open_.clear();
+}
+
+void tx_packer::add( unsigned mkt, const serum_pyth *req )
+{
+  items_.emplace_back();
+  item& it = items_.back();
+  it.mkt_ = mkt;
+  it.req_ = req;
+  it.size_ = serum_pyth::get_tx_size( &req, 1, &it.tx_keys_ );
+  it.units_ = req->get_cu_limit() ? req->get_cu_limit() : TX_DEFAULT_IX_UNITS;
+  it.has_limit_ = req->get_cu_limit() != 0;
+  it.ix_size_ = req->get_ix_size();
+
+  pc::pub_key keys[ serum_pyth::NUM_KEYS ];
+  uint8_t sizes[ serum_pyth::NUM_KEYS ];
+  req->get_keys( keys );
+  req->get_key_sizes( keys, sizes );
+  it.num_keys_ = 0;
+  for ( unsigned k = 0; k != serum_pyth::NUM_KEYS; ++k ) {
+    if ( std::find( it.keys_, it.keys_ + it.num_keys_, keys[ k ] )
+      == it.keys_ + it.num_keys_ ) {
+      it.keys_[ it.num_keys_ ] = keys[ k ];
+      it.tags_[ it.num_keys_ ] = pub_key_hash()( keys[ k ] );
+      it.key_sizes_[ it.num_keys_++ ] = sizes[ k ];
+    }
+  }
+}
+
+bool tx_packer::bin::has( const pc::pub_key& key, size_t tag ) const
+{
+  for ( size_t i = 0; i != tags_.size(); ++i ) {
+    if ( tags_[ i ] == tag && keys_[ i ] == key ) {
+      return true;
+    }
+  }
+  return false;
+}
+
+size_t tx_packer::get_size( const item& it, const bin& b ) const
+{
+  if ( ( max_per_tx_ && b.reqs_.size() >= max_per_tx_ )
+    || b.units_ + it.units_ > TX_MAX_UNITS ) {
+    return SIZE_MAX;
+  }
+  size_t size = b.size_ + it.ix_size_;
+  unsigned num_keys = b.num_keys_;
+  bool has_alt = b.has_alt_;
+  for ( unsigned k = 0; k != it.num_keys_; ++k ) {
+    if ( b.has( it.keys_[ k ], it.tags_[ k ] ) ) {
+      continue;
+    }
+    size += it.key_sizes_[ k ];
+    ++num_keys;
+    if ( it.key_sizes_[ k ] != sizeof( pc::pub_key ) && !has_alt ) {
+      size += serum_pyth::LOOKUP_SIZE;
+      has_alt = true;
+    }
+  }
+  // A market of unknown usage drops the transaction's unit limit.
+  if ( b.has_limit_ && !it.has_limit_ ) {
+    size -= serum_pyth::get_budget_size( true, b.has_price_ )
+      - serum_pyth::get_budget_size( false, b.has_price_ );
+    num_keys -= b.has_price_ ? 0 : 1;
+  }
+  if ( size > TX_MAX_SIZE || num_keys > TX_MAX_KEYS ) {
+    return SIZE_MAX;
+  }
+  return size;
+}
+
+size_t tx_packer::open_bin( const item& it )
+{
+  if ( num_bins_ == bins_.size() ) {
+    bins_.emplace_back();
+    bins_.back().keys_.reserve( TX_MAX_KEYS );
+    bins_.back().tags_.reserve( TX_MAX_KEYS );
+  }
+  bin& b = bins_[ num_bins_ ];
+  b.size_ = 0;
+  b.num_keys_ = 0;
+  b.units_ = 0;
+  b.has_alt_ = false;
+  b.has_limit_ = it.req_->get_budget_prog() && it.has_limit_;
+  b.has_price_ = it.req_->get_budget_prog() && it.req_->get_cu_price();
+  if ( open_.size() == MAX_OPEN ) {
+    open_.erase( open_.begin() );
+  }
+  open_.push_back( num_bins_ );
+  return num_bins_++;
+}
+
+void tx_packer::place(
+  const item& it,
+  bin& b,
+  size_t size,
+  unsigned num_keys
+) {
+  b.mkts_.push_back( it.mkt_ );
+  b.reqs_.push_back( it.req_ );
+  b.size_ = size;
+  b.num_keys_ = num_keys;
+  b.units_ += it.units_;
+  b.has_limit_ = b.has_limit_ && it.has_limit_;
+  for ( unsigned k = 0; k != it.num_keys_; ++k ) {
+    if ( !b.has( it.keys_[ k ], it.tags_[ k ] ) ) {
+      b.keys_.push_back( it.keys_[ k ] );
+      b.tags_.push_back( it.tags_[ k ] );
+      b.has_alt_ = b.has_alt_ || it.key_sizes_[ k ] != sizeof( pc::pub_key );
+    }
+  }
+}
+
+size_t tx_packer::pack()
+{
+  // Largest first; ties by market for a stable grouping.
+  order_.clear();
+  min_growth_ = SIZE_MAX;
+  for ( size_t i = 0; i != items_.size(); ++i ) {
+    order_.push_back( i );
+    const item& it = items_[ i ];
+    size_t growth = it.ix_size_
+      + *std::min_element( it.key_sizes_, it.key_sizes_ + it.num_keys_ );
+    if ( !it.has_limit_ ) {
+      const size_t drop = serum_pyth::get_budget_size( true, false );
+      growth = growth > drop ? growth - drop : 0;
+    }
+    min_growth_ = std::min( min_growth_, growth );
+  }
+  std::sort( order_.begin(), order_.end(), [this]( size_t a, size_t b ) {
+    const item& ia = items_[ a ];
+    const item& ib = items_[ b ];
+    return ia.size_ != ib.size_ ? ia.size_ > ib.size_ : ia.mkt_ < ib.mkt_;
+  } );
+
+  for ( size_t i : order_ ) {
+    const item& it = items_[ i ];
+    size_t best = open_.size();
+    size_t best_size = 0;
+    for ( size_t j = 0; j != open_.size(); ++j ) {
+      const bin& b = bins_[ open_[ j ] ];
+      const size_t size = get_size( it, b );
+      if ( size == SIZE_MAX ) {
+        continue;
+      }
+      // Least growth, then the fuller transaction.
+      if ( best == open_.size() ) {
+        best = j;
+        best_size = size;
+        continue;
+      }
+      const bin& bb = bins_[ open_[ best ] ];
+      const int64_t growth = ( int64_t )size - ( int64_t )b.size_;
+      const int64_t best_growth = ( int64_t )best_size - ( int64_t )bb.size_;
+      if ( growth < best_growth
+        || ( growth == best_growth && b.size_ > bb.size_ ) ) {
+        best = j;
+        best_size = size;
+      }
+    }
+
+    // Requests are sized against their own lookup table but built with
+    // the first one's, so check the transaction chosen exactly.
+    if ( best != open_.size() ) {
+      bin& b = bins_[ open_[ best ] ];
+      b.reqs_.push_back( it.req_ );
+      unsigned num_keys;
+      const size_t size = serum_pyth::get_tx_size(
+        b.reqs_.data(), b.reqs_.size(), &num_keys
+      );
+      b.reqs_.pop_back();
+      if ( size <= TX_MAX_SIZE && num_keys <= TX_MAX_KEYS ) {
+        place( it, b, size, num_keys );
+      }
+      else {
+        best = open_.size();
+      }
+    }
+    if ( best == open_.size() ) {
+      const size_t idx = open_bin( it );
+      best = open_.size() - 1;
+      place( it, bins_[ idx ], it.size_, it.tx_keys_ );
+    }
+
+    // Stop trying a transaction nothing more fits in.
+    const bin& b = bins_[ open_[ best ] ];
+    if ( ( max_per_tx_ && b.reqs_.size() >= max_per_tx_ )
+      || b.size_ + min_growth_ > TX_MAX_SIZE
+      || b.num_keys_ >= TX_MAX_KEYS ) {
+      open_.erase( open_.begin() + ( ptrdiff_t )best );
+    }
+  }
+  return num_bins_;
+}
+
+size_t tx_packer::get_num_tx() const
+{
+  return num_bins_;
+}
+
+size_t tx_packer::get_num( size_t tx ) const
+{
+  return bins_[ tx ].reqs_.size();
+}
+
+const unsigned *tx_packer::get_markets( size_t tx ) const
+{
+  return bins_[ tx ].mkts_.data();
+}
+
+const serum_pyth *const *tx_packer::get_reqs( size_t tx ) const
+{
+  return bins_[ tx ].reqs_.data();
+}
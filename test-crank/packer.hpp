@@ -0,0 +1,95 @@
+#pragma once
+
+#include "serum_pyth.hpp"
+
+#include <vector>
+
+namespace sp
+{
+
+  // Groups markets due to publish into as few transactions as fit in a
+  // packet, one serum-pyth instruction each. This is bin packing where
+  // items share part of their size: markets with a common quote mint
+  // cost less together, and every transaction pays once for the
+  // publisher, clock and programs. Markets go largest first to the
+  // transaction they grow least (best fit decreasing), within the
+  // packet size, account lock and compute unit limits.
+  //
+  // Each transaction keeps its accounts and size, so trying a market
+  // costs only its accounts the transaction doesn't have yet, and only
+  // the MAX_OPEN most recently opened transactions with room are tried.
+  class tx_packer
+  {
+  public:
+
+    tx_packer();
+
+    // Max markets per transaction (default 0: only the limits above).
+    void set_max_per_tx( unsigned );
+
+    void clear();
+
+    // req must stay valid until clear().
+    void add( unsigned mkt, const serum_pyth *req );
+
+    // Group the added markets. Returns the number of transactions.
+    size_t pack();
+
+    size_t get_num_tx() const;
+
+    // Markets of transaction tx and their requests, in instruction order.
+    size_t get_num( size_t tx ) const;
+    const unsigned *get_markets( size_t tx ) const;
+    const serum_pyth *const *get_reqs( size_t tx ) const;
+
+    // Transactions a market may join.
+    static const size_t MAX_OPEN = 16;
+
+  private:
+
+    struct item
+    {
+      unsigned          mkt_;
+      const serum_pyth *req_;
+      size_t            size_;      // alone in a transaction
+      unsigned          tx_keys_;   // accounts then
+      uint64_t          units_;
+      bool              has_limit_; // a compute unit limit of its own
+      size_t            ix_size_;   // besides accounts
+      unsigned          num_keys_;  // distinct
+      pc::pub_key       keys_[ serum_pyth::NUM_KEYS ];
+      size_t            tags_[ serum_pyth::NUM_KEYS ];
+      uint8_t           key_sizes_[ serum_pyth::NUM_KEYS ];
+    };
+
+    struct bin
+    {
+      bool has( const pc::pub_key&, size_t tag ) const;
+
+      std::vector<unsigned>          mkts_;
+      std::vector<const serum_pyth*> reqs_;
+      std::vector<pc::pub_key>       keys_;  // of the instructions
+      std::vector<size_t>            tags_;  // pub_key_hash of each
+      size_t                         size_;
+      unsigned                       num_keys_;
+      uint64_t                       units_;
+      bool                           has_alt_;
+      bool                           has_limit_;  // SetComputeUnitLimit
+      bool                           has_price_;  // SetComputeUnitPrice
+    };
+
+    // Size of b with it added, or SIZE_MAX if it doesn't fit.
+    size_t get_size( const item&, const bin& b ) const;
+    size_t open_bin( const item& );
+    void place( const item&, bin&, size_t size, unsigned num_keys );
+
+    unsigned            max_per_tx_;
+    size_t              min_growth_;  // lower bound for any item
+    std::vector<item>   items_;
+    std::vector<size_t> order_;       // items_, largest first
+    std::vector<bin>    bins_;
+    size_t              num_bins_;    // bins_ is reused across cycles
+    std::vector<size_t> open_;        // bins with room, oldest first
+  };
+
+}
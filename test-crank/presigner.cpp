@@ -0,0 +1,248 @@
+#include "presigner.hpp"
+
+#include <algorithm>
+
+using namespace sp;
+
+presigner::presigner()
+: depth_( 4 ),
+  seq_( 0 ),
+  do_run_( false ),
+  num_ready_( 0 ),
+  num_inline_( 0 )
+{
+}
+
+presigner::~presigner()
+{
+  stop();
+}
+
+void presigner::set_depth( unsigned depth )
+{
+  depth_ = depth;
+}
+
+unsigned presigner::add_market( const serum_pyth& tmpl )
+{
+  unsigned idx;
+  {
+    std::lock_guard<std::mutex> lck( mtx_ );
+    mkts_.emplace_back();
+    market& mkt = mkts_.back();
+    mkt.tmpl_ = tmpl;
+    mkt.tmpl_.set_pubcache( nullptr );
+    mkt.txs_.resize( depth_ );
+    idx = ( unsigned )( mkts_.size() - 1 );
+  }
+  cv_.notify_one();
+  return idx;
+}
+
+void presigner::set_mode( unsigned idx, uint8_t mode )
+{
+  {
+    std::lock_guard<std::mutex> lck( mtx_ );
+    market& mkt = mkts_[ idx ];
+    if ( mkt.tmpl_.get_mode() == mode ) {
+      return;
+    }
+    mkt.tmpl_.set_mode( mode );
+    clear_unused( idx );
+  }
+  cv_.notify_one();
+}
+
+void presigner::set_active( unsigned idx, bool active )
+{
+  {
+    std::lock_guard<std::mutex> lck( mtx_ );
+    market& mkt = mkts_[ idx ];
+    mkt.active_ = active;
+    clear_unused( idx );
+  }
+  cv_.notify_one();
+}
+
+void presigner::set_budget( unsigned idx, uint32_t cu_limit, uint64_t cu_price )
+{
+  {
+    std::lock_guard<std::mutex> lck( mtx_ );
+    market& mkt = mkts_[ idx ];
+    if ( mkt.tmpl_.get_cu_limit() == cu_limit
+      && mkt.tmpl_.get_cu_price() == cu_price ) {
+      return;
+    }
+    mkt.tmpl_.set_cu_limit( cu_limit );
+    mkt.tmpl_.set_cu_price( cu_price );
+    clear_unused( idx );
+  }
+  cv_.notify_one();
+}
+
+bool presigner::start()
+{
+  ring_.resize( depth_ );
+  do_run_ = true;
+  thrd_ = std::thread( &presigner::run, this );
+  return true;
+}
+
+void presigner::stop()
+{
+  {
+    std::lock_guard<std::mutex> lck( mtx_ );
+    do_run_ = false;
+  }
+  cv_.notify_one();
+  if ( thrd_.joinable() ) {
+    thrd_.join();
+  }
+}
+
+void presigner::on_block_hash( const pc::hash& hash )
+{
+  {
+    std::lock_guard<std::mutex> lck( mtx_ );
+    if ( seq_ && ring_[ seq_ % depth_ ].hash_ == hash ) {
+      return;
+    }
+    ++seq_;
+    block_hash& bh = ring_[ seq_ % depth_ ];
+    bh.hash_ = hash;
+    bh.seq_ = seq_;
+    bh.next_ = 0;
+  }
+  cv_.notify_one();
+}
+
+size_t presigner::get_tx( unsigned idx, char *buf )
+{
+  pc::hash hash;
+  serum_pyth tmpl;
+  {
+    std::lock_guard<std::mutex> lck( mtx_ );
+    market& mkt = mkts_[ idx ];
+
+    // Newest blockhash first; fall back to older, still valid ones.
+    uint64_t unsigned_seq = 0;
+    for ( uint64_t seq = seq_; seq && seq + depth_ > seq_; --seq ) {
+      signed_tx& tx = mkt.txs_[ seq % depth_ ];
+      if ( tx.seq_ == seq && tx.used_ ) {
+        continue;
+      }
+      if ( tx.seq_ == seq && tx.len_ ) {
+        tx.used_ = true;
+        ++num_ready_;
+        std::copy( tx.buf_, tx.buf_ + tx.len_, buf );
+        return tx.len_;
+      }
+      if ( !unsigned_seq ) {
+        unsigned_seq = seq;
+      }
+    }
+    if ( !unsigned_seq ) {
+      return 0;
+    }
+
+    // Nothing ready: sign inline, overriding any background claim.
+    signed_tx& tx = mkt.txs_[ unsigned_seq % depth_ ];
+    tx.seq_ = unsigned_seq;
+    tx.used_ = true;
+    tx.len_ = 0;
+    hash = ring_[ unsigned_seq % depth_ ].hash_;
+    tmpl = mkt.tmpl_;
+    ++num_inline_;
+  }
+  return sign( tmpl, hash, buf );
+}
+
+uint64_t presigner::get_num_ready() const
+{
+  return num_ready_;
+}
+
+uint64_t presigner::get_num_inline() const
+{
+  return num_inline_;
+}
+
+void presigner::run()
+{
+  char buf[ TX_MAX_SIZE ];
+  std::unique_lock<std::mutex> lck( mtx_ );
+  while ( true ) {
+    unsigned idx, pos;
+    cv_.wait( lck, [&]{ return !do_run_ || find_work( idx, pos ); } );
+    if ( !do_run_ ) {
+      break;
+    }
+
+    // Claim the slot, then sign without holding the lock.
+    const uint64_t seq = ring_[ pos ].seq_;
+    const pc::hash hash = ring_[ pos ].hash_;
+    const serum_pyth tmpl = mkts_[ idx ].tmpl_;
+    signed_tx *tx = &mkts_[ idx ].txs_[ pos ];
+    tx->seq_ = seq;
+    tx->used_ = false;
+    tx->len_ = 0;
+    lck.unlock();
+    const size_t len = sign( tmpl, hash, buf );
+    lck.lock();
+
+    // Skip if used inline, the ring moved on or the template changed
+    // meanwhile. Markets added meanwhile may have moved mkts_.
+    tx = &mkts_[ idx ].txs_[ pos ];
+    if ( tx->seq_ == seq && !tx->used_ ) {
+      std::copy( buf, buf + len, tx->buf_ );
+      tx->len_ = len;
+    }
+  }
+}
+
+// Called with the lock held: newest blockhash first, then the markets
+// from that blockhash's cursor on. Cursors only move back when a market's
+// transactions are cleared, so each blockhash costs one pass overall.
+bool presigner::find_work( unsigned& idx, unsigned& pos )
+{
+  for ( uint64_t seq = seq_; seq && seq + depth_ > seq_; --seq ) {
+    const unsigned p = ( unsigned )( seq % depth_ );
+    block_hash& bh = ring_[ p ];
+    for ( ; bh.next_ < mkts_.size(); ++bh.next_ ) {
+      const market& mkt = mkts_[ bh.next_ ];
+      if ( mkt.active_ && mkt.txs_[ p ].seq_ != seq ) {
+        idx = bh.next_;
+        pos = p;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// Called with the lock held: drop transactions signed with an old
+// template so they are signed again.
+void presigner::clear_unused( unsigned idx )
+{
+  for ( signed_tx& tx : mkts_[ idx ].txs_ ) {
+    if ( !tx.used_ ) {
+      tx.seq_ = 0;
+      tx.len_ = 0;
+    }
+  }
+  for ( block_hash& bh : ring_ ) {
+    bh.next_ = std::min( bh.next_, idx );
+  }
+}
+
+// Signs a copy of the template taken under the lock, so needs none.
+size_t presigner::sign( const serum_pyth& tmpl, const pc::hash& hash, char *buf )
+{
+  serum_pyth req = tmpl;
+  pc::hash bhash = hash;
+  req.set_block_hash( &bhash );
+  pc::bincode tx;
+  tx.attach( buf );
+  req.build_tx( tx );
+  return tx.size();
+}
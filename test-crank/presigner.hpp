@@ -0,0 +1,98 @@
+#pragma once
+
+#include "serum_pyth.hpp"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sp
+{
+
+  // Keeps a signed transaction ready for every market against each of the
+  // last few recent blockhashes, so a publish is a memcpy and a send.
+  // Signing runs on a background thread.
+  //
+  // Each (market, blockhash) transaction is handed out once: a second
+  // publish with the same blockhash would be a duplicate transaction.
+  class presigner
+  {
+  public:
+
+    presigner();
+    ~presigner();
+
+    // Number of recent blockhashes to keep (default 4).
+    void set_depth( unsigned );
+
+    // tmpl is copied; its block hash and key cache are replaced. May be
+    // called while running.
+    unsigned add_market( const serum_pyth& tmpl );
+
+    // Change mkt's sp_mode_t. Unused transactions are signed again.
+    void set_mode( unsigned mkt, uint8_t mode );
+
+    // Stop or resume signing for mkt, e.g. while it is removed.
+    void set_active( unsigned mkt, bool active );
+
+    // Change mkt's compute budget. Unused transactions signed with the
+    // old one are dropped and signed again.
+    void set_budget( unsigned mkt, uint32_t cu_limit, uint64_t cu_price );
+
+    bool start();
+    void stop();
+
+    // New recent blockhash from pc::manager.
+    void on_block_hash( const pc::hash& );
+
+    // Copy the newest unused transaction for mkt into buf, signing inline
+    // if the background thread hasn't got to it yet. Returns the length,
+    // or 0 if every known blockhash was already used for mkt.
+    size_t get_tx( unsigned mkt, char *buf );
+
+    uint64_t get_num_ready() const;
+    uint64_t get_num_inline() const;
+
+  private:
+
+    struct block_hash
+    {
+      pc::hash hash_;
+      uint64_t seq_ = 0;
+      unsigned next_ = 0;  // markets below are signed for seq_
+    };
+
+    struct signed_tx
+    {
+      uint64_t seq_  = 0;    // blockhash this was signed with
+      bool     used_ = false;
+      size_t   len_  = 0;
+      char     buf_[ TX_MAX_SIZE ];
+    };
+
+    struct market
+    {
+      serum_pyth tmpl_;
+      bool       active_ = true;
+      std::vector<signed_tx> txs_;  // one per blockhash ring slot
+    };
+
+    void run();
+    bool find_work( unsigned& mkt, unsigned& pos );
+    void clear_unused( unsigned mkt );
+    size_t sign( const serum_pyth& tmpl, const pc::hash&, char *buf );
+
+    unsigned depth_;
+    uint64_t seq_;
+    std::vector<block_hash> ring_;
+    std::vector<market>     mkts_;
+    std::mutex              mtx_;
+    std::condition_variable cv_;
+    std::thread             thrd_;
+    bool                    do_run_;
+    uint64_t                num_ready_;
+    uint64_t                num_inline_;
+  };
+
+}
@@ -0,0 +1,247 @@
+#include "scheduler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+using namespace sp;
+
+bool scheduler::entry::operator>( const entry& rhs ) const
+{
+  return due_ts_ > rhs.due_ts_;
+}
+
+scheduler::scheduler()
+: max_per_sec_( 50. ),
+  max_per_slot_( 20 ),
+  min_ival_( 400000000L ),   // ~1 slot
+  max_ival_( 5000000000L ),
+  target_move_( 1e-4 ),
+  half_life_( 30000000000L ),
+  stale_slots_( 25 ),
+  tokens_( 0. ),
+  token_ts_( 0 ),
+  slot_( 0 ),
+  slot_cnt_( 0 )
+{
+}
+
+void scheduler::set_max_tx_per_sec( double max_per_sec )
+{
+  max_per_sec_ = max_per_sec;
+}
+
+void scheduler::set_max_tx_per_slot( unsigned max_per_slot )
+{
+  max_per_slot_ = max_per_slot;
+}
+
+double scheduler::get_max_tx_per_sec() const
+{
+  return max_per_sec_;
+}
+
+unsigned scheduler::get_max_tx_per_slot() const
+{
+  return max_per_slot_;
+}
+
+void scheduler::set_min_interval( int64_t ival )
+{
+  min_ival_ = ival;
+}
+
+void scheduler::set_max_interval( int64_t ival )
+{
+  max_ival_ = ival;
+}
+
+void scheduler::set_target_move( double move )
+{
+  target_move_ = move;
+}
+
+void scheduler::set_half_life( int64_t half_life )
+{
+  half_life_ = half_life;
+}
+
+void scheduler::set_stale_slots( uint64_t slots )
+{
+  stale_slots_ = slots;
+}
+
+unsigned scheduler::add_market( int64_t now )
+{
+  const unsigned idx = get_num_markets();
+  mkts_.emplace_back();
+  market& m = mkts_.back();
+  m.last_ts_ = now;
+  m.due_ts_ = now;
+  queue_.reserve( get_max_queue() + 1 );
+  push( entry{ m.due_ts_, idx, m.gen_ } );
+  return idx;
+}
+
+unsigned scheduler::get_num_markets() const
+{
+  return ( unsigned )( mkts_.size() );
+}
+
+void scheduler::on_book( unsigned idx, uint64_t bid, uint64_t ask, int64_t now )
+{
+  if ( bid == 0 || ask == 0 ) {
+    return;
+  }
+  market& m = mkts_[ idx ];
+  const double mid = ( ( double )( bid ) + ask ) / 2.;
+  const double sprd = std::fabs( ( double )( ask ) - bid );
+  if ( m.mid_ > 0. && now > m.book_ts_ ) {
+    const double move = (
+      std::fabs( mid - m.mid_ ) + std::fabs( sprd - m.sprd_ )
+    ) / m.mid_;
+    const double dt = ( double )( now - m.book_ts_ );
+    const double decay = std::exp2( -dt / ( double )( half_life_ ) );
+    m.move_sum_ = m.move_sum_ * decay + move;
+    m.time_sum_ = m.time_sum_ * decay + dt;
+  }
+  m.mid_ = mid;
+  m.sprd_ = sprd;
+  m.book_ts_ = now;
+
+  // Only pull the market forward. A due time that is now too early gets
+  // corrected when the market is released by next().
+  if ( !m.parked_ && m.last_ts_ + calc_interval( m ) < m.due_ts_ ) {
+    reschedule( idx );
+  }
+}
+
+void scheduler::on_price( unsigned idx, uint64_t pub_slot )
+{
+  market& m = mkts_[ idx ];
+  m.pub_slot_ = pub_slot;
+}
+
+void scheduler::on_slot( uint64_t slot, int64_t )
+{
+  if ( slot != slot_ ) {
+    slot_ = slot;
+    slot_cnt_ = 0;
+  }
+}
+
+int scheduler::next( int64_t now )
+{
+  while ( !queue_.empty() ) {
+    const entry top = queue_.front();
+    market& m = mkts_[ top.idx_ ];
+    if ( top.gen_ != m.gen_ ) {
+      pop();
+      continue;
+    }
+    if ( top.due_ts_ > now || !has_budget( now ) ) {
+      return -1;
+    }
+    pop();
+    if ( m.blocked_ ) {
+      m.parked_ = true;
+      continue;
+    }
+    tokens_ -= 1.;
+    ++slot_cnt_;
+    m.last_ts_ = now;
+    reschedule( top.idx_ );
+    return ( int )( top.idx_ );
+  }
+  return -1;
+}
+
+void scheduler::refund()
+{
+  tokens_ += 1.;
+  if ( slot_cnt_ ) {
+    --slot_cnt_;
+  }
+}
+
+void scheduler::set_blocked( unsigned idx, bool blocked )
+{
+  market& m = mkts_[ idx ];
+  m.blocked_ = blocked;
+  if ( !blocked && m.parked_ ) {
+    m.parked_ = false;
+    ++m.gen_;
+    push( entry{ m.due_ts_, idx, m.gen_ } );
+  }
+}
+
+int64_t scheduler::get_interval( unsigned idx ) const
+{
+  return calc_interval( mkts_[ idx ] );
+}
+
+int64_t scheduler::calc_interval( const market& m ) const
+{
+  // Our last update (or everyone's) didn't land recently.
+  if ( m.pub_slot_ != 0 && slot_ > m.pub_slot_ + stale_slots_ ) {
+    return min_ival_;
+  }
+  if ( m.move_sum_ <= 0. || m.time_sum_ <= 0. ) {
+    return max_ival_;
+  }
+  // Time for the book to move target_move_ at its recent rate.
+  const double rate = m.move_sum_ / m.time_sum_;
+  const double ival = target_move_ / rate;
+  if ( ival >= ( double )( max_ival_ ) ) {
+    return max_ival_;
+  }
+  return std::max( min_ival_, ( int64_t )( ival ) );
+}
+
+void scheduler::reschedule( unsigned idx )
+{
+  market& m = mkts_[ idx ];
+  m.due_ts_ = m.last_ts_ + calc_interval( m );
+  ++m.gen_;
+
+  push( entry{ m.due_ts_, idx, m.gen_ } );
+}
+
+size_t scheduler::get_max_queue() const
+{
+  return 4 * mkts_.size() + 16;
+}
+
+void scheduler::push( const entry& ent )
+{
+  // Drop invalidated entries once they dominate the queue, in place
+  // within the capacity reserved by add_market().
+  if ( queue_.size() >= get_max_queue() ) {
+    queue_.clear();
+    for ( unsigned i = 0; i < mkts_.size(); ++i ) {
+      if ( i != ent.idx_ && !mkts_[ i ].parked_ ) {
+        queue_.push_back( entry{ mkts_[ i ].due_ts_, i, mkts_[ i ].gen_ } );
+      }
+    }
+    std::make_heap( queue_.begin(), queue_.end(), std::greater<entry>() );
+  }
+  queue_.push_back( ent );
+  std::push_heap( queue_.begin(), queue_.end(), std::greater<entry>() );
+}
+
+void scheduler::pop()
+{
+  std::pop_heap( queue_.begin(), queue_.end(), std::greater<entry>() );
+  queue_.pop_back();
+}
+
+bool scheduler::has_budget( int64_t now )
+{
+  if ( now > token_ts_ ) {
+    const double cap = std::max( 1., max_per_sec_ );
+    const double dt = ( double )( now - token_ts_ );
+    tokens_ = std::min( cap, tokens_ + dt * max_per_sec_ / 1e9 );
+    token_ts_ = now;
+  }
+  return tokens_ >= 1. && slot_cnt_ < max_per_slot_;
+}
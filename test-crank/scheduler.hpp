@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace sp
+{
+
+  // Assigns each market a publish interval from its recent book activity
+  // (mid-price moves and spread changes) and the staleness of its on-chain
+  // pub_slot_, then releases markets in due-time order while respecting a
+  // global transaction budget per second and per slot.
+  //
+  // All times are nanoseconds from pc::get_now().
+  class scheduler
+  {
+  public:
+
+    scheduler();
+
+    // Global budget.
+    void set_max_tx_per_sec( double );
+    void set_max_tx_per_slot( unsigned );
+    double get_max_tx_per_sec() const;
+    unsigned get_max_tx_per_slot() const;
+
+    // Bounds on each market's publish interval.
+    void set_min_interval( int64_t );
+    void set_max_interval( int64_t );
+
+    // Relative price move (e.g. 1e-4 = 1bp) worth one publish.
+    void set_target_move( double );
+
+    // Half-life of the book activity average.
+    void set_half_life( int64_t );
+
+    // Publish as soon as the budget allows once the on-chain price is
+    // this many slots behind the cluster.
+    void set_stale_slots( uint64_t );
+
+    // Add a market that is due immediately. Returns its index.
+    unsigned add_market( int64_t now );
+    unsigned get_num_markets() const;
+
+    // Serum best bid/ask (any consistent units) changed.
+    void on_book( unsigned idx, uint64_t bid, uint64_t ask, int64_t now );
+
+    // Pyth price account changed.
+    void on_price( unsigned idx, uint64_t pub_slot );
+
+    // Cluster slot changed.
+    void on_slot( uint64_t slot, int64_t now );
+
+    // Next market due to publish, or -1 if none is due or the budget is
+    // exhausted. The returned market is charged against the budget and
+    // rescheduled.
+    int next( int64_t now );
+
+    // Give back the budget next() charged for a market that wasn't sent
+    // after all, e.g. with no transaction left to send.
+    void refund();
+
+    // Blocked markets are held back by next() until unblocked, e.g. while
+    // a previous update is still in flight.
+    void set_blocked( unsigned idx, bool blocked );
+
+    // Current publish interval of a market.
+    int64_t get_interval( unsigned idx ) const;
+
+  private:
+
+    struct market
+    {
+      double   mid_      = 0.;
+      double   sprd_     = 0.;
+      double   move_sum_ = 0.; // decayed sum of relative moves
+      double   time_sum_ = 0.; // decayed sum of elapsed ns
+      int64_t  book_ts_  = 0;
+      int64_t  last_ts_  = 0;  // last publish
+      int64_t  due_ts_   = 0;
+      uint64_t pub_slot_ = 0;
+      uint64_t gen_      = 0;  // invalidates stale queue entries
+      bool     blocked_  = false;
+      bool     parked_   = false;  // blocked while due, not queued
+    };
+
+    struct entry
+    {
+      int64_t  due_ts_;
+      unsigned idx_;
+      uint64_t gen_;
+      bool operator>( const entry& ) const;
+    };
+
+    int64_t calc_interval( const market& ) const;
+    void reschedule( unsigned idx );
+    size_t get_max_queue() const;
+    void push( const entry& );
+    void pop();
+    bool has_budget( int64_t now );
+
+    std::vector<market> mkts_;
+    std::vector<entry>  queue_;  // min-heap by due time, capacity reserved
+    double   max_per_sec_;
+    unsigned max_per_slot_;
+    int64_t  min_ival_;
+    int64_t  max_ival_;
+    double   target_move_;
+    int64_t  half_life_;
+    uint64_t stale_slots_;
+    double   tokens_;
+    int64_t  token_ts_;
+    uint64_t slot_;
+    unsigned slot_cnt_;
+  };
+
+}
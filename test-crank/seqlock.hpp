@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+namespace sp
+{
+
+  // One writer broadcasting a value to any number of reader threads,
+  // with the same protocol as the shm_feed slots: the writer makes seq_
+  // odd, copies the value, then makes it even again, and readers retry
+  // until they copy it between two equal even reads. T is copied with
+  // memcpy, so it must be trivially copyable.
+  template<class T>
+  class seqlock
+  {
+  public:
+
+    seqlock() : seq_( 0 ) {}
+
+    void store( const T& val ) {
+      const uint64_t seq = seq_.load( std::memory_order_relaxed );
+      seq_.store( seq + 1, std::memory_order_relaxed );
+      std::atomic_thread_fence( std::memory_order_release );
+      std::memcpy( ( void* )&val_, ( const void* )&val, sizeof( T ) );
+      seq_.store( seq + 2, std::memory_order_release );
+    }
+
+    // Consistent copy of the latest value. Returns false if nothing was
+    // stored yet.
+    bool load( T& val ) const {
+      for ( ;; ) {
+        const uint64_t seq0 = seq_.load( std::memory_order_acquire );
+        if ( seq0 == 0 ) {
+          return false;
+        }
+        if ( seq0 & 1 ) {
+          continue;
+        }
+        std::memcpy( ( void* )&val, ( const void* )&val_, sizeof( T ) );
+        std::atomic_thread_fence( std::memory_order_acquire );
+        if ( seq_.load( std::memory_order_relaxed ) == seq0 ) {
+          return true;
+        }
+      }
+    }
+
+    // Changes with every store(), to skip load() when nothing did.
+    uint64_t get_seq() const {
+      return seq_.load( std::memory_order_acquire );
+    }
+
+  private:
+
+    alignas( 64 ) std::atomic<uint64_t> seq_;
+    T val_;
+  };
+
+}
@@ -0,0 +1,352 @@
+#include "serum_pyth.hpp"
+#include "budget.hpp"
+#include "lookup.hpp"
+
+#include <algorithm>
+
+using namespace sp;
+
+void tx_wtr::init( pc::bincode& tx )
+{
+  tx.attach( hd_->buf_ );
+  tx.add( (uint16_t)PC_TPU_PROTO_ID );
+  tx.add( (uint16_t)0 );
+}
+
+void tx_wtr::commit( pc::bincode& tx )
+{
+  pc::tx_hdr *hdr = (pc::tx_hdr*)hd_->buf_;
+  hd_->size_ = tx.size();
+  hdr->size_ = tx.size();
+}
+
+void raw_tx::build( pc::net_wtr& wtr )
+{
+  pc::bincode tx;
+  ((tx_wtr&)wtr).init( tx );
+  tx.add( buf_, len_ );
+  ((tx_wtr&)wtr).commit( tx );
+}
+
+void serum_pyth::build( pc::net_wtr& wtr )
+{
+  // construct binary transaction and add header
+  pc::bincode tx;
+  ((tx_wtr&)wtr).init( tx );
+  build_tx( tx );
+  ((tx_wtr&)wtr).commit( tx );
+}
+
+void serum_pyth::build_tx( pc::bincode& tx )
+{
+  const serum_pyth *req = this;
+  build_tx( tx, &req, 1 );
+}
+
+namespace
+{
+  // Compact-u16 lengths are written as one byte, so under 128 accounts.
+  const unsigned KEY_LIST_MAX = 127;
+
+  // Deduplicated account list of one transaction. Keys are added
+  // writable first, so an index is also the account's position.
+  struct key_list
+  {
+    pc::pub_key keys_[ KEY_LIST_MAX ];
+    unsigned    num_ = 0;
+
+    unsigned find( const pc::pub_key& key ) const {
+      for ( unsigned i = 0; i != num_; ++i ) {
+        if ( keys_[ i ] == key ) {
+          return i;
+        }
+      }
+      return num_;
+    }
+
+    void add( const pc::pub_key& key ) {
+      if ( find( key ) == num_ && num_ != KEY_LIST_MAX ) {
+        keys_[ num_++ ] = key;
+      }
+    }
+  };
+
+  struct tx_layout
+  {
+    key_list keys_;             // every account
+    unsigned num_writable_ = 0;
+    uint32_t cu_limit_ = 0;     // 0: no SetComputeUnitLimit
+    uint64_t cu_price_ = 0;     // 0: no SetComputeUnitPrice
+
+    // Accounts in the message, then (v0) those loaded from the table,
+    // writable first. Legacy messages list every account.
+    key_list stat_;
+    unsigned stat_writable_ = 0;
+    const lookup_table *alt_ = nullptr;
+    uint8_t  alt_w_[ KEY_LIST_MAX ];
+    uint8_t  alt_r_[ KEY_LIST_MAX ];
+    unsigned num_alt_w_ = 0;
+    unsigned num_alt_r_ = 0;
+
+    unsigned index( const pc::pub_key& key ) const {
+      const unsigned i = stat_.find( key );
+      uint8_t idx;
+      if ( i != stat_.num_ || !alt_ || !alt_->find( key, idx ) ) {
+        return i;
+      }
+      for ( unsigned j = 0; j != num_alt_w_; ++j ) {
+        if ( alt_w_[ j ] == idx ) {
+          return stat_.num_ + j;
+        }
+      }
+      for ( unsigned j = 0; j != num_alt_r_; ++j ) {
+        if ( alt_r_[ j ] == idx ) {
+          return stat_.num_ + num_alt_w_ + j;
+        }
+      }
+      return i;
+    }
+  };
+}
+
+// Bytes of each instruction: program index, account indices and data,
+// each list behind a one-byte compact-u16 length.
+static const size_t IX_CU_LIMIT_SIZE = 1 + 1 + 1 + 5;
+static const size_t IX_CU_PRICE_SIZE = 1 + 1 + 1 + 9;
+static const size_t IX_SP_SIZE = 1 + 1 + serum_pyth::NUM_ACCOUNTS + 1;
+
+void serum_pyth::get_keys( pc::pub_key keys[ NUM_KEYS ] ) const
+{
+  pkey_->get_pub_key( keys[ 0 ] );
+  keys[ 1 ] = *pyth_price_;
+  keys[ 2 ] = *serum_prog_;
+  keys[ 3 ] = *serum_market_;
+  keys[ 4 ] = *serum_bids_;
+  keys[ 5 ] = *serum_asks_;
+  keys[ 6 ] = *spl_quote_mint_;
+  keys[ 7 ] = *spl_base_mint_;
+  keys[ 8 ] = *sysvar_clock_;
+  keys[ 9 ] = *pyth_prog_;
+  keys[ 10 ] = *gkey_;
+}
+
+static void get_layout(
+  const serum_pyth *const *reqs,
+  size_t num,
+  tx_layout& lay
+) {
+  // publisher (signer), then price accounts (writable), then the rest
+  pc::pub_key keys[ serum_pyth::NUM_KEYS ];
+  for ( size_t r = 0; r != num; ++r ) {
+    reqs[ r ]->get_keys( keys );
+    lay.keys_.add( keys[ 0 ] );
+    lay.keys_.add( keys[ 1 ] );
+  }
+  lay.num_writable_ = lay.keys_.num_;
+  for ( size_t r = 0; r != num; ++r ) {
+    reqs[ r ]->get_keys( keys );
+    for ( unsigned k = 2; k != serum_pyth::NUM_KEYS; ++k ) {
+      lay.keys_.add( keys[ k ] );
+    }
+  }
+
+  // one limit for the whole transaction, unless some usage is unknown
+  const serum_pyth& first = *reqs[ 0 ];
+  if ( first.get_budget_prog() ) {
+    uint64_t limit = 0;
+    for ( size_t r = 0; r != num && limit != UINT64_MAX; ++r ) {
+      const uint32_t units = reqs[ r ]->get_cu_limit();
+      limit = units ? limit + units : UINT64_MAX;
+    }
+    if ( limit != UINT64_MAX ) {
+      lay.cu_limit_ = ( uint32_t )std::min( limit, TX_MAX_UNITS );
+    }
+    lay.cu_price_ = first.get_cu_price();
+    if ( lay.cu_limit_ || lay.cu_price_ ) {
+      lay.keys_.add( *first.get_budget_prog() );
+    }
+  }
+
+  // v0: accounts in the table by index, except the signer and invoked
+  // programs, which must be in the message
+  const lookup_table *alt = first.get_lookup();
+  if ( alt && alt->get_is_valid() ) {
+    lay.alt_ = alt;
+  }
+  for ( unsigned k = 0; k != lay.keys_.num_; ++k ) {
+    const pc::pub_key& key = lay.keys_.keys_[ k ];
+    const bool is_writable = k < lay.num_writable_;
+    uint8_t idx;
+    if ( k == 0 || !lay.alt_ || key == *first.get_program()
+      || ( first.get_budget_prog() && key == *first.get_budget_prog() )
+      || !lay.alt_->find( key, idx ) ) {
+      lay.stat_.add( key );
+      lay.stat_writable_ += is_writable;
+    }
+    else if ( is_writable ) {
+      lay.alt_w_[ lay.num_alt_w_++ ] = idx;
+    }
+    else {
+      lay.alt_r_[ lay.num_alt_r_++ ] = idx;
+    }
+  }
+}
+
+size_t serum_pyth::get_tx_size(
+  const serum_pyth *const *reqs,
+  size_t num,
+  unsigned *num_keys
+) {
+  tx_layout lay;
+  get_layout( reqs, num, lay );
+  if ( num_keys ) {
+    *num_keys = lay.keys_.num_;
+  }
+  size_t size = 1 + sizeof( pc::signature ) // signatures
+    + 3                                     // message header
+    + 1 + lay.stat_.num_ * sizeof( pc::pub_key )
+    + sizeof( pc::hash )                    // recent block hash
+    + 1;                                    // instruction count
+  if ( lay.alt_ ) {
+    size += 1 + 1;                          // version, table count
+    if ( lay.num_alt_w_ || lay.num_alt_r_ ) {
+      size += LOOKUP_SIZE + lay.num_alt_w_ + lay.num_alt_r_;
+    }
+  }
+  size += lay.cu_limit_ ? IX_CU_LIMIT_SIZE : 0;
+  size += lay.cu_price_ ? IX_CU_PRICE_SIZE : 0;
+  for ( size_t r = 0; r != num; ++r ) {
+    size += reqs[ r ]->get_ix_size();
+  }
+  return size;
+}
+
+size_t serum_pyth::get_ix_size() const
+{
+  return IX_SP_SIZE + ( mode_ ? 1 : 0 );
+}
+
+size_t serum_pyth::get_budget_size( bool has_limit, bool has_price )
+{
+  if ( !has_limit && !has_price ) {
+    return 0;
+  }
+  return sizeof( pc::pub_key )
+    + ( has_limit ? IX_CU_LIMIT_SIZE : 0 )
+    + ( has_price ? IX_CU_PRICE_SIZE : 0 );
+}
+
+void serum_pyth::get_key_sizes(
+  const pc::pub_key keys[ NUM_KEYS ],
+  uint8_t sizes[ NUM_KEYS ]
+) const {
+  // as get_layout() places them
+  const bool has_alt = alt_ && alt_->get_is_valid();
+  for ( unsigned k = 0; k != NUM_KEYS; ++k ) {
+    uint8_t idx;
+    const bool is_static = k == 0 || !has_alt || keys[ k ] == *gkey_
+      || ( budget_prog_ && keys[ k ] == *budget_prog_ )
+      || !alt_->find( keys[ k ], idx );
+    sizes[ k ] = is_static ? ( uint8_t )sizeof( pc::pub_key ) : 1;
+  }
+}
+
+unsigned serum_pyth::get_first_ix( const serum_pyth *const *reqs, size_t num )
+{
+  tx_layout lay;
+  get_layout( reqs, num, lay );
+  return ( lay.cu_limit_ ? 1U : 0U ) + ( lay.cu_price_ ? 1U : 0U );
+}
+
+void serum_pyth::build_tx(
+  pc::bincode& tx,
+  const serum_pyth *const *reqs,
+  size_t num
+) {
+  tx_layout lay;
+  get_layout( reqs, num, lay );
+  const serum_pyth& first = *reqs[ 0 ];
+
+  // signatures section
+  tx.add_len<1>();      // one signature (publish)
+  size_t pub_idx = tx.reserve_sign();
+
+  // message header
+  size_t tx_idx = tx.get_pos();
+  if ( lay.alt_ ) {
+    tx.add( (uint8_t)MESSAGE_V0 );
+  }
+  tx.add( (uint8_t)1 ); // pub is only signing account
+  tx.add( (uint8_t)0 ); // read-only signed accounts
+  tx.add( (uint8_t)( lay.stat_.num_ - lay.stat_writable_ ) );
+
+  // accounts (compact-u16 counts under 128 are a single byte)
+  tx.add( (uint8_t)lay.stat_.num_ );
+  for ( unsigned k = 0; k != lay.stat_.num_; ++k ) {
+    tx.add( lay.stat_.keys_[ k ] );
+  }
+
+  // recent block hash
+  tx.add( *first.bhash_ );
+
+  // instructions section: compute budget first
+  const size_t num_ix = num + ( lay.cu_limit_ ? 1 : 0 ) + ( lay.cu_price_ ? 1 : 0 );
+  tx.add( (uint8_t)num_ix );
+  if ( lay.cu_limit_ ) {
+    tx.add( (uint8_t)lay.index( *first.budget_prog_ ) );
+    tx.add_len<0>();       // no accounts
+    tx.add_len<5>();
+    tx.add( CU_SET_LIMIT );
+    tx.add( lay.cu_limit_ );
+  }
+  if ( lay.cu_price_ ) {
+    tx.add( (uint8_t)lay.index( *first.budget_prog_ ) );
+    tx.add_len<0>();       // no accounts
+    tx.add_len<9>();
+    tx.add( CU_SET_PRICE );
+    tx.add( lay.cu_price_ );
+  }
+
+  // one serum-pyth instruction per request
+  pc::pub_key keys[ NUM_KEYS ];
+  for ( size_t r = 0; r != num; ++r ) {
+    const serum_pyth& req = *reqs[ r ];
+    req.get_keys( keys );
+    tx.add( (uint8_t)lay.index( keys[ NUM_ACCOUNTS ] ) ); // program_id
+    tx.add_len<NUM_ACCOUNTS>();
+    for ( unsigned k = 0; k != NUM_ACCOUNTS; ++k ) {
+      tx.add( (uint8_t)lay.index( keys[ k ] ) );
+    }
+
+    // instruction parameter section: sp_instruction_t, if not the default
+    if ( req.mode_ ) {
+      tx.add_len<1>();
+      tx.add( req.mode_ );
+    }
+    else {
+      tx.add_len<0>();
+    }
+  }
+
+  // address table lookups (v0)
+  if ( lay.alt_ && ( lay.num_alt_w_ || lay.num_alt_r_ ) ) {
+    tx.add_len<1>();
+    tx.add( lay.alt_->get_address() );
+    tx.add( (uint8_t)lay.num_alt_w_ );
+    tx.add( lay.alt_w_, lay.num_alt_w_ );
+    tx.add( (uint8_t)lay.num_alt_r_ );
+    tx.add( lay.alt_r_, lay.num_alt_r_ );
+  }
+  else if ( lay.alt_ ) {
+    tx.add_len<0>();
+  }
+
+  // all accounts need to sign transaction
+  // sign with the key pair when no cache is set, e.g. off the main thread
+  if ( first.ckey_ ) {
+    tx.sign( pub_idx, tx_idx, *first.ckey_ );
+  }
+  else {
+    tx.sign( pub_idx, tx_idx, *first.pkey_ );
+  }
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include "tx_limits.hpp"
+
+#include <pc/bincode.hpp>
+#include <pc/manager.hpp>
+
+namespace sp
+{
+
+  // Prefix of a versioned (v0) message.
+  static const uint8_t MESSAGE_V0 = 0x80;
+
+  class lookup_table;
+
+  // Prepends the pyth_tx proxy header to a transaction.
+  class tx_wtr : public pc::net_wtr
+  {
+  public:
+    void init( pc::bincode& tx );
+    void commit( pc::bincode& tx );
+  };
+
+  // Already signed transaction, e.g. a rebroadcast.
+  class raw_tx : public pc::tx_request
+  {
+  public:
+    void set_tx( const uint8_t *buf, size_t len ) { buf_ = buf; len_ = len; }
+    void build( pc::net_wtr& ) override;
+
+  private:
+    const uint8_t *buf_ = nullptr;
+    size_t         len_ = 0;
+  };
+
+  // Transaction invoking serum-pyth for one market.
+  class serum_pyth : public pc::tx_request
+  {
+  public:
+
+    // Accounts of the serum-pyth instruction (SP_ACC_* in serum-pyth.c).
+    static const unsigned NUM_ACCOUNTS = 10;
+
+    // Those accounts in order, then the program.
+    static const unsigned NUM_KEYS = NUM_ACCOUNTS + 1;
+    void get_keys( pc::pub_key keys[ NUM_KEYS ] ) const;
+
+    void set_block_hash( pc::hash *bhash ) { bhash_ = bhash; }
+    void set_publish( pc::key_pair *kp ) { pkey_ = kp; }
+    void set_pubcache( pc::key_cache *kc ) { ckey_ = kc; }
+    void set_program( pc::pub_key *pk ) { gkey_ = pk; }
+    void set_serum_prog( pc::pub_key *pk ) { serum_prog_ = pk; }
+    void set_serum_market( pc::pub_key *pk ) { serum_market_ = pk; }
+    void set_serum_bids( pc::pub_key *pk ) { serum_bids_ = pk; }
+    void set_serum_asks( pc::pub_key *pk ) { serum_asks_ = pk; }
+    void set_spl_quote_mint( pc::pub_key *pk ) { spl_quote_mint_ = pk; }
+    void set_spl_base_mint( pc::pub_key *pk ) { spl_base_mint_ = pk; }
+    void set_sysvar_clock( pc::pub_key *pk ) { sysvar_clock_ = pk; }
+    void set_pyth_prog( pc::pub_key *pk ) { pyth_prog_ = pk; }
+    void set_pyth_price( pc::pub_key *pk ) { pyth_price_ = pk; }
+
+    // sp_mode_t; SP_MODE_MIDPT (default) sends no instruction data.
+    void set_mode( uint8_t mode ) { mode_ = mode; }
+    uint8_t get_mode() const { return mode_; }
+
+    // Prepend ComputeBudget instructions for a nonzero unit limit or
+    // price (micro-lamports per unit). Needs the budget program's key.
+    void set_budget_prog( pc::pub_key *pk ) { budget_prog_ = pk; }
+    void set_cu_limit( uint32_t units ) { cu_limit_ = units; }
+    void set_cu_price( uint64_t price ) { cu_price_ = price; }
+    pc::pub_key *get_budget_prog() const { return budget_prog_; }
+
+    // Build a v0 message loading accounts from this table where it has
+    // them, by one-byte index. The table isn't copied.
+    void set_lookup( const lookup_table *alt ) { alt_ = alt; }
+    const lookup_table *get_lookup() const { return alt_; }
+    pc::pub_key *get_program() const { return gkey_; }
+    uint32_t get_cu_limit() const { return cu_limit_; }
+    uint64_t get_cu_price() const { return cu_price_; }
+
+    // Build for submission through pc::manager (pyth_tx proxy).
+    void build( pc::net_wtr& ) override;
+
+    // Build the bare signed transaction, e.g. for sending to a TPU.
+    void build_tx( pc::bincode& );
+
+    // One transaction carrying the instructions of several markets, for
+    // the same publisher, block hash and programs. Accounts they share
+    // (e.g. clock, programs, quote mint) are listed once. The budget
+    // program, unit price, lookup table and key cache are the first
+    // request's; the unit limit is the sum of theirs, left out if any is
+    // unknown.
+    static void build_tx(
+      pc::bincode&, const serum_pyth *const *reqs, size_t num
+    );
+
+    // Serialized size of that transaction and its number of accounts.
+    static size_t get_tx_size(
+      const serum_pyth *const *reqs, size_t num, unsigned *num_keys = nullptr
+    );
+
+    // Bytes one more market's instruction adds to such a transaction,
+    // besides its accounts, and what each of its accounts (as get_keys()
+    // lists them) adds if the transaction doesn't have it yet: a key in
+    // the message, or an index into the lookup table.
+    size_t get_ix_size() const;
+    void get_key_sizes(
+      const pc::pub_key keys[ NUM_KEYS ], uint8_t sizes[ NUM_KEYS ]
+    ) const;
+
+    // Bytes of the compute budget instructions and program in such a
+    // transaction, with or without a unit limit and price.
+    static size_t get_budget_size( bool has_limit, bool has_price );
+
+    // Bytes a v0 message spends on the table once it loads any account.
+    static const size_t LOOKUP_SIZE = sizeof( pc::pub_key ) + 1 + 1;
+
+    // Index of its first serum-pyth instruction, after compute budget ones.
+    static unsigned get_first_ix( const serum_pyth *const *reqs, size_t num );
+
+  private:
+    pc::hash         *bhash_ = nullptr;
+    pc::key_pair     *pkey_ = nullptr;
+    pc::key_cache    *ckey_ = nullptr;
+    pc::pub_key      *gkey_ = nullptr;
+    pc::pub_key      *serum_prog_ = nullptr;
+    pc::pub_key      *serum_market_ = nullptr;
+    pc::pub_key      *serum_bids_ = nullptr;
+    pc::pub_key      *serum_asks_ = nullptr;
+    pc::pub_key      *spl_quote_mint_ = nullptr;
+    pc::pub_key      *spl_base_mint_ = nullptr;
+    pc::pub_key      *sysvar_clock_ = nullptr;
+    pc::pub_key      *pyth_prog_ = nullptr;
+    pc::pub_key      *pyth_price_ = nullptr;
+    pc::pub_key      *budget_prog_ = nullptr;
+    const lookup_table *alt_ = nullptr;
+    uint8_t           mode_ = 0;
+    uint32_t          cu_limit_ = 0;
+    uint64_t          cu_price_ = 0;
+  };
+
+}
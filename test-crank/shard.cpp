@@ -0,0 +1,481 @@
+#include "shard.hpp"
+#include "alloc_check.hpp"
+
+#include <pc/log.hpp>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+using namespace sp;
+
+// Outgoing transactions queued per shard.
+static const size_t TX_QUEUE_SIZE = 1UL << 20;
+
+// Updates decoded and transactions sent per pass, so neither starves.
+static const unsigned MAX_BATCH = 256;
+
+// Pause of a thread with nothing to do.
+static const std::chrono::microseconds IDLE_WAIT( 20 );
+
+// Price account keys are uniformly distributed, so their leading bytes
+// already make a good hash.
+static unsigned get_shard( const pc::pub_key& key, unsigned num )
+{
+  uint64_t h;
+  std::memcpy( &h, key.data(), sizeof( h ) );
+  return ( unsigned )( h % num );
+}
+
+shard::shard(
+  const scheduler& sched,
+  const inflight& infl,
+  const seqlock<chain_state>& chain,
+  size_t queue_size
+) : sched_( sched ),
+    infl_( infl ),
+    chain_( chain ),
+    chain_seq_( 0 ),
+    has_hash_( false ),
+    slot_( 0 ),
+    do_run_( false ),
+    num_submitted_( 0 ),
+    num_resent_( 0 ),
+    num_landed_( 0 ),
+    num_expired_( 0 ),
+    num_tx_dropped_( 0 )
+{
+  std::memset( &state_, 0, sizeof( state_ ) );
+  bhash_.zero();
+  infl_.set_sub( this );
+  in_.init( queue_size );
+  out_.init( TX_QUEUE_SIZE );
+}
+
+shard::~shard()
+{
+  stop();
+}
+
+unsigned shard::add_market(
+  const market& src,
+  const serum_pyth& tmpl,
+  pc::pub_key *pub
+) {
+  const unsigned pos = sched_.add_market( pc::get_now() );
+  infl_.add_market();
+
+  std::unique_ptr<market> mkt( new market );
+  mkt->init( src );
+  mkt->set_sub( this );
+  mkt->set_pub_key( pub );
+  const unsigned idx = mkt->get_index();
+  if ( idx >= pos_.size() ) {
+    pos_.resize( idx + 1 );
+  }
+  pos_[ idx ] = pos;
+  mkts_.emplace_back( std::move( mkt ) );
+
+  // sign with the key pair: the key cache belongs to the I/O thread
+  tmpls_.push_back( tmpl );
+  tmpls_.back().set_pubcache( nullptr );
+  tmpls_.back().set_block_hash( &bhash_ );
+  return pos;
+}
+
+bool shard::start()
+{
+  do_run_ = true;
+  thrd_ = std::thread( &shard::run, this );
+  return true;
+}
+
+void shard::stop()
+{
+  do_run_ = false;
+  if ( thrd_.joinable() ) {
+    thrd_.join();
+  }
+}
+
+bool shard::push(
+  unsigned pos,
+  market_acct acct,
+  const uint8_t *data,
+  size_t len,
+  uint64_t slot
+) {
+  uint8_t *rec = in_.reserve( sizeof( update_hdr ) + len );
+  if ( !rec ) {
+    return false;
+  }
+  update_hdr *hdr = ( update_hdr* )rec;
+  hdr->pos_ = pos;
+  hdr->acct_ = ( uint32_t )acct;
+  hdr->slot_ = slot;
+  std::memcpy( hdr + 1, data, len );
+  in_.commit();
+  return true;
+}
+
+spsc_ring& shard::get_tx_queue()
+{
+  return out_;
+}
+
+uint64_t shard::get_num_submitted() const
+{
+  return num_submitted_.load( std::memory_order_relaxed );
+}
+
+uint64_t shard::get_num_resent() const
+{
+  return num_resent_.load( std::memory_order_relaxed );
+}
+
+uint64_t shard::get_num_landed() const
+{
+  return num_landed_.load( std::memory_order_relaxed );
+}
+
+uint64_t shard::get_num_expired() const
+{
+  return num_expired_.load( std::memory_order_relaxed );
+}
+
+uint64_t shard::get_num_tx_dropped() const
+{
+  return num_tx_dropped_.load( std::memory_order_relaxed );
+}
+
+void shard::on_book( market *mkt )
+{
+  sched_.on_book(
+    pos_[ mkt->get_index() ],
+    mkt->get_bid().price_,
+    mkt->get_ask().price_,
+    pc::get_now()
+  );
+}
+
+void shard::on_price( market *mkt )
+{
+  const unsigned pos = pos_[ mkt->get_index() ];
+  sched_.on_price( pos, mkt->get_pub_slot() );
+  infl_.on_pub_slot( pos, mkt->get_pub_slot() );
+}
+
+void shard::on_resend( unsigned, const uint8_t *buf, size_t len )
+{
+  send( buf, len );
+}
+
+void shard::on_done( unsigned pos, const tx_sig&, tx_outcome, uint64_t )
+{
+  update_blocked( pos );
+}
+
+void shard::run()
+{
+  while ( do_run_.load( std::memory_order_relaxed ) ) {
+    const int64_t now = pc::get_now();
+    bool is_busy;
+    {
+      alloc_scope checked;
+      is_busy = poll_updates();
+      if ( poll_chain( now ) ) {
+        for ( int pos; ( pos = sched_.next( now ) ) >= 0; ) {
+          publish( ( unsigned )pos );
+          is_busy = true;
+        }
+      }
+    }
+    num_submitted_.store( infl_.get_num_submitted(), std::memory_order_relaxed );
+    num_resent_.store( infl_.get_num_resent(), std::memory_order_relaxed );
+    num_landed_.store( infl_.get_num_landed(), std::memory_order_relaxed );
+    num_expired_.store( infl_.get_num_expired(), std::memory_order_relaxed );
+    if ( !is_busy ) {
+      std::this_thread::sleep_for( IDLE_WAIT );
+    }
+  }
+}
+
+bool shard::poll_updates()
+{
+  unsigned num = 0;
+  size_t len;
+  for ( const uint8_t *rec; num != MAX_BATCH && ( rec = in_.front( len ) ); ++num ) {
+    const update_hdr *hdr = ( const update_hdr* )rec;
+    mkts_[ hdr->pos_ ]->on_account(
+      ( market_acct )hdr->acct_,
+      ( const uint8_t* )( hdr + 1 ),
+      len - sizeof( update_hdr ),
+      hdr->slot_
+    );
+    in_.pop();
+  }
+  return num != 0;
+}
+
+bool shard::poll_chain( int64_t now )
+{
+  const uint64_t seq = chain_.get_seq();
+  if ( seq != chain_seq_ && chain_.load( state_ ) ) {
+    chain_seq_ = seq;
+    bhash_.init_from_buf( state_.bhash_ );
+    has_hash_ = true;
+    if ( state_.slot_ != slot_ ) {
+      slot_ = state_.slot_;
+      sched_.on_slot( slot_, now );
+      infl_.on_slot( slot_ );
+    }
+  }
+  return has_hash_;
+}
+
+void shard::publish( unsigned pos )
+{
+  char buf[ TX_MAX_SIZE ];
+  pc::bincode tx;
+  tx.attach( buf );
+  tmpls_[ pos ].build_tx( tx );
+  infl_.on_submit( pos, ( const uint8_t* )buf, tx.size(), slot_ );
+  update_blocked( pos );
+  send( ( const uint8_t* )buf, tx.size() );
+}
+
+void shard::send( const uint8_t *buf, size_t len )
+{
+  // a transaction dropped here is still in flight and rebroadcast
+  uint8_t *rec = out_.reserve( len );
+  if ( !rec ) {
+    num_tx_dropped_.fetch_add( 1, std::memory_order_relaxed );
+    return;
+  }
+  std::memcpy( rec, buf, len );
+  out_.commit();
+}
+
+void shard::update_blocked( unsigned pos )
+{
+  sched_.set_blocked( pos, !infl_.can_submit( pos ) );
+}
+
+shard_set::shard_set()
+: num_shards_( 1 ),
+  queue_size_( 1UL << 24 ),
+  pub_( nullptr ),
+  num_dropped_( 0 ),
+  fd_( -1 ),
+  do_run_( false ),
+  num_sent_( 0 )
+{
+  std::memset( &last_, 0, sizeof( last_ ) );
+}
+
+shard_set::~shard_set()
+{
+  stop();
+  if ( fd_ >= 0 ) {
+    ::close( fd_ );
+  }
+}
+
+void shard_set::set_num_shards( unsigned num )
+{
+  num_shards_ = std::max( num, 1U );
+}
+
+unsigned shard_set::get_num_shards() const
+{
+  return num_shards_;
+}
+
+void shard_set::set_queue_size( size_t size )
+{
+  queue_size_ = size;
+}
+
+void shard_set::init(
+  const scheduler& sched,
+  const inflight& infl,
+  pc::pub_key *pub
+) {
+  pub_ = pub;
+  scheduler share( sched );
+  share.set_max_tx_per_sec( sched.get_max_tx_per_sec() / num_shards_ );
+  share.set_max_tx_per_slot( std::max(
+    ( sched.get_max_tx_per_slot() + num_shards_ - 1 ) / num_shards_, 1U
+  ) );
+  for ( unsigned i = 0; i != num_shards_; ++i ) {
+    shards_.emplace_back( new shard( share, infl, chain_, queue_size_ ) );
+  }
+}
+
+void shard_set::add_market( market& mkt, const serum_pyth& tmpl )
+{
+  route rt;
+  rt.shard_ = get_shard( *mkt.get_pyth_price(), num_shards_ );
+  rt.pos_ = shards_[ rt.shard_ ]->add_market( mkt, tmpl, pub_ );
+  const unsigned idx = mkt.get_index();
+  if ( idx >= routes_.size() ) {
+    routes_.resize( idx + 1 );
+  }
+  routes_[ idx ] = rt;
+  mkt.set_fwd( this );
+}
+
+bool shard_set::start()
+{
+  fd_ = ::socket( AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0 );
+  if ( fd_ < 0 ) {
+    err_msg_ = std::string( "failed to open udp socket: " ) + strerror( errno );
+    return false;
+  }
+  for ( auto& shd : shards_ ) {
+    shd->start();
+  }
+  do_run_ = true;
+  thrd_ = std::thread( &shard_set::run_sender, this );
+  return true;
+}
+
+void shard_set::stop()
+{
+  for ( auto& shd : shards_ ) {
+    shd->stop();
+  }
+  do_run_ = false;
+  if ( thrd_.joinable() ) {
+    thrd_.join();
+  }
+}
+
+void shard_set::on_chain(
+  uint64_t slot,
+  const pc::hash& bhash,
+  tpu_sender& tpu,
+  uint64_t send_slot
+) {
+  chain_state state;
+  std::memset( &state, 0, sizeof( state ) );
+  state.slot_ = slot;
+  std::memcpy( state.bhash_, bhash.data(), sizeof( state.bhash_ ) );
+  state.num_tpu_ = tpu.get_targets( send_slot, state.tpu_ );
+  if ( std::memcmp( &state, &last_, sizeof( state ) ) != 0 ) {
+    last_ = state;
+    chain_.store( state );
+  }
+}
+
+void shard_set::on_account(
+  market *mkt,
+  market_acct acct,
+  const uint8_t *data,
+  size_t len,
+  uint64_t slot
+) {
+  const route& rt = routes_[ mkt->get_index() ];
+  if ( !shards_[ rt.shard_ ]->push( rt.pos_, acct, data, len, slot ) ) {
+    ++num_dropped_;
+  }
+}
+
+void shard_set::run_sender()
+{
+  chain_state state;
+  std::memset( &state, 0, sizeof( state ) );
+  uint64_t seq = 0;
+  while ( do_run_.load( std::memory_order_relaxed ) ) {
+    if ( chain_.get_seq() != seq ) {
+      seq = chain_.get_seq();
+      chain_.load( state );
+    }
+    bool is_busy = false;
+    for ( auto& shd : shards_ ) {
+      spsc_ring& queue = shd->get_tx_queue();
+      size_t len;
+      unsigned num = 0;
+      for ( const uint8_t *buf; num != MAX_BATCH && ( buf = queue.front( len ) ); ++num ) {
+        for ( unsigned i = 0; i != state.num_tpu_; ++i ) {
+          const ssize_t n = ::sendto(
+            fd_, buf, len, 0,
+            ( const sockaddr* )&state.tpu_[ i ], sizeof( state.tpu_[ i ] )
+          );
+          if ( n == ( ssize_t )len ) {
+            num_sent_.fetch_add( 1, std::memory_order_relaxed );
+          }
+        }
+        queue.pop();
+      }
+      is_busy = is_busy || num != 0;
+    }
+    if ( !is_busy ) {
+      std::this_thread::sleep_for( IDLE_WAIT );
+    }
+  }
+}
+
+uint64_t shard_set::get_num_submitted() const
+{
+  uint64_t num = 0;
+  for ( const auto& shd : shards_ ) {
+    num += shd->get_num_submitted();
+  }
+  return num;
+}
+
+uint64_t shard_set::get_num_resent() const
+{
+  uint64_t num = 0;
+  for ( const auto& shd : shards_ ) {
+    num += shd->get_num_resent();
+  }
+  return num;
+}
+
+uint64_t shard_set::get_num_landed() const
+{
+  uint64_t num = 0;
+  for ( const auto& shd : shards_ ) {
+    num += shd->get_num_landed();
+  }
+  return num;
+}
+
+uint64_t shard_set::get_num_expired() const
+{
+  uint64_t num = 0;
+  for ( const auto& shd : shards_ ) {
+    num += shd->get_num_expired();
+  }
+  return num;
+}
+
+uint64_t shard_set::get_num_tx_dropped() const
+{
+  uint64_t num = 0;
+  for ( const auto& shd : shards_ ) {
+    num += shd->get_num_tx_dropped();
+  }
+  return num;
+}
+
+uint64_t shard_set::get_num_dropped() const
+{
+  return num_dropped_;
+}
+
+uint64_t shard_set::get_num_sent() const
+{
+  return num_sent_.load( std::memory_order_relaxed );
+}
+
+const std::string& shard_set::get_err_msg() const
+{
+  return err_msg_;
+}
@@ -0,0 +1,209 @@
+#pragma once
+
+#include "inflight.hpp"
+#include "market.hpp"
+#include "scheduler.hpp"
+#include "seqlock.hpp"
+#include "serum_pyth.hpp"
+#include "spsc.hpp"
+#include "tpu_sender.hpp"
+
+#include <netinet/in.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace sp
+{
+
+  // Cluster state the I/O thread broadcasts to the shards and sender.
+  struct chain_state
+  {
+    uint64_t    slot_;
+    uint8_t     bhash_[ 32 ];  // recent blockhash
+    unsigned    num_tpu_;
+    sockaddr_in tpu_[ tpu_sender::MAX_FANOUT ];
+  };
+
+  // A worker thread owning a partition of the markets: it decodes their
+  // forwarded account updates, schedules them under its share of the
+  // transaction budget, tracks them in flight and builds and signs their
+  // transactions. Only the queues and the chain state cross threads.
+  //
+  // Transactions are confirmed by our component's pub_slot_ alone.
+  class shard : public market_sub, public inflight_sub
+  {
+  public:
+
+    shard(
+      const scheduler& sched,
+      const inflight& infl,
+      const seqlock<chain_state>& chain,
+      size_t queue_size
+    );
+    ~shard();
+
+    // Call before start(). Decodes mkt's updates in a copy of it and
+    // publishes with tmpl, whose block hash and key cache are replaced.
+    // Returns the market's position in the shard.
+    unsigned add_market(
+      const market& mkt, const serum_pyth& tmpl, pc::pub_key *pub
+    );
+
+    bool start();
+    void stop();
+
+    // I/O thread: queue an account update of the market at pos. Returns
+    // false if the queue is full and the update was dropped.
+    bool push(
+      unsigned pos,
+      market_acct,
+      const uint8_t *data,
+      size_t len,
+      uint64_t slot
+    );
+
+    // Send thread: signed transactions, one per record.
+    spsc_ring& get_tx_queue();
+
+    // Totals, from any thread.
+    uint64_t get_num_submitted() const;
+    uint64_t get_num_resent() const;
+    uint64_t get_num_landed() const;
+    uint64_t get_num_expired() const;
+    uint64_t get_num_tx_dropped() const;
+
+    void on_book( market * ) override;
+    void on_price( market * ) override;
+    void on_resend( unsigned, const uint8_t *buf, size_t len ) override;
+    void on_done(
+      unsigned, const tx_sig&, tx_outcome, uint64_t slots
+    ) override;
+
+  private:
+
+    struct update_hdr
+    {
+      uint32_t pos_;
+      uint32_t acct_;
+      uint64_t slot_;
+    };
+
+    void run();
+    bool poll_updates();
+    bool poll_chain( int64_t now );
+    void publish( unsigned pos );
+    void send( const uint8_t *buf, size_t len );
+    void update_blocked( unsigned pos );
+
+    scheduler sched_;
+    inflight  infl_;
+    const seqlock<chain_state>& chain_;
+    uint64_t  chain_seq_;
+    chain_state state_;
+    pc::hash  bhash_;
+    bool      has_hash_;
+    uint64_t  slot_;
+    std::vector<std::unique_ptr<market>> mkts_;
+    std::vector<serum_pyth> tmpls_;
+    std::vector<unsigned>   pos_;  // by market index
+    spsc_ring in_;
+    spsc_ring out_;
+    std::thread thrd_;
+    std::atomic<bool> do_run_;
+
+    std::atomic<uint64_t> num_submitted_;
+    std::atomic<uint64_t> num_resent_;
+    std::atomic<uint64_t> num_landed_;
+    std::atomic<uint64_t> num_expired_;
+    std::atomic<uint64_t> num_tx_dropped_;
+  };
+
+  // Markets hash-partitioned by price account over worker shards, the
+  // chain state they share and a thread sending their transactions to
+  // the TPU on its own socket. The I/O thread (pc::manager's) forwards
+  // account notifications to the owning shard and broadcasts the slot,
+  // blockhash and leader TPU addresses through a seqlock.
+  class shard_set : public market_fwd
+  {
+  public:
+
+    shard_set();
+    ~shard_set();
+
+    // Worker threads (default 1).
+    void set_num_shards( unsigned );
+    unsigned get_num_shards() const;
+
+    // Bytes of each shard's update queue (default 16MiB).
+    void set_queue_size( size_t );
+
+    // Create the shards, each with a copy of sched's and infl's settings
+    // and an even share of the transaction budget. Call before adding
+    // markets.
+    void init( const scheduler&, const inflight&, pc::pub_key *pub );
+
+    // Hand mkt to its shard; its updates are forwarded from now on.
+    void add_market( market&, const serum_pyth& tmpl );
+
+    bool start();
+    void stop();
+
+    // I/O thread: latest slot and blockhash, and the TPUs of the leaders
+    // of send_slot.
+    void on_chain(
+      uint64_t slot, const pc::hash&, tpu_sender&, uint64_t send_slot
+    );
+
+    void on_account(
+      market *,
+      market_acct,
+      const uint8_t *data,
+      size_t len,
+      uint64_t slot
+    ) override;
+
+    // Totals over every shard.
+    uint64_t get_num_submitted() const;
+    uint64_t get_num_resent() const;
+    uint64_t get_num_landed() const;
+    uint64_t get_num_expired() const;
+    uint64_t get_num_tx_dropped() const;
+
+    // Account updates dropped on a full shard queue.
+    uint64_t get_num_dropped() const;
+
+    // Transactions sent by the send thread, per TPU address.
+    uint64_t get_num_sent() const;
+
+    const std::string& get_err_msg() const;
+
+  private:
+
+    struct route
+    {
+      unsigned shard_;
+      unsigned pos_;
+    };
+
+    void run_sender();
+
+    unsigned    num_shards_;
+    size_t      queue_size_;
+    pc::pub_key *pub_;
+    std::vector<std::unique_ptr<shard>> shards_;
+    std::vector<route> routes_;  // by market index
+    seqlock<chain_state> chain_;
+    chain_state last_;
+    uint64_t    num_dropped_;
+    int         fd_;
+    std::thread thrd_;
+    std::atomic<bool> do_run_;
+    std::atomic<uint64_t> num_sent_;
+    std::string err_msg_;
+  };
+
+}
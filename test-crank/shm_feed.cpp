@@ -0,0 +1,261 @@
+#include "shm_feed.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace sp;
+
+static_assert(
+  std::atomic<uint64_t>::is_always_lock_free,
+  "shared-memory seqlocks need address-free atomics"
+);
+
+static size_t get_region_len( uint32_t num_slots, uint32_t ring_size )
+{
+  return sizeof( shm_header )
+    + num_slots * sizeof( shm_slot )
+    + ring_size * sizeof( shm_update );
+}
+
+shm_feed::shm_feed()
+: name_( "/serum-pyth" ),
+  ring_size_( 0 ),
+  len_( 0 ),
+  base_( nullptr ),
+  hdr_( nullptr ),
+  slots_( nullptr ),
+  ring_( nullptr )
+{
+}
+
+shm_feed::~shm_feed()
+{
+  if ( base_ ) {
+    ::munmap( base_, len_ );
+  }
+}
+
+void shm_feed::set_name( const std::string& name )
+{
+  name_ = name;
+}
+
+void shm_feed::set_ring_size( uint32_t ring_size )
+{
+  ring_size_ = 0;
+  if ( ring_size ) {
+    ring_size_ = 1;
+    while ( ring_size_ < ring_size ) {
+      ring_size_ <<= 1;
+    }
+  }
+}
+
+bool shm_feed::init( unsigned num_slots )
+{
+  // Unlink first so readers of a previous run keep a valid (stale) mapping
+  // instead of faulting on a resized object.
+  ::shm_unlink( name_.c_str() );
+  const int fd = ::shm_open( name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644 );
+  if ( fd < 0 ) {
+    err_ = "shm_open " + name_ + ": " + std::strerror( errno );
+    return false;
+  }
+  len_ = get_region_len( num_slots, ring_size_ );
+  if ( ::ftruncate( fd, ( off_t )len_ ) != 0 ) {
+    err_ = "ftruncate " + name_ + ": " + std::strerror( errno );
+    ::close( fd );
+    return false;
+  }
+  void *base = ::mmap(
+    nullptr, len_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0
+  );
+  ::close( fd );
+  if ( base == MAP_FAILED ) {
+    err_ = "mmap " + name_ + ": " + std::strerror( errno );
+    return false;
+  }
+
+  // ftruncate zero-fills: every seq_ starts at 0 (never written).
+  base_ = ( uint8_t* )base;
+  hdr_ = ( shm_header* )base_;
+  slots_ = ( shm_slot* )( hdr_ + 1 );
+  ring_ = ( shm_update* )( slots_ + num_slots );
+  hdr_->version_ = SHM_VERSION;
+  hdr_->num_slots_ = num_slots;
+  hdr_->ring_size_ = ring_size_;
+  std::atomic_thread_fence( std::memory_order_release );
+  hdr_->magic_ = SHM_MAGIC;
+  return true;
+}
+
+bool shm_feed::get_is_init() const
+{
+  return base_ != nullptr;
+}
+
+unsigned shm_feed::get_num_slots() const
+{
+  return base_ ? hdr_->num_slots_ : 0;
+}
+
+void shm_feed::update( unsigned idx, const shm_quote& quote )
+{
+  if ( !base_ || idx >= hdr_->num_slots_ ) {
+    return;
+  }
+
+  shm_slot& slot = slots_[ idx ];
+  const uint64_t seq = slot.seq_.load( std::memory_order_relaxed );
+  slot.seq_.store( seq + 1, std::memory_order_relaxed );
+  std::atomic_thread_fence( std::memory_order_release );
+  std::memcpy( &slot.quote_, &quote, sizeof( quote ) );
+  slot.seq_.store( seq + 2, std::memory_order_release );
+
+  if ( ring_size_ ) {
+    const uint64_t pos = hdr_->ring_head_.load( std::memory_order_relaxed );
+    shm_update& upd = ring_[ pos & ( ring_size_ - 1 ) ];
+    upd.seq_.store( 2 * pos + 1, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_release );
+    upd.idx_ = idx;
+    std::memcpy( &upd.quote_, &quote, sizeof( quote ) );
+    upd.seq_.store( 2 * pos + 2, std::memory_order_release );
+    hdr_->ring_head_.store( pos + 1, std::memory_order_release );
+  }
+}
+
+const std::string& shm_feed::get_err_msg() const
+{
+  return err_;
+}
+
+shm_reader::shm_reader()
+: len_( 0 ),
+  base_( nullptr ),
+  hdr_( nullptr ),
+  slots_( nullptr ),
+  ring_( nullptr ),
+  pos_( 0 ),
+  lost_( 0 )
+{
+}
+
+shm_reader::~shm_reader()
+{
+  if ( base_ ) {
+    ::munmap( base_, len_ );
+  }
+}
+
+bool shm_reader::init( const std::string& name )
+{
+  const int fd = ::shm_open( name.c_str(), O_RDONLY, 0 );
+  if ( fd < 0 ) {
+    err_ = "shm_open " + name + ": " + std::strerror( errno );
+    return false;
+  }
+  struct stat st;
+  if ( ::fstat( fd, &st ) != 0 || ( size_t )st.st_size < sizeof( shm_header ) ) {
+    err_ = "invalid shm region " + name;
+    ::close( fd );
+    return false;
+  }
+  len_ = ( size_t )st.st_size;
+  void *base = ::mmap( nullptr, len_, PROT_READ, MAP_SHARED, fd, 0 );
+  ::close( fd );
+  if ( base == MAP_FAILED ) {
+    err_ = "mmap " + name + ": " + std::strerror( errno );
+    return false;
+  }
+  base_ = ( uint8_t* )base;
+  hdr_ = ( const shm_header* )base_;
+  if ( hdr_->magic_ != SHM_MAGIC || hdr_->version_ != SHM_VERSION
+    || len_ != get_region_len( hdr_->num_slots_, hdr_->ring_size_ ) ) {
+    err_ = "unexpected shm layout " + name;
+    return false;
+  }
+  std::atomic_thread_fence( std::memory_order_acquire );
+  slots_ = ( const shm_slot* )( hdr_ + 1 );
+  ring_ = ( const shm_update* )( slots_ + hdr_->num_slots_ );
+
+  // Start at the oldest update still in the ring.
+  const uint64_t head = hdr_->ring_head_.load( std::memory_order_acquire );
+  pos_ = head > hdr_->ring_size_ ? head - hdr_->ring_size_ : 0;
+  return true;
+}
+
+unsigned shm_reader::get_num_slots() const
+{
+  return slots_ ? hdr_->num_slots_ : 0;
+}
+
+bool shm_reader::read(
+  unsigned idx,
+  shm_quote& quote,
+  unsigned max_tries
+) const {
+  if ( idx >= get_num_slots() ) {
+    return false;
+  }
+  const shm_slot& slot = slots_[ idx ];
+  for ( unsigned i = 0; i < max_tries; ++i ) {
+    const uint64_t seq0 = slot.seq_.load( std::memory_order_acquire );
+    if ( seq0 == 0 ) {
+      return false;
+    }
+    if ( seq0 & 1 ) {
+      continue;
+    }
+    std::memcpy( &quote, &slot.quote_, sizeof( quote ) );
+    std::atomic_thread_fence( std::memory_order_acquire );
+    if ( slot.seq_.load( std::memory_order_relaxed ) == seq0 ) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool shm_reader::next( unsigned& idx, shm_quote& quote )
+{
+  if ( !ring_ || hdr_->ring_size_ == 0 ) {
+    return false;
+  }
+  const uint64_t size = hdr_->ring_size_;
+  for ( ;; ) {
+    const uint64_t head = hdr_->ring_head_.load( std::memory_order_acquire );
+    if ( pos_ >= head ) {
+      return false;
+    }
+    if ( head - pos_ > size ) {
+      lost_ += head - size - pos_;
+      pos_ = head - size;
+    }
+    const shm_update& upd = ring_[ pos_ & ( size - 1 ) ];
+    const uint64_t seq0 = upd.seq_.load( std::memory_order_acquire );
+    if ( seq0 == 2 * pos_ + 2 ) {
+      idx = upd.idx_;
+      std::memcpy( &quote, &upd.quote_, sizeof( quote ) );
+      std::atomic_thread_fence( std::memory_order_acquire );
+      if ( upd.seq_.load( std::memory_order_relaxed ) == seq0 ) {
+        ++pos_;
+        return true;
+      }
+    }
+    // Overwritten while reading: the head has moved on, so retry from
+    // the oldest surviving entry.
+  }
+}
+
+uint64_t shm_reader::get_num_lost() const
+{
+  return lost_;
+}
+
+const std::string& shm_reader::get_err_msg() const
+{
+  return err_;
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace sp
+{
+
+  // Shared-memory layout of the crank's price feed. Other processes on
+  // the host map the region read-only through shm_reader.
+  //
+  //   shm_header | shm_slot[ num_slots_ ] | shm_update[ ring_size_ ]
+  //
+  // Each slot holds the latest quote of one market behind a seqlock: the
+  // writer makes seq_ odd, copies the quote, then makes it even again.
+  // The optional ring is a single-producer log of every update. It never
+  // blocks the writer; readers keep their own cursor and detect overruns.
+
+  static const uint64_t SHM_MAGIC   = 0x7370666565640001UL;  // "spfeed"
+  static const uint32_t SHM_VERSION = 1;
+
+  // Latest values computed by the crank for one market.
+  struct shm_quote
+  {
+    uint8_t  pyth_price_[32];  // price account key
+    uint64_t bid_;             // serum best bid, QuoteLot/BaseLot
+    uint64_t ask_;             // serum best ask, QuoteLot/BaseLot
+    int64_t  price_;           // pyth units, scaled by 10^expo_
+    uint64_t conf_;            // pyth units
+    int32_t  expo_;
+    uint32_t trading_;         // 1 if the program would publish TRADING
+    uint64_t book_slot_;       // slot of the last book notification
+    int64_t  ts_;              // crank time of the update in ns
+  };
+
+  struct alignas( 64 ) shm_header
+  {
+    uint64_t magic_;
+    uint32_t version_;
+    uint32_t num_slots_;
+    uint32_t ring_size_;       // 0 or a power of 2
+    uint32_t unused_;
+    std::atomic<uint64_t> ring_head_;  // total updates written to the ring
+  };
+
+  struct alignas( 64 ) shm_slot
+  {
+    std::atomic<uint64_t> seq_;
+    shm_quote quote_;
+  };
+
+  struct alignas( 64 ) shm_update
+  {
+    std::atomic<uint64_t> seq_;  // 2 * position + 2 once written
+    uint32_t  idx_;              // slot index
+    uint32_t  unused_;
+    shm_quote quote_;
+  };
+
+  // Writer side, owned by the crank.
+  class shm_feed
+  {
+  public:
+
+    shm_feed();
+    ~shm_feed();
+
+    // POSIX shm name, e.g. "/serum-pyth".
+    void set_name( const std::string& );
+
+    // Entries in the update ring, rounded up to a power of 2. 0 disables it.
+    void set_ring_size( uint32_t );
+
+    // Create or replace the region with one slot per market, plus any
+    // for markets added later. Updates of markets past them are dropped.
+    bool init( unsigned num_slots );
+    bool get_is_init() const;
+    unsigned get_num_slots() const;
+
+    // Publish the latest quote of a market.
+    void update( unsigned idx, const shm_quote& );
+
+    const std::string& get_err_msg() const;
+
+  private:
+
+    std::string name_;
+    std::string err_;
+    uint32_t    ring_size_;
+    size_t      len_;
+    uint8_t    *base_;
+    shm_header *hdr_;
+    shm_slot   *slots_;
+    shm_update *ring_;
+  };
+
+  // Reader side, for local consumers.
+  class shm_reader
+  {
+  public:
+
+    shm_reader();
+    ~shm_reader();
+
+    bool init( const std::string& name );
+    unsigned get_num_slots() const;
+
+    // Consistent copy of a market's latest quote. Returns false if the
+    // slot was never written or kept changing for max_tries attempts.
+    bool read( unsigned idx, shm_quote&, unsigned max_tries = 64 ) const;
+
+    // Next update from the ring in write order. Returns false when caught
+    // up. If the writer lapped the reader, skips to the oldest update
+    // still in the ring and counts the lost ones.
+    bool next( unsigned& idx, shm_quote& );
+    uint64_t get_num_lost() const;
+
+    const std::string& get_err_msg() const;
+
+  private:
+
+    std::string err_;
+    size_t      len_;
+    uint8_t    *base_;
+    const shm_header *hdr_;
+    const shm_slot   *slots_;
+    const shm_update *ring_;
+    uint64_t    pos_;
+    uint64_t    lost_;
+  };
+
+}
@@ -0,0 +1,189 @@
+#include "sig_status.hpp"
+
+#include <cstdlib>
+
+using namespace sp;
+
+static std::string to_string( const pc::jtree& jt, uint32_t tok )
+{
+  const pc::str s = jt.get_str( tok );
+  return std::string( s.str_, s.len_ );
+}
+
+void sig_status::clear()
+{
+  res_.clear();
+}
+
+void sig_status::add( const tx_sig& sig )
+{
+  res_.emplace_back();
+  result& r = res_.back();
+  r.sig_ = sig;
+  r.st_ = e_pending;
+  r.err_ = tx_error::none;
+  r.code_ = 0;
+  r.ix_ = NO_INSTRUCTION;
+}
+
+size_t sig_status::get_num() const
+{
+  return res_.size();
+}
+
+const tx_sig& sig_status::get_sig( size_t i ) const
+{
+  return res_[ i ].sig_;
+}
+
+sig_status::status sig_status::get_status( size_t i ) const
+{
+  return res_[ i ].st_;
+}
+
+tx_error sig_status::get_error( size_t i ) const
+{
+  return res_[ i ].err_;
+}
+
+uint32_t sig_status::get_custom_code( size_t i ) const
+{
+  return res_[ i ].code_;
+}
+
+uint32_t sig_status::get_instruction( size_t i ) const
+{
+  return res_[ i ].ix_;
+}
+
+void sig_status::request( pc::json_wtr& msg )
+{
+  msg.add_key( "method", "getSignatureStatuses" );
+  msg.add_key( "params", pc::json_wtr::e_arr );
+  msg.add_val( pc::json_wtr::e_arr );
+  for ( const result& r : res_ ) {
+    pc::signature sig;
+    sig.init_from_buf( r.sig_.data() );
+    std::string txt;
+    sig.enc_base58( txt );
+    msg.add_val( pc::str( txt ) );
+  }
+  msg.pop();
+  msg.pop();
+}
+
+void sig_status::response( const pc::jtree& jt )
+{
+  if ( on_error( jt, this ) ) {
+    return;
+  }
+  const uint32_t rtok = jt.find_val( 1, "result" );
+  const uint32_t vtok = jt.find_val( rtok, "value" );
+  size_t i = 0;
+  for ( uint32_t it = jt.get_first( vtok ); it && i < res_.size();
+        it = jt.get_next( it ), ++i ) {
+    result& r = res_[ i ];
+    if ( jt.get_type( it ) != pc::jtree::e_obj ) {
+      continue; // null: not seen yet
+    }
+    const uint32_t etok = jt.find_val( it, "err" );
+    if ( !etok || to_string( jt, etok ) == "null" ) {
+      r.st_ = e_landed;
+    }
+    else {
+      r.st_ = e_failed;
+      parse_error( jt, etok, r );
+    }
+  }
+  on_response( this );
+}
+
+// "err" is either a TransactionError name, or an object such as
+// { "InstructionError": [ 0, "InvalidAccountData" ] }
+// { "InstructionError": [ 0, { "Custom": 1 } ] }
+void sig_status::parse_error( const pc::jtree& jt, uint32_t tok, result& r )
+{
+  if ( jt.get_type( tok ) != pc::jtree::e_obj ) {
+    r.err_ = parse_tx_error( to_string( jt, tok ) );
+    return;
+  }
+  const uint32_t kv = jt.get_first( tok );
+  const std::string name = to_string( jt, jt.get_key( kv ) );
+  if ( name != "InstructionError" ) {
+    r.err_ = parse_tx_error( name );
+    return;
+  }
+  const uint32_t arr = jt.get_val( kv );
+  r.ix_ = ( uint32_t )jt.get_uint( jt.get_first( arr ) );
+  const uint32_t inner = jt.get_next( jt.get_first( arr ) );
+  if ( jt.get_type( inner ) != pc::jtree::e_obj ) {
+    r.err_ = parse_tx_error( to_string( jt, inner ) );
+    return;
+  }
+  const uint32_t ikv = jt.get_first( inner );
+  r.err_ = parse_tx_error( to_string( jt, jt.get_key( ikv ) ) );
+  if ( r.err_ == tx_error::custom ) {
+    r.code_ = ( uint32_t )jt.get_uint( jt.get_val( ikv ) );
+  }
+}
+
+void tx_units::set_program( const pc::pub_key& prog )
+{
+  std::string txt;
+  prog.enc_base58( txt );
+  prefix_ = "Program " + txt + " consumed ";
+}
+
+void tx_units::request( pc::json_wtr& msg )
+{
+  pc::signature sig;
+  sig.init_from_buf( sig_.data() );
+  std::string txt;
+  sig.enc_base58( txt );
+  msg.add_key( "method", "getTransaction" );
+  msg.add_key( "params", pc::json_wtr::e_arr );
+  msg.add_val( pc::str( txt ) );
+  msg.add_val( pc::json_wtr::e_obj );
+  msg.add_key( "encoding", "json" );
+  msg.add_key( "commitment", "confirmed" );
+  msg.add_key( "maxSupportedTransactionVersion", (uint64_t)0 );
+  msg.pop();
+  msg.pop();
+}
+
+void tx_units::response( const pc::jtree& jt )
+{
+  found_ = false;
+  units_ = 0;
+  ix_units_.clear();
+  if ( on_error( jt, this ) ) {
+    return;
+  }
+  const uint32_t rtok = jt.find_val( 1, "result" );
+  if ( rtok && jt.get_type( rtok ) == pc::jtree::e_obj ) {
+    const uint32_t mtok = jt.find_val( rtok, "meta" );
+    const uint32_t utok = mtok && jt.get_type( mtok ) == pc::jtree::e_obj
+      ? jt.find_val( mtok, "computeUnitsConsumed" ) : 0;
+    if ( utok ) {
+      found_ = true;
+      units_ = jt.get_uint( utok );
+      parse_logs( jt, jt.find_val( mtok, "logMessages" ) );
+    }
+  }
+  on_response( this );
+}
+
+// Nested invocations log "consumed" too, but of other programs (pyth).
+void tx_units::parse_logs( const pc::jtree& jt, uint32_t tok )
+{
+  if ( !tok || prefix_.empty() || jt.get_type( tok ) != pc::jtree::e_arr ) {
+    return;
+  }
+  for ( uint32_t it = jt.get_first( tok ); it; it = jt.get_next( it ) ) {
+    const pc::str line = jt.get_str( it );
+    if ( line.len_ > prefix_.size()
+      && prefix_.compare( 0, prefix_.size(), line.str_, prefix_.size() ) == 0 ) {
+      ix_units_.push_back( std::strtoull( line.str_ + prefix_.size(), nullptr, 10 ) );
+    }
+  }
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "inflight.hpp"
+#include "tx_error.hpp"
+
+#include <pc/rpc_client.hpp>
+
+#include <string>
+#include <vector>
+
+namespace sp
+{
+
+  // getSignatureStatuses for a batch of in-flight transactions.
+  class sig_status : public pc::rpc_request
+  {
+  public:
+
+    // Max signatures per request.
+    static const size_t MAX_SIGS = 256;
+
+    enum status { e_pending, e_landed, e_failed };
+
+    void clear();
+    void add( const tx_sig& );
+
+    size_t get_num() const;
+    const tx_sig& get_sig( size_t ) const;
+    status get_status( size_t ) const;
+    tx_error get_error( size_t ) const;
+    uint32_t get_custom_code( size_t ) const;
+
+    // Index of the failed instruction, or NO_INSTRUCTION.
+    static const uint32_t NO_INSTRUCTION = UINT32_MAX;
+    uint32_t get_instruction( size_t ) const;
+
+    void request( pc::json_wtr& ) override;
+    void response( const pc::jtree& ) override;
+
+  private:
+
+    struct result
+    {
+      tx_sig   sig_;
+      status   st_;
+      tx_error err_;
+      uint32_t code_;
+      uint32_t ix_;
+    };
+
+    void parse_error( const pc::jtree&, uint32_t tok, result& );
+
+    std::vector<result> res_;
+  };
+
+  // getTransaction for one landed transaction, for the compute units it
+  // consumed (meta.computeUnitsConsumed) and, from its logs, those of each
+  // top-level instruction of one program.
+  class tx_units : public pc::rpc_request
+  {
+  public:
+
+    void set_sig( const tx_sig& sig ) { sig_ = sig; }
+    const tx_sig& get_sig() const { return sig_; }
+
+    // Program whose "Program <id> consumed <n> of <m> compute units" log
+    // lines to collect.
+    void set_program( const pc::pub_key& );
+
+    // False if the node doesn't have the transaction (yet) or predates
+    // computeUnitsConsumed.
+    bool get_is_found() const { return found_; }
+    uint64_t get_units() const { return units_; }
+
+    // Units of each instruction of the program, in order.
+    size_t get_num_ix() const { return ix_units_.size(); }
+    uint64_t get_ix_units( size_t i ) const { return ix_units_[ i ]; }
+
+    void request( pc::json_wtr& ) override;
+    void response( const pc::jtree& ) override;
+
+  private:
+    void parse_logs( const pc::jtree&, uint32_t tok );
+
+    tx_sig   sig_;
+    bool     found_ = false;
+    uint64_t units_ = 0;
+    std::string prefix_;   // "Program <id> consumed "
+    std::vector<uint64_t> ix_units_;
+  };
+
+}
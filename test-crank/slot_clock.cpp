@@ -0,0 +1,76 @@
+#include "slot_clock.hpp"
+
+using namespace sp;
+
+// DEFAULT_MS_PER_SLOT
+static const int64_t DEFAULT_SLOT_DURATION = 400000000L;
+
+slot_clock::slot_clock()
+: slot_( 0 ),
+  slot_ts_( 0 ),
+  slot_dur_( DEFAULT_SLOT_DURATION ),
+  latency_( 0 ),
+  window_( DEFAULT_SLOT_DURATION / 4 )
+{
+}
+
+void slot_clock::set_latency( int64_t latency )
+{
+  latency_ = latency;
+}
+
+void slot_clock::set_window( int64_t window )
+{
+  window_ = window;
+}
+
+void slot_clock::on_slot( uint64_t slot, int64_t now )
+{
+  if ( slot <= slot_ ) {
+    return;
+  }
+  if ( slot_ != 0 ) {
+    const int64_t nslots = ( int64_t )( slot - slot_ );
+    const int64_t dur = ( now - slot_ts_ ) / nslots;
+    // Ignore samples skewed by stalled or bunched notifications.
+    if ( dur > slot_dur_ / 4 && dur < slot_dur_ * 4 ) {
+      slot_dur_ += ( dur - slot_dur_ ) / 8;
+    }
+  }
+  slot_ = slot;
+  slot_ts_ = now;
+}
+
+uint64_t slot_clock::get_slot() const
+{
+  return slot_;
+}
+
+int64_t slot_clock::get_slot_duration() const
+{
+  return slot_dur_;
+}
+
+uint64_t slot_clock::get_arrival_slot( int64_t now ) const
+{
+  const int64_t elapsed = now + latency_ - slot_ts_;
+  if ( slot_ == 0 || elapsed < 0 ) {
+    return slot_;
+  }
+  return slot_ + ( uint64_t )( elapsed / slot_dur_ );
+}
+
+bool slot_clock::is_send_window( int64_t now ) const
+{
+  // Send freely until the first slot is seen.
+  return slot_ == 0 || get_phase( now ) < window_;
+}
+
+int64_t slot_clock::get_phase( int64_t now ) const
+{
+  const int64_t elapsed = now + latency_ - slot_ts_;
+  if ( elapsed < 0 ) {
+    return slot_dur_ + elapsed % slot_dur_;
+  }
+  return elapsed % slot_dur_;
+}
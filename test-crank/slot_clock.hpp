@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+
+namespace sp
+{
+
+  // Estimates slot boundaries from the slot updates seen through
+  // pc::manager so submissions can be timed to land early in a slot.
+  //
+  // All times are nanoseconds from pc::get_now().
+  class slot_clock
+  {
+  public:
+
+    slot_clock();
+
+    // Expected delay from submission until the leader sees the
+    // transaction, net of the delay in observing a new slot.
+    void set_latency( int64_t );
+
+    // Length of the send window at the start of each slot.
+    void set_window( int64_t );
+
+    void on_slot( uint64_t slot, int64_t now );
+
+    uint64_t get_slot() const;
+
+    // Smoothed observed slot duration.
+    int64_t get_slot_duration() const;
+
+    // Slot a transaction submitted now should arrive in.
+    uint64_t get_arrival_slot( int64_t now ) const;
+
+    // Whether a transaction submitted now arrives within the send window.
+    bool is_send_window( int64_t now ) const;
+
+  private:
+
+    int64_t get_phase( int64_t now ) const;
+
+    uint64_t slot_;
+    int64_t  slot_ts_;
+    int64_t  slot_dur_;
+    int64_t  latency_;
+    int64_t  window_;
+  };
+
+}
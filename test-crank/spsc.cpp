@@ -0,0 +1,94 @@
+#include "spsc.hpp"
+
+#include <cstring>
+
+using namespace sp;
+
+spsc_ring::spsc_ring()
+: size_( 0 ),
+  head_( 0 ),
+  tail_cache_( 0 ),
+  rsv_size_( 0 ),
+  tail_( 0 ),
+  head_cache_( 0 ),
+  pos_( 0 )
+{
+}
+
+void spsc_ring::init( size_t size )
+{
+  size_ = 64;
+  while ( size_ < size ) {
+    size_ <<= 1;
+  }
+  buf_.assign( size_, 0 );
+}
+
+size_t spsc_ring::get_rec_size( size_t len )
+{
+  return ( sizeof( header ) + len + 7 ) & ~( size_t )7;
+}
+
+uint8_t *spsc_ring::reserve( size_t len )
+{
+  const size_t rec = get_rec_size( len );
+  if ( rec > size_ / 2 || len > UINT32_MAX ) {
+    return nullptr;
+  }
+
+  // records don't wrap: skip the rest of the buffer if too short
+  const uint64_t head = head_.load( std::memory_order_relaxed );
+  const size_t off = ( size_t )( head & ( size_ - 1 ) );
+  const size_t skip = size_ - off < rec ? size_ - off : 0;
+  if ( head + skip + rec - tail_cache_ > size_ ) {
+    tail_cache_ = tail_.load( std::memory_order_acquire );
+    if ( head + skip + rec - tail_cache_ > size_ ) {
+      return nullptr;
+    }
+  }
+  if ( skip ) {
+    header *hdr = ( header* )&buf_[ off ];
+    hdr->len_ = 0;
+    hdr->skip_ = 1;
+  }
+  rsv_size_ = skip + rec;
+  header *hdr = ( header* )&buf_[ ( head + skip ) & ( size_ - 1 ) ];
+  hdr->len_ = ( uint32_t )len;
+  hdr->skip_ = 0;
+  return ( uint8_t* )( hdr + 1 );
+}
+
+void spsc_ring::commit()
+{
+  const uint64_t head = head_.load( std::memory_order_relaxed );
+  head_.store( head + rsv_size_, std::memory_order_release );
+  rsv_size_ = 0;
+}
+
+const uint8_t *spsc_ring::front( size_t& len )
+{
+  for ( ;; ) {
+    if ( pos_ == head_cache_ ) {
+      head_cache_ = head_.load( std::memory_order_acquire );
+      if ( pos_ == head_cache_ ) {
+        return nullptr;
+      }
+    }
+    const size_t off = ( size_t )( pos_ & ( size_ - 1 ) );
+    const header *hdr = ( const header* )&buf_[ off ];
+    if ( hdr->skip_ ) {
+      pos_ += size_ - off;
+      tail_.store( pos_, std::memory_order_release );
+      continue;
+    }
+    len = hdr->len_;
+    return ( const uint8_t* )( hdr + 1 );
+  }
+}
+
+void spsc_ring::pop()
+{
+  const header *hdr = ( const header* )&buf_[ pos_ & ( size_ - 1 ) ];
+  pos_ += get_rec_size( hdr->len_ );
+  tail_.store( pos_, std::memory_order_release );
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace sp
+{
+
+  // Bounded single-producer, single-consumer queue of variable-length
+  // records in one preallocated buffer, e.g. account updates into a
+  // shard or signed transactions out of it. Neither side locks or
+  // blocks: a full queue is a failed reserve().
+  //
+  // Records are an 8-byte header and the payload, padded to 8 bytes. One
+  // that doesn't fit before the end of the buffer is preceded by a skip
+  // record and starts again at the beginning.
+  class spsc_ring
+  {
+  public:
+
+    spsc_ring();
+
+    // Buffer size in bytes, rounded up to a power of 2. Call before use.
+    void init( size_t size );
+
+    // Producer: space for a record of len bytes, or nullptr if the queue
+    // is full or the record could never fit. Call commit() to publish it.
+    uint8_t *reserve( size_t len );
+    void commit();
+
+    // Consumer: oldest record, or nullptr if empty. Call pop() to release
+    // it once done with the data.
+    const uint8_t *front( size_t& len );
+    void pop();
+
+  private:
+
+    struct header
+    {
+      uint32_t len_;
+      uint32_t skip_;  // rest of the buffer is unused
+    };
+
+    static size_t get_rec_size( size_t len );
+
+    std::vector<uint8_t> buf_;
+    size_t   size_;
+
+    // producer
+    alignas( 64 ) std::atomic<uint64_t> head_;  // bytes published
+    uint64_t tail_cache_;
+    size_t   rsv_size_;
+
+    // consumer
+    alignas( 64 ) std::atomic<uint64_t> tail_;  // bytes released
+    uint64_t head_cache_;
+    uint64_t pos_;
+  };
+
+}
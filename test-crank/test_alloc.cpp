@@ -0,0 +1,177 @@
+#include "alloc_check.hpp"
+#include "inflight.hpp"
+#include "scheduler.hpp"
+#include "spsc.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+// Runs the crank's per-slot work over many markets, past warm-up, and
+// fails on any heap allocation: scheduling, in-flight tracking with
+// rebroadcasts, expiry and confirmation, and the shard queues.
+
+static const unsigned NUM_MKTS = 10000;
+static const uint64_t NUM_SLOTS = 2000;
+static const uint64_t WARM_SLOTS = 100;
+static const int64_t SLOT_NS = 400000000L;
+
+static int num_fail = 0;
+
+// Counts rebroadcasts and outcomes like the crank's subscriber does.
+class counter : public sp::inflight_sub
+{
+public:
+  void on_resend( unsigned, const uint8_t *, size_t len ) override {
+    num_resent_ += len != 0;
+  }
+  void on_done(
+    unsigned, const sp::tx_sig&, sp::tx_outcome outcome, uint64_t
+  ) override {
+    switch ( outcome ) {
+      case sp::tx_outcome::landed: ++num_landed_; break;
+      case sp::tx_outcome::failed: ++num_failed_; break;
+      case sp::tx_outcome::expired: ++num_expired_; break;
+    }
+  }
+  uint64_t num_resent_ = 0;
+  uint64_t num_landed_ = 0;
+  uint64_t num_failed_ = 0;
+  uint64_t num_expired_ = 0;
+};
+
+static void check_counter()
+{
+  sp::alloc_scope::reset_count();
+  {
+    // Direct calls, which unlike new-expressions can't be elided.
+    sp::alloc_scope checked;
+    ::operator delete( ::operator new( 16 ) );
+    {
+      sp::alloc_scope unchecked( false );
+      ::operator delete[]( ::operator new[]( 16 ) );
+    }
+  }
+  ::operator delete( ::operator new( 16 ) );
+  if ( sp::alloc_scope::get_count() != 1 ) {
+    std::printf(
+      "FAIL counter: %lu allocations, expected 1\n",
+      sp::alloc_scope::get_count()
+    );
+    ++num_fail;
+  }
+}
+
+static void check_loop()
+{
+  std::mt19937_64 rng( 42 );
+  counter sub;
+  sp::scheduler sched;
+  sp::inflight infl;
+  sched.set_max_tx_per_slot( 500 );
+  infl.set_sub( &sub );
+  infl.set_max_per_market( 4 );
+  int64_t now = 0;
+  for ( unsigned i = 0; i != NUM_MKTS; ++i ) {
+    sched.add_market( now );
+    infl.add_market();
+  }
+  sp::spsc_ring ring;
+  ring.init( 1UL << 20 );
+
+  uint8_t buf[ sp::TX_MAX_SIZE ] = { 1 };
+  uint64_t num_sig = 0;
+  unsigned mkts[ sp::TX_MAX_MARKETS ];
+  std::vector<sp::tx_sig> live;
+  live.reserve( 64 );
+  for ( uint64_t slot = 1; slot <= NUM_SLOTS; ++slot ) {
+    if ( slot == WARM_SLOTS ) {
+      sp::alloc_scope::reset_count();
+    }
+    sp::alloc_scope checked;
+    now += SLOT_NS;
+    sched.on_slot( slot, now );
+    infl.on_slot( slot );
+
+    // book updates, through a shard queue
+    for ( unsigned i = 0; i != 2000; ++i ) {
+      uint8_t *rec = ring.reserve( 64 + rng() % 512 );
+      if ( rec ) {
+        std::memset( rec, 0, 16 );
+        ring.commit();
+      }
+    }
+    size_t len;
+    while ( ring.front( len ) ) {
+      const unsigned idx = ( unsigned )( rng() % NUM_MKTS );
+      const uint64_t mid = 1000000 + rng() % 1000;
+      sched.on_book( idx, mid - 5, mid + 5, now );
+      ring.pop();
+    }
+
+    // publish due markets, a few per transaction
+    size_t num = 0;
+    size_t per_tx = 1 + rng() % sp::TX_MAX_MARKETS;
+    for ( int idx; ( idx = sched.next( now ) ) >= 0; ) {
+      if ( !infl.can_submit( ( unsigned )idx ) ) {
+        sched.set_blocked( ( unsigned )idx, true );
+        continue;
+      }
+      mkts[ num++ ] = ( unsigned )idx;
+      if ( num == per_tx ) {
+        ++num_sig;
+        std::memcpy( buf + 1, &num_sig, sizeof( num_sig ) );
+        infl.on_submit( mkts, num, 0, buf, 200 + rng() % 1000, slot );
+        num = 0;
+        per_tx = 1 + rng() % sp::TX_MAX_MARKETS;
+      }
+    }
+
+    // most land by price update or signature, some fail, the rest expire
+    for ( unsigned i = 0; i != 200; ++i ) {
+      const unsigned idx = ( unsigned )( rng() % NUM_MKTS );
+      infl.on_pub_slot( idx, slot - rng() % 4 );
+      if ( !infl.can_submit( idx ) ) {
+        sched.set_blocked( idx, true );
+      }
+      else {
+        sched.set_blocked( idx, false );
+      }
+    }
+    infl.get_sigs( live, live.capacity() );
+    if ( slot % 8 == 0 && !live.empty() ) {
+      infl.on_confirm( live[ rng() % live.size() ], rng() % 2 != 0 );
+    }
+    for ( unsigned i = 0; i != 20; ++i ) {
+      const unsigned idx = ( unsigned )( rng() % NUM_MKTS );
+      sched.on_price( idx, slot );
+    }
+  }
+
+  std::printf(
+    "submitted=%lu resent=%lu landed=%lu failed=%lu expired=%lu\n",
+    infl.get_num_submitted(), sub.num_resent_, sub.num_landed_,
+    sub.num_failed_, sub.num_expired_
+  );
+  if ( infl.get_num_submitted() == 0 || sub.num_resent_ == 0
+    || sub.num_landed_ == 0 || sub.num_failed_ == 0 || sub.num_expired_ == 0 ) {
+    std::printf( "FAIL loop: did not exercise every path\n" );
+    ++num_fail;
+  }
+  if ( sp::alloc_scope::get_count() != 0 ) {
+    std::printf(
+      "FAIL loop: %lu heap allocations after warm-up\n",
+      sp::alloc_scope::get_count()
+    );
+    ++num_fail;
+  }
+}
+
+int main()
+{
+  check_counter();
+  check_loop();
+  std::printf( "%s\n", num_fail ? "FAILED" : "PASSED" );
+  return num_fail ? 1 : 0;
+}
@@ -0,0 +1,101 @@
+#include "batch.hpp"
+
+#include <serum-pyth/sp-util.h>
+
+#include <cstdio>
+#include <random>
+#include <vector>
+
+// Differential test: every batch kernel must match the scalar sp-util.h
+// functions bit for bit, including on overflow.
+
+static int num_fail = 0;
+
+static void check_price( sp::batch_isa isa, uint64_t fee_bps )
+{
+  std::mt19937_64 rng( 42 );
+  std::vector<uint64_t> bid, ask, s2p;
+  const uint64_t edges[] = {
+    0, 1, 2, 3, 9999, 10000, 10001, UINT32_MAX, UINT32_MAX + 1UL,
+    INT64_MAX, UINT64_MAX - 1, UINT64_MAX
+  };
+  for ( uint64_t b : edges ) {
+    for ( uint64_t a : edges ) {
+      for ( uint64_t s : { 0UL, 1UL, 10UL, 1000000UL, UINT64_MAX } ) {
+        bid.push_back( b );
+        ask.push_back( a );
+        s2p.push_back( s );
+      }
+    }
+  }
+  for ( int i = 0; i != 100000; ++i ) {
+    // Realistic books, then arbitrary bits.
+    const uint64_t mid = rng() % 100000000;
+    bid.push_back( mid - rng() % ( mid + 1 ) / 10 );
+    ask.push_back( mid + rng() % ( mid + 1 ) / 10 );
+    s2p.push_back( rng() % 1000000 );
+    bid.push_back( rng() );
+    ask.push_back( rng() );
+    s2p.push_back( rng() >> ( rng() % 64 ) );
+  }
+
+  // Odd length to exercise the scalar tail.
+  const size_t num = bid.size() - 3;
+  std::vector<int64_t> price( num );
+  std::vector<uint64_t> conf( num );
+  sp::batch_books in{ bid.data(), ask.data(), s2p.data(), num };
+  sp::batch_prices out{ price.data(), conf.data() };
+  sp::batch_price( in, fee_bps, out, isa );
+
+  for ( size_t i = 0; i != num; ++i ) {
+    const sp_size_t b = bid[ i ] * s2p[ i ];
+    const sp_size_t a = ask[ i ] * s2p[ i ];
+    const int64_t exp_price = ( int64_t )sp_midpt( b, a );
+    const uint64_t exp_conf = sp_confidence_fee( b, a, fee_bps );
+    if ( price[ i ] != exp_price || conf[ i ] != exp_conf ) {
+      std::printf(
+        "FAIL %s fee=%lu bid=%lu ask=%lu s2p=%lu: price %ld != %ld, "
+        "conf %lu != %lu\n",
+        sp::to_str( isa ), fee_bps, bid[ i ], ask[ i ], s2p[ i ],
+        price[ i ], exp_price, conf[ i ], exp_conf
+      );
+      if ( ++num_fail > 20 ) {
+        return;
+      }
+    }
+  }
+}
+
+static void check_status()
+{
+  const int64_t price[] = { 2000, 2000, -2000, -2000, INT64_MIN, INT64_MAX, 0 };
+  const uint64_t conf[] = { 100, 101, 100, 101, 1, UINT64_MAX, 0 };
+  const size_t num = sizeof( price ) / sizeof( price[ 0 ] );
+  uint8_t trading[ num ];
+  sp::batch_status( price, conf, num, PRICE_CONF_THRESHOLD, trading );
+  for ( size_t i = 0; i != num; ++i ) {
+    if ( trading[ i ] != sp_conf_within( price[ i ], conf[ i ], PRICE_CONF_THRESHOLD ) ) {
+      std::printf( "FAIL status price=%ld conf=%lu\n", price[ i ], conf[ i ] );
+      ++num_fail;
+    }
+  }
+}
+
+int main()
+{
+  const sp::batch_isa best = sp::get_batch_isa();
+  std::printf( "best isa: %s\n", sp::to_str( best ) );
+  for ( sp::batch_isa isa : {
+      sp::batch_isa::scalar, sp::batch_isa::avx2, sp::batch_isa::avx512 } ) {
+    if ( isa > best ) {
+      std::printf( "skip %s: not supported\n", sp::to_str( isa ) );
+      continue;
+    }
+    for ( uint64_t fee_bps : { 0UL, 1UL, 10UL, 30UL, 10000UL, UINT64_MAX } ) {
+      check_price( isa, fee_bps );
+    }
+  }
+  check_status();
+  std::printf( "%s\n", num_fail ? "FAILED" : "PASSED" );
+  return num_fail ? 1 : 0;
+}
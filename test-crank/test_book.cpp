@@ -0,0 +1,488 @@
+#include "book.hpp"
+
+#include <serum-pyth/serum-pyth.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+// Builds random critbit slabs the way serum lays them out, and checks
+// l2_book::decode() against a plain sort of their leaves. Corrupted
+// slabs (cycles, child indices past the end, a wrong LeafCount) must be
+// rejected. Then books patched by slab_diff over random order flow must
+// equal a fresh decode, and the time of each is reported.
+
+using sp::book_side;
+
+// Serum's 128 bit order key: price above, sequence number below.
+typedef unsigned __int128 crit_key;
+
+static int num_fail = 0;
+
+static void expect( bool cond, const char *what, unsigned iter )
+{
+  if ( !cond ) {
+    std::printf( "FAIL %s (iteration %u)\n", what, iter );
+    ++num_fail;
+  }
+}
+
+struct order
+{
+  uint64_t price_;
+  uint64_t seq_;
+  uint64_t qty_;
+  uint32_t slot_;  // node index of its leaf
+
+  crit_key get_key() const { return ( crit_key )price_ << 64 | seq_; }
+};
+
+// A bids/asks account: orders at their leaf slots, inner nodes in free
+// slots picked at random, unused slots tagged free.
+class slab_builder
+{
+public:
+
+  void build(
+    std::vector<order>& ords,
+    uint32_t num_nodes,
+    book_side side,
+    std::mt19937_64& rng
+  );
+
+  uint8_t *data() { return buf_.data(); }
+  size_t size() const { return buf_.size(); }
+
+  serum_book_t *get_book() {
+    return ( serum_book_t* )( buf_.data() + 5 + sizeof( serum_flags_t ) );
+  }
+  serum_node_any_t *get_node( uint32_t idx ) {
+    return ( serum_node_any_t* )( get_book() + 1 ) + idx;
+  }
+
+  // Inner nodes from the root down, and the position of each one's
+  // parent in inner_ (none for the root).
+  std::vector<uint32_t> inner_;
+  std::vector<size_t>   parent_;
+
+private:
+
+  uint32_t add_tree(
+    std::vector<order>& ords, size_t lo, size_t hi, size_t parent
+  );
+
+  std::vector<uint8_t>  buf_;
+  std::vector<uint32_t> free_;
+};
+
+void slab_builder::build(
+  std::vector<order>& ords,
+  uint32_t num_nodes,
+  book_side side,
+  std::mt19937_64& rng
+) {
+  const size_t len = 5 + sizeof( serum_flags_t ) + sizeof( serum_book_t )
+    + num_nodes * sizeof( serum_node_any_t ) + 7;
+  buf_.assign( len, 0 );
+  std::memcpy( buf_.data(), "serum", 5 );
+  std::memcpy( buf_.data() + len - 7, "padding", 7 );
+  serum_flags_t *flags = ( serum_flags_t* )( buf_.data() + 5 );
+  flags->Initialized = 1;
+  if ( side == book_side::bids ) {
+    flags->Bids = 1;
+  }
+  else {
+    flags->Asks = 1;
+  }
+
+  std::vector<bool> used( num_nodes, false );
+  for ( const order& o : ords ) {
+    used[ o.slot_ ] = true;
+  }
+  free_.clear();
+  for ( uint32_t i = 0; i != num_nodes; ++i ) {
+    if ( !used[ i ] ) {
+      free_.push_back( i );
+      get_node( i )->Tag = 3;
+    }
+  }
+  std::shuffle( free_.begin(), free_.end(), rng );
+
+  std::sort( ords.begin(), ords.end(), []( const order& a, const order& b ) {
+    return a.get_key() < b.get_key();
+  } );
+  inner_.clear();
+  parent_.clear();
+  serum_book_t *book = get_book();
+  book->LeafCount = ords.size();
+  book->Root = ords.empty() ? 0 : add_tree( ords, 0, ords.size(), SIZE_MAX );
+}
+
+// Subtree of the sorted, distinct keys in [lo, hi).
+uint32_t slab_builder::add_tree(
+  std::vector<order>& ords, size_t lo, size_t hi, size_t parent
+) {
+  if ( hi - lo == 1 ) {
+    const order& o = ords[ lo ];
+    serum_node_leaf_t *leaf = ( serum_node_leaf_t* )get_node( o.slot_ );
+    std::memset( ( void* )leaf, 0, sizeof( *leaf ) );
+    leaf->Tag = SERUM_NODE_TYPE_LEAF;
+    leaf->Key0 = o.seq_;
+    leaf->Key1 = o.price_;
+    leaf->Quantity = o.qty_;
+    return o.slot_;
+  }
+
+  // Highest bit where the first and last keys differ splits the range.
+  const crit_key diff = ords[ lo ].get_key() ^ ords[ hi - 1 ].get_key();
+  uint32_t bit = 127;
+  while ( !( diff >> bit & 1 ) ) {
+    --bit;
+  }
+  size_t mid = lo;
+  while ( !( ords[ mid ].get_key() >> bit & 1 ) ) {
+    ++mid;
+  }
+
+  const uint32_t idx = free_.back();
+  free_.pop_back();
+  const size_t pos = inner_.size();
+  inner_.push_back( idx );
+  parent_.push_back( parent );
+  serum_node_inner_t *inner = ( serum_node_inner_t* )get_node( idx );
+  std::memset( ( void* )get_node( idx ), 0, sizeof( serum_node_any_t ) );
+  inner->Tag = SERUM_NODE_TYPE_INNER;
+  inner->PrefixLen = 127 - bit;
+  inner->Key1 = ( uint64_t )( ords[ lo ].get_key() >> 64 );
+  inner->ChildA = add_tree( ords, lo, mid, pos );
+  inner->ChildB = add_tree( ords, mid, hi, pos );
+  return idx;
+}
+
+// Levels by sorting the orders, best first.
+static std::vector<sp::book_level> sort_levels(
+  std::vector<order> ords,
+  book_side side,
+  uint64_t s2p,
+  uint64_t base_lot
+) {
+  std::sort( ords.begin(), ords.end(), [side]( const order& a, const order& b ) {
+    return side == book_side::bids ? a.price_ > b.price_ : a.price_ < b.price_;
+  } );
+  std::vector<sp::book_level> lvls;
+  for ( size_t i = 0; i != ords.size(); ++i ) {
+    if ( i == 0 || ords[ i ].price_ != ords[ i - 1 ].price_ ) {
+      lvls.push_back( { ( int64_t )( ords[ i ].price_ * s2p ), 0, 0 } );
+    }
+    lvls.back().qty_ += ords[ i ].qty_ * base_lot;
+    ++lvls.back().orders_;
+  }
+  return lvls;
+}
+
+static bool same_levels(
+  const sp::l2_book& book,
+  const std::vector<sp::book_level>& lvls
+) {
+  if ( book.get_num_levels() != lvls.size() ) {
+    return false;
+  }
+  for ( size_t i = 0; i != lvls.size(); ++i ) {
+    const sp::book_level& lvl = book.get_level( i );
+    if ( lvl.price_ != lvls[ i ].price_ || lvl.qty_ != lvls[ i ].qty_
+      || lvl.orders_ != lvls[ i ].orders_ ) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Up to max_orders orders with distinct keys, prices bunched so levels
+// hold several orders, at distinct random leaf slots.
+static std::vector<order> random_orders(
+  size_t max_orders,
+  uint32_t num_nodes,
+  std::mt19937_64& rng
+) {
+  const size_t num = rng() % ( max_orders + 1 );
+  std::vector<uint32_t> slots( num_nodes );
+  for ( uint32_t i = 0; i != num_nodes; ++i ) {
+    slots[ i ] = i;
+  }
+  std::shuffle( slots.begin(), slots.end(), rng );
+  const uint64_t base = 1 + rng() % 1000000;
+  const uint64_t range = 1 + rng() % 64;
+  std::vector<order> ords( num );
+  for ( size_t i = 0; i != num; ++i ) {
+    ords[ i ].price_ = base + rng() % range;
+    ords[ i ].seq_ = i * 1000 + rng() % 1000;
+    ords[ i ].qty_ = 1 + rng() % 10000;
+    ords[ i ].slot_ = slots[ i ];
+  }
+  return ords;
+}
+
+static void check_decode()
+{
+  std::mt19937_64 rng( 7 );
+  slab_builder sb;
+  sp::l2_book book;
+  for ( unsigned iter = 0; iter != 2000; ++iter ) {
+    const size_t max_orders = iter % 10 == 0 ? 2000 : 200;
+    const uint32_t num_nodes = ( uint32_t )( 2 * max_orders + rng() % 64 );
+    const book_side side = rng() % 2 ? book_side::bids : book_side::asks;
+    const uint64_t s2p = 1 + rng() % 1000;
+    const uint64_t base_lot = 1 + rng() % 1000;
+    std::vector<order> ords = random_orders( max_orders, num_nodes, rng );
+    sb.build( ords, num_nodes, side, rng );
+
+    expect(
+      book.decode( sb.data(), sb.size(), side, s2p, base_lot ),
+      "decode valid slab", iter
+    );
+    expect(
+      same_levels( book, sort_levels( ords, side, s2p, base_lot ) ),
+      "levels match sorted orders", iter
+    );
+    expect( book.get_num_orders() == ords.size(), "order count", iter );
+    expect(
+      !book.decode( sb.data(), sb.size(),
+        side == book_side::bids ? book_side::asks : book_side::bids,
+        s2p, base_lot ),
+      "reject other side", iter
+    );
+    if ( ords.size() < 2 ) {
+      continue;
+    }
+
+    serum_book_t *hdr = sb.get_book();
+    const uint64_t leaf_count = hdr->LeafCount;
+    hdr->LeafCount = leaf_count - 1 - rng() % ( leaf_count - 1 );
+    expect(
+      !book.decode( sb.data(), sb.size(), side, s2p, base_lot )
+        && book.get_num_levels() == 0,
+      "reject LeafCount too small", iter
+    );
+    hdr->LeafCount = leaf_count + 1 + rng() % 8;
+    expect(
+      !book.decode( sb.data(), sb.size(), side, s2p, base_lot ),
+      "reject LeafCount too large", iter
+    );
+    hdr->LeafCount = num_nodes + 1;
+    expect(
+      !book.decode( sb.data(), sb.size(), side, s2p, base_lot ),
+      "reject LeafCount past the slab", iter
+    );
+    hdr->LeafCount = leaf_count;
+
+    // A child pointing back at itself or one of its ancestors.
+    const size_t pos = rng() % sb.inner_.size();
+    serum_node_inner_t *inner = ( serum_node_inner_t* )sb.get_node( sb.inner_[ pos ] );
+    const bool is_a = rng() % 2;
+    const uint32_t saved = is_a ? inner->ChildA : inner->ChildB;
+    auto set_child = [inner, is_a]( uint32_t idx ) {
+      if ( is_a ) {
+        inner->ChildA = idx;
+      }
+      else {
+        inner->ChildB = idx;
+      }
+    };
+    size_t up = pos;
+    for ( size_t n = rng() % 4; n && sb.parent_[ up ] != SIZE_MAX; --n ) {
+      up = sb.parent_[ up ];
+    }
+    set_child( sb.inner_[ up ] );
+    expect(
+      !book.decode( sb.data(), sb.size(), side, s2p, base_lot )
+        && book.get_num_levels() == 0,
+      "reject cycle", iter
+    );
+
+    // A child past the end of the slab.
+    set_child( num_nodes + ( uint32_t )( rng() % 1000 ) );
+    expect(
+      !book.decode( sb.data(), sb.size(), side, s2p, base_lot ),
+      "reject child index past the slab", iter
+    );
+    set_child( saved );
+
+    // A root past the end of the slab.
+    const uint32_t root = hdr->Root;
+    hdr->Root = num_nodes;
+    expect(
+      !book.decode( sb.data(), sb.size(), side, s2p, base_lot ),
+      "reject root past the slab", iter
+    );
+    hdr->Root = root;
+
+    expect(
+      book.decode( sb.data(), sb.size(), side, s2p, base_lot )
+        && same_levels( book, sort_levels( ords, side, s2p, base_lot ) ),
+      "decode after restoring", iter
+    );
+  }
+}
+
+static bool same_book( const sp::l2_book& a, const sp::l2_book& b )
+{
+  if ( a.get_num_orders() != b.get_num_orders() ) {
+    return false;
+  }
+  return same_levels( a, std::vector<sp::book_level>(
+    b.get_levels(), b.get_levels() + b.get_num_levels()
+  ) );
+}
+
+// Inserts, removes and resizes a few orders, keeping the others' leaf
+// slots the way serum does.
+static void step_orders(
+  std::vector<order>& ords,
+  uint32_t num_nodes,
+  uint64_t& next_seq,
+  std::mt19937_64& rng
+) {
+  std::vector<bool> used( num_nodes, false );
+  for ( const order& o : ords ) {
+    used[ o.slot_ ] = true;
+  }
+  const uint64_t base = ords.empty() ? 1000 : ords[ 0 ].price_;
+  for ( unsigned n = 1 + ( unsigned )( rng() % 5 ); n; --n ) {
+    const unsigned op = ( unsigned )( rng() % 3 );
+    if ( op == 0 && 2 * ords.size() + 2 < num_nodes ) {
+      order o;
+      o.price_ = base + rng() % 16;
+      o.seq_ = next_seq++;
+      o.qty_ = 1 + rng() % 10000;
+      do {
+        o.slot_ = ( uint32_t )( rng() % num_nodes );
+      } while ( used[ o.slot_ ] );
+      used[ o.slot_ ] = true;
+      ords.push_back( o );
+    }
+    else if ( op == 1 && !ords.empty() ) {
+      const size_t i = rng() % ords.size();
+      used[ ords[ i ].slot_ ] = false;
+      ords.erase( ords.begin() + ( ptrdiff_t )i );
+    }
+    else if ( !ords.empty() ) {
+      ords[ rng() % ords.size() ].qty_ = 1 + rng() % 10000;
+    }
+  }
+}
+
+static void check_apply()
+{
+  std::mt19937_64 rng( 11 );
+  slab_builder sb;
+  sp::slab_diff diff;
+  sp::l2_book book, fresh;
+  uint64_t next_seq = 1UL << 40;
+  unsigned iter = 0;
+  for ( unsigned run = 0; run != 200; ++run ) {
+    const book_side side = rng() % 2 ? book_side::bids : book_side::asks;
+    uint32_t num_nodes = ( uint32_t )( 600 + rng() % 64 );
+    const uint64_t s2p = 1 + rng() % 1000;
+    const uint64_t base_lot = 1 + rng() % 1000;
+    std::vector<order> ords = random_orders( 300, num_nodes, rng );
+    sb.build( ords, num_nodes, side, rng );
+    expect( diff.update( sb.data(), sb.size(), side ) && diff.is_reset(),
+      "first snapshot resets", iter );
+    book.decode( sb.data(), sb.size(), side, s2p, base_lot );
+
+    for ( unsigned step = 0; step != 50; ++step, ++iter ) {
+      // Now and then the account grows and the book must be rebuilt.
+      const bool resize = rng() % 25 == 0;
+      if ( resize ) {
+        num_nodes += 8;
+      }
+      step_orders( ords, num_nodes, next_seq, rng );
+      sb.build( ords, num_nodes, side, rng );
+      expect( diff.update( sb.data(), sb.size(), side ), "update", iter );
+      expect( diff.is_reset() == resize, "reset on resize only", iter );
+      expect( fresh.decode( sb.data(), sb.size(), side, s2p, base_lot ),
+        "decode", iter );
+      if ( resize ) {
+        expect( !book.apply( diff ) && book.get_num_levels() == 0,
+          "reject reset diff", iter );
+        book.decode( sb.data(), sb.size(), side, s2p, base_lot );
+        continue;
+      }
+      expect( book.apply( diff ), "apply", iter );
+      expect( same_book( book, fresh ), "apply equals decode", iter );
+      if ( !same_book( book, fresh ) ) {
+        book.decode( sb.data(), sb.size(), side, s2p, base_lot );
+      }
+    }
+
+    // A diff of the other side's account.
+    const book_side other =
+      side == book_side::bids ? book_side::asks : book_side::bids;
+    sp::slab_diff wrong;
+    sb.build( ords, num_nodes, other, rng );
+    wrong.update( sb.data(), sb.size(), other );
+    wrong.update( sb.data(), sb.size(), other );
+    expect( !book.apply( wrong ) && book.get_num_levels() == 0,
+      "reject other side's diff", iter );
+  }
+}
+
+// Diff plus apply against a full decode on a 1 MB slab of 7000 orders,
+// three of which change per update.
+static void check_speed()
+{
+  std::mt19937_64 rng( 3 );
+  const uint32_t num_nodes = ( 1 << 20 ) / sizeof( serum_node_any_t );
+  const unsigned num_upd = 1000;
+  std::vector<order> ords;
+  while ( ords.size() != 7000 ) {
+    ords = random_orders( 7000, num_nodes, rng );
+  }
+  slab_builder sb;
+  sb.build( ords, num_nodes, book_side::bids, rng );
+  sp::slab_diff diff;
+  sp::l2_book book;
+  diff.update( sb.data(), sb.size(), book_side::bids );
+  book.decode( sb.data(), sb.size(), book_side::bids, 1, 1 );
+
+  // Changes in place, as serum writes them: two resizes and one order
+  // replaced in its leaf slot by another at the same price.
+  std::chrono::nanoseconds diff_ns( 0 ), decode_ns( 0 );
+  for ( unsigned i = 0; i != num_upd; ++i ) {
+    for ( unsigned j = 0; j != 3; ++j ) {
+      const order& o = ords[ rng() % ords.size() ];
+      serum_node_leaf_t *leaf = ( serum_node_leaf_t* )sb.get_node( o.slot_ );
+      if ( j == 2 ) {
+        leaf->Key0 ^= 1UL << 63;
+      }
+      leaf->Quantity = 1 + rng() % 10000;
+    }
+    auto t0 = std::chrono::steady_clock::now();
+    const bool ok = diff.update( sb.data(), sb.size(), book_side::bids )
+      && book.apply( diff );
+    auto t1 = std::chrono::steady_clock::now();
+    expect( ok, "apply in place change", i );
+    book.decode( sb.data(), sb.size(), book_side::bids, 1, 1 );
+    auto t2 = std::chrono::steady_clock::now();
+    diff_ns += t1 - t0;
+    decode_ns += t2 - t1;
+  }
+  std::printf(
+    "1 MB slab, 7000 orders, 3 changes: diff+apply %.1fus decode %.1fus\n",
+    ( double )diff_ns.count() / num_upd / 1e3,
+    ( double )decode_ns.count() / num_upd / 1e3
+  );
+}
+
+int main()
+{
+  check_decode();
+  check_apply();
+  check_speed();
+  std::printf( "%s\n", num_fail ? "FAILED" : "PASSED" );
+  return num_fail ? 1 : 0;
+}
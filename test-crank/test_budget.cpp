@@ -0,0 +1,144 @@
+#include "budget.hpp"
+#include "tx_error.hpp"
+
+#include <cstdio>
+
+// Compute unit limits from observed usage and from running out, and the
+// priority fee's response to land rate and delay.
+
+static int num_fail = 0;
+
+static void expect( bool cond, const char *what )
+{
+  if ( !cond ) {
+    std::printf( "FAIL %s\n", what );
+    ++num_fail;
+  }
+}
+
+static void check_limits()
+{
+  sp::cu_limits lims;
+  lims.set_window( 4 );
+  lims.add_market();
+  lims.add_market();
+  expect( lims.get_limit( 0 ) == 0, "no limit before usage" );
+
+  // Headroom, rounded up to whole thousands.
+  lims.on_usage( 0, 50000 );
+  expect( lims.get_limit( 0 ) == 60000, "20% headroom" );
+  lims.on_usage( 0, 50123 );
+  expect( lims.get_limit( 0 ) == 61000, "rounded up" );
+  expect( lims.get_limit( 1 ) == 0, "other market untouched" );
+
+  // The largest of the window, until it leaves it.
+  lims.on_usage( 0, 100000 );
+  expect( lims.get_limit( 0 ) == 120000, "largest in window" );
+  for ( unsigned i = 0; i != 3; ++i ) {
+    lims.on_usage( 0, 10000 );
+  }
+  expect( lims.get_limit( 0 ) == 120000, "largest still in window" );
+  lims.on_usage( 0, 10000 );
+  expect( lims.get_limit( 0 ) == 12000, "largest left window" );
+
+  lims.on_usage( 1, 10 );
+  expect( lims.get_limit( 1 ) == 1000, "min bound" );
+  lims.on_usage( 1, 5000000 );
+  expect( lims.get_limit( 1 ) == 1400000, "max bound" );
+
+  // Running out doubles the limit and forgets the usage behind it.
+  expect( lims.on_exceeded( 0 ), "raise" );
+  expect( lims.get_limit( 0 ) == 24000, "doubled" );
+  lims.on_usage( 0, 30000 );
+  expect( lims.get_limit( 0 ) == 36000, "usage after raise" );
+  expect( !lims.on_exceeded( 1 ), "no raise past max" );
+  expect( lims.get_limit( 1 ) == 1400000, "max kept" );
+
+  // Without usage, from the runtime default.
+  sp::cu_limits fresh;
+  fresh.add_market();
+  expect( fresh.on_exceeded( 0 ), "raise from default" );
+  expect( fresh.get_limit( 0 ) == 400000, "double default" );
+  unsigned num_raised = 0;
+  while ( fresh.on_exceeded( 0 ) ) {
+    ++num_raised;
+  }
+  expect( num_raised == 2, "raised to max" );
+  expect( fresh.get_limit( 0 ) == 1400000, "clamped to max" );
+
+  expect(
+    sp::parse_tx_error( "ComputationalBudgetExceeded" )
+      == sp::tx_error::compute_budget, "parse budget exceeded"
+  );
+  expect(
+    sp::get_error_class( sp::tx_error::compute_budget )
+      == sp::tx_error_class::market, "budget exceeded is the market's"
+  );
+}
+
+static void check_fee()
+{
+  sp::fee_tuner fees;
+  fees.set_bounds( 0, 8000 );
+  fees.set_interval( 10 );
+  uint64_t slot = 100;
+  expect( !fees.on_slot( slot ), "no change without outcomes" );
+  expect( fees.get_price() == 0, "starts at min" );
+
+  // Expiries raise it from the step, doubling up to the max.
+  const uint64_t want_up[] = { 1000, 2000, 4000, 8000, 8000 };
+  for ( const uint64_t want : want_up ) {
+    for ( unsigned i = 0; i != 5; ++i ) {
+      fees.on_done( false, 0 );
+    }
+    slot += 10;
+    fees.on_slot( slot );
+    expect( fees.get_price() == want, "raised on expiry" );
+  }
+  expect( fees.get_land_rate() < 0.9, "land rate fell" );
+
+  // Not before the interval.
+  fees.on_done( false, 0 );
+  expect( !fees.on_slot( slot + 9 ), "held within interval" );
+
+  // Quick landings restore the rate, then decay it to zero.
+  for ( unsigned i = 0; i != 100; ++i ) {
+    fees.on_done( true, 1 );
+  }
+  uint64_t prev = fees.get_price();
+  unsigned num_steps = 0;
+  for ( ; fees.get_price() != 0 && num_steps != 100; ++num_steps ) {
+    fees.on_done( true, 1 );
+    slot += 10;
+    fees.on_slot( slot );
+    expect( fees.get_price() < prev, "decayed" );
+    prev = fees.get_price();
+  }
+  expect( fees.get_price() == 0, "decayed to zero" );
+
+  // Slow landings raise it too.
+  for ( unsigned i = 0; i != 100; ++i ) {
+    fees.on_done( true, 20 );
+  }
+  slot += 10;
+  expect( fees.on_slot( slot ), "raised on delay" );
+  expect( fees.get_delay() > 4., "delay over target" );
+  expect( fees.get_price() == 1000, "raised to step" );
+
+  sp::fee_tuner floor;
+  floor.set_bounds( 500, 8000 );
+  expect( floor.get_price() == 500, "starts at floor" );
+  for ( unsigned i = 0; i != 20; ++i ) {
+    floor.on_done( true, 1 );
+    floor.on_slot( 10 * ( i + 1 ) );
+  }
+  expect( floor.get_price() == 500, "stays at floor" );
+}
+
+int main()
+{
+  check_limits();
+  check_fee();
+  std::printf( "%s\n", num_fail ? "FAILED" : "PASSED" );
+  return num_fail ? 1 : 0;
+}
@@ -0,0 +1,292 @@
+#include "history.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+// Writes rows for two markets across a day boundary, reads every column
+// of every block back, then cuts files partway through their last block
+// and checks that a new writer drops the torn tail and appends after the
+// complete blocks. A file that isn't history is left alone and reported.
+
+static const int64_t NS_PER_DAY = 86400L * 1000000000L;
+static const int64_t DAY0 = 19000;  // 2022-01-08
+static const uint32_t BLOCK_ROWS = 16;
+static const unsigned NUM_ROWS = 100;  // half on each day
+static const unsigned NUM_MORE = 20;
+
+static int num_fail = 0;
+
+static void expect( bool cond, const char *what )
+{
+  if ( !cond ) {
+    std::printf( "FAIL %s\n", what );
+    ++num_fail;
+  }
+}
+
+static uint64_t mix( uint64_t x )
+{
+  x += 0x9e3779b97f4a7c15UL;
+  x = ( x ^ ( x >> 30 ) ) * 0xbf58476d1ce4e5b9UL;
+  x = ( x ^ ( x >> 27 ) ) * 0x94d049bb133111ebUL;
+  return x ^ ( x >> 31 );
+}
+
+// Row i of a market; row NUM_ROWS / 2 is the first of the second day.
+static sp::history_row make_row( unsigned mkt, unsigned i )
+{
+  const int64_t start = ( DAY0 + 1 ) * NS_PER_DAY
+    - ( int64_t )( NUM_ROWS / 2 ) * 400000000L;
+  const uint64_t h = mix( mkt * 1000000UL + i );
+  sp::history_row row;
+  row.slot_ = 1000 + 3 * i + ( h % 3 );
+  row.ts_ = start + ( int64_t )i * 400000000L + ( int64_t )( h % 1000 );
+  row.bid_ = h % 100000;
+  row.ask_ = row.bid_ + ( h >> 20 ) % 100;
+  row.bid_qty_ = h >> 32;
+  row.ask_qty_ = h >> 40;
+  row.price_ = -( int64_t )( h >> 24 );
+  row.conf_ = h >> 48;
+  row.s2p_ = mix( h );
+  row.status_ = ( uint8_t )( h & 1 );
+  row.outcome_ = ( uint8_t )( h >> 8 );
+  return row;
+}
+
+static uint64_t get_value( const sp::history_row& row, sp::history_col col )
+{
+  switch ( col ) {
+    case sp::e_hist_slot:    return row.slot_;
+    case sp::e_hist_ts:      return ( uint64_t )row.ts_;
+    case sp::e_hist_bid:     return row.bid_;
+    case sp::e_hist_ask:     return row.ask_;
+    case sp::e_hist_bid_qty: return row.bid_qty_;
+    case sp::e_hist_ask_qty: return row.ask_qty_;
+    case sp::e_hist_price:   return ( uint64_t )row.price_;
+    case sp::e_hist_conf:    return row.conf_;
+    case sp::e_hist_s2p:     return row.s2p_;
+    case sp::e_hist_status:  return row.status_;
+    default:                 return row.outcome_;
+  }
+}
+
+static void make_key( unsigned mkt, uint8_t *key )
+{
+  for ( unsigned i = 0; i != 32; ++i ) {
+    key[ i ] = ( uint8_t )( mkt * 32 + i );
+  }
+}
+
+static std::string get_path(
+  const std::string& dir, const char *name, int64_t day
+) {
+  return dir + "/" + name + ( day == DAY0 ? "-20220108.sph" : "-20220109.sph" );
+}
+
+// The file holds exactly these rows, in order, in blocks that agree with
+// their headers. Returns the reader's blocks.
+static std::vector<sp::history_block> check_file(
+  const std::string& path,
+  unsigned mkt,
+  const std::vector<unsigned>& want
+) {
+  std::vector<sp::history_block> blks;
+  sp::history_reader rd;
+  if ( !rd.open( path ) ) {
+    std::printf( "FAIL open: %s\n", rd.get_err_msg().c_str() );
+    ++num_fail;
+    return blks;
+  }
+  uint8_t key[ 32 ];
+  make_key( mkt, key );
+  expect( std::memcmp( rd.get_pyth_price(), key, sizeof( key ) ) == 0,
+    "pyth price in header" );
+  expect( rd.get_num_rows() == want.size(), "row count" );
+
+  size_t row = 0;
+  bool is_ok = true, is_index_ok = true;
+  std::vector<uint8_t> vals;
+  for ( size_t b = 0; b != rd.get_num_blocks(); ++b ) {
+    const sp::history_block& blk = rd.get_block( b );
+    blks.push_back( blk );
+    if ( blk.num_rows_ == 0 || row + blk.num_rows_ > want.size() ) {
+      is_ok = false;
+      break;
+    }
+    const sp::history_row first = make_row( mkt, want[ row ] );
+    const sp::history_row last = make_row( mkt, want[ row + blk.num_rows_ - 1 ] );
+    is_ok = is_ok && blk.first_slot_ == first.slot_
+      && blk.last_slot_ == last.slot_
+      && blk.first_ts_ == first.ts_ && blk.last_ts_ == last.ts_;
+    is_index_ok = is_index_ok && rd.find_slot( first.slot_ ) == b
+      && rd.find_slot( last.slot_ ) == b && rd.find_time( last.ts_ ) == b
+      && rd.find_time( first.ts_ ) == b;
+    for ( uint32_t c = 0; c != sp::e_hist_num_cols; ++c ) {
+      const sp::history_col col = ( sp::history_col )c;
+      const size_t width = sp::get_col_width( col );
+      if ( !rd.read_column( b, col, vals ) ) {
+        std::printf( "FAIL read_column: %s\n", rd.get_err_msg().c_str() );
+        ++num_fail;
+        return blks;
+      }
+      for ( uint32_t r = 0; r != blk.num_rows_; ++r ) {
+        uint64_t val = 0;
+        std::memcpy( &val, vals.data() + r * width, width );
+        is_ok = is_ok && val == get_value( make_row( mkt, want[ row + r ] ), col );
+      }
+    }
+    row += blk.num_rows_;
+  }
+  expect( is_ok && row == want.size(), "rows read back" );
+  expect( is_index_ok, "blocks found by slot and time" );
+  expect( rd.find_slot( make_row( mkt, want.back() ).slot_ + 1 )
+    == rd.get_num_blocks(), "no block past the last slot" );
+  return blks;
+}
+
+static std::vector<unsigned> get_range( unsigned from, unsigned to )
+{
+  std::vector<unsigned> idx;
+  for ( unsigned i = from; i != to; ++i ) {
+    idx.push_back( i );
+  }
+  return idx;
+}
+
+// Cut the file partway into its last block, at off bytes past its header,
+// and return the rows still complete.
+static std::vector<unsigned> cut_file(
+  const std::string& path,
+  const std::vector<sp::history_block>& blks,
+  std::vector<unsigned> want,
+  size_t off
+) {
+  if ( blks.empty() ) {
+    return want;
+  }
+  const sp::history_block& blk = blks.back();
+  if ( ::truncate( path.c_str(), ( off_t )( blk.offset_ + off ) ) != 0 ) {
+    std::printf( "FAIL truncate %s\n", path.c_str() );
+    ++num_fail;
+  }
+  want.resize( want.size() - blk.num_rows_ );
+  return want;
+}
+
+int main()
+{
+  char tmpl[] = "/tmp/test-history-XXXXXX";
+  if ( !::mkdtemp( tmpl ) ) {
+    std::printf( "FAIL mkdtemp\n" );
+    return 1;
+  }
+  const std::string dir = tmpl;
+  const char *names[] = { "a", "b" };
+  uint8_t key[ 32 ];
+
+  {
+    sp::history_writer wr;
+    wr.set_dir( dir );
+    wr.set_block_rows( BLOCK_ROWS );
+    for ( unsigned m = 0; m != 2; ++m ) {
+      make_key( m, key );
+      wr.add_market( names[ m ], key );
+    }
+    bool is_ok = true;
+    for ( unsigned i = 0; i != NUM_ROWS; ++i ) {
+      for ( unsigned m = 0; m != 2; ++m ) {
+        is_ok = wr.add( m, make_row( m, i ) ) && is_ok;
+      }
+    }
+    expect( is_ok, "add" );
+    expect( wr.flush(), "flush" );
+  }
+
+  // A day per file, the second market's first block of each shortened.
+  std::vector<sp::history_block> blks[ 2 ];
+  for ( unsigned m = 0; m != 2; ++m ) {
+    const std::vector<sp::history_block> day0 = check_file(
+      get_path( dir, names[ m ], DAY0 ), m, get_range( 0, NUM_ROWS / 2 )
+    );
+    blks[ m ] = check_file(
+      get_path( dir, names[ m ], DAY0 + 1 ), m, get_range( NUM_ROWS / 2, NUM_ROWS )
+    );
+    expect( !day0.empty() && day0[ 0 ].num_rows_ == BLOCK_ROWS - m,
+      "first block of the day staggered" );
+    expect( !blks[ m ].empty() && blks[ m ][ 0 ].num_rows_ == BLOCK_ROWS - m,
+      "first block of the next day staggered" );
+    expect( blks[ m ].size() > 1, "several blocks" );
+  }
+
+  // Torn mid-block, and torn inside the block header.
+  std::vector<unsigned> want[ 2 ];
+  want[ 0 ] = cut_file(
+    get_path( dir, names[ 0 ], DAY0 + 1 ), blks[ 0 ],
+    get_range( NUM_ROWS / 2, NUM_ROWS ), sizeof( sp::history_block_hdr ) + 5
+  );
+  want[ 1 ] = cut_file(
+    get_path( dir, names[ 1 ], DAY0 + 1 ), blks[ 1 ],
+    get_range( NUM_ROWS / 2, NUM_ROWS ), 4
+  );
+  expect( want[ 0 ].size() < NUM_ROWS / 2 && want[ 1 ].size() < NUM_ROWS / 2,
+    "last blocks cut" );
+
+  // A file that isn't history.
+  const std::string junk = get_path( dir, "c", DAY0 + 1 );
+  FILE *out = std::fopen( junk.c_str(), "wb" );
+  std::fputs( "not history, not to be touched\n", out );
+  std::fclose( out );
+
+  {
+    sp::history_writer wr;
+    wr.set_dir( dir );
+    wr.set_block_rows( BLOCK_ROWS );
+    for ( unsigned m = 0; m != 2; ++m ) {
+      make_key( m, key );
+      wr.add_market( names[ m ], key );
+    }
+    bool is_ok = true;
+    for ( unsigned i = NUM_ROWS; i != NUM_ROWS + NUM_MORE; ++i ) {
+      for ( unsigned m = 0; m != 2; ++m ) {
+        is_ok = wr.add( m, make_row( m, i ) ) && is_ok;
+        want[ m ].push_back( i );
+      }
+    }
+    expect( is_ok, "add after cut" );
+    expect( wr.flush(), "flush after cut" );
+
+    make_key( 2, key );
+    const unsigned idx = wr.add_market( "c", key );
+    wr.add( idx, make_row( 2, NUM_ROWS ) );
+    expect( !wr.flush(), "junk file fails" );
+    expect( wr.get_err_msg() == "not a history file: " + junk,
+      "junk file error message" );
+  }
+
+  for ( unsigned m = 0; m != 2; ++m ) {
+    check_file( get_path( dir, names[ m ], DAY0 + 1 ), m, want[ m ] );
+  }
+  sp::history_reader rd;
+  expect( !rd.open( junk ), "junk file not history" );
+  char line[ 64 ] = {};
+  FILE *in = std::fopen( junk.c_str(), "rb" );
+  expect( in && std::fgets( line, sizeof( line ), in )
+    && std::strcmp( line, "not history, not to be touched\n" ) == 0,
+    "junk file kept" );
+  if ( in ) {
+    std::fclose( in );
+  }
+
+  for ( unsigned m = 0; m != 2; ++m ) {
+    ::unlink( get_path( dir, names[ m ], DAY0 ).c_str() );
+    ::unlink( get_path( dir, names[ m ], DAY0 + 1 ).c_str() );
+  }
+  ::unlink( junk.c_str() );
+  ::rmdir( dir.c_str() );
+  std::printf( "%s\n", num_fail ? "FAILED" : "PASSED" );
+  return num_fail ? 1 : 0;
+}
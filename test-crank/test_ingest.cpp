@@ -0,0 +1,261 @@
+#include "ingest.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <unistd.h>
+
+// Replays a recorded account stream through file_source into an
+// account_router and checks what each market receives, in order: records
+// of every size up to the limit split across reads, updates not newer
+// by (slot, write version) dropped, unknown keys counted, a mint shared
+// by two markets routed to both, and an oversize record failing the
+// source without delivering anything after it.
+
+static const unsigned NUM_MARKETS = 2;
+static const unsigned NUM_ACCTS = 6;
+static const uint64_t NUM_SLOTS = 40;
+
+static int num_fail = 0;
+
+static void expect( bool cond, const char *what )
+{
+  if ( !cond ) {
+    std::printf( "FAIL %s\n", what );
+    ++num_fail;
+  }
+}
+
+static uint64_t mix( uint64_t x )
+{
+  x += 0x9e3779b97f4a7c15UL;
+  x = ( x ^ ( x >> 30 ) ) * 0xbf58476d1ce4e5b9UL;
+  x = ( x ^ ( x >> 27 ) ) * 0x94d049bb133111ebUL;
+  return x ^ ( x >> 31 );
+}
+
+// Account data derived from its key, slot and write version.
+static uint8_t data_byte( uint8_t key, uint64_t slot, uint64_t ver, size_t i )
+{
+  return ( uint8_t )( mix( key ^ slot << 8 ^ ver << 24 ) >> ( i % 8 * 8 ) )
+    ^ ( uint8_t )( i / 8 );
+}
+
+// Markets 0 and 1 share their quote mint; key 0xff is nobody's.
+static uint8_t get_key( unsigned mkt, sp::market_acct acct )
+{
+  if ( acct == sp::market_acct::quote_mint ) {
+    return 1;
+  }
+  return ( uint8_t )( 2 + mkt * NUM_ACCTS + ( unsigned )acct );
+}
+
+static const uint8_t UNKNOWN_KEY = 0xff;
+
+struct delivery
+{
+  unsigned        mkt_;
+  sp::market_acct acct_;
+  uint8_t         key_;
+  uint64_t        slot_;
+  uint64_t        ver_;
+  size_t          len_;
+};
+
+// Checks the updates the markets receive against the expected ones.
+class checker : public sp::market_fwd
+{
+public:
+
+  void expect_update( const delivery& d )
+  {
+    want_.push_back( d );
+  }
+
+  void on_account(
+    sp::market *mkt,
+    sp::market_acct acct,
+    const uint8_t *data,
+    size_t len,
+    uint64_t slot
+  ) override {
+    if ( num_ == want_.size() ) {
+      if ( num_bad_++ == 0 ) {
+        std::printf( "FAIL unexpected update %u past the last\n", num_ );
+      }
+      return;
+    }
+    const delivery& d = want_[ num_++ ];
+    bool ok = mkt->get_index() == d.mkt_ && acct == d.acct_
+      && slot == d.slot_ && len == d.len_;
+    for ( size_t i = 0; ok && i != len; ++i ) {
+      ok = data[ i ] == data_byte( d.key_, d.slot_, d.ver_, i );
+    }
+    if ( !ok && num_bad_++ == 0 ) {
+      std::printf(
+        "FAIL update %u: market %u acct %u slot %lu len %lu, "
+        "expected market %u acct %u slot %lu len %lu\n",
+        num_ - 1, mkt->get_index(), ( unsigned )acct, slot, len,
+        d.mkt_, ( unsigned )d.acct_, d.slot_, d.len_
+      );
+    }
+  }
+
+  unsigned get_num() const { return num_; }
+  unsigned get_num_want() const { return ( unsigned )want_.size(); }
+  unsigned get_num_bad() const { return num_bad_; }
+
+private:
+
+  std::vector<delivery> want_;
+  unsigned num_ = 0;
+  unsigned num_bad_ = 0;
+};
+
+static void write_update(
+  FILE *out, uint8_t key, uint64_t slot, uint64_t ver, size_t len
+) {
+  sp::update_hdr hdr;
+  std::memset( &hdr, 0, sizeof( hdr ) );
+  hdr.key_[ 0 ] = key;
+  hdr.slot_ = slot;
+  hdr.write_version_ = ver;
+  hdr.data_len_ = ( uint32_t )len;
+  std::fwrite( &hdr, sizeof( hdr ), 1, out );
+  std::vector<uint8_t> data( len );
+  for ( size_t i = 0; i != len; ++i ) {
+    data[ i ] = data_byte( key, slot, ver, i );
+  }
+  std::fwrite( data.data(), 1, len, out );
+}
+
+// Mostly under a page, at odd lengths so headers straddle reads, some
+// over the initial buffer, and once the largest allowed.
+static size_t get_len( uint64_t slot, unsigned key )
+{
+  const uint64_t h = mix( slot * 256 + key );
+  if ( slot == NUM_SLOTS / 2 && key == get_key( 0, sp::market_acct::bids ) ) {
+    return sp::UPDATE_MAX_DATA;
+  }
+  switch ( h % 16 ) {
+    case 0: return 0;
+    case 1: return ( 1UL << 20 ) + ( h >> 8 ) % ( 2UL << 20 );
+    default: return ( h >> 8 ) % 4000;
+  }
+}
+
+int main()
+{
+  char path[] = "/tmp/test-ingest-XXXXXX";
+  const int fd = ::mkstemp( path );
+  if ( fd < 0 ) {
+    std::printf( "FAIL mkstemp\n" );
+    return 1;
+  }
+  FILE *out = ::fdopen( fd, "wb" );
+
+  checker chk;
+  sp::market mkts[ NUM_MARKETS ];
+  sp::account_router router;
+  for ( unsigned m = 0; m != NUM_MARKETS; ++m ) {
+    uint8_t buf[ 32 ] = {};
+    pc::pub_key *keys[ NUM_ACCTS ] = {
+      mkts[ m ].get_serum_market(),
+      mkts[ m ].get_spl_quote_mint(),
+      mkts[ m ].get_spl_base_mint(),
+      mkts[ m ].get_serum_bids(),
+      mkts[ m ].get_serum_asks(),
+      mkts[ m ].get_pyth_price()
+    };
+    for ( unsigned a = 0; a != NUM_ACCTS; ++a ) {
+      buf[ 0 ] = get_key( m, ( sp::market_acct )a );
+      keys[ a ]->init_from_buf( buf );
+    }
+    mkts[ m ].set_index( m );
+    mkts[ m ].set_fwd( &chk );
+    router.add_market( &mkts[ m ] );
+  }
+
+  // Every account of both markets each slot, with stale and unknown
+  // updates mixed in.
+  uint64_t ver = 0, num_stale = 0, num_unknown = 0;
+  for ( uint64_t slot = 1; slot <= NUM_SLOTS; ++slot ) {
+    uint64_t bids_ver = 0;
+    for ( unsigned m = 0; m != NUM_MARKETS; ++m ) {
+      for ( unsigned a = 0; a != NUM_ACCTS; ++a ) {
+        const sp::market_acct acct = ( sp::market_acct )a;
+        const uint8_t key = get_key( m, acct );
+        if ( acct == sp::market_acct::quote_mint && m != 0 ) {
+          continue;
+        }
+        const size_t len = get_len( slot, key );
+        write_update( out, key, slot, ++ver, len );
+        if ( m == 0 && acct == sp::market_acct::bids ) {
+          bids_ver = ver;
+        }
+        for ( unsigned t = 0; t != NUM_MARKETS; ++t ) {
+          if ( t == m || get_key( t, acct ) == key ) {
+            chk.expect_update( delivery{ t, acct, key, slot, ver, len } );
+          }
+        }
+      }
+    }
+
+    // Replays of the last bids update, an older slot and an older write
+    // version in this slot are dropped; a newer one in the slot isn't.
+    const uint8_t bids = get_key( 0, sp::market_acct::bids );
+    write_update( out, bids, slot, bids_ver, 16 );
+    write_update( out, bids, slot - 1, ver + 1, 16 );
+    write_update( out, bids, slot, bids_ver - 1, 16 );
+    num_stale += 3;
+    write_update( out, bids, slot, ++ver, 24 );
+    chk.expect_update( delivery{
+      0, sp::market_acct::bids, bids, slot, ver, 24
+    } );
+
+    // The shared mint, stale for both markets.
+    write_update( out, get_key( 1, sp::market_acct::quote_mint ), slot, 0, 8 );
+    ++num_stale;
+
+    write_update( out, UNKNOWN_KEY, slot, ++ver, get_len( slot, UNKNOWN_KEY ) );
+    ++num_unknown;
+  }
+
+  // Nothing after an oversize record is delivered.
+  sp::update_hdr hdr;
+  std::memset( &hdr, 0, sizeof( hdr ) );
+  hdr.key_[ 0 ] = get_key( 1, sp::market_acct::asks );
+  hdr.slot_ = NUM_SLOTS + 1;
+  hdr.data_len_ = ( uint32_t )sp::UPDATE_MAX_DATA + 1;
+  std::fwrite( &hdr, sizeof( hdr ), 1, out );
+  write_update( out, get_key( 1, sp::market_acct::asks ), NUM_SLOTS + 2, ++ver, 8 );
+  std::fclose( out );
+
+  sp::file_source src;
+  if ( !src.init( path ) ) {
+    std::printf( "FAIL init: %s\n", src.get_err_msg().c_str() );
+    ::unlink( path );
+    return 1;
+  }
+  unsigned num_polls = 0;
+  while ( !src.get_is_done() && !src.get_is_err() && num_polls != 10000 ) {
+    src.poll( router );
+    ++num_polls;
+  }
+  ::unlink( path );
+
+  expect( num_polls > 1, "replay spans several polls" );
+  expect( src.get_is_err() && !src.get_is_done(), "oversize record fails" );
+  expect(
+    src.get_err_msg() == "account update too large", "oversize error message"
+  );
+  expect( src.poll( router ) == 0, "no updates after failing" );
+  expect( chk.get_num_bad() == 0, "updates match" );
+  expect( chk.get_num() == chk.get_num_want(), "every update delivered" );
+  expect( router.get_num_stale() == num_stale, "stale updates dropped" );
+  expect( router.get_num_unknown() == num_unknown, "unknown keys counted" );
+  expect( src.get_num_updates() == ver - 1 + num_stale, "records parsed" );
+  std::printf( "%s\n", num_fail ? "FAILED" : "PASSED" );
+  return num_fail ? 1 : 0;
+}
@@ -0,0 +1,100 @@
+#include "lease.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+// Two cranks' failover over one lease file, on a simulated clock:
+// exactly one is active at a time, and the standby takes over on
+// expiry, on a stall of landed updates and on release.
+
+static const int64_t MS = 1000000L;
+
+static int num_fail = 0;
+
+static void expect( bool cond, const char *what )
+{
+  if ( !cond ) {
+    std::printf( "FAIL %s\n", what );
+    ++num_fail;
+  }
+}
+
+int main()
+{
+  char path[] = "/tmp/test-lease-XXXXXX";
+  const int fd = ::mkstemp( path );
+  if ( fd < 0 ) {
+    std::printf( "FAIL mkstemp\n" );
+    return 1;
+  }
+  ::close( fd );
+
+  sp::file_lease la, lb;
+  la.set_owner( "a" );
+  lb.set_owner( "b" );
+  if ( !la.init( path ) || !lb.init( path ) ) {
+    std::printf( "FAIL init: %s\n", la.get_err_msg().c_str() );
+    return 1;
+  }
+  sp::failover a, b;
+  a.set_lease( &la );
+  b.set_lease( &lb );
+  a.set_stall( 2000 * MS );
+  b.set_stall( 2000 * MS );
+
+  // a comes up first and keeps renewing while b waits.
+  int64_t now = 1000 * MS;
+  expect( a.poll( now ) && a.is_active(), "a takes free lease" );
+  expect( !b.poll( now ) && !b.is_active(), "b stands by" );
+  expect( lb.get_holder() == "a", "b sees a as holder" );
+  for ( int i = 0; i != 30; ++i ) {
+    now += 100 * MS;
+    a.poll( now );
+    a.on_landed( now );
+    b.on_landed( now );
+    b.poll( now );
+    expect( a.is_active() && !b.is_active(), "one active while renewed" );
+  }
+
+  // a stops renewing: b takes over once the lease expires.
+  const int64_t stop = now;
+  while ( !b.is_active() ) {
+    now += 10 * MS;
+    b.on_landed( now );
+    b.poll( now );
+  }
+  expect( now - stop > 500 * MS - 100 * MS, "b waits for expiry" );
+  expect( now - stop <= 700 * MS, "b takes over within ttl and renewal" );
+  expect( b.get_num_takeovers() == 0, "expiry isn't a forced takeover" );
+  now += 100 * MS;
+  expect( a.poll( now ) && !a.is_active(), "a finds b active and stands by" );
+
+  // b's updates stop landing: a forces a takeover after the stall.
+  const int64_t stall = now;
+  while ( !a.is_active() && now - stall < 5000 * MS ) {
+    now += 100 * MS;
+    b.poll( now );
+    a.poll( now );
+  }
+  expect( a.is_active() && a.get_num_takeovers() == 1, "a takes over stall" );
+  expect( now - stall > 2000 * MS, "a waits out the stall" );
+  now += 100 * MS;
+  expect( b.poll( now ) && !b.is_active(), "b stands down" );
+  now += 100 * MS;
+  a.on_landed( now );
+  b.on_landed( now );
+  a.poll( now );
+  b.poll( now );
+  expect( a.is_active() && !b.is_active(), "no flapping after takeover" );
+
+  // a shuts down cleanly: b takes the lease on its next poll.
+  la.release();
+  now += 100 * MS;
+  b.poll( now );
+  expect( b.is_active(), "b takes released lease" );
+
+  ::unlink( path );
+  std::printf( "%s\n", num_fail ? "FAILED" : "PASSED" );
+  return num_fail ? 1 : 0;
+}
@@ -0,0 +1,440 @@
+#include "budget.hpp"
+#include "lookup.hpp"
+#include "serum_pyth.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+// Program derived addresses against the ones solana_program derives,
+// when table keys become usable, and transactions built with and without
+// a lookup table decoded back: header counts, the keys left in the
+// message, the table indexes loaded writable and readonly, and the
+// accounts and data of every instruction.
+
+static int num_fail = 0;
+
+static void expect( bool cond, const char *what )
+{
+  if ( !cond ) {
+    std::printf( "FAIL %s\n", what );
+    ++num_fail;
+  }
+}
+
+static pc::pub_key from_text( const char *text )
+{
+  pc::pub_key key;
+  key.init_from_text( std::string( text ) );
+  return key;
+}
+
+static bool is_key( const pc::pub_key& key, const char *text )
+{
+  return key == from_text( text );
+}
+
+static void check_pda()
+{
+  const pc::pub_key prog = from_text(
+    "BPFLoaderUpgradeab1e11111111111111111111111"
+  );
+  pc::pub_key addr;
+  uint8_t bump = 0;
+
+  // The first bump is off the curve.
+  const char talking[] = "Talking";
+  const char squirrels[] = "Squirrels";
+  expect( sp::find_program_address(
+    { { ( const uint8_t* )talking, sizeof( talking ) - 1 },
+      { ( const uint8_t* )squirrels, sizeof( squirrels ) - 1 } },
+    prog, addr, bump
+  ), "find address" );
+  expect(
+    is_key( addr, "HTqKuCuTUMwRJV4ceegG2CwYRxub4qjpj9DEg3nz1NGF" )
+    && bump == 255, "address of first bump"
+  );
+
+  // Bumps 255 to 252 hash onto the curve.
+  const char skip[] = "skip";
+  const uint8_t three = 3;
+  expect( sp::find_program_address(
+    { { ( const uint8_t* )skip, sizeof( skip ) - 1 }, { &three, 1 } },
+    prog, addr, bump
+  ), "find address past curve points" );
+  expect(
+    is_key( addr, "4PxZBWbmMvQt6JUSTzZmosMrZZT5nVn8Rb5HRhfe7QZ3" )
+    && bump == 251, "address past curve points"
+  );
+
+  // CreateLookupTable's address for an authority and recent slot.
+  expect( sp::get_lookup_table_address(
+    from_text( "SeedPubey1111111111111111111111111111111111" ),
+    123456789,
+    from_text( "AddressLookupTab1e1111111111111111111111111" ),
+    addr, bump
+  ), "find table address" );
+  expect(
+    is_key( addr, "79sj5H42t3ScP82CSt5oUAag1hfXTDr1sULYz2QYx7m2" )
+    && bump == 251, "table address"
+  );
+
+  const uint8_t long_seed[ 33 ] = {};
+  expect( !sp::find_program_address(
+    { { long_seed, sizeof( long_seed ) } }, prog, addr, bump
+  ), "reject seed over 32 bytes" );
+  std::vector<std::pair<const uint8_t*, size_t>> seeds(
+    16, { long_seed, 1 }
+  );
+  expect(
+    !sp::find_program_address( seeds, prog, addr, bump ),
+    "reject 16 seeds and a bump"
+  );
+}
+
+static pc::pub_key make_key( uint8_t id )
+{
+  pc::pub_key key;
+  key.zero();
+  key.pk_[ 0 ] = id;
+  key.pk_[ 31 ] = 0x5a;
+  return key;
+}
+
+// Table account holding keys, those from index last_start on appended
+// at last_slot.
+static std::vector<uint8_t> make_table(
+  const std::vector<pc::pub_key>& keys,
+  uint64_t last_slot,
+  uint8_t last_start
+) {
+  std::vector<uint8_t> data( sp::ALT_META_SIZE );
+  const uint32_t state = 1;
+  const uint64_t deactivation = std::numeric_limits<uint64_t>::max();
+  std::memcpy( &data[ 0 ], &state, sizeof( state ) );
+  std::memcpy( &data[ 4 ], &deactivation, sizeof( deactivation ) );
+  std::memcpy( &data[ 12 ], &last_slot, sizeof( last_slot ) );
+  data[ 20 ] = last_start;
+  for ( const pc::pub_key& key : keys ) {
+    data.insert( data.end(), key.data(), key.data() + sizeof( key ) );
+  }
+  return data;
+}
+
+static void check_table()
+{
+  std::vector<pc::pub_key> keys;
+  for ( uint8_t i = 0; i != 10; ++i ) {
+    keys.push_back( make_key( i ) );
+  }
+  sp::lookup_table alt;
+  std::vector<uint8_t> data = make_table( keys, 20, 6 );
+  expect( alt.update( data.data(), data.size(), 20 ), "valid table" );
+  uint8_t idx = 0;
+  expect( alt.find( keys[ 5 ], idx ) && idx == 5, "older keys usable" );
+  expect( !alt.find( keys[ 6 ], idx ), "keys of this slot not usable" );
+  expect( alt.has( keys[ 6 ] ), "keys of this slot held" );
+  alt.on_slot( 21 );
+  expect( alt.find( keys[ 9 ], idx ) && idx == 9, "usable next slot" );
+
+  const pc::pub_key more[] = { make_key( 10 ), make_key( 11 ) };
+  alt.on_extend( more, 2, 21 );
+  expect( alt.has( more[ 0 ] ) && !alt.find( more[ 0 ], idx ), "pending" );
+  expect( alt.get_num_pending() == 2, "two pending" );
+  keys.push_back( more[ 0 ] );
+  data = make_table( keys, 22, 10 );
+  alt.update( data.data(), data.size(), 22 );
+  expect( alt.get_num_pending() == 1, "one landed" );
+  alt.on_slot( 22 + sp::ALT_RETRY_SLOTS + 1 );
+  expect( alt.get_num_pending() == 0, "lost extend forgotten" );
+  expect( !alt.has( more[ 1 ] ), "lost key sent again" );
+
+  data[ 4 ] = 0;
+  expect( !alt.update( data.data(), data.size(), 200 ), "deactivated" );
+  expect( !alt.get_is_valid(), "deactivated not valid" );
+  expect( !alt.update( data.data(), sp::ALT_META_SIZE - 1, 200 ), "short" );
+}
+
+// A transaction decoded back into its parts.
+struct decoded
+{
+  bool     is_v0_ = false;
+  uint8_t  num_sigs_ = 0;
+  uint8_t  num_ro_signed_ = 0;
+  uint8_t  num_ro_unsigned_ = 0;
+  std::vector<pc::pub_key> keys_;
+  struct ix
+  {
+    uint8_t prog_;
+    std::vector<uint8_t> accts_;
+    std::vector<uint8_t> data_;
+  };
+  std::vector<ix> ixs_;
+  std::vector<pc::pub_key> tables_;
+  std::vector<uint8_t> writable_;
+  std::vector<uint8_t> readonly_;
+  size_t   size_ = 0;
+};
+
+class reader
+{
+public:
+  reader( const uint8_t *buf, size_t len ) : buf_( buf ), len_( len ) {}
+
+  uint8_t byte() {
+    return pos_ < len_ ? buf_[ pos_++ ] : ( ok_ = false, 0 );
+  }
+  size_t compact_u16() {
+    size_t val = 0;
+    for ( unsigned shift = 0; shift != 21; shift += 7 ) {
+      const uint8_t b = byte();
+      val |= ( size_t )( b & 0x7f ) << shift;
+      if ( !( b & 0x80 ) ) {
+        break;
+      }
+    }
+    return val;
+  }
+  void bytes( void *out, size_t len ) {
+    if ( len > len_ - pos_ ) {
+      ok_ = false;
+      return;
+    }
+    std::memcpy( out, buf_ + pos_, len );
+    pos_ += len;
+  }
+  std::vector<uint8_t> list() {
+    std::vector<uint8_t> out( compact_u16() );
+    bytes( out.data(), out.size() );
+    return out;
+  }
+  pc::pub_key key() {
+    pc::pub_key key;
+    bytes( key.pk_, sizeof( key.pk_ ) );
+    return key;
+  }
+
+  bool get_ok() const { return ok_; }
+  size_t get_pos() const { return pos_; }
+
+private:
+  const uint8_t *buf_;
+  size_t len_;
+  size_t pos_ = 0;
+  bool   ok_ = true;
+};
+
+static bool decode( const uint8_t *buf, size_t len, decoded& tx )
+{
+  reader rd( buf, len );
+  uint8_t sig[ 64 ];
+  const size_t num_sigs = rd.compact_u16();
+  for ( size_t i = 0; i != num_sigs; ++i ) {
+    rd.bytes( sig, sizeof( sig ) );
+  }
+  uint8_t first = rd.byte();
+  tx.is_v0_ = first == sp::MESSAGE_V0;
+  if ( tx.is_v0_ ) {
+    first = rd.byte();
+  }
+  tx.num_sigs_ = first;
+  tx.num_ro_signed_ = rd.byte();
+  tx.num_ro_unsigned_ = rd.byte();
+  tx.keys_.resize( rd.compact_u16() );
+  for ( pc::pub_key& key : tx.keys_ ) {
+    key = rd.key();
+  }
+  rd.key(); // block hash
+  tx.ixs_.resize( rd.compact_u16() );
+  for ( decoded::ix& ix : tx.ixs_ ) {
+    ix.prog_ = rd.byte();
+    ix.accts_ = rd.list();
+    ix.data_ = rd.list();
+  }
+  if ( tx.is_v0_ ) {
+    const size_t num_tables = rd.compact_u16();
+    for ( size_t i = 0; i != num_tables; ++i ) {
+      tx.tables_.push_back( rd.key() );
+      const std::vector<uint8_t> w = rd.list();
+      const std::vector<uint8_t> r = rd.list();
+      tx.writable_.insert( tx.writable_.end(), w.begin(), w.end() );
+      tx.readonly_.insert( tx.readonly_.end(), r.begin(), r.end() );
+    }
+  }
+  tx.size_ = rd.get_pos();
+  return rd.get_ok() && num_sigs == 1 && tx.size_ == len;
+}
+
+static void check_tx( bool use_alt )
+{
+  pc::key_pair pkey;
+  pkey.gen();
+  pc::pub_key publisher;
+  pkey.get_pub_key( publisher );
+  pc::hash bhash;
+  bhash.zero();
+  pc::pub_key this_prog = make_key( 1 );
+  pc::pub_key serum_prog = make_key( 2 );
+  pc::pub_key clock = make_key( 3 );
+  pc::pub_key pyth_prog = make_key( 4 );
+  pc::pub_key budget_prog = make_key( 5 );
+  pc::pub_key quote_mint = make_key( 6 );
+
+  // Two markets sharing the quote mint: 10 + m * 8 + account.
+  static const unsigned NUM_MKTS = 2;
+  pc::pub_key mkt_keys[ NUM_MKTS ][ 5 ];
+  sp::serum_pyth reqs[ NUM_MKTS ];
+  const sp::serum_pyth *req_ptrs[ NUM_MKTS ];
+  for ( unsigned m = 0; m != NUM_MKTS; ++m ) {
+    for ( unsigned a = 0; a != 5; ++a ) {
+      mkt_keys[ m ][ a ] = make_key( ( uint8_t )( 10 + m * 8 + a ) );
+    }
+    sp::serum_pyth& req = reqs[ m ];
+    req.set_publish( &pkey );
+    req.set_block_hash( &bhash );
+    req.set_program( &this_prog );
+    req.set_serum_prog( &serum_prog );
+    req.set_sysvar_clock( &clock );
+    req.set_pyth_prog( &pyth_prog );
+    req.set_spl_quote_mint( &quote_mint );
+    req.set_pyth_price( &mkt_keys[ m ][ 0 ] );
+    req.set_serum_market( &mkt_keys[ m ][ 1 ] );
+    req.set_serum_bids( &mkt_keys[ m ][ 2 ] );
+    req.set_serum_asks( &mkt_keys[ m ][ 3 ] );
+    req.set_spl_base_mint( &mkt_keys[ m ][ 4 ] );
+    req.set_budget_prog( &budget_prog );
+    req.set_cu_limit( 30000 + m * 1000 );
+    req.set_cu_price( 5000 );
+    req.set_mode( ( uint8_t )m );
+    req_ptrs[ m ] = &req;
+  }
+
+  // The table has every account but the second market's base mint,
+  // including the invoked programs, which must stay in the message.
+  std::vector<pc::pub_key> table_keys = {
+    this_prog, budget_prog, serum_prog, clock, pyth_prog, quote_mint
+  };
+  for ( unsigned m = 0; m != NUM_MKTS; ++m ) {
+    for ( unsigned a = 0; a != ( m ? 4U : 5U ); ++a ) {
+      table_keys.push_back( mkt_keys[ m ][ a ] );
+    }
+  }
+  sp::lookup_table alt;
+  alt.set_address( make_key( 0xaa ) );
+  const std::vector<uint8_t> data = make_table( table_keys, 5, 0 );
+  alt.update( data.data(), data.size(), 6 );
+  for ( sp::serum_pyth& req : reqs ) {
+    req.set_lookup( use_alt ? &alt : nullptr );
+  }
+
+  char buf[ 2 * sp::TX_MAX_SIZE ];
+  pc::bincode bc;
+  bc.attach( buf );
+  sp::serum_pyth::build_tx( bc, req_ptrs, NUM_MKTS );
+  unsigned num_keys = 0;
+  const size_t want_size = sp::serum_pyth::get_tx_size(
+    req_ptrs, NUM_MKTS, &num_keys
+  );
+  decoded tx;
+  const bool ok = decode( ( const uint8_t* )buf, bc.size(), tx );
+  expect( ok, "decode" );
+  if ( !ok ) {
+    return;
+  }
+  expect( tx.size_ == want_size, "size is get_tx_size" );
+  expect( tx.is_v0_ == use_alt, "message version" );
+  expect( tx.num_sigs_ == 1 && tx.num_ro_signed_ == 0, "signer counts" );
+
+  // Accounts as the runtime loads them: the message's, then the table's
+  // writable and readonly ones.
+  std::vector<pc::pub_key> accts = tx.keys_;
+  for ( const uint8_t idx : tx.writable_ ) {
+    accts.push_back( table_keys[ idx ] );
+  }
+  for ( const uint8_t idx : tx.readonly_ ) {
+    accts.push_back( table_keys[ idx ] );
+  }
+  const size_t num_static_w = tx.keys_.size() - tx.num_ro_unsigned_;
+  auto is_writable = [&]( size_t i ) {
+    return i < num_static_w || ( i >= tx.keys_.size()
+      && i < tx.keys_.size() + tx.writable_.size() );
+  };
+  expect( accts.size() == num_keys, "account count" );
+  expect( accts[ 0 ] == publisher, "publisher first" );
+  for ( size_t i = 0; i != accts.size(); ++i ) {
+    const bool is_price = accts[ i ] == mkt_keys[ 0 ][ 0 ]
+      || accts[ i ] == mkt_keys[ 1 ][ 0 ];
+    expect( is_writable( i ) == ( i == 0 || is_price ), "writable accounts" );
+  }
+  if ( use_alt ) {
+    expect(
+      tx.tables_.size() == 1 && tx.tables_[ 0 ] == alt.get_address(),
+      "one table"
+    );
+    expect( tx.writable_.size() == 2, "price accounts from the table" );
+    expect(
+      tx.keys_.size() == 4 && tx.keys_[ 1 ] == this_prog
+      && tx.keys_[ 2 ] == mkt_keys[ 1 ][ 4 ] && tx.keys_[ 3 ] == budget_prog,
+      "message keys: signer, programs and the key not in the table"
+    );
+  }
+  else {
+    expect( tx.tables_.empty() && tx.keys_.size() == num_keys, "legacy" );
+  }
+
+  // Budget instructions, then one per market in get_keys() order.
+  expect(
+    tx.ixs_.size() == 2 + NUM_MKTS
+    && sp::serum_pyth::get_first_ix( req_ptrs, NUM_MKTS ) == 2,
+    "instruction count"
+  );
+  if ( tx.ixs_.size() != 2 + NUM_MKTS ) {
+    return;
+  }
+  uint32_t limit = 0;
+  uint64_t price = 0;
+  const decoded::ix& lim_ix = tx.ixs_[ 0 ];
+  const decoded::ix& price_ix = tx.ixs_[ 1 ];
+  expect(
+    lim_ix.prog_ < accts.size() && accts[ lim_ix.prog_ ] == budget_prog
+    && lim_ix.accts_.empty()
+    && lim_ix.data_.size() == 5 && lim_ix.data_[ 0 ] == sp::CU_SET_LIMIT,
+    "unit limit instruction"
+  );
+  if ( lim_ix.data_.size() == 5 ) {
+    std::memcpy( &limit, &lim_ix.data_[ 1 ], sizeof( limit ) );
+  }
+  expect( limit == 61000, "unit limit is the sum" );
+  expect(
+    price_ix.prog_ < accts.size() && accts[ price_ix.prog_ ] == budget_prog
+    && price_ix.data_.size() == 9 && price_ix.data_[ 0 ] == sp::CU_SET_PRICE,
+    "unit price instruction"
+  );
+  if ( price_ix.data_.size() == 9 ) {
+    std::memcpy( &price, &price_ix.data_[ 1 ], sizeof( price ) );
+  }
+  expect( price == 5000, "unit price" );
+  for ( unsigned m = 0; m != NUM_MKTS; ++m ) {
+    const decoded::ix& ix = tx.ixs_[ 2 + m ];
+    pc::pub_key keys[ sp::serum_pyth::NUM_KEYS ];
+    reqs[ m ].get_keys( keys );
+    bool same = ix.prog_ < accts.size() && accts[ ix.prog_ ] == this_prog
+      && ix.accts_.size() == sp::serum_pyth::NUM_ACCOUNTS;
+    for ( size_t k = 0; same && k != ix.accts_.size(); ++k ) {
+      same = ix.accts_[ k ] < accts.size() && accts[ ix.accts_[ k ] ] == keys[ k ];
+    }
+    expect( same, "serum-pyth accounts" );
+    expect( ix.data_.size() == m, "mode only when not the default" );
+  }
+}
+
+int main()
+{
+  check_pda();
+  check_table();
+  check_tx( false );
+  check_tx( true );
+  std::printf( "%s\n", num_fail ? "FAILED" : "PASSED" );
+  return num_fail ? 1 : 0;
+}
@@ -0,0 +1,224 @@
+#include "notify.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+// Differential test: every base64 kernel must decode what a reference
+// encoder produces, and reject the same malformed input as the scalar
+// kernel. Then notification scanning on RPC-shaped messages.
+
+static int num_fail = 0;
+
+static void expect( bool cond, const char *what )
+{
+  if ( !cond ) {
+    std::printf( "FAIL %s\n", what );
+    ++num_fail;
+  }
+}
+
+static std::string encode64( const std::vector<uint8_t>& in )
+{
+  static const char ALPHABET[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string out;
+  size_t i = 0;
+  for ( ; i + 3 <= in.size(); i += 3 ) {
+    const uint32_t v = ( uint32_t )in[ i ] << 16 | ( uint32_t )in[ i + 1 ] << 8 | in[ i + 2 ];
+    out += ALPHABET[ v >> 18 ];
+    out += ALPHABET[ v >> 12 & 63 ];
+    out += ALPHABET[ v >> 6 & 63 ];
+    out += ALPHABET[ v & 63 ];
+  }
+  if ( i + 1 == in.size() ) {
+    const uint32_t v = ( uint32_t )in[ i ] << 16;
+    out += ALPHABET[ v >> 18 ];
+    out += ALPHABET[ v >> 12 & 63 ];
+    out += "==";
+  }
+  else if ( i + 2 == in.size() ) {
+    const uint32_t v = ( uint32_t )in[ i ] << 16 | ( uint32_t )in[ i + 1 ] << 8;
+    out += ALPHABET[ v >> 18 ];
+    out += ALPHABET[ v >> 12 & 63 ];
+    out += ALPHABET[ v >> 6 & 63 ];
+    out += '=';
+  }
+  return out;
+}
+
+static std::string encode58( const uint8_t key[ 32 ] )
+{
+  static const char ALPHABET[] =
+    "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
+  std::vector<uint8_t> num( key, key + 32 );
+  std::string out;
+  size_t zeros = 0;
+  while ( zeros != 32 && key[ zeros ] == 0 ) {
+    ++zeros;
+  }
+  while ( zeros != 32 ) {
+    uint32_t rem = 0;
+    bool is_zero = true;
+    for ( uint8_t& b : num ) {
+      const uint32_t cur = rem << 8 | b;
+      b = ( uint8_t )( cur / 58 );
+      rem = cur % 58;
+      is_zero = is_zero && b == 0;
+    }
+    out.insert( out.begin(), ALPHABET[ rem ] );
+    if ( is_zero ) {
+      break;
+    }
+  }
+  // Leading zero bytes encode as leading '1's.
+  return std::string( zeros, '1' ) + out;
+}
+
+static void check_base64( sp::batch_isa isa )
+{
+  std::mt19937_64 rng( 42 );
+  for ( size_t len = 0; len != 600; ++len ) {
+    std::vector<uint8_t> in( len );
+    for ( uint8_t& b : in ) {
+      b = ( uint8_t )rng();
+    }
+    const std::string enc = encode64( in );
+    std::vector<uint8_t> out( sp::base64_max_len( enc.size() ) );
+    const size_t num = sp::base64_decode( enc.data(), enc.size(), out.data(), isa );
+    if ( num != len || ( len && std::memcmp( out.data(), in.data(), len ) != 0 ) ) {
+      std::printf( "FAIL %s decode len=%zu\n", sp::to_str( isa ), len );
+      if ( ++num_fail > 20 ) {
+        return;
+      }
+    }
+
+    // Corrupt one character anywhere, including the padding; '=' is
+    // only wrong before the last two.
+    if ( enc.empty() ) {
+      continue;
+    }
+    for ( char bad : { '=', '-', '_', ' ', '\0', '\x80', '\xff', '.' } ) {
+      std::string cor = enc;
+      const size_t pos = rng() % cor.size();
+      if ( bad == '=' && pos + 2 >= cor.size() ) {
+        continue;
+      }
+      cor[ pos ] = bad;
+      const size_t exp = sp::base64_decode(
+        cor.data(), cor.size(), out.data(), sp::batch_isa::scalar );
+      const size_t got = sp::base64_decode( cor.data(), cor.size(), out.data(), isa );
+      if ( got != sp::BASE64_ERR || exp != sp::BASE64_ERR ) {
+        std::printf( "FAIL %s accepts 0x%02x at %zu of %zu\n",
+          sp::to_str( isa ), ( unsigned )( uint8_t )bad, pos, cor.size() );
+        if ( ++num_fail > 20 ) {
+          return;
+        }
+      }
+    }
+  }
+  uint8_t out[ 8 ];
+  expect( sp::base64_decode( "QUJD", 3, out, isa ) == sp::BASE64_ERR,
+          "unpadded length rejected" );
+}
+
+static void check_base58()
+{
+  uint8_t key[ 32 ];
+  expect( sp::base58_decode32( "11111111111111111111111111111111", 32, key ),
+          "system program decodes" );
+  bool is_zero = true;
+  for ( uint8_t b : key ) {
+    is_zero = is_zero && b == 0;
+  }
+  expect( is_zero, "system program is zero" );
+
+  std::mt19937_64 rng( 7 );
+  for ( int i = 0; i != 1000; ++i ) {
+    uint8_t exp[ 32 ];
+    for ( uint8_t& b : exp ) {
+      b = ( uint8_t )rng();
+    }
+    std::memset( exp, 0, ( size_t )( i % 4 ) );
+    const std::string enc = encode58( exp );
+    if ( !sp::base58_decode32( enc.data(), enc.size(), key )
+        || std::memcmp( key, exp, 32 ) != 0 ) {
+      std::printf( "FAIL base58 %s\n", enc.c_str() );
+      ++num_fail;
+    }
+  }
+  expect( !sp::base58_decode32( "0OIl", 4, key ), "base58 rejects 0OIl" );
+  const std::string big( 44, 'z' );
+  expect( !sp::base58_decode32( big.data(), big.size(), key ),
+          "base58 rejects more than 32 bytes" );
+}
+
+static void check_scan()
+{
+  std::vector<uint8_t> data( 3228 );
+  for ( size_t i = 0; i != data.size(); ++i ) {
+    data[ i ] = ( uint8_t )( i * 7 );
+  }
+  const std::string b64 = encode64( data );
+
+  const std::string acct =
+    "{\"jsonrpc\":\"2.0\",\"method\":\"accountNotification\",\"params\":"
+    "{\"result\":{\"context\":{\"slot\":5199307},\"value\":{\"data\":[\""
+    + b64 + "\",\"base64\"],\"executable\":false,\"lamports\":33594,"
+    "\"owner\":\"11111111111111111111111111111111\",\"rentEpoch\":635,"
+    "\"space\":3228}},\"subscription\":23784}}";
+  sp::notify_decoder dec;
+  expect( dec.decode( acct.data(), acct.size() ), "account notification" );
+  expect( dec.get_fields().slot_ == 5199307, "account slot" );
+  expect( dec.get_fields().pubkey_ == nullptr, "account has no pubkey" );
+  expect( dec.get_len() == data.size()
+       && std::memcmp( dec.get_data(), data.data(), data.size() ) == 0,
+          "account data" );
+
+  // Pretty-printed, with escaped quotes in a string ahead of the fields.
+  const std::string prog =
+    "{ \"jsonrpc\": \"2.0\", \"method\": \"programNotification\",\n"
+    "  \"note\": \"a \\\"slot\\\": 1 \\\\\",\n"
+    "  \"params\": { \"result\": { \"context\": { \"slot\" : 5208469 },\n"
+    "    \"value\": { \"pubkey\": \"H4S4q3jVkXYKyGo6Tuo1a8cb5P5rnSKpdZhjQ27mAp7j\",\n"
+    "      \"account\": { \"data\": [ \"" + b64 + "\", \"base64\" ],\n"
+    "        \"executable\": false, \"lamports\": 33594 } } },\n"
+    "    \"subscription\": 24040 } }";
+  expect( dec.decode( prog.data(), prog.size() ), "program notification" );
+  const sp::notify_fields& f = dec.get_fields();
+  expect( f.slot_ == 5208469, "program slot" );
+  expect( f.pubkey_ && std::string( f.pubkey_, f.pubkey_len_ )
+       == "H4S4q3jVkXYKyGo6Tuo1a8cb5P5rnSKpdZhjQ27mAp7j", "program pubkey" );
+  expect( dec.get_len() == data.size()
+       && std::memcmp( dec.get_data(), data.data(), data.size() ) == 0,
+          "program data" );
+
+  const std::string reply = "{\"jsonrpc\":\"2.0\",\"result\":23784,\"id\":1}";
+  expect( !dec.decode( reply.data(), reply.size() ), "subscribe reply skipped" );
+  const std::string parsed =
+    "{\"params\":{\"result\":{\"context\":{\"slot\":1},\"value\":{\"data\":"
+    "{\"program\":\"spl-token\"}}}}}";
+  expect( !dec.decode( parsed.data(), parsed.size() ), "jsonParsed skipped" );
+  const std::string cut = acct.substr( 0, acct.size() / 2 );
+  expect( !dec.decode( cut.data(), cut.size() ), "truncated skipped" );
+}
+
+int main()
+{
+  const sp::batch_isa best = sp::get_batch_isa();
+  std::printf( "best isa: %s\n", sp::to_str( best ) );
+  for ( sp::batch_isa isa : {
+      sp::batch_isa::scalar, sp::batch_isa::avx2, sp::batch_isa::avx512 } ) {
+    if ( isa > best ) {
+      std::printf( "skip %s: not supported\n", sp::to_str( isa ) );
+      continue;
+    }
+    check_base64( isa );
+  }
+  check_base58();
+  check_scan();
+  std::printf( "%s\n", num_fail ? "FAILED" : "PASSED" );
+  return num_fail ? 1 : 0;
+}
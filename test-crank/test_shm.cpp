@@ -0,0 +1,209 @@
+#include "shm_feed.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+
+// The shared-memory feed through its own mapping on each side. First
+// single-threaded: the ring in order, a reader lapped by the writer
+// skipping to the oldest update left and counting the rest as lost, and
+// out-of-range updates dropped. Then a writer thread updating every slot
+// while a reader thread takes seqlock snapshots and follows the ring.
+// Every field of a quote is derived from its update number, so a torn
+// copy doesn't check out.
+
+static const unsigned NUM_SLOTS = 4;
+static const uint32_t RING_SIZE = 64;
+static const uint64_t NUM_UPDATES = 1000000;
+
+static int num_fail = 0;
+
+static void expect( bool cond, const char *what )
+{
+  if ( !cond ) {
+    std::printf( "FAIL %s\n", what );
+    ++num_fail;
+  }
+}
+
+static uint64_t mix( uint64_t x )
+{
+  x += 0x9e3779b97f4a7c15UL;
+  x = ( x ^ ( x >> 30 ) ) * 0xbf58476d1ce4e5b9UL;
+  x = ( x ^ ( x >> 27 ) ) * 0x94d049bb133111ebUL;
+  return x ^ ( x >> 31 );
+}
+
+static sp::shm_quote make_quote( uint64_t n )
+{
+  sp::shm_quote q;
+  const uint64_t h = mix( n );
+  for ( unsigned i = 0; i != sizeof( q.pyth_price_ ); ++i ) {
+    q.pyth_price_[ i ] = ( uint8_t )( h >> ( i % 8 * 8 ) ) ^ ( uint8_t )i;
+  }
+  q.bid_ = n;
+  q.ask_ = h;
+  q.price_ = ( int64_t )mix( h );
+  q.conf_ = h >> 16;
+  q.expo_ = -( int32_t )( n % 12 );
+  q.trading_ = ( uint32_t )( h & 1 );
+  q.book_slot_ = n / 4;
+  q.ts_ = ( int64_t )( n * 3 );
+  return q;
+}
+
+// The update number a quote was made from, if it's a whole one.
+static bool check_quote( const sp::shm_quote& q, uint64_t& n )
+{
+  n = q.bid_;
+  const sp::shm_quote want = make_quote( n );
+  return std::memcmp( &q, &want, sizeof( q ) ) == 0;
+}
+
+static unsigned get_slot( uint64_t n )
+{
+  return ( unsigned )( n % NUM_SLOTS );
+}
+
+static void check_ring( const std::string& name )
+{
+  sp::shm_feed feed;
+  feed.set_name( name );
+  feed.set_ring_size( RING_SIZE - 1 );
+  if ( !feed.init( NUM_SLOTS ) ) {
+    std::printf( "FAIL init: %s\n", feed.get_err_msg().c_str() );
+    ++num_fail;
+    return;
+  }
+  sp::shm_reader rd;
+  if ( !rd.init( name ) ) {
+    std::printf( "FAIL reader init: %s\n", rd.get_err_msg().c_str() );
+    ++num_fail;
+    return;
+  }
+  expect( rd.get_num_slots() == NUM_SLOTS, "slots" );
+
+  unsigned idx;
+  uint64_t n;
+  sp::shm_quote q;
+  expect( !rd.read( 0, q ), "never written" );
+  expect( !rd.next( idx, q ), "empty ring" );
+
+  // In order.
+  uint64_t num = 0;
+  for ( ; num != 10; ++num ) {
+    feed.update( get_slot( num ), make_quote( num ) );
+  }
+  bool is_ok = true;
+  for ( uint64_t i = 0; i != num; ++i ) {
+    is_ok = is_ok && rd.next( idx, q ) && check_quote( q, n ) && n == i
+      && idx == get_slot( n );
+  }
+  expect( is_ok, "ring in order" );
+  expect( !rd.next( idx, q ), "caught up" );
+  expect( rd.read( 1, q ) && check_quote( q, n ) && n == 9, "latest in slot" );
+
+  // Lapped: only the last RING_SIZE are left.
+  for ( ; num != 10 + 3 * RING_SIZE + 5; ++num ) {
+    feed.update( get_slot( num ), make_quote( num ) );
+  }
+  uint64_t first = 0, count = 0;
+  is_ok = true;
+  while ( rd.next( idx, q ) ) {
+    is_ok = is_ok && check_quote( q, n ) && idx == get_slot( n )
+      && ( count == 0 || n == first + count );
+    first = count == 0 ? n : first;
+    ++count;
+  }
+  expect( is_ok, "ring after overrun in order" );
+  expect( first == num - RING_SIZE && count == RING_SIZE, "oldest left read" );
+  expect( rd.get_num_lost() == num - 10 - RING_SIZE, "lost counted" );
+
+  // Past the slots, dropped from both.
+  feed.update( NUM_SLOTS, make_quote( num ) );
+  expect( !rd.next( idx, q ), "out of range dropped" );
+  expect( !rd.read( NUM_SLOTS, q ), "no slot out of range" );
+
+  // Another reader starts at the oldest update left.
+  sp::shm_reader late;
+  late.init( name );
+  expect( late.next( idx, q ) && check_quote( q, n ) && n == num - RING_SIZE,
+    "late reader starts at oldest" );
+}
+
+static void check_threads( const std::string& name )
+{
+  sp::shm_feed feed;
+  feed.set_name( name );
+  feed.set_ring_size( RING_SIZE );
+  sp::shm_reader rd;
+  if ( !feed.init( NUM_SLOTS ) || !rd.init( name ) ) {
+    std::printf( "FAIL init\n" );
+    ++num_fail;
+    return;
+  }
+
+  std::atomic<bool> is_done( false );
+  std::thread writer( [&]{
+    for ( uint64_t n = 0; n != NUM_UPDATES; ++n ) {
+      feed.update( get_slot( n ), make_quote( n ) );
+      if ( n % 256 == 0 ) {
+        std::this_thread::yield();
+      }
+    }
+    is_done.store( true, std::memory_order_release );
+  } );
+
+  // Snapshots are whole and never go back; the ring is whole and in
+  // order, with gaps only where it was lapped.
+  uint64_t last[ NUM_SLOTS ] = {};
+  uint64_t num_reads = 0, num_recv = 0, num_gap = 0, prev = 0;
+  bool is_read_ok = true, is_ring_ok = true;
+  unsigned idx;
+  uint64_t n;
+  sp::shm_quote q;
+  for ( bool is_last = false; !is_last; ) {
+    is_last = is_done.load( std::memory_order_acquire );
+    for ( unsigned s = 0; s != NUM_SLOTS; ++s ) {
+      if ( rd.read( s, q ) ) {
+        is_read_ok = is_read_ok && check_quote( q, n ) && get_slot( n ) == s
+          && n >= last[ s ];
+        last[ s ] = n;
+        ++num_reads;
+      }
+    }
+    while ( rd.next( idx, q ) ) {
+      is_ring_ok = is_ring_ok && check_quote( q, n ) && idx == get_slot( n )
+        && ( num_recv == 0 || n > prev );
+      num_gap += num_recv == 0 ? n : n - prev - 1;
+      prev = n;
+      ++num_recv;
+    }
+  }
+  writer.join();
+
+  expect( is_read_ok, "snapshots consistent" );
+  expect( num_reads != 0, "snapshots taken" );
+  for ( unsigned s = 0; s != NUM_SLOTS; ++s ) {
+    expect( rd.read( s, q ) && check_quote( q, n )
+      && n == NUM_UPDATES - NUM_SLOTS + s, "final snapshot" );
+  }
+  expect( is_ring_ok, "ring consistent" );
+  expect( prev == NUM_UPDATES - 1, "ring read to the end" );
+  expect( num_gap == rd.get_num_lost(), "gaps counted as lost" );
+  expect( num_recv + rd.get_num_lost() == NUM_UPDATES, "every update seen or lost" );
+}
+
+int main()
+{
+  const std::string name = "/test-shm-" + std::to_string( ::getpid() );
+  check_ring( name );
+  check_threads( name );
+  ::shm_unlink( name.c_str() );
+  std::printf( "%s\n", num_fail ? "FAILED" : "PASSED" );
+  return num_fail ? 1 : 0;
+}
@@ -0,0 +1,154 @@
+#include "spsc.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+// One producer and one consumer thread pass records of varied sizes,
+// from empty to the largest the ring takes, through rings small enough
+// to wrap and fill constantly. The consumer checks every record's order,
+// length and content, which are derived from its sequence number.
+
+static const uint64_t NUM_RECS = 500000;
+
+static int num_fail = 0;
+
+// Longest either side waits for the other before the ring counts as
+// stuck.
+static const std::chrono::seconds STALL( 10 );
+
+static void expect( bool cond, const char *what )
+{
+  if ( !cond ) {
+    std::printf( "FAIL %s\n", what );
+    ++num_fail;
+  }
+}
+
+static uint64_t mix( uint64_t x )
+{
+  x += 0x9e3779b97f4a7c15UL;
+  x = ( x ^ ( x >> 30 ) ) * 0xbf58476d1ce4e5b9UL;
+  x = ( x ^ ( x >> 27 ) ) * 0x94d049bb133111ebUL;
+  return x ^ ( x >> 31 );
+}
+
+// Mostly small, some empty, some as large as fits.
+static size_t get_len( uint64_t seq, size_t max_len )
+{
+  const uint64_t h = mix( seq );
+  switch ( h % 8 ) {
+    case 0: return 0;
+    case 1: return max_len - ( size_t )( h >> 8 ) % 16;
+    case 2: return ( size_t )( h >> 8 ) % ( max_len + 1 );
+    default: return std::min( ( size_t )( h >> 8 ) % 128, max_len );
+  }
+}
+
+static void fill( uint8_t *buf, uint64_t seq, size_t len )
+{
+  uint64_t h = mix( seq ^ 0x5555 );
+  for ( size_t i = 0; i != len; ++i ) {
+    buf[ i ] = ( uint8_t )( h >> ( i % 8 * 8 ) ) ^ ( uint8_t )( i / 8 );
+  }
+  if ( len >= sizeof( seq ) ) {
+    std::memcpy( buf, &seq, sizeof( seq ) );
+  }
+}
+
+// Yield until ready() or the other side has stalled.
+template<class F>
+static bool wait_for( F ready )
+{
+  const auto start = std::chrono::steady_clock::now();
+  for ( unsigned n = 0; !ready(); ++n ) {
+    if ( n % 1024 == 0 && std::chrono::steady_clock::now() - start > STALL ) {
+      return false;
+    }
+    std::this_thread::yield();
+  }
+  return true;
+}
+
+static void check_limits()
+{
+  sp::spsc_ring ring;
+  ring.init( 4096 );
+  size_t len;
+  expect( ring.front( len ) == nullptr, "new ring is empty" );
+  expect( ring.reserve( 2048 - 8 + 1 ) == nullptr, "reject over half" );
+  uint8_t *rec = ring.reserve( 2048 - 8 );
+  expect( rec != nullptr, "take half" );
+  ring.commit();
+  expect( ring.reserve( 2048 - 8 ) != nullptr, "take second half" );
+  ring.commit();
+  expect( ring.reserve( 0 ) == nullptr, "reject when full" );
+  expect( ring.front( len ) == rec && len == 2048 - 8, "oldest first" );
+  ring.pop();
+  expect( ring.reserve( 0 ) != nullptr, "room after pop" );
+}
+
+static void check_threads( size_t size )
+{
+  sp::spsc_ring ring;
+  ring.init( size );
+  const size_t max_len = size / 2 - 8;
+  std::atomic<uint64_t> num_bad( 0 );
+
+  std::thread prod( [&]() {
+    for ( uint64_t seq = 0; seq != NUM_RECS; ++seq ) {
+      const size_t len = get_len( seq, max_len );
+      uint8_t *rec = nullptr;
+      if ( !wait_for( [&]() { return ( rec = ring.reserve( len ) ); } ) ) {
+        std::printf( "FAIL ring size %lu full at record %lu\n", size, seq );
+        ++num_bad;
+        return;
+      }
+      fill( rec, seq, len );
+      ring.commit();
+    }
+  } );
+
+  uint8_t want[ 1 << 16 ];
+  for ( uint64_t seq = 0; seq != NUM_RECS; ++seq ) {
+    const uint8_t *rec = nullptr;
+    size_t len = 0;
+    if ( !wait_for( [&]() { return ( rec = ring.front( len ) ); } ) ) {
+      std::printf( "FAIL ring size %lu empty at record %lu\n", size, seq );
+      ++num_bad;
+      break;
+    }
+    const size_t want_len = get_len( seq, max_len );
+    fill( want, seq, want_len );
+    if ( len != want_len || std::memcmp( rec, want, len ) ) {
+      if ( num_bad++ == 0 ) {
+        std::printf(
+          "FAIL record %lu of ring size %lu: len %lu, expected %lu\n",
+          seq, size, len, want_len
+        );
+      }
+    }
+    ring.pop();
+  }
+  prod.join();
+
+  size_t len;
+  expect( ring.front( len ) == nullptr, "drained" );
+  if ( num_bad ) {
+    std::printf( "FAIL %lu bad records\n", num_bad.load() );
+    ++num_fail;
+  }
+}
+
+int main()
+{
+  check_limits();
+  check_threads( 256 );
+  check_threads( 4096 );
+  check_threads( 1 << 16 );
+  std::printf( "%s\n", num_fail ? "FAILED" : "PASSED" );
+  return num_fail ? 1 : 0;
+}
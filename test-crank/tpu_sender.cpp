@@ -0,0 +1,200 @@
+#include "tpu_sender.hpp"
+
+#include <pc/log.hpp>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+using namespace sp;
+
+// Leader schedule lookahead.
+static const uint64_t LEADER_LIMIT = 256;
+static const uint64_t LEADER_REFRESH = 64;
+
+// Leaders hold NUM_CONSECUTIVE_LEADER_SLOTS.
+static const uint64_t LEADER_SLOTS = 4;
+
+static const int64_t NODES_REFRESH = 60000000000L;
+
+tpu_sender::tpu_sender()
+: fd_( -1 ),
+  fanout_( 2 ),
+  has_leaders_( false ),
+  has_nodes_( false ),
+  leaders_sent_( false ),
+  nodes_sent_( false ),
+  nodes_ts_( 0 ),
+  num_sent_( 0 )
+{
+  std::memset( &fixed_addr_, 0, sizeof( fixed_addr_ ) );
+}
+
+tpu_sender::~tpu_sender()
+{
+  if ( fd_ >= 0 ) {
+    ::close( fd_ );
+  }
+}
+
+void tpu_sender::set_fixed_tpu( const std::string& host_port )
+{
+  fixed_tpu_ = host_port;
+}
+
+void tpu_sender::set_fanout( unsigned fanout )
+{
+  fanout_ = std::min( fanout, MAX_FANOUT );
+}
+
+bool tpu_sender::init()
+{
+  fd_ = ::socket( AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0 );
+  if ( fd_ < 0 ) {
+    err_msg_ = std::string( "failed to open udp socket: " ) + strerror( errno );
+    return false;
+  }
+  if ( fixed_tpu_.empty() ) {
+    return true;
+  }
+
+  const size_t pos = fixed_tpu_.rfind( ':' );
+  if ( pos == std::string::npos ) {
+    err_msg_ = "expected host:port for tpu [" + fixed_tpu_ + "]";
+    return false;
+  }
+  const std::string host = fixed_tpu_.substr( 0, pos );
+  const std::string port = fixed_tpu_.substr( pos + 1 );
+  addrinfo hints, *res = nullptr;
+  std::memset( &hints, 0, sizeof( hints ) );
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_DGRAM;
+  if ( ::getaddrinfo( host.c_str(), port.c_str(), &hints, &res ) || !res ) {
+    err_msg_ = "failed to resolve tpu [" + fixed_tpu_ + "]";
+    return false;
+  }
+  std::memcpy( &fixed_addr_, res->ai_addr, sizeof( fixed_addr_ ) );
+  ::freeaddrinfo( res );
+  return true;
+}
+
+void tpu_sender::poll( pc::manager& mgr, uint64_t slot )
+{
+  if ( !fixed_tpu_.empty() || slot == 0 ) {
+    return;
+  }
+  pc::rpc_client *clnt = mgr.get_rpc_client();
+  if ( !leaders_sent_ && (
+      !has_leaders_ || lreq_->get_last_slot() < slot + LEADER_REFRESH ) ) {
+    lreq_->set_slot( slot );
+    lreq_->set_limit( LEADER_LIMIT );
+    lreq_->set_sub( this );
+    clnt->send( lreq_ );
+    leaders_sent_ = true;
+  }
+  const int64_t now = pc::get_now();
+  if ( !nodes_sent_ && ( !has_nodes_ || now - nodes_ts_ > NODES_REFRESH ) ) {
+    creq_->set_sub( this );
+    clnt->send( creq_ );
+    nodes_sent_ = true;
+    nodes_ts_ = now;
+  }
+}
+
+bool tpu_sender::send( uint64_t slot, const char *buf, size_t len )
+{
+  sockaddr_in addrs[ MAX_FANOUT ];
+  const unsigned num = get_targets( slot, addrs );
+  bool sent = false;
+  for ( unsigned i = 0; i != num; ++i ) {
+    sent = send_to( &addrs[ i ], sizeof( addrs[ i ] ), buf, len ) || sent;
+  }
+  return sent;
+}
+
+unsigned tpu_sender::get_targets( uint64_t slot, sockaddr_in *addrs )
+{
+  if ( !fixed_tpu_.empty() ) {
+    addrs[ 0 ] = fixed_addr_;
+    return 1;
+  }
+  if ( !has_leaders_ || !has_nodes_ ) {
+    return 0;
+  }
+
+  // Step through leader rotations from the current slot.
+  pc::pub_key *prev = nullptr;
+  unsigned nldr = 0, num = 0;
+  for ( uint64_t s = slot; nldr < fanout_ && s < slot + LEADER_SLOTS * 4; ++s ) {
+    pc::pub_key *ldr = lreq_->get_leader( s );
+    if ( !ldr || ( prev && *ldr == *prev ) ) {
+      continue;
+    }
+    prev = ldr;
+    ++nldr;
+    pc::ip_addr addr;
+    if ( creq_->get_ip_addr( *ldr, addr ) ) {
+      std::memset( &addrs[ num ], 0, sizeof( addrs[ num ] ) );
+      std::memcpy(
+        &addrs[ num++ ], &addr, std::min( sizeof( addr ), sizeof( sockaddr_in ) )
+      );
+    }
+  }
+  return num;
+}
+
+bool tpu_sender::send_to(
+  const void *addr,
+  size_t addr_len,
+  const char *buf,
+  size_t len
+) {
+  const ssize_t n = ::sendto(
+    fd_, buf, len, 0, (const sockaddr*)addr, (socklen_t)addr_len
+  );
+  if ( n != (ssize_t)len ) {
+    PC_LOG_DBG( "tpu send failed" ).add( "error", strerror( errno ) ).end();
+    return false;
+  }
+  ++num_sent_;
+  return true;
+}
+
+uint64_t tpu_sender::get_num_sent() const
+{
+  return num_sent_;
+}
+
+const std::string& tpu_sender::get_err_msg() const
+{
+  return err_msg_;
+}
+
+void tpu_sender::on_response( pc::rpc::get_slot_leaders *res )
+{
+  leaders_sent_ = false;
+  if ( res->get_is_err() ) {
+    PC_LOG_ERR( "failed to get slot leaders" )
+      .add( "error", res->get_err_msg() )
+      .end();
+    return;
+  }
+  has_leaders_ = true;
+}
+
+void tpu_sender::on_response( pc::rpc::get_cluster_nodes *res )
+{
+  nodes_sent_ = false;
+  if ( res->get_is_err() ) {
+    PC_LOG_ERR( "failed to get cluster nodes" )
+      .add( "error", res->get_err_msg() )
+      .end();
+    return;
+  }
+  has_nodes_ = true;
+}
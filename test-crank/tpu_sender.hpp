@@ -0,0 +1,71 @@
+#pragma once
+
+#include <pc/manager.hpp>
+
+#include <netinet/in.h>
+#include <string>
+
+namespace sp
+{
+
+  // Sends signed transactions over UDP straight to the TPU ports of the
+  // current and upcoming leaders, per the cluster's leader schedule.
+  // A fixed TPU address (e.g. solana-test-validator or a mock TPU)
+  // bypasses the schedule.
+  class tpu_sender :
+    public pc::rpc_sub_i<pc::rpc::get_slot_leaders>,
+    public pc::rpc_sub_i<pc::rpc::get_cluster_nodes>
+  {
+  public:
+
+    static constexpr unsigned MAX_FANOUT = 8;
+
+    tpu_sender();
+    ~tpu_sender();
+
+    // "host:port" of a single TPU to send to.
+    void set_fixed_tpu( const std::string& );
+
+    // Number of distinct leaders to send to, starting with the current
+    // (default 2, at most MAX_FANOUT).
+    void set_fanout( unsigned );
+
+    bool init();
+
+    // Refresh the leader schedule and cluster nodes as needed.
+    void poll( pc::manager&, uint64_t slot );
+
+    // Send to the leaders of slot and its successors.
+    bool send( uint64_t slot, const char *buf, size_t len );
+
+    // TPU addresses send() would use for slot, e.g. for another thread
+    // sending on its own socket. Returns how many, up to MAX_FANOUT.
+    unsigned get_targets( uint64_t slot, sockaddr_in *addrs );
+
+    uint64_t get_num_sent() const;
+    const std::string& get_err_msg() const;
+
+    void on_response( pc::rpc::get_slot_leaders * ) override;
+    void on_response( pc::rpc::get_cluster_nodes * ) override;
+
+  private:
+
+    bool send_to( const void *addr, size_t addr_len, const char *, size_t );
+
+    int          fd_;
+    unsigned     fanout_;
+    std::string  fixed_tpu_;
+    sockaddr_in  fixed_addr_;
+    bool         has_leaders_;
+    bool         has_nodes_;
+    bool         leaders_sent_;
+    bool         nodes_sent_;
+    int64_t      nodes_ts_;
+    uint64_t     num_sent_;
+    std::string  err_msg_;
+
+    pc::rpc::get_slot_leaders  lreq_[1];
+    pc::rpc::get_cluster_nodes creq_[1];
+  };
+
+}
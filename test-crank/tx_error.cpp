@@ -0,0 +1,96 @@
+#include "tx_error.hpp"
+
+using namespace sp;
+
+tx_error sp::parse_tx_error( const std::string& name )
+{
+  static const struct
+  {
+    const char *name_;
+    tx_error    err_;
+  } ERRORS[] = {
+    { "InvalidArgument", tx_error::invalid_argument },
+    { "InvalidAccountData", tx_error::invalid_account_data },
+    { "AccountDataTooSmall", tx_error::account_data_too_small },
+    { "IncorrectProgramId", tx_error::incorrect_program_id },
+    { "NotEnoughAccountKeys", tx_error::not_enough_account_keys },
+    { "Custom", tx_error::custom },
+    { "ComputationalBudgetExceeded", tx_error::compute_budget },
+    { "MissingRequiredSignature", tx_error::missing_signature },
+    { "InsufficientFundsForFee", tx_error::insufficient_funds },
+    { "AccountNotFound", tx_error::insufficient_funds },
+    { "AddressLookupTableNotFound", tx_error::lookup_table },
+    { "InvalidAddressLookupTableOwner", tx_error::lookup_table },
+    { "InvalidAddressLookupTableData", tx_error::lookup_table },
+    { "InvalidAddressLookupTableIndex", tx_error::lookup_table },
+    { "InvalidAccountIndex", tx_error::invalid_account_index },
+    { "TooManyAccountLocks", tx_error::invalid_account_index },
+    { "BlockhashNotFound", tx_error::blockhash_not_found },
+    { "AlreadyProcessed", tx_error::already_processed },
+    { "AccountInUse", tx_error::account_in_use },
+    { "WouldExceedMaxBlockCostLimit", tx_error::block_limit },
+    { "WouldExceedMaxAccountCostLimit", tx_error::block_limit },
+    { "WouldExceedAccountDataBlockLimit", tx_error::block_limit },
+  };
+  if ( name.empty() ) {
+    return tx_error::none;
+  }
+  for ( const auto& e : ERRORS ) {
+    if ( name == e.name_ ) {
+      return e.err_;
+    }
+  }
+  return tx_error::unknown;
+}
+
+tx_error_class sp::get_error_class( tx_error err )
+{
+  switch ( err ) {
+    case tx_error::none:
+      return tx_error_class::none;
+    case tx_error::invalid_account_data:
+    case tx_error::account_data_too_small:
+    case tx_error::incorrect_program_id:
+    case tx_error::not_enough_account_keys:
+    case tx_error::custom:
+    case tx_error::compute_budget:
+      return tx_error_class::market;
+    case tx_error::missing_signature:
+    case tx_error::insufficient_funds:
+    case tx_error::lookup_table:
+    case tx_error::invalid_account_index:
+      return tx_error_class::payer;
+    case tx_error::invalid_argument:
+    case tx_error::blockhash_not_found:
+    case tx_error::already_processed:
+    case tx_error::account_in_use:
+    case tx_error::block_limit:
+    case tx_error::unknown:
+      return tx_error_class::transient;
+  }
+  return tx_error_class::transient;
+}
+
+const char *sp::to_str( tx_error err )
+{
+  switch ( err ) {
+    case tx_error::none: return "none";
+    case tx_error::invalid_argument: return "invalid_argument";
+    case tx_error::invalid_account_data: return "invalid_account_data";
+    case tx_error::account_data_too_small: return "account_data_too_small";
+    case tx_error::incorrect_program_id: return "incorrect_program_id";
+    case tx_error::not_enough_account_keys: return "not_enough_account_keys";
+    case tx_error::custom: return "custom";
+    case tx_error::compute_budget: return "compute_budget";
+    case tx_error::missing_signature: return "missing_signature";
+    case tx_error::insufficient_funds: return "insufficient_funds";
+    case tx_error::lookup_table: return "lookup_table";
+    case tx_error::invalid_account_index: return "invalid_account_index";
+    case tx_error::blockhash_not_found: return "blockhash_not_found";
+    case tx_error::already_processed: return "already_processed";
+    case tx_error::account_in_use: return "account_in_use";
+    case tx_error::block_limit: return "block_limit";
+    case tx_error::unknown: return "unknown";
+  }
+  return "unknown";
+}
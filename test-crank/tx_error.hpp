@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace sp
+{
+
+  // Transaction failure as reported by the cluster.
+  enum class tx_error
+  {
+    none,
+
+    // Instruction errors pointing at a broken market: serum-pyth's own
+    // custom codes (see sp-error.h), and builtin errors (ERROR_* in
+    // solana_sdk.h) from pyth's upd_price or the runtime.
+    invalid_account_data,
+    account_data_too_small,
+    incorrect_program_id,
+    not_enough_account_keys,
+    custom,
+
+    // The instruction ran out of compute units. Its market's fault only
+    // once its limit can't be raised (see cu_limits::on_exceeded()).
+    compute_budget,
+
+    // Payer or transaction problems shared by every market.
+    missing_signature,
+    insufficient_funds,
+    lookup_table,
+    invalid_account_index,
+
+    // Transient. serum-pyth never returns InvalidArgument itself; pyth's
+    // upd_price does, e.g. for a second update in the same slot.
+    invalid_argument,
+    blockhash_not_found,
+    already_processed,
+    account_in_use,
+    block_limit,
+
+    unknown
+  };
+
+  enum class tx_error_class
+  {
+    none,
+    market,     // the market itself fails: isolate it
+    payer,      // affects every market: don't blame one
+    transient,  // retry normally
+  };
+
+  // Classify the error name reported by getSignatureStatuses, either a
+  // TransactionError (e.g. "BlockhashNotFound") or the InstructionError
+  // inside one (e.g. "InvalidAccountData", or "Custom" with code).
+  tx_error parse_tx_error( const std::string& name );
+
+  // Class of an error. A market class error is only the market's fault
+  // if it came from that market's own serum-pyth instruction; callers
+  // treat it as transient otherwise, e.g. when it names no instruction
+  // or a compute budget one. Unknown errors are transient.
+  tx_error_class get_error_class( tx_error );
+
+  const char *to_str( tx_error );
+
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace sp
+{
+
+  // Max serialized transaction size (solana PACKET_DATA_SIZE).
+  static const size_t TX_MAX_SIZE = 1232;
+
+  // Max accounts a transaction may lock (MAX_TX_ACCOUNT_LOCKS).
+  static const unsigned TX_MAX_KEYS = 64;
+
+  // Max compute units of a transaction (MAX_COMPUTE_UNIT_LIMIT), and the
+  // default per instruction without a SetComputeUnitLimit.
+  static const uint64_t TX_MAX_UNITS = 1400000;
+  static const uint64_t TX_DEFAULT_IX_UNITS = 200000;
+
+  // Slots after its blockhash's slot that a transaction can still land
+  // (MAX_PROCESSING_AGE of 150, plus one).
+  static const uint64_t TX_VALID_SLOTS = 151;
+
+  // Markets one transaction can publish: each locks at least its price,
+  // market, bids and asks accounts.
+  static const unsigned TX_MAX_MARKETS = TX_MAX_KEYS / 4;
+
+}